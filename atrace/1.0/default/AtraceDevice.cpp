@@ -14,9 +14,11 @@
  * limitations under the License.
  */
 
-#include <android-base/file.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <android-base/logging.h>
-#include <android-base/stringprintf.h>
 
 #include "AtraceDevice.h"
 
@@ -62,16 +64,75 @@ Return<void> AtraceDevice::listCategories(listCategories_cb _hidl_cb) {
     return Void();
 }
 
-AtraceDevice::AtraceDevice() {
+static std::string findTracefsEventRoot() {
     struct stat st;
 
-    tracefs_event_root_ = "/sys/kernel/tracing/events/";
-    if (stat(tracefs_event_root_.c_str(), &st) != 0) {
-        tracefs_event_root_ = "/sys/kernel/debug/tracing/events/";
-        CHECK(stat(tracefs_event_root_.c_str(), &st) == 0) << "tracefs must be mounted at either"
-                                                              "/sys/kernel/tracing or "
-                                                              "/sys/kernel/debug/tracing";
+    std::string root = "/sys/kernel/tracing/events/";
+    if (stat(root.c_str(), &st) != 0) {
+        root = "/sys/kernel/debug/tracing/events/";
+        CHECK(stat(root.c_str(), &st) == 0) << "tracefs must be mounted at either"
+                                               "/sys/kernel/tracing or "
+                                               "/sys/kernel/debug/tracing";
+    }
+    return root;
+}
+
+AtraceDevice::AtraceDevice() : AtraceDevice(findTracefsEventRoot()) {}
+
+AtraceDevice::AtraceDevice(const std::string& tracefs_event_root)
+    : tracefs_event_root_(tracefs_event_root) {}
+
+AtraceDevice::~AtraceDevice() {
+    for (auto& [event, node] : nodes_) {
+        if (node.fd >= 0) {
+            close(node.fd);
+        }
+    }
+}
+
+int AtraceDevice::openNode(const std::string& path) {
+    return TEMP_FAILURE_RETRY(open(path.c_str(), O_RDWR | O_CLOEXEC));
+}
+
+bool AtraceDevice::readNode(int fd, bool* enabled) {
+    char value;
+    if (TEMP_FAILURE_RETRY(pread(fd, &value, 1, 0)) != 1) {
+        return false;
+    }
+    *enabled = value == '1';
+    return true;
+}
+
+bool AtraceDevice::writeNode(int fd, bool enable) {
+    // tracefs ignores the offset; pwrite keeps a regular file (in tests) a single byte too.
+    return TEMP_FAILURE_RETRY(pwrite(fd, enable ? "1" : "0", 1, 0)) == 1;
+}
+
+bool AtraceDevice::setEventLocked(const std::string& event, bool enable) {
+    EventNode& node = nodes_[event];
+    std::string path = tracefs_event_root_ + event + "/enable";
+    if (node.fd < 0) {
+        node.fd = openNode(path);
+        if (node.fd < 0) {
+            PLOG(ERROR) << "Failed to open " << path;
+            return false;
+        }
     }
+    node.enabled = enable;
+    // Other tracefs users (atrace itself, perfetto) may have flipped the node since this HAL
+    // last wrote it, so read the node rather than trusting what was last written.
+    bool enabled;
+    if (readNode(node.fd, &enabled) && enabled == enable) {
+        return true;
+    }
+    if (!writeNode(node.fd, enable)) {
+        PLOG(ERROR) << "Failed to " << (enable ? "enable" : "disable") << " tracing on: " << path;
+        // Reopen next time, in case the event went away with its module.
+        close(node.fd);
+        node.fd = -1;
+        return false;
+    }
+    return true;
 }
 
 Return<::android::hardware::atrace::V1_0::Status> AtraceDevice::enableCategories(
@@ -79,40 +140,42 @@ Return<::android::hardware::atrace::V1_0::Status> AtraceDevice::enableCategories
     if (!categories.size()) {
         return Status::ERROR_INVALID_ARGUMENT;
     }
+    for (auto& c : categories) {
+        if (!kTracingMap.count(c)) {
+            return Status::ERROR_INVALID_ARGUMENT;
+        }
+    }
 
+    std::lock_guard<std::mutex> lock(lock_);
     for (auto& c : categories) {
-        if (kTracingMap.count(c)) {
-            for (auto& p : kTracingMap.at(c).paths) {
-                std::string tracefs_event_enable_path = android::base::StringPrintf(
-                        "%s%s/enable", tracefs_event_root_.c_str(), p.first.c_str());
-                if (!android::base::WriteStringToFile("1", tracefs_event_enable_path)) {
-                    LOG(ERROR) << "Failed to enable tracing on: " << tracefs_event_enable_path;
-                    if (p.second) {
-                        // disable before return
-                        disableAllCategories();
-                        return Status::ERROR_TRACING_POINT;
-                    }
-                }
+        for (auto& p : kTracingMap.at(c).paths) {
+            if (!setEventLocked(p.first, true) && p.second) {
+                // disable before return
+                disableAllLocked();
+                return Status::ERROR_TRACING_POINT;
             }
-        } else {
-            return Status::ERROR_INVALID_ARGUMENT;
         }
     }
     return Status::SUCCESS;
 }
 
 Return<::android::hardware::atrace::V1_0::Status> AtraceDevice::disableAllCategories() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return disableAllLocked();
+}
+
+Status AtraceDevice::disableAllLocked() {
     auto ret = Status::SUCCESS;
 
+    // Only the events this HAL enabled.
     for (auto& c : kTracingMap) {
         for (auto& p : c.second.paths) {
-            std::string tracefs_event_enable_path = android::base::StringPrintf(
-                    "%s%s/enable", tracefs_event_root_.c_str(), p.first.c_str());
-            if (!android::base::WriteStringToFile("0", tracefs_event_enable_path)) {
-                LOG(ERROR) << "Failed to disable tracing on: " << tracefs_event_enable_path;
-                if (p.second) {
-                    ret = Status::ERROR_TRACING_POINT;
-                }
+            auto it = nodes_.find(p.first);
+            if (it == nodes_.end() || !it->second.enabled) {
+                continue;
+            }
+            if (!setEventLocked(p.first, false) && p.second) {
+                ret = Status::ERROR_TRACING_POINT;
             }
         }
     }
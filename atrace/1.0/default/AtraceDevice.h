@@ -21,6 +21,10 @@
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 
+#include <map>
+#include <mutex>
+#include <string>
+
 namespace android {
 namespace hardware {
 namespace atrace {
@@ -37,15 +41,39 @@ using ::android::hardware::Void;
 
 struct AtraceDevice : public IAtraceDevice {
     AtraceDevice();
+    explicit AtraceDevice(const std::string& tracefs_event_root);
+    ~AtraceDevice();
+
     // Methods from ::android::hardware::atrace::V1_0::IAtraceDevice follow.
     Return<void> listCategories(listCategories_cb _hidl_cb) override;
     Return<::android::hardware::atrace::V1_0::Status> enableCategories(
         const hidl_vec<hidl_string>& categories) override;
     Return<::android::hardware::atrace::V1_0::Status> disableAllCategories() override;
 
+  protected:
+    // Every access to tracefs goes through these, so tests can count them.
+    virtual int openNode(const std::string& path);
+    virtual bool readNode(int fd, bool* enabled);
+    virtual bool writeNode(int fd, bool enable);
+
   private:
+    // The enable node of one tracefs event. It stays open once opened.
+    struct EventNode {
+        int fd = -1;
+        // Whether this HAL enabled the event and has not disabled it since.
+        bool enabled = false;
+    };
+
+    // Writes the node unless it already is in that state. Returns whether the node is now in
+    // that state.
+    bool setEventLocked(const std::string& event, bool enable);
+    Status disableAllLocked();
+
     std::string tracefs_event_root_;
 
+    std::mutex lock_;
+    std::map<std::string, EventNode> nodes_;
+
     // Methods from ::android::hidl::base::V1_0::IBase follow.
 };
 
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/stat.h>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "AtraceDevice.h"
+
+using android::sp;
+using android::base::ReadFileToString;
+using android::base::TemporaryDir;
+using android::base::WriteStringToFile;
+using android::hardware::hidl_string;
+using android::hardware::hidl_vec;
+using android::hardware::atrace::V1_0::Status;
+using android::hardware::atrace::V1_0::implementation::AtraceDevice;
+
+namespace {
+
+// Counts the tracefs syscalls the device makes.
+class CountingAtraceDevice : public AtraceDevice {
+  public:
+    using AtraceDevice::AtraceDevice;
+
+    int openNode(const std::string& path) override {
+        mOpens++;
+        return AtraceDevice::openNode(path);
+    }
+
+    bool readNode(int fd, bool* enabled) override {
+        mReads++;
+        return AtraceDevice::readNode(fd, enabled);
+    }
+
+    bool writeNode(int fd, bool enable) override {
+        mWrites++;
+        return AtraceDevice::writeNode(fd, enable);
+    }
+
+    int mOpens = 0;
+    int mReads = 0;
+    int mWrites = 0;
+};
+
+}  // namespace
+
+// Mirrors tracefs/events: one directory per event with an enable node in it.
+class AtraceDeviceTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mRoot = std::string(mDir.path) + "/";
+        for (const char* event : {"mdss", "sde", "mali_systrace", "kmem/ion_alloc_buffer_start"}) {
+            addEvent(event);
+        }
+        mDevice = new CountingAtraceDevice(mRoot);
+    }
+
+    void addEvent(const std::string& event) {
+        std::string dir = mRoot;
+        for (size_t pos = 0; pos != std::string::npos;) {
+            size_t slash = event.find('/', pos);
+            dir = mRoot + event.substr(0, slash);
+            mkdir(dir.c_str(), 0755);
+            pos = slash == std::string::npos ? slash : slash + 1;
+        }
+        ASSERT_TRUE(WriteStringToFile("0", dir + "/enable"));
+    }
+
+    std::string enableOf(const std::string& event) {
+        std::string contents;
+        EXPECT_TRUE(ReadFileToString(mRoot + event + "/enable", &contents));
+        return contents;
+    }
+
+    Status enable(std::vector<hidl_string> categories) {
+        return mDevice->enableCategories(hidl_vec<hidl_string>(categories));
+    }
+
+    TemporaryDir mDir;
+    std::string mRoot;
+    sp<CountingAtraceDevice> mDevice;
+};
+
+TEST_F(AtraceDeviceTest, EnableWritesOnlyNodesThatAreOff) {
+    ASSERT_TRUE(WriteStringToFile("1", mRoot + "sde/enable"));
+
+    ASSERT_EQ(Status::SUCCESS, enable({"gfx"}));
+    EXPECT_EQ(3, mDevice->mOpens);
+    EXPECT_EQ(3, mDevice->mReads);
+    EXPECT_EQ(2, mDevice->mWrites);
+    EXPECT_EQ("1", enableOf("mdss"));
+    EXPECT_EQ("1", enableOf("sde"));
+    EXPECT_EQ("0", enableOf("kmem/ion_alloc_buffer_start"));
+
+    // Everything in gfx is on already.
+    ASSERT_EQ(Status::SUCCESS, enable({"gfx", "ion"}));
+    EXPECT_EQ(4, mDevice->mOpens);
+    EXPECT_EQ(2 + 1, mDevice->mWrites);
+    EXPECT_EQ("1", enableOf("kmem/ion_alloc_buffer_start"));
+}
+
+TEST_F(AtraceDeviceTest, DisableWritesOnlyNodesThisHalEnabled) {
+    ASSERT_TRUE(WriteStringToFile("1", mRoot + "mdss/enable"));
+    ASSERT_EQ(Status::SUCCESS, mDevice->disableAllCategories());
+    EXPECT_EQ(0, mDevice->mOpens);
+    EXPECT_EQ(0, mDevice->mWrites);
+    EXPECT_EQ("1", enableOf("mdss"));
+
+    ASSERT_EQ(Status::SUCCESS, enable({"ion"}));
+    ASSERT_EQ(Status::SUCCESS, mDevice->disableAllCategories());
+    EXPECT_EQ(1, mDevice->mOpens);
+    EXPECT_EQ(1 + 1, mDevice->mWrites);
+    EXPECT_EQ("0", enableOf("kmem/ion_alloc_buffer_start"));
+    EXPECT_EQ("1", enableOf("mdss"));
+
+    // Nothing is left enabled.
+    ASSERT_EQ(Status::SUCCESS, mDevice->disableAllCategories());
+    EXPECT_EQ(2, mDevice->mWrites);
+}
+
+// Another tracefs writer changing a node behind the HAL's back must not stick, and a node it
+// already set to the wanted state is not written again.
+TEST_F(AtraceDeviceTest, ReadsNodesChangedByOthers) {
+    ASSERT_EQ(Status::SUCCESS, enable({"gfx"}));
+    ASSERT_TRUE(WriteStringToFile("0", mRoot + "mdss/enable"));
+    ASSERT_EQ(Status::SUCCESS, enable({"gfx"}));
+    EXPECT_EQ("1", enableOf("mdss"));
+    EXPECT_EQ(3 + 1, mDevice->mWrites);
+
+    ASSERT_TRUE(WriteStringToFile("0", mRoot + "sde/enable"));
+    ASSERT_EQ(Status::SUCCESS, mDevice->disableAllCategories());
+    EXPECT_EQ("0", enableOf("mdss"));
+    EXPECT_EQ("0", enableOf("sde"));
+    EXPECT_EQ("0", enableOf("mali_systrace"));
+    EXPECT_EQ(3 + 1 + 2, mDevice->mWrites);
+}
+
+TEST_F(AtraceDeviceTest, ReusesOpenNodesAcrossSessions) {
+    for (int session = 0; session < 3; ++session) {
+        ASSERT_EQ(Status::SUCCESS, enable({"gfx", "ion"}));
+        EXPECT_EQ("1", enableOf("mdss"));
+        ASSERT_EQ(Status::SUCCESS, mDevice->disableAllCategories());
+        EXPECT_EQ("0", enableOf("mdss"));
+    }
+    EXPECT_EQ(4, mDevice->mOpens);
+    EXPECT_EQ(3 * 2 * 4, mDevice->mWrites);
+}
+
+TEST_F(AtraceDeviceTest, MissingOptionalEventIsSkipped) {
+    ASSERT_EQ(0, unlink((mRoot + "mali_systrace/enable").c_str()));
+
+    ASSERT_EQ(Status::SUCCESS, enable({"gfx"}));
+    EXPECT_EQ("1", enableOf("mdss"));
+    EXPECT_EQ("1", enableOf("sde"));
+    EXPECT_EQ(2, mDevice->mWrites);
+}
+
+TEST_F(AtraceDeviceTest, InvalidCategoryEnablesNothing) {
+    EXPECT_EQ(Status::ERROR_INVALID_ARGUMENT, enable({}));
+    EXPECT_EQ(Status::ERROR_INVALID_ARGUMENT, enable({"gfx", "nonexistent"}));
+    EXPECT_EQ(0, mDevice->mOpens);
+    EXPECT_EQ(0, mDevice->mWrites);
+    EXPECT_EQ("0", enableOf("mdss"));
+}
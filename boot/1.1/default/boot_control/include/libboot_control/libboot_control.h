@@ -16,10 +16,15 @@
 
 #pragma once
 
+#include <memory>
+#include <mutex>
 #include <string>
 
+#include <android-base/unique_fd.h>
 #include <android/hardware/boot/1.1/IBootControl.h>
 
+struct bootloader_control;
+
 namespace android {
 namespace bootable {
 
@@ -28,7 +33,15 @@ class BootControl {
   using MergeStatus = ::android::hardware::boot::V1_1::MergeStatus;
 
  public:
+  BootControl();
+  ~BootControl();
+
   bool Init();
+  // Same as Init(), but with an explicit misc device and current slot instead
+  // of the ones from the fstab and ro.boot.slot_suffix. The Virtual A/B message
+  // is not initialized.
+  bool InitWithMiscDevice(const std::string& misc_device, unsigned int current_slot);
+
   unsigned int GetNumberSlots();
   unsigned int GetCurrentSlot();
   bool MarkBootSuccessful();
@@ -61,6 +74,21 @@ class BootControl {
 
   // The slot where we are running from.
   unsigned int current_slot_ = 0;
+
+  // Reads the bootloader_control from misc into boot_ctrl_. misc is read on
+  // every call, as recovery or bootctl may have written it since. Returns
+  // nullptr if misc cannot be read.
+  bootloader_control* GetBootloaderControl();
+  // Writes boot_ctrl_ back to misc with an updated CRC.
+  bool SaveBootloaderControl();
+
+  // Guards boot_ctrl_, so that read-modify-write cycles of the slot setters
+  // don't interleave.
+  std::mutex lock_;
+
+  // misc, kept open for the lifetime of this object.
+  android::base::unique_fd misc_fd_;
+  std::unique_ptr<bootloader_control> boot_ctrl_;
 };
 
 // Helper functions to write the Virtual A/B merge status message. These are
@@ -20,6 +20,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include <string>
 
@@ -32,6 +33,10 @@
 
 #include "private/boot_control_definition.h"
 
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
 namespace android {
 namespace bootable {
 
@@ -47,25 +52,58 @@ constexpr unsigned int kMaxNumSlots =
 constexpr const char* kSlotSuffixes[kMaxNumSlots] = { "_a", "_b", "_c", "_d" };
 constexpr off_t kBootloaderControlOffset = offsetof(bootloader_message_ab, slot_suffix);
 
-static uint32_t CRC32(const uint8_t* buf, size_t size) {
-  static uint32_t crc_table[256];
-
-  // Compute the CRC-32 table only once.
-  if (!crc_table[1]) {
+// Lookup tables for the slice-by-8 CRC-32: table[0] is the usual byte-wise
+// table, and table[k] advances a CRC over k more zero bytes.
+struct CRC32Tables {
+  constexpr CRC32Tables() : table() {
     for (uint32_t i = 0; i < 256; ++i) {
       uint32_t crc = i;
       for (uint32_t j = 0; j < 8; ++j) {
         uint32_t mask = -(crc & 1);
         crc = (crc >> 1) ^ (0xEDB88320 & mask);
       }
-      crc_table[i] = crc;
+      table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+      for (uint32_t k = 1; k < 8; ++k) {
+        table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+      }
     }
   }
 
+  uint32_t table[8][256];
+};
+
+static uint32_t CRC32(const uint8_t* buf, size_t size) {
   uint32_t ret = -1;
-  for (size_t i = 0; i < size; ++i) {
-    ret = (ret >> 8) ^ crc_table[(ret ^ buf[i]) & 0xFF];
+
+#if defined(__ARM_FEATURE_CRC32)
+  // The ARMv8 CRC32 instructions use the same polynomial as the tables below.
+  for (; size >= sizeof(uint64_t); buf += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, buf, sizeof(word));
+    ret = __crc32d(ret, le64toh(word));
+  }
+  for (; size > 0; ++buf, --size) {
+    ret = __crc32b(ret, *buf);
+  }
+#else
+  static constexpr CRC32Tables kTables;
+  const auto& t = kTables.table;
+
+  for (; size >= 2 * sizeof(uint32_t); buf += 2 * sizeof(uint32_t), size -= 2 * sizeof(uint32_t)) {
+    uint32_t lo, hi;
+    memcpy(&lo, buf, sizeof(lo));
+    memcpy(&hi, buf + sizeof(lo), sizeof(hi));
+    lo = le32toh(lo) ^ ret;
+    hi = le32toh(hi);
+    ret = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+          t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
   }
+  for (; size > 0; ++buf, --size) {
+    ret = (ret >> 8) ^ t[0][(ret ^ *buf) & 0xFF];
+  }
+#endif
 
   return ~ret;
 }
@@ -77,41 +115,6 @@ uint32_t BootloaderControlLECRC(const bootloader_control* boot_ctrl) {
       CRC32(reinterpret_cast<const uint8_t*>(boot_ctrl), offsetof(bootloader_control, crc32_le)));
 }
 
-bool LoadBootloaderControl(const std::string& misc_device, bootloader_control* buffer) {
-  android::base::unique_fd fd(open(misc_device.c_str(), O_RDONLY));
-  if (fd.get() == -1) {
-    PLOG(ERROR) << "failed to open " << misc_device;
-    return false;
-  }
-  if (lseek(fd, kBootloaderControlOffset, SEEK_SET) != kBootloaderControlOffset) {
-    PLOG(ERROR) << "failed to lseek " << misc_device;
-    return false;
-  }
-  if (!android::base::ReadFully(fd.get(), buffer, sizeof(bootloader_control))) {
-    PLOG(ERROR) << "failed to read " << misc_device;
-    return false;
-  }
-  return true;
-}
-
-bool UpdateAndSaveBootloaderControl(const std::string& misc_device, bootloader_control* buffer) {
-  buffer->crc32_le = BootloaderControlLECRC(buffer);
-  android::base::unique_fd fd(open(misc_device.c_str(), O_WRONLY | O_SYNC));
-  if (fd.get() == -1) {
-    PLOG(ERROR) << "failed to open " << misc_device;
-    return false;
-  }
-  if (lseek(fd.get(), kBootloaderControlOffset, SEEK_SET) != kBootloaderControlOffset) {
-    PLOG(ERROR) << "failed to lseek " << misc_device;
-    return false;
-  }
-  if (!android::base::WriteFully(fd.get(), buffer, sizeof(bootloader_control))) {
-    PLOG(ERROR) << "failed to write " << misc_device;
-    return false;
-  }
-  return true;
-}
-
 void InitDefaultBootloaderControl(BootControl* control, bootloader_control* boot_ctrl) {
   memset(boot_ctrl, 0, sizeof(*boot_ctrl));
 
@@ -181,6 +184,18 @@ void InitDefaultBootloaderControl(BootControl* control, bootloader_control* boot
   boot_ctrl->crc32_le = BootloaderControlLECRC(boot_ctrl);
 }
 
+// If the slot reverted after having created a snapshot, then the snapshot will
+// be thrown away at boot. Thus we don't count this as being in a snapshotted
+// state.
+static MergeStatus MergeStatusFromMessage(const misc_virtual_ab_message& message,
+                                          unsigned int current_slot) {
+  auto status = static_cast<MergeStatus>(message.merge_status);
+  if (status == MergeStatus::SNAPSHOTTED && current_slot == message.source_slot) {
+    status = MergeStatus::NONE;
+  }
+  return status;
+}
+
 // Return the index of the slot suffix passed or -1 if not a valid slot suffix.
 int SlotSuffixToIndex(const char* suffix) {
   for (unsigned int slot = 0; slot < kMaxNumSlots; ++slot) {
@@ -189,6 +204,10 @@ int SlotSuffixToIndex(const char* suffix) {
   return -1;
 }
 
+BootControl::BootControl() = default;
+
+BootControl::~BootControl() = default;
+
 // Initialize the boot_control_private struct with the information from
 // the bootloader_message buffer stored in |boot_ctrl|. Returns whether the
 // initialization succeeded.
@@ -203,7 +222,7 @@ bool BootControl::Init() {
     LOG(ERROR) << "Slot suffix property is not set";
     return false;
   }
-  current_slot_ = SlotSuffixToIndex(suffix_prop.c_str());
+  unsigned int current_slot = SlotSuffixToIndex(suffix_prop.c_str());
 
   std::string err;
   std::string device = get_bootloader_message_blk_device(&err);
@@ -212,32 +231,67 @@ bool BootControl::Init() {
     return false;
   }
 
-  bootloader_control boot_ctrl;
-  if (!LoadBootloaderControl(device.c_str(), &boot_ctrl)) {
-    LOG(ERROR) << "Failed to load bootloader control block";
+  if (!InitWithMiscDevice(device, current_slot)) {
     return false;
   }
 
-  // Note that since there isn't a module unload function this memory is leaked.
-  // We use `device` below sometimes, so it's not moved out of here.
-  misc_device_ = device;
+  return InitMiscVirtualAbMessageIfNeeded();
+}
+
+bool BootControl::InitWithMiscDevice(const std::string& misc_device, unsigned int current_slot) {
+  std::lock_guard<std::mutex> lock(lock_);
+  if (initialized_) return true;
+
+  current_slot_ = current_slot;
+
+  misc_fd_.reset(open(misc_device.c_str(), O_RDWR | O_SYNC | O_CLOEXEC));
+  if (misc_fd_.get() == -1) {
+    PLOG(ERROR) << "failed to open " << misc_device;
+    return false;
+  }
+  misc_device_ = misc_device;
+  if (!boot_ctrl_) boot_ctrl_ = std::make_unique<bootloader_control>();
   initialized_ = true;
+  if (!GetBootloaderControl()) {
+    LOG(ERROR) << "Failed to load bootloader control block";
+    initialized_ = false;
+    misc_fd_.reset();
+    misc_device_.clear();
+    return false;
+  }
 
   // Validate the loaded data, otherwise we will destroy it and re-initialize it
   // with the current information.
-  uint32_t computed_crc32 = BootloaderControlLECRC(&boot_ctrl);
-  if (boot_ctrl.crc32_le != computed_crc32) {
+  uint32_t computed_crc32 = BootloaderControlLECRC(boot_ctrl_.get());
+  if (boot_ctrl_->crc32_le != computed_crc32) {
     LOG(WARNING) << "Invalid boot control found, expected CRC-32 0x" << std::hex << computed_crc32
-                 << " but found 0x" << std::hex << boot_ctrl.crc32_le << ". Re-initializing.";
-    InitDefaultBootloaderControl(this, &boot_ctrl);
-    UpdateAndSaveBootloaderControl(device.c_str(), &boot_ctrl);
+                 << " but found 0x" << std::hex << boot_ctrl_->crc32_le << ". Re-initializing.";
+    InitDefaultBootloaderControl(this, boot_ctrl_.get());
+    SaveBootloaderControl();
   }
 
-  if (!InitMiscVirtualAbMessageIfNeeded()) {
-    return false;
+  num_slots_ = boot_ctrl_->nb_slot;
+  return true;
+}
+
+bootloader_control* BootControl::GetBootloaderControl() {
+  if (!initialized_) return nullptr;
+
+  if (!android::base::ReadFullyAtOffset(misc_fd_.get(), boot_ctrl_.get(),
+                                       sizeof(bootloader_control), kBootloaderControlOffset)) {
+    PLOG(ERROR) << "failed to read " << misc_device_;
+    return nullptr;
   }
+  return boot_ctrl_.get();
+}
 
-  num_slots_ = boot_ctrl.nb_slot;
+bool BootControl::SaveBootloaderControl() {
+  boot_ctrl_->crc32_le = BootloaderControlLECRC(boot_ctrl_.get());
+  if (!android::base::WriteFullyAtOffset(misc_fd_.get(), boot_ctrl_.get(),
+                                        sizeof(bootloader_control), kBootloaderControlOffset)) {
+    PLOG(ERROR) << "failed to write " << misc_device_;
+    return false;
+  }
   return true;
 }
 
@@ -250,28 +304,30 @@ unsigned int BootControl::GetCurrentSlot() {
 }
 
 bool BootControl::MarkBootSuccessful() {
-  bootloader_control bootctrl;
-  if (!LoadBootloaderControl(misc_device_, &bootctrl)) return false;
+  std::lock_guard<std::mutex> lock(lock_);
+  bootloader_control* bootctrl = GetBootloaderControl();
+  if (!bootctrl) return false;
 
-  bootctrl.slot_info[current_slot_].successful_boot = 1;
+  bootctrl->slot_info[current_slot_].successful_boot = 1;
   // tries_remaining == 0 means that the slot is not bootable anymore, make
   // sure we mark the current slot as bootable if it succeeds in the last
   // attempt.
-  bootctrl.slot_info[current_slot_].tries_remaining = 1;
-  return UpdateAndSaveBootloaderControl(misc_device_, &bootctrl);
+  bootctrl->slot_info[current_slot_].tries_remaining = 1;
+  return SaveBootloaderControl();
 }
 
 unsigned int BootControl::GetActiveBootSlot() {
-  bootloader_control bootctrl;
-  if (!LoadBootloaderControl(misc_device_, &bootctrl)) return false;
+  std::lock_guard<std::mutex> lock(lock_);
+  bootloader_control* bootctrl = GetBootloaderControl();
+  if (!bootctrl) return false;
 
   // Use the current slot by default.
   unsigned int active_boot_slot = current_slot_;
-  unsigned int max_priority = bootctrl.slot_info[current_slot_].priority;
+  unsigned int max_priority = bootctrl->slot_info[current_slot_].priority;
   // Find the slot with the highest priority.
   for (unsigned int i = 0; i < num_slots_; ++i) {
-    if (bootctrl.slot_info[i].priority > max_priority) {
-      max_priority = bootctrl.slot_info[i].priority;
+    if (bootctrl->slot_info[i].priority > max_priority) {
+      max_priority = bootctrl->slot_info[i].priority;
       active_boot_slot = i;
     }
   }
@@ -285,32 +341,33 @@ bool BootControl::SetActiveBootSlot(unsigned int slot) {
     return false;
   }
 
-  bootloader_control bootctrl;
-  if (!LoadBootloaderControl(misc_device_, &bootctrl)) return false;
+  std::lock_guard<std::mutex> lock(lock_);
+  bootloader_control* bootctrl = GetBootloaderControl();
+  if (!bootctrl) return false;
 
   // Set every other slot with a lower priority than the new "active" slot.
   const unsigned int kActivePriority = 15;
   const unsigned int kActiveTries = 6;
   for (unsigned int i = 0; i < num_slots_; ++i) {
     if (i != slot) {
-      if (bootctrl.slot_info[i].priority >= kActivePriority)
-        bootctrl.slot_info[i].priority = kActivePriority - 1;
+      if (bootctrl->slot_info[i].priority >= kActivePriority)
+        bootctrl->slot_info[i].priority = kActivePriority - 1;
     }
   }
 
   // Note that setting a slot as active doesn't change the successful bit.
   // The successful bit will only be changed by setSlotAsUnbootable().
-  bootctrl.slot_info[slot].priority = kActivePriority;
-  bootctrl.slot_info[slot].tries_remaining = kActiveTries;
+  bootctrl->slot_info[slot].priority = kActivePriority;
+  bootctrl->slot_info[slot].tries_remaining = kActiveTries;
 
   // Setting the current slot as active is a way to revert the operation that
   // set *another* slot as active at the end of an updater. This is commonly
   // used to cancel the pending update. We should only reset the verity_corrpted
   // bit when attempting a new slot, otherwise the verity bit on the current
   // slot would be flip.
-  if (slot != current_slot_) bootctrl.slot_info[slot].verity_corrupted = 0;
+  if (slot != current_slot_) bootctrl->slot_info[slot].verity_corrupted = 0;
 
-  return UpdateAndSaveBootloaderControl(misc_device_, &bootctrl);
+  return SaveBootloaderControl();
 }
 
 bool BootControl::SetSlotAsUnbootable(unsigned int slot) {
@@ -319,14 +376,15 @@ bool BootControl::SetSlotAsUnbootable(unsigned int slot) {
     return false;
   }
 
-  bootloader_control bootctrl;
-  if (!LoadBootloaderControl(misc_device_, &bootctrl)) return false;
+  std::lock_guard<std::mutex> lock(lock_);
+  bootloader_control* bootctrl = GetBootloaderControl();
+  if (!bootctrl) return false;
 
   // The only way to mark a slot as unbootable, regardless of the priority is to
   // set the tries_remaining to 0.
-  bootctrl.slot_info[slot].successful_boot = 0;
-  bootctrl.slot_info[slot].tries_remaining = 0;
-  return UpdateAndSaveBootloaderControl(misc_device_, &bootctrl);
+  bootctrl->slot_info[slot].successful_boot = 0;
+  bootctrl->slot_info[slot].tries_remaining = 0;
+  return SaveBootloaderControl();
 }
 
 bool BootControl::IsSlotBootable(unsigned int slot) {
@@ -335,10 +393,11 @@ bool BootControl::IsSlotBootable(unsigned int slot) {
     return false;
   }
 
-  bootloader_control bootctrl;
-  if (!LoadBootloaderControl(misc_device_, &bootctrl)) return false;
+  std::lock_guard<std::mutex> lock(lock_);
+  bootloader_control* bootctrl = GetBootloaderControl();
+  if (!bootctrl) return false;
 
-  return bootctrl.slot_info[slot].tries_remaining != 0;
+  return bootctrl->slot_info[slot].tries_remaining != 0;
 }
 
 bool BootControl::IsSlotMarkedSuccessful(unsigned int slot) {
@@ -347,10 +406,11 @@ bool BootControl::IsSlotMarkedSuccessful(unsigned int slot) {
     return false;
   }
 
-  bootloader_control bootctrl;
-  if (!LoadBootloaderControl(misc_device_, &bootctrl)) return false;
+  std::lock_guard<std::mutex> lock(lock_);
+  bootloader_control* bootctrl = GetBootloaderControl();
+  if (!bootctrl) return false;
 
-  return bootctrl.slot_info[slot].successful_boot && bootctrl.slot_info[slot].tries_remaining;
+  return bootctrl->slot_info[slot].successful_boot && bootctrl->slot_info[slot].tries_remaining;
 }
 
 bool BootControl::IsValidSlot(unsigned int slot) {
@@ -429,13 +489,7 @@ bool GetMiscVirtualAbMergeStatus(unsigned int current_slot,
     return false;
   }
 
-  // If the slot reverted after having created a snapshot, then the snapshot will
-  // be thrown away at boot. Thus we don't count this as being in a snapshotted
-  // state.
-  *status = static_cast<MergeStatus>(message.merge_status);
-  if (*status == MergeStatus::SNAPSHOTTED && current_slot == message.source_slot) {
-    *status = MergeStatus::NONE;
-  }
+  *status = MergeStatusFromMessage(message, current_slot);
   return true;
 }
 
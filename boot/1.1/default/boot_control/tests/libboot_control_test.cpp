@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <libboot_control/libboot_control.h>
+
+#include <endian.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <random>
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <bootloader_message/bootloader_message.h>
+#include <gtest/gtest.h>
+
+#include "private/boot_control_definition.h"
+
+namespace android {
+namespace bootable {
+namespace {
+
+constexpr off_t kBootloaderControlOffset = offsetof(bootloader_message_ab, slot_suffix);
+
+// Bit-at-a-time reference for the CRC-32 used by the bootloader.
+uint32_t ReferenceCRC32(const uint8_t* buf, size_t size) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < size; ++i) {
+    crc ^= buf[i];
+    for (int j = 0; j < 8; ++j) {
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+  }
+  return ~crc;
+}
+
+uint32_t ReferenceCRC(const bootloader_control& boot_ctrl) {
+  return htole32(ReferenceCRC32(reinterpret_cast<const uint8_t*>(&boot_ctrl),
+                                offsetof(bootloader_control, crc32_le)));
+}
+
+class LibBootControlTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    misc_ = std::string(dir_.path) + "/misc";
+    // Two slots: InitDefaultBootloaderControl() probes for boot_<suffix> next
+    // to the misc device.
+    ASSERT_TRUE(android::base::WriteStringToFile("", std::string(dir_.path) + "/boot_a"));
+    ASSERT_TRUE(android::base::WriteStringToFile("", std::string(dir_.path) + "/boot_b"));
+    ASSERT_TRUE(android::base::WriteStringToFile(std::string(sizeof(bootloader_message_ab), '\0'),
+                                                 misc_));
+  }
+
+  bootloader_control ReadControl() {
+    bootloader_control boot_ctrl = {};
+    android::base::unique_fd fd(open(misc_.c_str(), O_RDONLY));
+    EXPECT_TRUE(android::base::ReadFullyAtOffset(fd.get(), &boot_ctrl, sizeof(boot_ctrl),
+                                                 kBootloaderControlOffset));
+    return boot_ctrl;
+  }
+
+  // Writes |boot_ctrl| behind the back of BootControl, the way recovery or
+  // bootctl would.
+  void WriteControlExternally(bootloader_control boot_ctrl) {
+    boot_ctrl.crc32_le = ReferenceCRC(boot_ctrl);
+    android::base::unique_fd fd(open(misc_.c_str(), O_WRONLY));
+    ASSERT_TRUE(android::base::WriteFullyAtOffset(fd.get(), &boot_ctrl, sizeof(boot_ctrl),
+                                                  kBootloaderControlOffset));
+  }
+
+  TemporaryDir dir_;
+  std::string misc_;
+};
+
+TEST_F(LibBootControlTest, InitializesInvalidControl) {
+  BootControl control;
+  ASSERT_TRUE(control.InitWithMiscDevice(misc_, 0));
+  EXPECT_EQ(2u, control.GetNumberSlots());
+
+  bootloader_control boot_ctrl = ReadControl();
+  EXPECT_EQ(BOOT_CTRL_MAGIC, boot_ctrl.magic);
+  EXPECT_EQ(ReferenceCRC(boot_ctrl), boot_ctrl.crc32_le);
+  EXPECT_TRUE(control.IsSlotMarkedSuccessful(0));
+  EXPECT_FALSE(control.IsSlotMarkedSuccessful(1));
+}
+
+TEST_F(LibBootControlTest, CrcMatchesReference) {
+  std::mt19937 rng(42);
+  for (int i = 0; i < 64; ++i) {
+    bootloader_control boot_ctrl;
+    auto* bytes = reinterpret_cast<uint8_t*>(&boot_ctrl);
+    for (size_t j = 0; j < sizeof(boot_ctrl); ++j) bytes[j] = rng();
+    boot_ctrl.nb_slot = 2;
+    WriteControlExternally(boot_ctrl);
+
+    // A control with a matching CRC is kept as is instead of re-initialized.
+    BootControl control;
+    ASSERT_TRUE(control.InitWithMiscDevice(misc_, 0));
+    bootloader_control on_disk = ReadControl();
+    EXPECT_EQ(0, memcmp(&boot_ctrl, &on_disk, offsetof(bootloader_control, crc32_le)))
+        << "iteration " << i;
+  }
+}
+
+TEST_F(LibBootControlTest, ReloadsAfterExternalWrite) {
+  BootControl control;
+  ASSERT_TRUE(control.InitWithMiscDevice(misc_, 0));
+  ASSERT_TRUE(control.IsSlotBootable(1));
+
+  bootloader_control boot_ctrl = ReadControl();
+  boot_ctrl.slot_info[1].tries_remaining = 0;
+  WriteControlExternally(boot_ctrl);
+
+  EXPECT_FALSE(control.IsSlotBootable(1));
+}
+
+TEST_F(LibBootControlTest, WritesAreReadBack) {
+  BootControl control;
+  ASSERT_TRUE(control.InitWithMiscDevice(misc_, 0));
+
+  ASSERT_TRUE(control.SetActiveBootSlot(1));
+  EXPECT_EQ(1u, control.GetActiveBootSlot());
+
+  bootloader_control boot_ctrl = ReadControl();
+  EXPECT_EQ(15, boot_ctrl.slot_info[1].priority);
+  EXPECT_EQ(ReferenceCRC(boot_ctrl), boot_ctrl.crc32_le);
+}
+
+}  // namespace
+}  // namespace bootable
+}  // namespace android
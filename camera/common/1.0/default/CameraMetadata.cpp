@@ -23,6 +23,10 @@
 #include "CameraMetadata.h"
 #include "VendorTagDescriptor.h"
 
+#include <deque>
+#include <string>
+#include <string_view>
+
 namespace android {
 namespace hardware {
 namespace camera {
@@ -67,6 +71,7 @@ CameraMetadata &CameraMetadata::operator=(const camera_metadata_t *buffer) {
         camera_metadata_t *newBuffer = clone_camera_metadata(buffer);
         clear();
         mBuffer = newBuffer;
+        invalidateIndex();
     }
     return *this;
 }
@@ -102,6 +107,7 @@ camera_metadata_t* CameraMetadata::release() {
     }
     camera_metadata_t *released = mBuffer;
     mBuffer = NULL;
+    invalidateIndex();
     return released;
 }
 
@@ -114,6 +120,7 @@ void CameraMetadata::clear() {
         free_camera_metadata(mBuffer);
         mBuffer = NULL;
     }
+    invalidateIndex();
 }
 
 void CameraMetadata::acquire(camera_metadata_t *buffer) {
@@ -123,6 +130,7 @@ void CameraMetadata::acquire(camera_metadata_t *buffer) {
     }
     clear();
     mBuffer = buffer;
+    invalidateIndex();
 
     ALOGE_IF(validate_camera_metadata_structure(mBuffer, /*size*/NULL) != OK,
              "%s: Failed to validate metadata structure %p",
@@ -149,6 +157,7 @@ status_t CameraMetadata::append(const camera_metadata_t* other) {
     size_t extraEntries = get_camera_metadata_entry_count(other);
     size_t extraData = get_camera_metadata_data_count(other);
     resizeIfNeeded(extraEntries, extraData);
+    invalidateIndex();
 
     return append_camera_metadata(mBuffer, other);
 }
@@ -167,9 +176,35 @@ status_t CameraMetadata::sort() {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return INVALID_OPERATION;
     }
+    invalidateIndex();
     return sort_camera_metadata(mBuffer);
 }
 
+void CameraMetadata::invalidateIndex() {
+    mIndex.clear();
+    mIndexValid = false;
+}
+
+bool CameraMetadata::indexOf(uint32_t tag, size_t *index) {
+    if (!mIndexValid) {
+        size_t count = entryCount();
+        mIndex.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            camera_metadata_ro_entry entry;
+            get_camera_metadata_ro_entry(mBuffer, i, &entry);
+            // Like find_camera_metadata_entry, the first of duplicate entries wins.
+            mIndex.emplace(entry.tag, i);
+        }
+        mIndexValid = true;
+    }
+    auto it = mIndex.find(tag);
+    if (it == mIndex.end()) {
+        return false;
+    }
+    *index = it->second;
+    return true;
+}
+
 status_t CameraMetadata::checkType(uint32_t tag, uint8_t expectedType) {
     int tagType = get_local_camera_metadata_tag_type(tag, mBuffer);
     if ( CC_UNLIKELY(tagType == -1)) {
@@ -318,15 +353,18 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
 
     res = resizeIfNeeded(1, data_size);
 
+    // Resizing copies the entries in order, so the index stays valid.
     if (res == OK) {
-        camera_metadata_entry_t entry;
-        res = find_camera_metadata_entry(mBuffer, tag, &entry);
-        if (res == NAME_NOT_FOUND) {
+        size_t index;
+        if (indexOf(tag, &index)) {
+            res = update_camera_metadata_entry(mBuffer,
+                    index, data, data_count, NULL);
+        } else {
             res = add_camera_metadata_entry(mBuffer,
                     tag, data, data_count);
-        } else if (res == OK) {
-            res = update_camera_metadata_entry(mBuffer,
-                    entry.index, data, data_count, NULL);
+            if (res == OK) {
+                mIndex.emplace(tag, get_camera_metadata_entry_count(mBuffer) - 1);
+            }
         }
     }
 
@@ -348,6 +386,9 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
 }
 
 bool CameraMetadata::exists(uint32_t tag) const {
+    if (mIndexValid) {
+        return mIndex.count(tag) != 0;
+    }
     camera_metadata_ro_entry entry;
     return find_camera_metadata_ro_entry(mBuffer, tag, &entry) == 0;
 }
@@ -360,7 +401,9 @@ camera_metadata_entry_t CameraMetadata::find(uint32_t tag) {
         entry.count = 0;
         return entry;
     }
-    res = find_camera_metadata_entry(mBuffer, tag, &entry);
+    size_t index;
+    res = indexOf(tag, &index) ? get_camera_metadata_entry(mBuffer, index, &entry)
+                               : NAME_NOT_FOUND;
     if (CC_UNLIKELY( res != OK )) {
         entry.count = 0;
         entry.data.u8 = NULL;
@@ -371,7 +414,13 @@ camera_metadata_entry_t CameraMetadata::find(uint32_t tag) {
 camera_metadata_ro_entry_t CameraMetadata::find(uint32_t tag) const {
     status_t res;
     camera_metadata_ro_entry entry;
-    res = find_camera_metadata_ro_entry(mBuffer, tag, &entry);
+    if (mIndexValid) {
+        auto it = mIndex.find(tag);
+        res = it != mIndex.end() ? get_camera_metadata_ro_entry(mBuffer, it->second, &entry)
+                                 : NAME_NOT_FOUND;
+    } else {
+        res = find_camera_metadata_ro_entry(mBuffer, tag, &entry);
+    }
     if (CC_UNLIKELY( res != OK )) {
         entry.count = 0;
         entry.data.u8 = NULL;
@@ -380,22 +429,18 @@ camera_metadata_ro_entry_t CameraMetadata::find(uint32_t tag) const {
 }
 
 status_t CameraMetadata::erase(uint32_t tag) {
-    camera_metadata_entry_t entry;
     status_t res;
     if (mLocked) {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return INVALID_OPERATION;
     }
-    res = find_camera_metadata_entry(mBuffer, tag, &entry);
-    if (res == NAME_NOT_FOUND) {
+    size_t index;
+    if (!indexOf(tag, &index)) {
         return OK;
-    } else if (res != OK) {
-        ALOGE("%s: Error looking for entry %s.%s (%x): %s %d", __FUNCTION__,
-              get_local_camera_metadata_section_name(tag, mBuffer),
-              get_local_camera_metadata_tag_name(tag, mBuffer), tag, strerror(-res), res);
-        return res;
     }
-    res = delete_camera_metadata_entry(mBuffer, entry.index);
+    // Deleting shifts the entries after it.
+    invalidateIndex();
+    res = delete_camera_metadata_entry(mBuffer, index);
     if (res != OK) {
         ALOGE("%s: Error deleting entry %s.%s (%x): %s %d", __FUNCTION__,
               get_local_camera_metadata_section_name(tag, mBuffer),
@@ -460,101 +505,211 @@ void CameraMetadata::swap(CameraMetadata& other) {
 
     other.mBuffer = thisBuf;
     mBuffer = otherBuf;
-}
+    std::swap(mIndex, other.mIndex);
+    std::swap(mIndexValid, other.mIndexValid);
+}
+
+namespace {
+
+// Full names ("android.control.aeMode") of all built-in tags.
+class BuiltInTagNames {
+  public:
+    BuiltInTagNames() {
+        for (size_t section = 0; section < ANDROID_SECTION_COUNT; ++section) {
+            uint32_t tagBegin = camera_metadata_section_bounds[section][0];
+            uint32_t tagEnd = camera_metadata_section_bounds[section][1];
+            for (uint32_t tag = tagBegin; tag < tagEnd; ++tag) {
+                const char *tagName = get_camera_metadata_tag_name(tag);
+                if (tagName == nullptr) continue;
+                mNames.push_back(std::string(camera_metadata_section_names[section]) + "." +
+                                 tagName);
+                mTags.emplace(mNames.back(), tag);
+            }
+        }
+    }
+
+    bool lookup(std::string_view name, uint32_t *tag) const {
+        auto it = mTags.find(name);
+        if (it == mTags.end()) {
+            return false;
+        }
+        *tag = it->second;
+        return true;
+    }
+
+  private:
+    // Owns the strings that the keys of mTags point to; a deque never moves them.
+    std::deque<std::string> mNames;
+    std::unordered_map<std::string_view, uint32_t> mTags;
+};
+
+} // anonymous namespace
 
 status_t CameraMetadata::getTagFromName(const char *name,
         const VendorTagDescriptor* vTags, uint32_t *tag) {
 
     if (name == nullptr || tag == nullptr) return BAD_VALUE;
 
-    size_t nameLength = strlen(name);
+    static const BuiltInTagNames builtInTags;
+    const std::string_view fullName(name);
+    if (builtInTags.lookup(fullName, tag)) {
+        return OK;
+    }
+    if (vTags == NULL) {
+        return NAME_NOT_FOUND;
+    }
 
-    const SortedVector<String8> *vendorSections;
-    size_t vendorSectionCount = 0;
+    // The section is the longest prefix that names a vendor section; the rest
+    // of the name is the tag name.
+    for (size_t dot = fullName.rfind('.'); dot != std::string_view::npos && dot > 0;
+            dot = fullName.rfind('.', dot - 1)) {
+        ssize_t sectionIndex = vTags->findSectionIndex(fullName.substr(0, dot));
+        if (sectionIndex < 0) {
+            continue;
+        }
+        ALOGV("%s: Found matched section '%.*s'", __FUNCTION__, static_cast<int>(dot), name);
+        if (dot + 1 >= fullName.size()) {
+            return BAD_VALUE;
+        }
+        uint32_t candidateTag = 0;
+        if (vTags->lookupTag(fullName.substr(dot + 1), sectionIndex, &candidateTag) != OK) {
+            return NAME_NOT_FOUND;
+        }
+        *tag = candidateTag;
+        return OK;
+    }
+    return NAME_NOT_FOUND;
+}
 
-    if (vTags != NULL) {
-        vendorSections = vTags->getAllSectionNames();
-        vendorSectionCount = vendorSections->size();
+CameraMetadataBuilder::CameraMetadataBuilder(size_t entryCapacity, size_t dataCapacity) {
+    mUpdates.reserve(entryCapacity);
+    mData.reserve(dataCapacity);
+}
+
+void CameraMetadataBuilder::add(uint32_t tag, uint8_t type, const void *data,
+        size_t data_count) {
+    const size_t offset = mData.size();
+    const size_t bytes = data_count * camera_metadata_type_size[type];
+    mData.resize(offset + bytes);
+    if (bytes > 0) {
+        memcpy(mData.data() + offset, data, bytes);
     }
+    mUpdates.push_back({tag, type, data_count, offset});
+}
 
-    // First, find the section by the longest string match
-    const char *section = NULL;
-    size_t sectionIndex = 0;
-    size_t sectionLength = 0;
-    size_t totalSectionCount = ANDROID_SECTION_COUNT + vendorSectionCount;
-    for (size_t i = 0; i < totalSectionCount; ++i) {
+void CameraMetadataBuilder::update(uint32_t tag, const uint8_t *data, size_t data_count) {
+    add(tag, TYPE_BYTE, data, data_count);
+}
 
-        const char *str = (i < ANDROID_SECTION_COUNT) ? camera_metadata_section_names[i] :
-                (*vendorSections)[i - ANDROID_SECTION_COUNT].string();
+void CameraMetadataBuilder::update(uint32_t tag, const int32_t *data, size_t data_count) {
+    add(tag, TYPE_INT32, data, data_count);
+}
 
-        ALOGV("%s: Trying to match against section '%s'", __FUNCTION__, str);
+void CameraMetadataBuilder::update(uint32_t tag, const float *data, size_t data_count) {
+    add(tag, TYPE_FLOAT, data, data_count);
+}
 
-        if (strstr(name, str) == name) { // name begins with the section name
-            size_t strLength = strlen(str);
+void CameraMetadataBuilder::update(uint32_t tag, const int64_t *data, size_t data_count) {
+    add(tag, TYPE_INT64, data, data_count);
+}
 
-            ALOGV("%s: Name begins with section name", __FUNCTION__);
+void CameraMetadataBuilder::update(uint32_t tag, const double *data, size_t data_count) {
+    add(tag, TYPE_DOUBLE, data, data_count);
+}
 
-            // section name is the longest we've found so far
-            if (section == NULL || sectionLength < strLength) {
-                section = str;
-                sectionIndex = i;
-                sectionLength = strLength;
+void CameraMetadataBuilder::update(uint32_t tag, const camera_metadata_rational_t *data,
+        size_t data_count) {
+    add(tag, TYPE_RATIONAL, data, data_count);
+}
 
-                ALOGV("%s: Found new best section (%s)", __FUNCTION__, section);
-            }
+void CameraMetadataBuilder::update(uint32_t tag, const String8 &string) {
+    // string.size() doesn't count the null termination character.
+    add(tag, TYPE_BYTE, string.string(), string.size() + 1);
+}
+
+size_t CameraMetadataBuilder::size() const {
+    return mUpdates.size();
+}
+
+void CameraMetadataBuilder::clear() {
+    mUpdates.clear();
+    mData.clear();
+}
+
+void CameraMetadataBuilder::countExtra(CameraMetadata *metadata, size_t *entries,
+        size_t *data) const {
+    *entries = 0;
+    *data = 0;
+    size_t index;
+    for (const Update &update : mUpdates) {
+        if (!metadata->indexOf(update.tag, &index)) {
+            ++*entries;
         }
+        // Room for the whole new value, even where it replaces an old one.
+        *data += calculate_camera_metadata_entry_data_size(update.type, update.count);
     }
+}
 
-    if (section == NULL) {
-        return NAME_NOT_FOUND;
-    } else {
-        ALOGV("%s: Found matched section '%s' (%zu)",
-              __FUNCTION__, section, sectionIndex);
+status_t CameraMetadataBuilder::applyTo(CameraMetadata *metadata) const {
+    if (metadata->mLocked) {
+        ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
+        return INVALID_OPERATION;
     }
-
-    // Get the tag name component of the name
-    const char *nameTagName = name + sectionLength + 1; // x.y.z -> z
-    if (sectionLength + 1 >= nameLength) {
-        return BAD_VALUE;
+    size_t extraEntries, extraData;
+    countExtra(metadata, &extraEntries, &extraData);
+    status_t res = metadata->resizeIfNeeded(extraEntries, extraData);
+    if (res != OK) {
+        return res;
     }
+    for (const Update &update : mUpdates) {
+        res = metadata->checkType(update.tag, update.type);
+        if (res == OK) {
+            res = metadata->updateImpl(update.tag, mData.data() + update.offset, update.count);
+        }
+        if (res != OK) {
+            return res;
+        }
+    }
+    return OK;
+}
 
-    // Match rest of name against the tag names in that section only
-    uint32_t candidateTag = 0;
-    if (sectionIndex < ANDROID_SECTION_COUNT) {
-        // Match built-in tags (typically android.*)
-        uint32_t tagBegin, tagEnd; // [tagBegin, tagEnd)
-        tagBegin = camera_metadata_section_bounds[sectionIndex][0];
-        tagEnd = camera_metadata_section_bounds[sectionIndex][1];
-
-        for (candidateTag = tagBegin; candidateTag < tagEnd; ++candidateTag) {
-            const char *tagName = get_camera_metadata_tag_name(candidateTag);
+status_t CameraMetadataBuilder::build(CameraMetadata *metadata) const {
+    if (metadata->mLocked) {
+        ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
+        return INVALID_OPERATION;
+    }
+    size_t entries = 0, data = 0;
+    // Only the last update of a tag makes it into the buffer.
+    std::unordered_map<uint32_t, const Update *> last;
+    last.reserve(mUpdates.size());
+    for (const Update &update : mUpdates) {
+        last[update.tag] = &update;
+    }
+    for (const auto &tagAndUpdate : last) {
+        const Update &update = *tagAndUpdate.second;
+        entries++;
+        data += calculate_camera_metadata_entry_data_size(update.type, update.count);
+    }
 
-            if (strcmp(nameTagName, tagName) == 0) {
-                ALOGV("%s: Found matched tag '%s' (%d)",
-                      __FUNCTION__, tagName, candidateTag);
-                break;
-            }
+    CameraMetadata built(entries, data);
+    for (const Update &update : mUpdates) {
+        if (last[update.tag] != &update) {
+            continue;
         }
-
-        if (candidateTag == tagEnd) {
-            return NAME_NOT_FOUND;
+        status_t res = built.checkType(update.tag, update.type);
+        if (res == OK) {
+            res = add_camera_metadata_entry(built.mBuffer, update.tag,
+                    mData.data() + update.offset, update.count);
         }
-    } else if (vTags != NULL) {
-        // Match vendor tags (typically com.*)
-        const String8 sectionName(section);
-        const String8 tagName(nameTagName);
-
-        status_t res = OK;
-        if ((res = vTags->lookupTag(tagName, sectionName, &candidateTag)) != OK) {
-            return NAME_NOT_FOUND;
+        if (res != OK) {
+            return res;
         }
     }
-
-    *tag = candidateTag;
+    built.sort();
+    metadata->acquire(built);
     return OK;
 }
 
-
 } // namespace helper
 } // namespace V1_0
 } // namespace common
@@ -35,41 +35,46 @@ using MapperErrorV3 = android::hardware::graphics::mapper::V3_0::Error;
 using MapperErrorV4 = android::hardware::graphics::mapper::V4_0::Error;
 using IMapperV3 = android::hardware::graphics::mapper::V3_0::IMapper;
 using IMapperV4 = android::hardware::graphics::mapper::V4_0::IMapper;
+using android::hardware::graphics::common::V1_0::BufferUsage;
 
-HandleImporter::HandleImporter() : mInitialized(false) {}
+HandleImporter::HandleImporter() {}
 
-void HandleImporter::initializeLocked() {
-    if (mInitialized) {
-        return;
-    }
+HandleImporter::HandleImporter(const sp<IMapperV4>& mapper) {
+    mMapperV4 = mapper;
+    mInitialized = (mapper != nullptr);
+}
 
-    mMapperV4 = IMapperV4::getService();
-    if (mMapperV4 != nullptr) {
-        mInitialized = true;
-        return;
+bool HandleImporter::initialize() {
+    if (mInitialized.load(std::memory_order_acquire)) {
+        return true;
     }
 
-    mMapperV3 = IMapperV3::getService();
-    if (mMapperV3 != nullptr) {
-        mInitialized = true;
-        return;
+    // No mapper found yet: look again, since it may only have been slow to start. The members are
+    // only written once a mapper is found, and never change after mInitialized is set.
+    std::lock_guard<std::mutex> lock(mInitLock);
+    if (mInitialized.load(std::memory_order_relaxed)) {
+        return true;
     }
 
-    mMapperV2 = IMapper::getService();
-    if (mMapperV2 == nullptr) {
+    sp<IMapperV4> mapperV4 = IMapperV4::getService();
+    sp<IMapperV3> mapperV3;
+    sp<IMapper> mapperV2;
+    if (mapperV4 == nullptr) {
+        mapperV3 = IMapperV3::getService();
+    }
+    if (mapperV4 == nullptr && mapperV3 == nullptr) {
+        mapperV2 = IMapper::getService();
+    }
+    if (mapperV4 == nullptr && mapperV3 == nullptr && mapperV2 == nullptr) {
         ALOGE("%s: cannnot acccess graphics mapper HAL!", __FUNCTION__);
-        return;
+        return false;
     }
 
-    mInitialized = true;
-    return;
-}
-
-void HandleImporter::cleanup() {
-    mMapperV4.clear();
-    mMapperV3.clear();
-    mMapperV2.clear();
-    mInitialized = false;
+    mMapperV4 = mapperV4;
+    mMapperV3 = mapperV3;
+    mMapperV2 = mapperV2;
+    mInitialized.store(true, std::memory_order_release);
+    return true;
 }
 
 template<class M, class E>
@@ -230,6 +235,87 @@ int HandleImporter::unlockInternal(const sp<M> mapper, buffer_handle_t& buf) {
     return releaseFence;
 }
 
+int HandleImporter::flushInternal(buffer_handle_t& buf) {
+    int releaseFence = -1;
+    auto buffer = const_cast<native_handle_t*>(buf);
+
+    mMapperV4->flushLockedBuffer(
+        buffer, [&](const auto& tmpError, const auto& tmpReleaseFence) {
+            if (tmpError == MapperErrorV4::NONE) {
+                auto fenceHandle = tmpReleaseFence.getNativeHandle();
+                if (fenceHandle && fenceHandle->numFds == 1) {
+                    releaseFence = dup(fenceHandle->data[0]);
+                }
+            } else {
+                ALOGE("%s: failed to flush error %d!", __FUNCTION__, tmpError);
+            }
+        });
+    return releaseFence;
+}
+
+void HandleImporter::enablePersistentMappings() {
+    if (!initialize()) {
+        return;
+    }
+    if (mMapperV4 == nullptr) {
+        ALOGW("%s: persistent mappings need mapper 4.0", __FUNCTION__);
+        return;
+    }
+    mPersistentMappings = true;
+}
+
+bool HandleImporter::findMapping(buffer_handle_t buf, uint64_t cpuUsage,
+                                 const IMapper::Rect& accessRegion, bool isYCbCr,
+                                 Mapping* mapping) {
+    bool stale = false;
+    {
+        std::lock_guard<std::mutex> lock(mMappingsLock);
+        auto it = mMappings.find(buf);
+        if (it == mMappings.end()) {
+            return false;
+        }
+        const Mapping& found = it->second;
+        if (found.cpuUsage == cpuUsage && found.isYCbCr == isYCbCr &&
+            found.accessRegion.left == accessRegion.left &&
+            found.accessRegion.top == accessRegion.top &&
+            found.accessRegion.width == accessRegion.width &&
+            found.accessRegion.height == accessRegion.height) {
+            *mapping = found;
+        } else {
+            mMappings.erase(it);
+            stale = true;
+        }
+    }
+
+    if (stale) {
+        closeFence(unlockInternal<IMapperV4, MapperErrorV4>(mMapperV4, buf));
+        return false;
+    }
+    // Picks up what other users of the buffer wrote since the last lock.
+    if (cpuUsage & static_cast<uint64_t>(BufferUsage::CPU_READ_MASK)) {
+        auto ret = mMapperV4->rereadLockedBuffer(const_cast<native_handle_t*>(buf));
+        if (!ret.isOk() || ret != MapperErrorV4::NONE) {
+            ALOGE("%s: failed to reread buffer", __FUNCTION__);
+        }
+    }
+    return true;
+}
+
+void HandleImporter::addMapping(buffer_handle_t buf, const Mapping& mapping) {
+    std::lock_guard<std::mutex> lock(mMappingsLock);
+    mMappings[buf] = mapping;
+}
+
+void HandleImporter::removeMapping(buffer_handle_t buf) {
+    {
+        std::lock_guard<std::mutex> lock(mMappingsLock);
+        if (mMappings.erase(buf) == 0) {
+            return;
+        }
+    }
+    closeFence(unlockInternal<IMapperV4, MapperErrorV4>(mMapperV4, buf));
+}
+
 // In IComposer, any buffer_handle_t is owned by the caller and we need to
 // make a clone for hwcomposer2.  We also need to translate empty handle
 // to nullptr.  This function does that, in-place.
@@ -239,9 +325,8 @@ bool HandleImporter::importBuffer(buffer_handle_t& handle) {
         return true;
     }
 
-    Mutex::Autolock lock(mLock);
-    if (!mInitialized) {
-        initializeLocked();
+    if (!initialize()) {
+        return false;
     }
 
     if (mMapperV4 != nullptr) {
@@ -265,9 +350,12 @@ void HandleImporter::freeBuffer(buffer_handle_t handle) {
         return;
     }
 
-    Mutex::Autolock lock(mLock);
-    if (!mInitialized) {
-        initializeLocked();
+    if (!initialize()) {
+        return;
+    }
+
+    if (mPersistentMappings) {
+        removeMapping(handle);
     }
 
     if (mMapperV4 != nullptr) {
@@ -322,10 +410,8 @@ void* HandleImporter::lock(
 
 void* HandleImporter::lock(buffer_handle_t& buf, uint64_t cpuUsage,
                            const IMapper::Rect& accessRegion) {
-    Mutex::Autolock lock(mLock);
-
-    if (!mInitialized) {
-        initializeLocked();
+    if (!initialize()) {
+        return nullptr;
     }
 
     void* ret = nullptr;
@@ -335,6 +421,11 @@ void* HandleImporter::lock(buffer_handle_t& buf, uint64_t cpuUsage,
         return ret;
     }
 
+    Mapping mapping = {};
+    if (mPersistentMappings && findMapping(buf, cpuUsage, accessRegion, false, &mapping)) {
+        return mapping.ptr;
+    }
+
     hidl_handle acquireFenceHandle;
     auto buffer = const_cast<native_handle_t*>(buf);
     if (mMapperV4 != nullptr) {
@@ -377,20 +468,30 @@ void* HandleImporter::lock(buffer_handle_t& buf, uint64_t cpuUsage,
           "accessRegion.height: %d",
           __FUNCTION__, ret, accessRegion.top, accessRegion.left, accessRegion.width,
           accessRegion.height);
+    if (mPersistentMappings && ret != nullptr) {
+        addMapping(buf, {cpuUsage, accessRegion, false, ret, {}});
+    }
     return ret;
 }
 
 YCbCrLayout HandleImporter::lockYCbCr(
         buffer_handle_t& buf, uint64_t cpuUsage,
         const IMapper::Rect& accessRegion) {
-    Mutex::Autolock lock(mLock);
-
-    if (!mInitialized) {
-        initializeLocked();
+    if (!initialize()) {
+        return {};
     }
 
     if (mMapperV4 != nullptr) {
-        return lockYCbCrInternal<IMapperV4, MapperErrorV4>(mMapperV4, buf, cpuUsage, accessRegion);
+        Mapping mapping = {};
+        if (mPersistentMappings && findMapping(buf, cpuUsage, accessRegion, true, &mapping)) {
+            return mapping.layout;
+        }
+        YCbCrLayout layout = lockYCbCrInternal<IMapperV4, MapperErrorV4>(
+                mMapperV4, buf, cpuUsage, accessRegion);
+        if (mPersistentMappings && layout.y != nullptr) {
+            addMapping(buf, {cpuUsage, accessRegion, true, nullptr, layout});
+        }
+        return layout;
     }
 
     if (mMapperV3 != nullptr) {
@@ -412,10 +513,8 @@ status_t HandleImporter::getMonoPlanarStrideBytes(buffer_handle_t &buf, uint32_t
         return BAD_VALUE;
     }
 
-    Mutex::Autolock lock(mLock);
-
-    if (!mInitialized) {
-        initializeLocked();
+    if (!initialize()) {
+        return NO_INIT;
     }
 
     if (mMapperV4 != nullptr) {
@@ -435,6 +534,30 @@ status_t HandleImporter::getMonoPlanarStrideBytes(buffer_handle_t &buf, uint32_t
 }
 
 int HandleImporter::unlock(buffer_handle_t& buf) {
+    if (!initialize()) {
+        return -1;
+    }
+
+    if (mPersistentMappings) {
+        uint64_t cpuUsage = 0;
+        bool persistent = false;
+        {
+            std::lock_guard<std::mutex> lock(mMappingsLock);
+            auto it = mMappings.find(buf);
+            if (it != mMappings.end()) {
+                cpuUsage = it->second.cpuUsage;
+                persistent = true;
+            }
+        }
+        if (persistent) {
+            // The buffer stays mapped; only CPU writes need to reach the other users.
+            if (cpuUsage & static_cast<uint64_t>(BufferUsage::CPU_WRITE_MASK)) {
+                return flushInternal(buf);
+            }
+            return -1;
+        }
+    }
+
     if (mMapperV4 != nullptr) {
         return unlockInternal<IMapperV4, MapperErrorV4>(mMapperV4, buf);
     }
@@ -29,19 +29,149 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+
 namespace android {
 namespace hardware {
 namespace camera2 {
 namespace params {
 
-VendorTagDescriptor::~VendorTagDescriptor() {
-    size_t len = mReverseMapping.size();
-    for (size_t i = 0; i < len; ++i)  {
-        delete mReverseMapping[i];
+namespace {
+
+const std::shared_ptr<const VendorTagTable>& emptyTable() {
+    static const std::shared_ptr<const VendorTagTable> table =
+            std::make_shared<const VendorTagTable>();
+    return table;
+}
+
+} // anonymous namespace
+
+status_t VendorTagTable::createFromOps(const vendor_tag_ops_t* vOps,
+            /*out*/
+            std::shared_ptr<const VendorTagTable>* table) {
+    int tagCount = vOps->get_tag_count(vOps);
+    if (tagCount < 0 || tagCount > INT32_MAX) {
+        ALOGE("%s: tag count %d from vendor ops is invalid.", __FUNCTION__, tagCount);
+        return BAD_VALUE;
     }
+
+    std::shared_ptr<VendorTagTable> t = std::make_shared<VendorTagTable>();
+    t->mTags.resize(tagCount);
+    vOps->get_all_tags(vOps, /*out*/t->mTags.data());
+    std::sort(t->mTags.begin(), t->mTags.end());
+    t->mTags.erase(std::unique(t->mTags.begin(), t->mTags.end()), t->mTags.end());
+    tagCount = t->mTags.size();
+    t->mTagInfo.reserve(tagCount);
+
+    std::vector<String8> tagSections(tagCount);
+    for (size_t i = 0; i < static_cast<size_t>(tagCount); ++i) {
+        uint32_t tag = t->mTags[i];
+        if (tag < CAMERA_METADATA_VENDOR_TAG_BOUNDARY) {
+            ALOGE("%s: vendor tag %d not in vendor tag section.", __FUNCTION__, tag);
+            return BAD_VALUE;
+        }
+        const char *tagName = vOps->get_tag_name(vOps, tag);
+        if (tagName == NULL) {
+            ALOGE("%s: no tag name defined for vendor tag %d.", __FUNCTION__, tag);
+            return BAD_VALUE;
+        }
+        const char *sectionName = vOps->get_section_name(vOps, tag);
+        if (sectionName == NULL) {
+            ALOGE("%s: no section name defined for vendor tag %d.", __FUNCTION__, tag);
+            return BAD_VALUE;
+        }
+        int tagType = vOps->get_tag_type(vOps, tag);
+        if (tagType < 0 || tagType >= NUM_TYPES) {
+            ALOGE("%s: tag type %d from vendor ops does not exist.", __FUNCTION__, tagType);
+            return BAD_VALUE;
+        }
+        // The section index is filled in once all sections are known.
+        t->mTagInfo[tag] = {String8(tagName), 0, tagType};
+        tagSections[i] = String8(sectionName);
+        t->mSections.add(tagSections[i]);
+    }
+
+    // The section and tag names no longer move, so they can back the keys.
+    const size_t sectionCount = t->mSections.size();
+    t->mSectionIndices.reserve(sectionCount);
+    for (size_t i = 0; i < sectionCount; ++i) {
+        const String8& section = t->mSections[i];
+        t->mSectionIndices.emplace(std::string_view(section.string(), section.size()), i);
+    }
+    t->mReverseMapping.resize(sectionCount);
+    for (size_t i = 0; i < static_cast<size_t>(tagCount); ++i) {
+        uint32_t tag = t->mTags[i];
+        ssize_t index = t->mSections.indexOf(tagSections[i]);
+        LOG_ALWAYS_FATAL_IF(index < 0, "index %zd must be non-negative", index);
+        TagInfo& info = t->mTagInfo[tag];
+        info.sectionIndex = static_cast<uint32_t>(index);
+        t->mReverseMapping[index].emplace(
+                std::string_view(info.name.string(), info.name.size()), tag);
+    }
+
+    *table = std::move(t);
+    return OK;
+}
+
+const VendorTagTable::TagInfo* VendorTagTable::find(uint32_t tag) const {
+    auto iter = mTagInfo.find(tag);
+    return iter != mTagInfo.end() ? &iter->second : nullptr;
+}
+
+const char* VendorTagTable::getSectionName(uint32_t tag) const {
+    const TagInfo* info = find(tag);
+    if (info == nullptr) {
+        return VENDOR_SECTION_NAME_ERR;
+    }
+    return mSections[info->sectionIndex].string();
+}
+
+ssize_t VendorTagTable::getSectionIndex(uint32_t tag) const {
+    const TagInfo* info = find(tag);
+    return info != nullptr ? static_cast<ssize_t>(info->sectionIndex) : -1;
+}
+
+const char* VendorTagTable::getTagName(uint32_t tag) const {
+    const TagInfo* info = find(tag);
+    if (info == nullptr) {
+        return VENDOR_TAG_NAME_ERR;
+    }
+    return info->name.string();
+}
+
+int VendorTagTable::getTagType(uint32_t tag) const {
+    const TagInfo* info = find(tag);
+    if (info == nullptr) {
+        return VENDOR_TAG_TYPE_ERR;
+    }
+    return info->type;
+}
+
+ssize_t VendorTagTable::findSectionIndex(std::string_view section) const {
+    auto iter = mSectionIndices.find(section);
+    return iter != mSectionIndices.end() ? static_cast<ssize_t>(iter->second) : -1;
+}
+
+status_t VendorTagTable::lookupTag(std::string_view name, size_t sectionIndex,
+        /*out*/uint32_t* tag) const {
+    if (sectionIndex >= mReverseMapping.size()) {
+        return NAME_NOT_FOUND;
+    }
+    auto iter = mReverseMapping[sectionIndex].find(name);
+    if (iter == mReverseMapping[sectionIndex].end()) {
+        return NAME_NOT_FOUND;
+    }
+    if (tag != NULL) {
+        *tag = iter->second;
+    }
+    return OK;
+}
+
+VendorTagDescriptor::~VendorTagDescriptor() {
 }
 
 VendorTagDescriptor::VendorTagDescriptor() :
+        mTable(emptyTable()),
         mTagCount(0),
         mVendorOps() {
 }
@@ -58,30 +188,14 @@ VendorTagDescriptor& VendorTagDescriptor::operator=(const VendorTagDescriptor& r
 void VendorTagDescriptor::copyFrom(const VendorTagDescriptor& src) {
     if (this == &src) return;
 
-    size_t len = mReverseMapping.size();
-    for (size_t i = 0; i < len; ++i) {
-        delete mReverseMapping[i];
-    }
-    mReverseMapping.clear();
-
-    len = src.mReverseMapping.size();
-    // Have to copy KeyedVectors inside mReverseMapping
-    for (size_t i = 0; i < len; ++i) {
-        KeyedVector<String8, uint32_t>* nameMapper = new KeyedVector<String8, uint32_t>();
-        *nameMapper = *(src.mReverseMapping.valueAt(i));
-        mReverseMapping.add(src.mReverseMapping.keyAt(i), nameMapper);
-    }
-    // Everything else is simple
-    mTagToNameMap = src.mTagToNameMap;
-    mTagToSectionMap = src.mTagToSectionMap;
-    mTagToTypeMap = src.mTagToTypeMap;
-    mSections = src.mSections;
+    // The table is immutable, so it is shared rather than copied.
+    mTable = src.mTable;
     mTagCount = src.mTagCount;
     mVendorOps = src.mVendorOps;
 }
 
 int VendorTagDescriptor::getTagCount() const {
-    size_t size = mTagToNameMap.size();
+    size_t size = mTable->getTags().size();
     if (size == 0) {
         return VENDOR_TAG_COUNT_ERR;
     }
@@ -89,66 +203,57 @@ int VendorTagDescriptor::getTagCount() const {
 }
 
 void VendorTagDescriptor::getTagArray(uint32_t* tagArray) const {
-    size_t size = mTagToNameMap.size();
-    for (size_t i = 0; i < size; ++i) {
-        tagArray[i] = mTagToNameMap.keyAt(i);
-    }
+    const std::vector<uint32_t>& tags = mTable->getTags();
+    std::copy(tags.begin(), tags.end(), tagArray);
 }
 
 const char* VendorTagDescriptor::getSectionName(uint32_t tag) const {
-    ssize_t index = mTagToSectionMap.indexOfKey(tag);
-    if (index < 0) {
-        return VENDOR_SECTION_NAME_ERR;
-    }
-    return mSections[mTagToSectionMap.valueAt(index)].string();
+    return mTable->getSectionName(tag);
 }
 
 ssize_t VendorTagDescriptor::getSectionIndex(uint32_t tag) const {
-    return mTagToSectionMap.valueFor(tag);
+    return mTable->getSectionIndex(tag);
 }
 
 const char* VendorTagDescriptor::getTagName(uint32_t tag) const {
-    ssize_t index = mTagToNameMap.indexOfKey(tag);
-    if (index < 0) {
-        return VENDOR_TAG_NAME_ERR;
-    }
-    return mTagToNameMap.valueAt(index).string();
+    return mTable->getTagName(tag);
 }
 
 int VendorTagDescriptor::getTagType(uint32_t tag) const {
-    auto iter = mTagToTypeMap.find(tag);
-    if (iter == mTagToTypeMap.end()) {
-        return VENDOR_TAG_TYPE_ERR;
-    }
-    return iter->second;
+    return mTable->getTagType(tag);
 }
 
 const SortedVector<String8>* VendorTagDescriptor::getAllSectionNames() const {
-    return &mSections;
+    return &mTable->getSections();
 }
 
 status_t VendorTagDescriptor::lookupTag(const String8& name, const String8& section, /*out*/uint32_t* tag) const {
-    ssize_t index = mReverseMapping.indexOfKey(section);
+    ssize_t index = findSectionIndex(std::string_view(section.string(), section.size()));
     if (index < 0) {
         ALOGE("%s: Section '%s' does not exist.", __FUNCTION__, section.string());
         return BAD_VALUE;
     }
 
-    ssize_t nameIndex = mReverseMapping[index]->indexOfKey(name);
-    if (nameIndex < 0) {
+    if (lookupTag(std::string_view(name.string(), name.size()), index, tag) != OK) {
         ALOGE("%s: Tag name '%s' does not exist.", __FUNCTION__, name.string());
         return BAD_VALUE;
     }
-
-    if (tag != NULL) {
-        *tag = mReverseMapping[index]->valueAt(nameIndex);
-    }
     return OK;
 }
 
+ssize_t VendorTagDescriptor::findSectionIndex(std::string_view section) const {
+    return mTable->findSectionIndex(section);
+}
+
+status_t VendorTagDescriptor::lookupTag(std::string_view name, size_t sectionIndex,
+        /*out*/uint32_t* tag) const {
+    return mTable->lookupTag(name, sectionIndex, tag);
+}
+
 void VendorTagDescriptor::dump(int fd, int verbosity, int indentation) const {
 
-    size_t size = mTagToNameMap.size();
+    const std::vector<uint32_t>& tags = mTable->getTags();
+    size_t size = tags.size();
     if (size == 0) {
         dprintf(fd, "%*sDumping configured vendor tag descriptors: None set\n",
                 indentation, "");
@@ -158,104 +263,90 @@ void VendorTagDescriptor::dump(int fd, int verbosity, int indentation) const {
     dprintf(fd, "%*sDumping configured vendor tag descriptors: %zu entries\n",
             indentation, "", size);
     for (size_t i = 0; i < size; ++i) {
-        uint32_t tag =  mTagToNameMap.keyAt(i);
+        uint32_t tag = tags[i];
 
         if (verbosity < 1) {
             dprintf(fd, "%*s0x%x\n", indentation + 2, "", tag);
             continue;
         }
-        String8 name = mTagToNameMap.valueAt(i);
-        uint32_t sectionId = mTagToSectionMap.valueFor(tag);
-        String8 sectionName = mSections[sectionId];
-        int type = mTagToTypeMap.at(tag);
+        const char* name = mTable->getTagName(tag);
+        const char* sectionName = mTable->getSectionName(tag);
+        int type = mTable->getTagType(tag);
         const char* typeName = (type >= 0 && type < NUM_TYPES) ?
                 camera_metadata_type_names[type] : "UNKNOWN";
         dprintf(fd, "%*s0x%x (%s) with type %d (%s) defined in section %s\n", indentation + 2,
-            "", tag, name.string(), type, typeName, sectionName.string());
+            "", tag, name, type, typeName, sectionName);
     }
 
 }
 
-int VendorTagDescriptorCache::getTagCount(metadata_vendor_id_t id) const {
-    int ret = 0;
-    auto desc = mVendorMap.find(id);
-    if (desc != mVendorMap.end()) {
-        ret = desc->second->getTagCount();
-    } else {
+const VendorTagDescriptorCache::VendorTagDescriptor* VendorTagDescriptorCache::find(
+        metadata_vendor_id_t id) const {
+    // Descriptors are never removed, so the pointer outlives the snapshot.
+    std::shared_ptr<const VendorMap> vendorMap = std::atomic_load(&mVendorMap);
+    auto desc = vendorMap->find(id);
+    if (desc == vendorMap->end()) {
         ALOGE("%s: Vendor descriptor id is missing!", __func__);
+        return nullptr;
     }
+    return desc->second.get();
+}
 
-    return ret;
+int VendorTagDescriptorCache::getTagCount(metadata_vendor_id_t id) const {
+    const VendorTagDescriptor* desc = find(id);
+    return desc != nullptr ? desc->getTagCount() : 0;
 }
 
 void VendorTagDescriptorCache::getTagArray(uint32_t* tagArray, metadata_vendor_id_t id) const {
-    auto desc = mVendorMap.find(id);
-    if (desc != mVendorMap.end()) {
-        desc->second->getTagArray(tagArray);
-    } else {
-        ALOGE("%s: Vendor descriptor id is missing!", __func__);
+    const VendorTagDescriptor* desc = find(id);
+    if (desc != nullptr) {
+        desc->getTagArray(tagArray);
     }
 }
 
 const char* VendorTagDescriptorCache::getSectionName(uint32_t tag, metadata_vendor_id_t id) const {
-    const char* ret = nullptr;
-    auto desc = mVendorMap.find(id);
-    if (desc != mVendorMap.end()) {
-        ret = desc->second->getSectionName(tag);
-    } else {
-        ALOGE("%s: Vendor descriptor id is missing!", __func__);
-    }
-
-    return ret;
+    const VendorTagDescriptor* desc = find(id);
+    return desc != nullptr ? desc->getSectionName(tag) : nullptr;
 }
 
 const char* VendorTagDescriptorCache::getTagName(uint32_t tag, metadata_vendor_id_t id) const {
-    const char* ret = nullptr;
-    auto desc = mVendorMap.find(id);
-    if (desc != mVendorMap.end()) {
-        ret = desc->second->getTagName(tag);
-    } else {
-        ALOGE("%s: Vendor descriptor id is missing!", __func__);
-    }
-
-    return ret;
+    const VendorTagDescriptor* desc = find(id);
+    return desc != nullptr ? desc->getTagName(tag) : nullptr;
 }
 
 int VendorTagDescriptorCache::getTagType(uint32_t tag, metadata_vendor_id_t id) const {
-    int ret = 0;
-    auto desc = mVendorMap.find(id);
-    if (desc != mVendorMap.end()) {
-        ret = desc->second->getTagType(tag);
-    } else {
-        ALOGE("%s: Vendor descriptor id is missing!", __func__);
-    }
-
-    return ret;
+    const VendorTagDescriptor* desc = find(id);
+    return desc != nullptr ? desc->getTagType(tag) : 0;
 }
 
 void VendorTagDescriptorCache::dump(int fd, int verbosity, int indentation) const {
-    for (const auto& desc : mVendorMap) {
+    for (const auto& desc : *std::atomic_load(&mVendorMap)) {
         desc.second->dump(fd, verbosity, indentation);
     }
 }
 
 int32_t VendorTagDescriptorCache::addVendorDescriptor(
     metadata_vendor_id_t id, sp<hardware::camera::common::V1_0::helper::VendorTagDescriptor> desc) {
-    auto entry = mVendorMap.find(id);
-    if (entry != mVendorMap.end()) {
+    std::lock_guard<std::mutex> lock(mWriteLock);
+    std::shared_ptr<const VendorMap> vendorMap = std::atomic_load(&mVendorMap);
+    auto entry = vendorMap->find(id);
+    if (entry != vendorMap->end()) {
         ALOGE("%s: Vendor descriptor with same id already present!", __func__);
         return BAD_VALUE;
     }
 
-    mVendorMap.emplace(id, desc);
+    std::shared_ptr<VendorMap> newVendorMap = std::make_shared<VendorMap>(*vendorMap);
+    newVendorMap->emplace(id, desc);
+    std::atomic_store(&mVendorMap, std::shared_ptr<const VendorMap>(std::move(newVendorMap)));
     return NO_ERROR;
 }
 
 int32_t VendorTagDescriptorCache::getVendorTagDescriptor(
     metadata_vendor_id_t id,
     sp<hardware::camera::common::V1_0::helper::VendorTagDescriptor>* desc /*out*/) {
-    auto entry = mVendorMap.find(id);
-    if (entry == mVendorMap.end()) {
+    std::shared_ptr<const VendorMap> vendorMap = std::atomic_load(&mVendorMap);
+    auto entry = vendorMap->find(id);
+    if (entry == vendorMap->end()) {
         return NAME_NOT_FOUND;
     }
 
@@ -287,9 +378,16 @@ static const char* vendor_tag_descriptor_cache_get_tag_name(uint32_t tag, metada
 static int vendor_tag_descriptor_cache_get_tag_type(uint32_t tag, metadata_vendor_id_t id);
 } /* extern "C" */
 
+using camera2::params::VendorTagTable;
+
 static Mutex sLock;
 static sp<VendorTagDescriptor> sGlobalVendorTagDescriptor;
 static sp<VendorTagDescriptorCache> sGlobalVendorTagDescriptorCache;
+// What the vendor tag callbacks read, without taking sLock. They are published
+// with std::atomic_store() under sLock whenever the globals above change; the
+// cache reference holds a strong reference to sGlobalVendorTagDescriptorCache.
+static std::shared_ptr<const VendorTagTable> sGlobalVendorTagTable;
+static std::shared_ptr<const VendorTagDescriptorCache> sGlobalVendorTagCacheRef;
 
 status_t VendorTagDescriptor::createDescriptorFromOps(const vendor_tag_ops_t* vOps,
             /*out*/
@@ -299,74 +397,15 @@ status_t VendorTagDescriptor::createDescriptorFromOps(const vendor_tag_ops_t* vO
         return BAD_VALUE;
     }
 
-    int tagCount = vOps->get_tag_count(vOps);
-    if (tagCount < 0 || tagCount > INT32_MAX) {
-        ALOGE("%s: tag count %d from vendor ops is invalid.", __FUNCTION__, tagCount);
-        return BAD_VALUE;
+    std::shared_ptr<const camera2::params::VendorTagTable> table;
+    status_t res = camera2::params::VendorTagTable::createFromOps(vOps, &table);
+    if (res != OK) {
+        return res;
     }
 
-    Vector<uint32_t> tagArray;
-    LOG_ALWAYS_FATAL_IF(tagArray.resize(tagCount) != tagCount,
-            "%s: too many (%u) vendor tags defined.", __FUNCTION__, tagCount);
-
-    vOps->get_all_tags(vOps, /*out*/tagArray.editArray());
-
     sp<VendorTagDescriptor> desc = new VendorTagDescriptor();
-    desc->mTagCount = tagCount;
-
-    SortedVector<String8> sections;
-    KeyedVector<uint32_t, String8> tagToSectionMap;
-
-    for (size_t i = 0; i < static_cast<size_t>(tagCount); ++i) {
-        uint32_t tag = tagArray[i];
-        if (tag < CAMERA_METADATA_VENDOR_TAG_BOUNDARY) {
-            ALOGE("%s: vendor tag %d not in vendor tag section.", __FUNCTION__, tag);
-            return BAD_VALUE;
-        }
-        const char *tagName = vOps->get_tag_name(vOps, tag);
-        if (tagName == NULL) {
-            ALOGE("%s: no tag name defined for vendor tag %d.", __FUNCTION__, tag);
-            return BAD_VALUE;
-        }
-        desc->mTagToNameMap.add(tag, String8(tagName));
-        const char *sectionName = vOps->get_section_name(vOps, tag);
-        if (sectionName == NULL) {
-            ALOGE("%s: no section name defined for vendor tag %d.", __FUNCTION__, tag);
-            return BAD_VALUE;
-        }
-
-        String8 sectionString(sectionName);
-
-        sections.add(sectionString);
-        tagToSectionMap.add(tag, sectionString);
-
-        int tagType = vOps->get_tag_type(vOps, tag);
-        if (tagType < 0 || tagType >= NUM_TYPES) {
-            ALOGE("%s: tag type %d from vendor ops does not exist.", __FUNCTION__, tagType);
-            return BAD_VALUE;
-        }
-        desc->mTagToTypeMap.insert(std::make_pair(tag, tagType));
-    }
-
-    desc->mSections = sections;
-
-    for (size_t i = 0; i < static_cast<size_t>(tagCount); ++i) {
-        uint32_t tag = tagArray[i];
-        const String8& sectionString = tagToSectionMap.valueFor(tag);
-
-        // Set up tag to section index map
-        ssize_t index = sections.indexOf(sectionString);
-        LOG_ALWAYS_FATAL_IF(index < 0, "index %zd must be non-negative", index);
-        desc->mTagToSectionMap.add(tag, static_cast<uint32_t>(index));
-
-        // Set up reverse mapping
-        ssize_t reverseIndex = -1;
-        if ((reverseIndex = desc->mReverseMapping.indexOfKey(sectionString)) < 0) {
-            KeyedVector<String8, uint32_t>* nameMapper = new KeyedVector<String8, uint32_t>();
-            reverseIndex = desc->mReverseMapping.add(sectionString, nameMapper);
-        }
-        desc->mReverseMapping[reverseIndex]->add(desc->mTagToNameMap.valueFor(tag), tag);
-    }
+    desc->mTagCount = table->getTags().size();
+    desc->mTable = std::move(table);
 
     descriptor = desc;
     return OK;
@@ -376,6 +415,8 @@ status_t VendorTagDescriptor::setAsGlobalVendorTagDescriptor(const sp<VendorTagD
     status_t res = OK;
     Mutex::Autolock al(sLock);
     sGlobalVendorTagDescriptor = desc;
+    std::atomic_store(&sGlobalVendorTagTable,
+            desc != NULL ? desc->mTable : std::shared_ptr<const VendorTagTable>());
 
     vendor_tag_ops_t* opsPtr = NULL;
     if (desc != NULL) {
@@ -397,6 +438,7 @@ void VendorTagDescriptor::clearGlobalVendorTagDescriptor() {
     Mutex::Autolock al(sLock);
     set_camera_metadata_vendor_ops(NULL);
     sGlobalVendorTagDescriptor.clear();
+    std::atomic_store(&sGlobalVendorTagTable, std::shared_ptr<const VendorTagTable>());
 }
 
 sp<VendorTagDescriptor> VendorTagDescriptor::getGlobalVendorTagDescriptor() {
@@ -409,6 +451,11 @@ status_t VendorTagDescriptorCache::setAsGlobalVendorTagCache(
     status_t res = OK;
     Mutex::Autolock al(sLock);
     sGlobalVendorTagDescriptorCache = cache;
+    std::shared_ptr<const VendorTagDescriptorCache> cacheRef;
+    if (cache != NULL) {
+        cacheRef.reset(cache.get(), [cache](const VendorTagDescriptorCache*) {});
+    }
+    std::atomic_store(&sGlobalVendorTagCacheRef, std::move(cacheRef));
 
     struct vendor_tag_cache_ops* opsPtr = NULL;
     if (cache != NULL) {
@@ -430,6 +477,8 @@ void VendorTagDescriptorCache::clearGlobalVendorTagCache() {
     Mutex::Autolock al(sLock);
     set_camera_metadata_vendor_cache_ops(NULL);
     sGlobalVendorTagDescriptorCache.clear();
+    std::atomic_store(&sGlobalVendorTagCacheRef,
+            std::shared_ptr<const VendorTagDescriptorCache>());
 }
 
 sp<VendorTagDescriptorCache> VendorTagDescriptorCache::getGlobalVendorTagCache() {
@@ -440,92 +489,101 @@ sp<VendorTagDescriptorCache> VendorTagDescriptorCache::getGlobalVendorTagCache()
 extern "C" {
 
 int vendor_tag_descriptor_get_tag_count(const vendor_tag_ops_t* /*v*/) {
-    Mutex::Autolock al(sLock);
-    if (sGlobalVendorTagDescriptor == NULL) {
+    std::shared_ptr<const VendorTagTable> table = std::atomic_load(&sGlobalVendorTagTable);
+    if (table == nullptr) {
         ALOGE("%s: Vendor tag descriptor not initialized.", __FUNCTION__);
         return VENDOR_TAG_COUNT_ERR;
     }
-    return sGlobalVendorTagDescriptor->getTagCount();
+    if (table->getTags().empty()) {
+        return VENDOR_TAG_COUNT_ERR;
+    }
+    return table->getTags().size();
 }
 
 void vendor_tag_descriptor_get_all_tags(const vendor_tag_ops_t* /*v*/, uint32_t* tagArray) {
-    Mutex::Autolock al(sLock);
-    if (sGlobalVendorTagDescriptor == NULL) {
+    std::shared_ptr<const VendorTagTable> table = std::atomic_load(&sGlobalVendorTagTable);
+    if (table == nullptr) {
         ALOGE("%s: Vendor tag descriptor not initialized.", __FUNCTION__);
         return;
     }
-    sGlobalVendorTagDescriptor->getTagArray(tagArray);
+    std::copy(table->getTags().begin(), table->getTags().end(), tagArray);
 }
 
 const char* vendor_tag_descriptor_get_section_name(const vendor_tag_ops_t* /*v*/, uint32_t tag) {
-    Mutex::Autolock al(sLock);
-    if (sGlobalVendorTagDescriptor == NULL) {
+    std::shared_ptr<const VendorTagTable> table = std::atomic_load(&sGlobalVendorTagTable);
+    if (table == nullptr) {
         ALOGE("%s: Vendor tag descriptor not initialized.", __FUNCTION__);
         return VENDOR_SECTION_NAME_ERR;
     }
-    return sGlobalVendorTagDescriptor->getSectionName(tag);
+    return table->getSectionName(tag);
 }
 
 const char* vendor_tag_descriptor_get_tag_name(const vendor_tag_ops_t* /*v*/, uint32_t tag) {
-    Mutex::Autolock al(sLock);
-    if (sGlobalVendorTagDescriptor == NULL) {
+    std::shared_ptr<const VendorTagTable> table = std::atomic_load(&sGlobalVendorTagTable);
+    if (table == nullptr) {
         ALOGE("%s: Vendor tag descriptor not initialized.", __FUNCTION__);
         return VENDOR_TAG_NAME_ERR;
     }
-    return sGlobalVendorTagDescriptor->getTagName(tag);
+    return table->getTagName(tag);
 }
 
 int vendor_tag_descriptor_get_tag_type(const vendor_tag_ops_t* /*v*/, uint32_t tag) {
-    Mutex::Autolock al(sLock);
-    if (sGlobalVendorTagDescriptor == NULL) {
+    std::shared_ptr<const VendorTagTable> table = std::atomic_load(&sGlobalVendorTagTable);
+    if (table == nullptr) {
         ALOGE("%s: Vendor tag descriptor not initialized.", __FUNCTION__);
         return VENDOR_TAG_TYPE_ERR;
     }
-    return sGlobalVendorTagDescriptor->getTagType(tag);
+    return table->getTagType(tag);
 }
 
 int vendor_tag_descriptor_cache_get_tag_count(metadata_vendor_id_t id) {
-    Mutex::Autolock al(sLock);
-    if (sGlobalVendorTagDescriptorCache == NULL) {
+    std::shared_ptr<const VendorTagDescriptorCache> cache =
+            std::atomic_load(&sGlobalVendorTagCacheRef);
+    if (cache == nullptr) {
         ALOGE("%s: Vendor tag descriptor cache not initialized.", __FUNCTION__);
         return VENDOR_TAG_COUNT_ERR;
     }
-    return sGlobalVendorTagDescriptorCache->getTagCount(id);
+    return cache->getTagCount(id);
 }
 
 void vendor_tag_descriptor_cache_get_all_tags(uint32_t* tagArray, metadata_vendor_id_t id) {
-    Mutex::Autolock al(sLock);
-    if (sGlobalVendorTagDescriptorCache == NULL) {
+    std::shared_ptr<const VendorTagDescriptorCache> cache =
+            std::atomic_load(&sGlobalVendorTagCacheRef);
+    if (cache == nullptr) {
         ALOGE("%s: Vendor tag descriptor cache not initialized.", __FUNCTION__);
+        return;
     }
-    sGlobalVendorTagDescriptorCache->getTagArray(tagArray, id);
+    cache->getTagArray(tagArray, id);
 }
 
 const char* vendor_tag_descriptor_cache_get_section_name(uint32_t tag, metadata_vendor_id_t id) {
-    Mutex::Autolock al(sLock);
-    if (sGlobalVendorTagDescriptorCache == NULL) {
+    std::shared_ptr<const VendorTagDescriptorCache> cache =
+            std::atomic_load(&sGlobalVendorTagCacheRef);
+    if (cache == nullptr) {
         ALOGE("%s: Vendor tag descriptor cache not initialized.", __FUNCTION__);
         return VENDOR_SECTION_NAME_ERR;
     }
-    return sGlobalVendorTagDescriptorCache->getSectionName(tag, id);
+    return cache->getSectionName(tag, id);
 }
 
 const char* vendor_tag_descriptor_cache_get_tag_name(uint32_t tag, metadata_vendor_id_t id) {
-    Mutex::Autolock al(sLock);
-    if (sGlobalVendorTagDescriptorCache == NULL) {
+    std::shared_ptr<const VendorTagDescriptorCache> cache =
+            std::atomic_load(&sGlobalVendorTagCacheRef);
+    if (cache == nullptr) {
         ALOGE("%s: Vendor tag descriptor cache not initialized.", __FUNCTION__);
         return VENDOR_TAG_NAME_ERR;
     }
-    return sGlobalVendorTagDescriptorCache->getTagName(tag, id);
+    return cache->getTagName(tag, id);
 }
 
 int vendor_tag_descriptor_cache_get_tag_type(uint32_t tag, metadata_vendor_id_t id) {
-    Mutex::Autolock al(sLock);
-    if (sGlobalVendorTagDescriptorCache == NULL) {
+    std::shared_ptr<const VendorTagDescriptorCache> cache =
+            std::atomic_load(&sGlobalVendorTagCacheRef);
+    if (cache == nullptr) {
         ALOGE("%s: Vendor tag descriptor cache not initialized.", __FUNCTION__);
-        return VENDOR_TAG_NAME_ERR;
+        return VENDOR_TAG_TYPE_ERR;
     }
-    return sGlobalVendorTagDescriptorCache->getTagType(tag, id);
+    return cache->getTagType(tag, id);
 }
 
 } /* extern "C" */
@@ -22,6 +22,9 @@
 #include <utils/String8.h>
 #include <utils/Vector.h>
 
+#include <unordered_map>
+#include <vector>
+
 namespace android {
 namespace hardware {
 namespace camera {
@@ -30,6 +33,7 @@ namespace V1_0 {
 namespace helper {
 
 class VendorTagDescriptor;
+class CameraMetadataBuilder;
 
 /**
  * A convenience wrapper around the C-based camera_metadata_t library.
@@ -194,15 +198,33 @@ class CameraMetadata {
      * Find tag id for a given tag name, also checking vendor tags if available.
      * On success, returns OK and writes the tag id into tag.
      *
-     * This is a slow method.
+     * Built-in names are resolved through a hash table built on first use;
+     * vendor names through the vendor section and tag maps.
      */
     static status_t getTagFromName(const char *name,
             const VendorTagDescriptor* vTags, uint32_t *tag);
 
   private:
+    friend class CameraMetadataBuilder;
+
     camera_metadata_t *mBuffer;
     mutable bool       mLocked;
 
+    /**
+     * Entry index of every tag in mBuffer, so that lookups do not scan the
+     * buffer. Built by the first non-const lookup and kept up to date by
+     * update(); any other change to the layout of mBuffer drops it. Const
+     * lookups only use it when it is already built.
+     */
+    std::unordered_map<uint32_t, size_t> mIndex;
+    bool mIndexValid = false;
+
+    void invalidateIndex();
+    /**
+     * Looks up the entry index of tag, building the index first if needed
+     */
+    bool indexOf(uint32_t tag, size_t *index);
+
     /**
      * Check if tag has a given type
      */
@@ -220,6 +242,65 @@ class CameraMetadata {
 
 };
 
+/**
+ * Collects metadata updates and writes them out together, so that the target
+ * buffer is sized once for all of them instead of growing entry by entry.
+ * Updates to the same tag replace each other. Tag types are checked when the
+ * updates are applied.
+ */
+class CameraMetadataBuilder {
+  public:
+    CameraMetadataBuilder(size_t entryCapacity = 0, size_t dataCapacity = 0);
+
+    void update(uint32_t tag, const uint8_t *data, size_t data_count);
+    void update(uint32_t tag, const int32_t *data, size_t data_count);
+    void update(uint32_t tag, const float *data, size_t data_count);
+    void update(uint32_t tag, const int64_t *data, size_t data_count);
+    void update(uint32_t tag, const double *data, size_t data_count);
+    void update(uint32_t tag, const camera_metadata_rational_t *data, size_t data_count);
+    void update(uint32_t tag, const String8 &string);
+
+    template<typename T>
+    void update(uint32_t tag, const T &value) {
+        update(tag, &value, 1);
+    }
+
+    /**
+     * Number of updates collected, including ones to the same tag
+     */
+    size_t size() const;
+
+    /**
+     * Drop all collected updates, keeping the storage for reuse
+     */
+    void clear();
+
+    /**
+     * Apply all updates to metadata, reallocating its buffer at most once
+     */
+    status_t applyTo(CameraMetadata *metadata) const;
+
+    /**
+     * Create a sorted metadata buffer holding exactly the collected entries
+     */
+    status_t build(CameraMetadata *metadata) const;
+
+  private:
+    struct Update {
+        uint32_t tag;
+        uint8_t type;
+        size_t count;
+        size_t offset;
+    };
+
+    void add(uint32_t tag, uint8_t type, const void *data, size_t data_count);
+    // Entries and data bytes needed on top of what metadata already holds.
+    void countExtra(CameraMetadata *metadata, size_t *entries, size_t *data) const;
+
+    std::vector<Update> mUpdates;
+    std::vector<uint8_t> mData;
+};
+
 } // namespace helper
 } // namespace V1_0
 } // namespace common
@@ -23,6 +23,10 @@
 #include <cutils/native_handle.h>
 #include <utils/Mutex.h>
 
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
 using android::hardware::graphics::mapper::V2_0::IMapper;
 using android::hardware::graphics::mapper::V2_0::YCbCrLayout;
 
@@ -38,6 +42,9 @@ class HandleImporter {
 public:
     HandleImporter();
 
+    // Uses mapper instead of looking up the mapper services, e.g. to run against a fake mapper.
+    explicit HandleImporter(const sp<graphics::mapper::V4_0::IMapper>& mapper);
+
     // In IComposer, any buffer_handle_t is owned by the caller and we need to
     // make a clone for hwcomposer2.  We also need to translate empty handle
     // to nullptr.  This function does that, in-place.
@@ -61,9 +68,32 @@ public:
 
     int unlock(buffer_handle_t& buf); // returns release fence
 
+    // Opts in to persistent CPU mappings (mapper 4.0 only). A buffer then stays mapped from its
+    // first lock until freeBuffer(). Locking it again with the same usage and region re-reads
+    // it in place, and unlock() flushes CPU writes instead of unmapping it. This cannot be
+    // turned off again.
+    void enablePersistentMappings();
+
 private:
-    void initializeLocked();
-    void cleanup();
+    struct Mapping {
+        uint64_t cpuUsage;
+        IMapper::Rect accessRegion;
+        bool isYCbCr;
+        void* ptr;
+        YCbCrLayout layout;
+    };
+
+    // Picks the newest mapper available. Returns false, and leaves the mapper members unset, if
+    // none is up yet.
+    bool initialize();
+
+    // Looks up a persistent mapping of buf made for the same kind of lock, usage and region, and
+    // re-reads it if found. A mapping made for anything else is unlocked and forgotten.
+    bool findMapping(buffer_handle_t buf, uint64_t cpuUsage, const IMapper::Rect& accessRegion,
+                     bool isYCbCr, Mapping* mapping);
+    void addMapping(buffer_handle_t buf, const Mapping& mapping);
+    // Unlocks buf for good if it has a persistent mapping.
+    void removeMapping(buffer_handle_t buf);
 
     template<class M, class E>
     bool importBufferInternal(const sp<M> mapper, buffer_handle_t& handle);
@@ -72,12 +102,19 @@ private:
             const IMapper::Rect& accessRegion);
     template<class M, class E>
     int unlockInternal(const sp<M> mapper, buffer_handle_t& buf);
+    int flushInternal(buffer_handle_t& buf);
 
-    Mutex mLock;
-    bool mInitialized;
+    // The mapper is picked under mInitLock until one is found; after that, calls only go through
+    // mMappingsLock, and only while looking up persistent mappings.
+    std::mutex mInitLock;
+    std::atomic<bool> mInitialized{false};
     sp<IMapper> mMapperV2;
     sp<graphics::mapper::V3_0::IMapper> mMapperV3;
     sp<graphics::mapper::V4_0::IMapper> mMapperV4;
+
+    std::atomic<bool> mPersistentMappings{false};
+    std::mutex mMappingsLock;
+    std::unordered_map<buffer_handle_t, Mapping> mMappings;
 };
 
 } // namespace helper
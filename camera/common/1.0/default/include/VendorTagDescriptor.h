@@ -24,13 +24,85 @@
 #include <system/camera_vendor_tags.h>
 
 #include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 namespace android {
 namespace hardware {
 namespace camera2 {
 namespace params {
 
+/**
+ * VendorTagTable objects hold the vendor tag definitions enumerated from a
+ * vendor_tag_ops_t, hashed by tag id and by name. A table is never modified
+ * once built, so it can be shared by copies of a descriptor and read without
+ * locking.
+ */
+class VendorTagTable {
+    public:
+        // An empty table.
+        VendorTagTable() = default;
+
+        /**
+         * Build a table from the given vendor_tag_ops_t struct.
+         *
+         * Returns OK on success, or a negative error code.
+         */
+        static status_t createFromOps(const vendor_tag_ops_t* vOps,
+                /*out*/
+                std::shared_ptr<const VendorTagTable>* table);
+
+        // Returns the ids of all vendor tags defined, in ascending order.
+        const std::vector<uint32_t>& getTags() const { return mTags; }
+
+        // Returns the section name for a given vendor tag id, or
+        // VENDOR_SECTION_NAME_ERR.
+        const char* getSectionName(uint32_t tag) const;
+
+        // Returns the index in getSections() for a given vendor tag id, or -1.
+        ssize_t getSectionIndex(uint32_t tag) const;
+
+        // Returns the tag name for a given vendor tag id, or VENDOR_TAG_NAME_ERR.
+        const char* getTagName(uint32_t tag) const;
+
+        // Returns the tag type for a given vendor tag id, or VENDOR_TAG_TYPE_ERR.
+        int getTagType(uint32_t tag) const;
+
+        const SortedVector<String8>& getSections() const { return mSections; }
+
+        // Returns the index in getSections() of the named section, or -1.
+        ssize_t findSectionIndex(std::string_view section) const;
+
+        /**
+         * Lookup the tag id for a given tag name in the section at the given
+         * index of getSections().
+         *
+         * Returns OK on success, or NAME_NOT_FOUND.
+         */
+        status_t lookupTag(std::string_view name, size_t sectionIndex,
+                /*out*/uint32_t* tag) const;
+
+    private:
+        struct TagInfo {
+            String8 name;
+            uint32_t sectionIndex;
+            int32_t type;
+        };
+
+        const TagInfo* find(uint32_t tag) const;
+
+        std::vector<uint32_t> mTags;
+        std::unordered_map<uint32_t, TagInfo> mTagInfo;
+        SortedVector<String8> mSections;
+        // The keys point into mSections and into the names in mTagInfo.
+        std::unordered_map<std::string_view, uint32_t> mSectionIndices;
+        // Tag name to tag id, per section index.
+        std::vector<std::unordered_map<std::string_view, uint32_t>> mReverseMapping;
+};
+
 /**
  * VendorTagDescriptor objects are containers for the vendor tag
  * definitions provided, and are typically used to pass the vendor tag
@@ -86,18 +158,27 @@ class VendorTagDescriptor {
          */
         status_t lookupTag(const String8& name, const String8& section, /*out*/uint32_t* tag) const;
 
+        // Returns the index in getAllSectionNames() of the named section, or -1.
+        ssize_t findSectionIndex(std::string_view section) const;
+
+        /**
+         * Lookup the tag id for a given tag name in the section at the given
+         * index of getAllSectionNames(), without building String8 keys or
+         * logging misses.
+         *
+         * Returns OK on success, or NAME_NOT_FOUND.
+         */
+        status_t lookupTag(std::string_view name, size_t sectionIndex,
+                /*out*/uint32_t* tag) const;
+
         /**
          * Dump the currently configured vendor tags to a file descriptor.
          */
         void dump(int fd, int verbosity, int indentation) const;
 
     protected:
-        KeyedVector<String8, KeyedVector<String8, uint32_t>*> mReverseMapping;
-        KeyedVector<uint32_t, String8> mTagToNameMap;
-        KeyedVector<uint32_t, uint32_t> mTagToSectionMap; // Value is offset in mSections
-
-        std::unordered_map<uint32_t, int32_t> mTagToTypeMap;
-        SortedVector<String8> mSections;
+        // Shared by all copies of this descriptor.
+        std::shared_ptr<const VendorTagTable> mTable;
         // must be int32_t to be compatible with Parcel::writeInt32
         int32_t mTagCount;
 
@@ -195,7 +276,16 @@ class VendorTagDescriptorCache {
     void dump(int fd, int verbosity, int indentation) const;
 
    protected:
-    std::unordered_map<metadata_vendor_id_t, sp<VendorTagDescriptor>> mVendorMap;
+    typedef std::unordered_map<metadata_vendor_id_t, sp<VendorTagDescriptor>> VendorMap;
+
+    // Returns the descriptor of the given vendor id, or nullptr.
+    const VendorTagDescriptor* find(metadata_vendor_id_t id) const;
+
+    // Replaced rather than modified by addVendorDescriptor(), so that lookups
+    // need no lock.
+    std::shared_ptr<const VendorMap> mVendorMap = std::make_shared<const VendorMap>();
+    // Serializes addVendorDescriptor() calls.
+    std::mutex mWriteLock;
     struct vendor_tag_cache_ops mVendorCacheOps;
 };
 
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Builds a 100-entry capture result the way a camera HAL assembles one per
+ * frame: every entry is written, then read back.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include "CameraMetadata.h"
+
+using android::hardware::camera::common::V1_0::helper::CameraMetadata;
+using android::hardware::camera::common::V1_0::helper::CameraMetadataBuilder;
+
+namespace {
+
+constexpr size_t kResultEntries = 100;
+
+// The first kResultEntries built-in tags of a scalar type.
+const std::vector<uint32_t>& resultTags() {
+    static const std::vector<uint32_t> tags = [] {
+        std::vector<uint32_t> tags;
+        for (size_t section = 0; section < ANDROID_SECTION_COUNT; ++section) {
+            for (uint32_t tag = camera_metadata_section_bounds[section][0];
+                 tag < camera_metadata_section_bounds[section][1]; ++tag) {
+                int type = get_camera_metadata_tag_type(tag);
+                if (type == TYPE_BYTE || type == TYPE_INT32 || type == TYPE_INT64 ||
+                    type == TYPE_FLOAT) {
+                    tags.push_back(tag);
+                    if (tags.size() == kResultEntries) return tags;
+                }
+            }
+        }
+        return tags;
+    }();
+    return tags;
+}
+
+template <typename Metadata>
+void updateValue(Metadata* metadata, uint32_t tag, int32_t value) {
+    switch (get_camera_metadata_tag_type(tag)) {
+        case TYPE_BYTE: {
+            uint8_t byte = value;
+            metadata->update(tag, &byte, 1);
+            break;
+        }
+        case TYPE_INT32:
+            metadata->update(tag, &value, 1);
+            break;
+        case TYPE_INT64: {
+            int64_t wide = value;
+            metadata->update(tag, &wide, 1);
+            break;
+        }
+        case TYPE_FLOAT: {
+            float real = value;
+            metadata->update(tag, &real, 1);
+            break;
+        }
+    }
+}
+
+void readBack(const CameraMetadata& result) {
+    for (uint32_t tag : resultTags()) {
+        benchmark::DoNotOptimize(result.find(tag).data.u8);
+    }
+}
+
+void BM_UpdateEachEntry(benchmark::State& state) {
+    int32_t frame = 0;
+    for (auto _ : state) {
+        CameraMetadata result;
+        for (uint32_t tag : resultTags()) {
+            updateValue(&result, tag, frame);
+        }
+        readBack(result);
+        frame++;
+    }
+}
+
+void BM_BuildAtOnce(benchmark::State& state) {
+    int32_t frame = 0;
+    CameraMetadataBuilder builder(kResultEntries, kResultEntries * 8);
+    for (auto _ : state) {
+        builder.clear();
+        for (uint32_t tag : resultTags()) {
+            updateValue(&builder, tag, frame);
+        }
+        CameraMetadata result;
+        builder.build(&result);
+        readBack(result);
+        frame++;
+    }
+}
+
+void BM_GetTagFromName(benchmark::State& state) {
+    std::vector<std::string> names;
+    for (uint32_t tag : resultTags()) {
+        names.push_back(std::string(get_camera_metadata_section_name(tag)) + "." +
+                        get_camera_metadata_tag_name(tag));
+    }
+    for (auto _ : state) {
+        for (const auto& name : names) {
+            uint32_t tag;
+            CameraMetadata::getTagFromName(name.c_str(), nullptr, &tag);
+            benchmark::DoNotOptimize(tag);
+        }
+    }
+}
+
+}  // namespace
+
+BENCHMARK(BM_UpdateEachEntry);
+BENCHMARK(BM_BuildAtOnce);
+BENCHMARK(BM_GetTagFromName);
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs HandleImporter against a fake mapper 4.0 from several threads, the way
+ * concurrent camera streams use it. Every call into the fake mapper busy-waits
+ * for a fixed time in place of the IPC and cache maintenance of a real one.
+ */
+
+#include <benchmark/benchmark.h>
+#include <cutils/native_handle.h>
+
+#include <chrono>
+
+#include "HandleImporter.h"
+
+using android::sp;
+using android::hardware::hidl_handle;
+using android::hardware::hidl_vec;
+using android::hardware::Return;
+using android::hardware::Void;
+using android::hardware::camera::common::V1_0::helper::HandleImporter;
+using android::hardware::graphics::common::V1_0::BufferUsage;
+using android::hardware::graphics::mapper::V4_0::Error;
+using IMapperV4 = android::hardware::graphics::mapper::V4_0::IMapper;
+
+namespace {
+
+constexpr std::chrono::nanoseconds kMapperCallTime = std::chrono::microseconds(5);
+constexpr int kWidth = 1920;
+constexpr int kHeight = 1080;
+
+void mapperWork() {
+    const auto end = std::chrono::steady_clock::now() + kMapperCallTime;
+    while (std::chrono::steady_clock::now() < end)
+        ;
+}
+
+// Imports a handle as itself and maps every buffer to the same scratch memory.
+class FakeMapper : public IMapperV4 {
+  public:
+    Return<void> createDescriptor(const BufferDescriptorInfo&, createDescriptor_cb cb) override {
+        cb(Error::UNSUPPORTED, {});
+        return Void();
+    }
+
+    Return<void> importBuffer(const hidl_handle& rawHandle, importBuffer_cb cb) override {
+        mapperWork();
+        cb(Error::NONE, const_cast<native_handle_t*>(rawHandle.getNativeHandle()));
+        return Void();
+    }
+
+    Return<Error> freeBuffer(void*) override {
+        mapperWork();
+        return Error::NONE;
+    }
+
+    Return<Error> validateBufferSize(void*, const BufferDescriptorInfo&, uint32_t) override {
+        return Error::NONE;
+    }
+
+    Return<void> getTransportSize(void*, getTransportSize_cb cb) override {
+        cb(Error::NONE, 0, 1);
+        return Void();
+    }
+
+    Return<void> lock(void*, uint64_t, const Rect&, const hidl_handle&, lock_cb cb) override {
+        mapperWork();
+        cb(Error::NONE, mPixels);
+        return Void();
+    }
+
+    Return<void> unlock(void*, unlock_cb cb) override {
+        mapperWork();
+        cb(Error::NONE, hidl_handle());
+        return Void();
+    }
+
+    Return<void> flushLockedBuffer(void*, flushLockedBuffer_cb cb) override {
+        cb(Error::NONE, hidl_handle());
+        return Void();
+    }
+
+    Return<Error> rereadLockedBuffer(void*) override { return Error::NONE; }
+
+    Return<void> isSupported(const BufferDescriptorInfo&, isSupported_cb cb) override {
+        cb(Error::NONE, true);
+        return Void();
+    }
+
+    Return<void> get(void*, const MetadataType&, get_cb cb) override {
+        cb(Error::UNSUPPORTED, {});
+        return Void();
+    }
+
+    Return<Error> set(void*, const MetadataType&, const hidl_vec<uint8_t>&) override {
+        return Error::UNSUPPORTED;
+    }
+
+    Return<void> getFromBufferDescriptorInfo(const BufferDescriptorInfo&, const MetadataType&,
+                                             getFromBufferDescriptorInfo_cb cb) override {
+        cb(Error::UNSUPPORTED, {});
+        return Void();
+    }
+
+    Return<void> listSupportedMetadataTypes(listSupportedMetadataTypes_cb cb) override {
+        cb(Error::NONE, {});
+        return Void();
+    }
+
+    Return<void> dumpBuffer(void*, dumpBuffer_cb cb) override {
+        cb(Error::UNSUPPORTED, {});
+        return Void();
+    }
+
+    Return<void> dumpBuffers(dumpBuffers_cb cb) override {
+        cb(Error::UNSUPPORTED, {});
+        return Void();
+    }
+
+    Return<void> getReservedRegion(void*, getReservedRegion_cb cb) override {
+        cb(Error::UNSUPPORTED, nullptr, 0);
+        return Void();
+    }
+
+  private:
+    uint8_t mPixels[64] = {};
+};
+
+HandleImporter& importer(bool persistent) {
+    static HandleImporter* importers[] = {
+            new HandleImporter(sp<IMapperV4>(new FakeMapper())),
+            [] {
+                auto importer = new HandleImporter(sp<IMapperV4>(new FakeMapper()));
+                importer->enablePersistentMappings();
+                return importer;
+            }(),
+    };
+    return *importers[persistent];
+}
+
+// Every thread imports a buffer of its own, then locks and unlocks it once per frame.
+void BM_LockUnlock(benchmark::State& state) {
+    HandleImporter& handleImporter = importer(state.range(0));
+    native_handle_t* raw = native_handle_create(0, 1);
+    raw->data[0] = state.thread_index;
+    buffer_handle_t buf = raw;
+    if (!handleImporter.importBuffer(buf)) {
+        state.SkipWithError("importBuffer failed");
+        native_handle_delete(raw);
+        return;
+    }
+
+    const uint64_t usage = static_cast<uint64_t>(BufferUsage::CPU_WRITE_OFTEN);
+    const IMapperV4::Rect region = {0, 0, kWidth, kHeight};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(handleImporter.lock(buf, usage, region));
+        handleImporter.closeFence(handleImporter.unlock(buf));
+    }
+    handleImporter.freeBuffer(buf);
+    native_handle_delete(raw);
+}
+
+// Buffers churn through import and free, as when streams are reconfigured.
+void BM_ImportFree(benchmark::State& state) {
+    HandleImporter& handleImporter = importer(false);
+    native_handle_t* raw = native_handle_create(0, 1);
+    raw->data[0] = state.thread_index;
+    for (auto _ : state) {
+        buffer_handle_t buf = raw;
+        handleImporter.importBuffer(buf);
+        handleImporter.freeBuffer(buf);
+    }
+    native_handle_delete(raw);
+}
+
+}  // namespace
+
+BENCHMARK(BM_LockUnlock)
+        ->ArgName("persistent")
+        ->Arg(0)
+        ->Arg(1)
+        ->ThreadRange(1, 8)
+        ->UseRealTime();
+BENCHMARK(BM_ImportFree)->ThreadRange(1, 8)->UseRealTime();
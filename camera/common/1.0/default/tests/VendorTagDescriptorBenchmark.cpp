@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Looks up the tags of a vendor with 500 tags spread over 10 sections, the
+ * way the camera service and the HAL resolve vendor tags for every request.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include "CameraMetadata.h"
+#include "VendorTagDescriptor.h"
+
+using android::sp;
+using android::String8;
+using android::hardware::camera::common::V1_0::helper::CameraMetadata;
+using android::hardware::camera::common::V1_0::helper::VendorTagDescriptor;
+using BaseVendorTagDescriptor = android::hardware::camera2::params::VendorTagDescriptor;
+
+namespace {
+
+constexpr uint32_t kSections = 10;
+constexpr uint32_t kTagsPerSection = 50;
+constexpr uint32_t kTagCount = kSections * kTagsPerSection;
+
+struct SyntheticVendor {
+    std::vector<std::string> sectionNames;
+    std::vector<std::string> tagNames;
+
+    SyntheticVendor() {
+        for (uint32_t i = 0; i < kSections; ++i) {
+            sectionNames.push_back("com.vendor.section" + std::to_string(i));
+        }
+        for (uint32_t i = 0; i < kTagsPerSection; ++i) {
+            tagNames.push_back("tag" + std::to_string(i));
+        }
+    }
+
+    static const SyntheticVendor& get() {
+        static const SyntheticVendor vendor;
+        return vendor;
+    }
+};
+
+uint32_t tagAt(uint32_t i) {
+    return CAMERA_METADATA_VENDOR_TAG_BOUNDARY + i;
+}
+
+int getTagCount(const vendor_tag_ops_t* /*v*/) {
+    return kTagCount;
+}
+
+void getAllTags(const vendor_tag_ops_t* /*v*/, uint32_t* tagArray) {
+    for (uint32_t i = 0; i < kTagCount; ++i) {
+        tagArray[i] = tagAt(i);
+    }
+}
+
+const char* getSectionName(const vendor_tag_ops_t* /*v*/, uint32_t tag) {
+    uint32_t i = tag - CAMERA_METADATA_VENDOR_TAG_BOUNDARY;
+    return SyntheticVendor::get().sectionNames[i / kTagsPerSection].c_str();
+}
+
+const char* getTagName(const vendor_tag_ops_t* /*v*/, uint32_t tag) {
+    uint32_t i = tag - CAMERA_METADATA_VENDOR_TAG_BOUNDARY;
+    return SyntheticVendor::get().tagNames[i % kTagsPerSection].c_str();
+}
+
+int getTagType(const vendor_tag_ops_t* /*v*/, uint32_t tag) {
+    return (tag - CAMERA_METADATA_VENDOR_TAG_BOUNDARY) % NUM_TYPES;
+}
+
+const vendor_tag_ops_t kVendorOps = {
+    .get_tag_count = getTagCount,
+    .get_all_tags = getAllTags,
+    .get_section_name = getSectionName,
+    .get_tag_name = getTagName,
+    .get_tag_type = getTagType,
+};
+
+const sp<VendorTagDescriptor>& descriptor() {
+    static const sp<VendorTagDescriptor> desc = [] {
+        sp<VendorTagDescriptor> desc;
+        VendorTagDescriptor::createDescriptorFromOps(&kVendorOps, desc);
+        return desc;
+    }();
+    return desc;
+}
+
+void BM_CreateDescriptorFromOps(benchmark::State& state) {
+    for (auto _ : state) {
+        sp<VendorTagDescriptor> desc;
+        VendorTagDescriptor::createDescriptorFromOps(&kVendorOps, desc);
+        benchmark::DoNotOptimize(desc.get());
+    }
+}
+
+void BM_CopyDescriptor(benchmark::State& state) {
+    const sp<VendorTagDescriptor>& desc = descriptor();
+    for (auto _ : state) {
+        BaseVendorTagDescriptor copy(*desc);
+        benchmark::DoNotOptimize(&copy);
+    }
+}
+
+void BM_GetTagInfo(benchmark::State& state) {
+    const sp<VendorTagDescriptor>& desc = descriptor();
+    for (auto _ : state) {
+        for (uint32_t i = 0; i < kTagCount; ++i) {
+            benchmark::DoNotOptimize(desc->getSectionName(tagAt(i)));
+            benchmark::DoNotOptimize(desc->getTagName(tagAt(i)));
+            benchmark::DoNotOptimize(desc->getTagType(tagAt(i)));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kTagCount);
+}
+
+// The same lookups through the vendor tag callbacks of camera_metadata.
+void BM_GetTagInfoGlobal(benchmark::State& state) {
+    VendorTagDescriptor::setAsGlobalVendorTagDescriptor(descriptor());
+    for (auto _ : state) {
+        for (uint32_t i = 0; i < kTagCount; ++i) {
+            benchmark::DoNotOptimize(get_camera_metadata_section_name(tagAt(i)));
+            benchmark::DoNotOptimize(get_camera_metadata_tag_name(tagAt(i)));
+            benchmark::DoNotOptimize(get_camera_metadata_tag_type(tagAt(i)));
+        }
+    }
+    VendorTagDescriptor::clearGlobalVendorTagDescriptor();
+    state.SetItemsProcessed(state.iterations() * kTagCount);
+}
+
+void BM_LookupTag(benchmark::State& state) {
+    const sp<VendorTagDescriptor>& desc = descriptor();
+    const SyntheticVendor& vendor = SyntheticVendor::get();
+    std::vector<String8> sections;
+    for (const auto& section : vendor.sectionNames) {
+        sections.push_back(String8(section.c_str()));
+    }
+    std::vector<String8> names;
+    for (const auto& name : vendor.tagNames) {
+        names.push_back(String8(name.c_str()));
+    }
+    for (auto _ : state) {
+        for (uint32_t i = 0; i < kTagCount; ++i) {
+            uint32_t tag;
+            desc->lookupTag(names[i % kTagsPerSection], sections[i / kTagsPerSection], &tag);
+            benchmark::DoNotOptimize(tag);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kTagCount);
+}
+
+void BM_GetTagFromName(benchmark::State& state) {
+    const sp<VendorTagDescriptor>& desc = descriptor();
+    std::vector<std::string> names;
+    for (uint32_t i = 0; i < kTagCount; ++i) {
+        names.push_back(std::string(desc->getSectionName(tagAt(i))) + "." +
+                        desc->getTagName(tagAt(i)));
+    }
+    for (auto _ : state) {
+        for (const auto& name : names) {
+            uint32_t tag;
+            CameraMetadata::getTagFromName(name.c_str(), desc.get(), &tag);
+            benchmark::DoNotOptimize(tag);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kTagCount);
+}
+
+}  // namespace
+
+BENCHMARK(BM_CreateDescriptorFromOps);
+BENCHMARK(BM_CopyDescriptor);
+BENCHMARK(BM_GetTagInfo);
+BENCHMARK(BM_GetTagInfoGlobal);
+BENCHMARK(BM_LookupTag);
+BENCHMARK(BM_GetTagFromName);
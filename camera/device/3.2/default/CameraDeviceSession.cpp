@@ -283,6 +283,12 @@ Status CameraDeviceSession::importBuffer(int32_t streamId,
     }
 
     Mutex::Autolock _l(mInflightLock);
+    return importBufferLocked(streamId, bufId, buf, outBufPtr);
+}
+
+Status CameraDeviceSession::importBufferLocked(int32_t streamId,
+        uint64_t bufId, buffer_handle_t buf,
+        /*out*/buffer_handle_t** outBufPtr) {
     CirculatingBuffers& cbs = mCirculatingBuffers[streamId];
     if (cbs.count(bufId) == 0) {
         // Register a newly seen buffer
@@ -320,6 +320,11 @@ protected:
             /*out*/buffer_handle_t** outBufPtr,
             bool allowEmptyBuf);
 
+    // Same as importBuffer for a non-empty buffer, with mInflightLock held by the caller
+    Status importBufferLocked(int32_t streamId,
+            uint64_t bufId, buffer_handle_t buf,
+            /*out*/buffer_handle_t** outBufPtr);
+
     static void cleanupInflightFences(
             hidl_vec<int>& allFences, size_t numFences);
 
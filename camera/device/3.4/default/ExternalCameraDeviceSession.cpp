@@ -2059,6 +2059,8 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(
                 __FUNCTION__, v4lBufferCount, req_buffers.count);
         return NO_MEMORY;
     }
+    mV4l2SupportsOrphanedBufs =
+            (req_buffers.capabilities & V4L2_BUF_CAP_SUPPORTS_ORPHANED_BUFS) != 0;
 
     // VIDIOC_QUERYBUF:  get buffer offset in the V4L2 fd
     // VIDIOC_QBUF: send buffer to driver
@@ -2206,6 +2208,38 @@ void ExternalCameraDeviceSession::enqueueV4l2Frame(const sp<V4L2Frame>& frame) {
     mV4L2BufferReturned.notify_one();
 }
 
+int ExternalCameraDeviceSession::detachV4l2Frame(const sp<V4L2Frame>& frame) {
+    ATRACE_CALL();
+    if (!mV4l2SupportsOrphanedBufs) {
+        return -EOPNOTSUPP;
+    }
+
+    // The mapping keeps the buffer memory alive once VIDIOC_REQBUFS orphans it
+    uint8_t* data;
+    size_t dataSize;
+    int ret = frame->map(&data, &dataSize);
+    if (ret != 0) {
+        return ret;
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(mV4l2BufferLock);
+        mNumDequeuedV4l2Buffers--;
+    }
+    mV4L2BufferReturned.notify_one();
+    return 0;
+}
+
+sp<Frame> ExternalCameraDeviceSession::handOffV4l2Frame(const sp<V4L2Frame>& frame) {
+    if (detachV4l2Frame(frame) == 0) {
+        // Hand the V4L2 buffer itself over; it is orphaned when streaming stops
+        return frame;
+    }
+    sp<Frame> copy = new V3_6::implementation::AllocatedV4L2Frame(frame);
+    enqueueV4l2Frame(frame);
+    return copy;
+}
+
 Status ExternalCameraDeviceSession::isStreamCombinationSupported(
         const V3_2::StreamConfiguration& config,
         const std::vector<SupportedV4L2Format>& supportedFormats,
@@ -272,6 +272,13 @@ protected:
     // TODO: change to unique_ptr for better tracking
     sp<V4L2Frame> dequeueV4l2FrameLocked(/*out*/nsecs_t* shutterTs); // Called with mLock hold
     void enqueueV4l2Frame(const sp<V4L2Frame>&);
+    // Stop tracking a dequeued frame without queueing it back to the driver. The frame
+    // stays mapped, so its data remains readable after the V4L2 buffers are freed.
+    // Fails if the driver cannot orphan buffers; the frame must then be enqueued.
+    int detachV4l2Frame(const sp<V4L2Frame>&);
+    // Hand a dequeued frame over to an offline session. The frame is detached if the driver can
+    // orphan buffers; otherwise its data is copied and the V4L2 buffer is queued back.
+    sp<Frame> handOffV4l2Frame(const sp<V4L2Frame>&);
 
     // Check if input Stream is one of supported stream setting on this device
     static bool isSupported(const Stream& stream,
@@ -347,6 +354,8 @@ protected:
     std::condition_variable mV4L2BufferReturned;
     size_t mNumDequeuedV4l2Buffers = 0;
     uint32_t mMaxV4L2BufferSize = 0;
+    // Whether the V4L2 buffers can be freed while some of them are still mapped
+    bool mV4l2SupportsOrphanedBufs = false;
 
     // Not protected by mLock (but might be used when mLock is locked)
     sp<OutputThread> mOutputThread;
@@ -283,7 +283,8 @@ struct OutputThreadInterface : public virtual RefBase {
 namespace V3_6 {
 namespace implementation {
 
-// A CPU copy of a mapped V4L2Frame. Will map the input V4L2 frame.
+// A CPU copy of a mapped V4L2Frame. Will map the input V4L2 frame. Used to hand frames to
+// an offline session when the V4L2 buffers cannot be detached from the capture queue.
 class AllocatedV4L2Frame : public V3_4::implementation::Frame {
 public:
     AllocatedV4L2Frame(sp<V3_4::implementation::V4L2Frame> frameIn);
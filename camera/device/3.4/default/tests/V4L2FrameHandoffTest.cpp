@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Covers ExternalCameraDeviceSession::handOffV4l2Frame(), which switchToOffline() uses to hand
+ * in-flight frames to an offline session:
+ *
+ * - Detach: if the driver can orphan buffers, the V4L2 buffer stays mapped and the offline
+ *   session reads it in place. The buffer memory outlives the V4L2 queue.
+ * - Copy: otherwise, or if the frame cannot be mapped, AllocatedV4L2Frame copies the data and
+ *   the buffer is queued back to the driver.
+ *
+ * The MMAP buffers of the capture queue are faked with a memfd, so the test runs without a
+ * camera. The session has no V4L2 device, so queueing a buffer back always fails.
+ */
+
+#include <gtest/gtest.h>
+#include <linux/videodev2.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <vector>
+
+#include "ExternalCameraDeviceSession.h"
+
+using android::sp;
+using android::base::unique_fd;
+using android::hardware::camera::common::V1_0::helper::CameraMetadata;
+using android::hardware::camera::device::V3_4::implementation::ExternalCameraDeviceSession;
+using android::hardware::camera::device::V3_4::implementation::Frame;
+using android::hardware::camera::device::V3_4::implementation::V4L2Frame;
+using android::hardware::camera::device::V3_4::implementation::VERTICAL;
+using android::hardware::camera::external::common::ExternalCameraConfig;
+
+namespace {
+
+// A burst of 4K MJPEG frames, at the size of a typical UVC buffer for that mode.
+constexpr uint32_t kWidth = 3840;
+constexpr uint32_t kHeight = 2160;
+constexpr size_t kBufferSize = kWidth * kHeight * 2;
+constexpr int kNumBuffers = 8;
+
+// The MMAP buffers of a V4L2 capture queue, each filled with its own index.
+class FakeV4l2Buffers {
+  public:
+    FakeV4l2Buffers() {
+        mFd = memfd_create("FakeV4l2Buffers", 0);
+        if (mFd < 0 || ftruncate(mFd, kBufferSize * kNumBuffers) != 0) return;
+        void* data = mmap(nullptr, kBufferSize * kNumBuffers, PROT_WRITE, MAP_SHARED, mFd, 0);
+        if (data == MAP_FAILED) return;
+        for (int i = 0; i < kNumBuffers; i++) {
+            memset(static_cast<uint8_t*>(data) + i * kBufferSize, i, kBufferSize);
+        }
+        munmap(data, kBufferSize * kNumBuffers);
+        mValid = true;
+    }
+
+    ~FakeV4l2Buffers() { close(); }
+
+    bool isValid() const { return mValid; }
+
+    // A frame as VIDIOC_DQBUF would describe buffer index.
+    sp<V4L2Frame> dequeue(int index) const {
+        return new V4L2Frame(kWidth, kHeight, V4L2_PIX_FMT_MJPEG, index, mFd, kBufferSize,
+                             index * kBufferSize);
+    }
+
+    // Like closing the device, which frees the buffers of its queue.
+    void close() {
+        if (mFd >= 0) ::close(mFd);
+        mFd = -1;
+    }
+
+  private:
+    int mFd = -1;
+    bool mValid = false;
+};
+
+// A session that never opens a V4L2 device, with its stream state set up as if kNumBuffers
+// buffers were dequeued from a queue with or without orphaned-buffer support.
+class HandOffSession : public ExternalCameraDeviceSession {
+  public:
+    explicit HandOffSession(bool supportsOrphanedBufs)
+        : ExternalCameraDeviceSession(nullptr, ExternalCameraConfig::loadFromCfg(""), {},
+                                      VERTICAL, CameraMetadata(), "0", unique_fd()) {
+        mV4l2SupportsOrphanedBufs = supportsOrphanedBufs;
+        mNumDequeuedV4l2Buffers = kNumBuffers;
+    }
+
+    using ExternalCameraDeviceSession::handOffV4l2Frame;
+
+    size_t numDequeuedV4l2Buffers() {
+        std::lock_guard<std::mutex> lk(mV4l2BufferLock);
+        return mNumDequeuedV4l2Buffers;
+    }
+};
+
+bool hasContents(const sp<Frame>& frame, uint8_t value) {
+    uint8_t* data;
+    size_t dataSize;
+    if (frame->getData(&data, &dataSize) != 0 || dataSize != kBufferSize) return false;
+    for (size_t i = 0; i < dataSize; i += 4096) {
+        if (data[i] != value) return false;
+    }
+    return data[dataSize - 1] == value;
+}
+
+TEST(V4L2FrameHandoffTest, DetachesWhenDriverOrphansBuffers) {
+    FakeV4l2Buffers buffers;
+    ASSERT_TRUE(buffers.isValid());
+    sp<HandOffSession> session = new HandOffSession(/*supportsOrphanedBufs*/ true);
+
+    std::vector<sp<Frame>> offline;
+    for (int i = 0; i < kNumBuffers; i++) {
+        sp<V4L2Frame> frame = buffers.dequeue(i);
+        offline.push_back(session->handOffV4l2Frame(frame));
+        EXPECT_EQ(frame.get(), offline.back().get()) << "frame " << i;
+        EXPECT_EQ(static_cast<size_t>(kNumBuffers - i - 1), session->numDequeuedV4l2Buffers());
+    }
+    buffers.close();
+
+    for (int i = 0; i < kNumBuffers; i++) {
+        EXPECT_TRUE(hasContents(offline[i], i)) << "frame " << i;
+    }
+    session->close();
+}
+
+TEST(V4L2FrameHandoffTest, CopiesWhenDriverCannotOrphanBuffers) {
+    FakeV4l2Buffers buffers;
+    ASSERT_TRUE(buffers.isValid());
+    sp<HandOffSession> session = new HandOffSession(/*supportsOrphanedBufs*/ false);
+
+    std::vector<sp<Frame>> offline;
+    for (int i = 0; i < kNumBuffers; i++) {
+        sp<V4L2Frame> frame = buffers.dequeue(i);
+        offline.push_back(session->handOffV4l2Frame(frame));
+        EXPECT_NE(frame.get(), offline.back().get()) << "frame " << i;
+    }
+    // Only a successful VIDIOC_QBUF gives a buffer back, and there is no device to take it.
+    EXPECT_EQ(static_cast<size_t>(kNumBuffers), session->numDequeuedV4l2Buffers());
+    buffers.close();
+
+    for (int i = 0; i < kNumBuffers; i++) {
+        EXPECT_TRUE(hasContents(offline[i], i)) << "frame " << i;
+    }
+    session->close();
+}
+
+TEST(V4L2FrameHandoffTest, CopiesFramesThatFailToMap) {
+    sp<HandOffSession> session = new HandOffSession(/*supportsOrphanedBufs*/ true);
+    sp<V4L2Frame> frame =
+            new V4L2Frame(kWidth, kHeight, V4L2_PIX_FMT_MJPEG, 0, /*fd*/ -1, kBufferSize, 0);
+
+    sp<Frame> offline = session->handOffV4l2Frame(frame);
+    EXPECT_NE(frame.get(), offline.get());
+    EXPECT_EQ(static_cast<size_t>(kNumBuffers), session->numDequeuedV4l2Buffers());
+    session->close();
+}
+
+TEST(V4L2FrameHandoffTest, SwitchLatency) {
+    FakeV4l2Buffers buffers;
+    ASSERT_TRUE(buffers.isValid());
+
+    std::chrono::nanoseconds latency[2];
+    for (bool detach : {false, true}) {
+        sp<HandOffSession> session = new HandOffSession(detach);
+        std::vector<sp<V4L2Frame>> inflight;
+        for (int i = 0; i < kNumBuffers; i++) {
+            inflight.push_back(buffers.dequeue(i));
+            // The output thread has usually mapped the frame to decode it already.
+            uint8_t* data;
+            size_t dataSize;
+            ASSERT_EQ(0, inflight.back()->map(&data, &dataSize));
+        }
+
+        std::vector<sp<Frame>> offline;
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& frame : inflight) {
+            offline.push_back(session->handOffV4l2Frame(frame));
+        }
+        latency[detach] = std::chrono::steady_clock::now() - start;
+        session->close();
+    }
+
+    RecordProperty("copy_us", latency[false].count() / 1000);
+    RecordProperty("detach_us", latency[true].count() / 1000);
+}
+
+}  // namespace
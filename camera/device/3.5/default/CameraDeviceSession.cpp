@@ -18,6 +18,7 @@
 #define ATRACE_TAG ATRACE_TAG_CAMERA
 #include <android/log.h>
 
+#include <algorithm>
 #include <vector>
 #include <utils/Trace.h>
 #include "CameraDeviceSession.h"
@@ -67,6 +68,9 @@ Return<void> CameraDeviceSession::configureStreams_3_5(
         ICameraDeviceSession::configureStreams_3_5_cb _hidl_cb)  {
     configureStreams_3_4_Impl(requestedConfiguration.v3_4, _hidl_cb,
             requestedConfiguration.streamConfigCounter, false /*useOverriddenFields*/);
+    if (mSupportBufMgr) {
+        pruneBufferIdTables();
+    }
     return Void();
 }
 
@@ -115,37 +119,108 @@ Status CameraDeviceSession::importRequest(
     return importRequestImpl(request, allBufPtrs, allFences, /*allowEmptyBuf*/ false);
 }
 
-void CameraDeviceSession::pushBufferId(
-        const buffer_handle_t& buf, uint64_t bufferId, int streamId) {
-    std::lock_guard<std::mutex> lock(mBufferIdMapLock);
+std::shared_ptr<CameraDeviceSession::BufferIdTable> CameraDeviceSession::getBufferIdTable(
+        int streamId) {
+    auto tables = std::atomic_load(&mBufferIdTables);
+    if (tables == nullptr) {
+        return nullptr;
+    }
+    auto it = tables->find(streamId);
+    return (it == tables->end()) ? nullptr : it->second;
+}
+
+std::shared_ptr<CameraDeviceSession::BufferIdTable>
+CameraDeviceSession::getOrCreateBufferIdTable(int streamId, size_t capacity) {
+    auto table = getBufferIdTable(streamId);
+    if (table != nullptr) {
+        return table;
+    }
 
-    // emplace will return existing entry if there is one.
-    auto pair = mBufferIdMaps.emplace(streamId, BufferIdMap{});
-    BufferIdMap& bIdMap = pair.first->second;
-    bIdMap[buf] = bufferId;
+    std::lock_guard<std::mutex> lock(mBufferIdMapLock);
+    // Check again in case another thread created the table meanwhile
+    table = getBufferIdTable(streamId);
+    if (table != nullptr) {
+        return table;
+    }
+    table = std::make_shared<BufferIdTable>();
+    table->entries.reserve(capacity);
+
+    auto tables = std::atomic_load(&mBufferIdTables);
+    auto newTables = (tables == nullptr) ? std::make_shared<BufferIdTables>()
+                                         : std::make_shared<BufferIdTables>(*tables);
+    newTables->emplace(streamId, table);
+    std::atomic_store(&mBufferIdTables, std::shared_ptr<const BufferIdTables>(newTables));
+    return table;
 }
 
-uint64_t CameraDeviceSession::popBufferId(
-        const buffer_handle_t& buf, int streamId) {
+void CameraDeviceSession::pruneBufferIdTables() {
     std::lock_guard<std::mutex> lock(mBufferIdMapLock);
+    auto tables = std::atomic_load(&mBufferIdTables);
+    if (tables == nullptr) {
+        return;
+    }
 
-    auto streamIt = mBufferIdMaps.find(streamId);
-    if (streamIt == mBufferIdMaps.end()) {
-        return BUFFER_ID_NO_BUFFER;
+    auto newTables = std::make_shared<BufferIdTables>();
+    {
+        Mutex::Autolock _l(mInflightLock);
+        for (const auto& pair : *tables) {
+            std::lock_guard<std::mutex> tableLock(pair.second->lock);
+            if (mStreamMap.count(pair.first) != 0 || !pair.second->entries.empty()) {
+                newTables->emplace(pair.first, pair.second);
+            }
+        }
+    }
+    std::atomic_store(&mBufferIdTables, std::shared_ptr<const BufferIdTables>(newTables));
+}
+
+// The HAL normally hands back the handle it was given, so handles are compared by address
+// before being compared by content.
+CameraDeviceSession::BufferIdTable::Entries::iterator CameraDeviceSession::BufferIdTable::find(
+        const buffer_handle_t& buf) {
+    auto it = std::find_if(entries.begin(), entries.end(),
+            [&buf](const auto& entry) { return entry.first == buf; });
+    if (it != entries.end() || buf == nullptr) {
+        return it;
+    }
+    return std::find_if(entries.begin(), entries.end(), [&buf](const auto& entry) {
+        return entry.first != nullptr && BufferComparator()(entry.first, buf);
+    });
+}
+
+void CameraDeviceSession::pushBufferId(
+        BufferIdTable* table, const buffer_handle_t& buf, uint64_t bufferId) {
+    std::lock_guard<std::mutex> lock(table->lock);
+
+    auto it = table->find(buf);
+    if (it != table->entries.end()) {
+        it->second = bufferId;
+    } else {
+        table->entries.emplace_back(buf, bufferId);
     }
-    BufferIdMap& bIdMap = streamIt->second;
-    auto it = bIdMap.find(buf);
-    if (it == bIdMap.end()) {
+}
+
+uint64_t CameraDeviceSession::popBufferId(BufferIdTable* table, const buffer_handle_t& buf) {
+    std::lock_guard<std::mutex> lock(table->lock);
+
+    auto it = table->find(buf);
+    if (it == table->entries.end()) {
         return BUFFER_ID_NO_BUFFER;
     }
     uint64_t bufId = it->second;
-    bIdMap.erase(it);
-    if (bIdMap.empty()) {
-        mBufferIdMaps.erase(streamIt);
-    }
+    *it = table->entries.back();
+    table->entries.pop_back();
     return bufId;
 }
 
+uint64_t CameraDeviceSession::popBufferId(
+        const buffer_handle_t& buf, int streamId) {
+    auto table = getBufferIdTable(streamId);
+    if (table == nullptr) {
+        return BUFFER_ID_NO_BUFFER;
+    }
+    return popBufferId(table.get(), buf);
+}
+
 uint64_t CameraDeviceSession::getCapResultBufferId(const buffer_handle_t& buf, int streamId) {
     if (mSupportBufMgr) {
         return popBufferId(buf, streamId);
@@ -153,13 +228,36 @@ uint64_t CameraDeviceSession::getCapResultBufferId(const buffer_handle_t& buf, i
     return BUFFER_ID_NO_BUFFER;
 }
 
-Camera3Stream* CameraDeviceSession::getStreamPointer(int32_t streamId) {
+bool CameraDeviceSession::getStreamPointers(
+        const camera3_buffer_request_t* buffer_reqs, const hidl_vec<StreamBufferRet>& bufRets,
+        /*out*/camera3_stream_buffer_ret_t* returned_buf_reqs) {
+    bool allMatched = true;
+    for (size_t i = 0; i < bufRets.size(); i++) {
+        Camera3Stream* stream = static_cast<Camera3Stream*>(buffer_reqs[i].stream);
+        if (stream->mId == bufRets[i].streamId) {
+            returned_buf_reqs[i].stream = stream;
+        } else {
+            returned_buf_reqs[i].stream = nullptr;
+            allMatched = false;
+        }
+    }
+    if (allMatched) {
+        return true;
+    }
+
     Mutex::Autolock _l(mInflightLock);
-    if (mStreamMap.count(streamId) == 0) {
-        ALOGE("%s: unknown streamId %d", __FUNCTION__, streamId);
-        return nullptr;
+    for (size_t i = 0; i < bufRets.size(); i++) {
+        if (returned_buf_reqs[i].stream != nullptr) {
+            continue;
+        }
+        auto it = mStreamMap.find(bufRets[i].streamId);
+        if (it == mStreamMap.end()) {
+            ALOGE("%s: unknown streamId %d", __FUNCTION__, bufRets[i].streamId);
+            return false;
+        }
+        returned_buf_reqs[i].stream = &it->second;
     }
-    return &mStreamMap[streamId];
+    return true;
 }
 
 void CameraDeviceSession::cleanupInflightBufferFences(
@@ -223,14 +321,8 @@ camera3_buffer_request_status_t CameraDeviceSession::requestStreamBuffers(
     }
 
     *num_returned_buf_reqs = num_buffer_reqs;
-    for (size_t i = 0; i < num_buffer_reqs; i++) {
-        // maybe we can query all streams in one call to avoid frequent locking device here?
-        Camera3Stream* stream = getStreamPointer(bufRets[i].streamId);
-        if (stream == nullptr) {
-            ALOGE("%s: unknown streamId %d", __FUNCTION__, bufRets[i].streamId);
-            return CAMERA3_BUF_REQ_FAILED_UNKNOWN;
-        }
-        returned_buf_reqs[i].stream = stream;
+    if (!getStreamPointers(buffer_reqs, bufRets, returned_buf_reqs)) {
+        return CAMERA3_BUF_REQ_FAILED_UNKNOWN;
     }
 
     // Handle failed streams
@@ -263,11 +355,46 @@ camera3_buffer_request_status_t CameraDeviceSession::requestStreamBuffers(
     }
 
     // Only BufferRequestStatus::OK and BufferRequestStatus::FAILED_PARTIAL reaches here
+    // Look up the buffer ID tables first: creating one takes mBufferIdMapLock, which must
+    // not be acquired while holding mInflightLock.
+    std::vector<std::shared_ptr<BufferIdTable>> tables(num_buffer_reqs);
+    for (size_t i = 0; i < num_buffer_reqs; i++) {
+        if (bufRets[i].val.getDiscriminator() ==
+                StreamBuffersVal::hidl_discriminator::buffers) {
+            tables[i] = getOrCreateBufferIdTable(bufRets[i].streamId,
+                    returned_buf_reqs[i].stream->max_buffers);
+        }
+    }
+
+    {
+        // Import all returned buffers under a single lock
+        Mutex::Autolock _l(mInflightLock);
+        for (size_t i = 0; i < num_buffer_reqs; i++) {
+            if (tables[i] == nullptr) {
+                continue;
+            }
+            int streamId = bufRets[i].streamId;
+            const hidl_vec<StreamBuffer>& hBufs = bufRets[i].val.buffers();
+            camera3_stream_buffer_t* outBufs = returned_buf_reqs[i].output_buffers;
+            for (size_t b = 0; b < hBufs.size(); b++) {
+                const StreamBuffer& hBuf = hBufs[b];
+                buffer_handle_t buf = hBuf.buffer.getNativeHandle();
+                Status s = (buf == nullptr && hBuf.bufferId == BUFFER_ID_NO_BUFFER) ?
+                        Status::ILLEGAL_ARGUMENT :
+                        importBufferLocked(streamId, hBuf.bufferId, buf,
+                                /*out*/&(outBufs[b].buffer));
+                // Buffer import should never fail - restart HAL since something is very wrong.
+                LOG_ALWAYS_FATAL_IF(s != Status::OK,
+                        "%s: import stream %d bufferId %" PRIu64 " failed!",
+                        __FUNCTION__, streamId, hBuf.bufferId);
+            }
+        }
+    }
+
     std::vector<int> importedFences;
     std::vector<std::pair<buffer_handle_t, int>> importedBuffers;
     for (size_t i = 0; i < num_buffer_reqs; i++) {
-        if (bufRets[i].val.getDiscriminator() !=
-                StreamBuffersVal::hidl_discriminator::buffers) {
+        if (tables[i] == nullptr) {
             continue;
         }
         int streamId = bufRets[i].streamId;
@@ -277,17 +404,7 @@ camera3_buffer_request_status_t CameraDeviceSession::requestStreamBuffers(
         for (size_t b = 0; b < hBufs.size(); b++) {
             const StreamBuffer& hBuf = hBufs[b];
             camera3_stream_buffer_t& outBuf = outBufs[b];
-            // maybe add importBuffers API to avoid frequent locking device?
-            Status s = importBuffer(streamId,
-                    hBuf.bufferId, hBuf.buffer.getNativeHandle(),
-                    /*out*/&(outBuf.buffer),
-                    /*allowEmptyBuf*/false);
-            // Buffer import should never fail - restart HAL since something is very wrong.
-            LOG_ALWAYS_FATAL_IF(s != Status::OK,
-                    "%s: import stream %d bufferId %" PRIu64 " failed!",
-                    __FUNCTION__, streamId, hBuf.bufferId);
-
-            pushBufferId(*(outBuf.buffer), hBuf.bufferId, streamId);
+            pushBufferId(tables[i].get(), *(outBuf.buffer), hBuf.bufferId);
             importedBuffers.push_back(std::make_pair(*(outBuf.buffer), streamId));
 
             bool succ = sHandleImporter.importFence(hBuf.acquireFence, outBuf.acquire_fence);
@@ -313,11 +430,17 @@ void CameraDeviceSession::returnStreamBuffers(
     ATRACE_CALL();
     hidl_vec<StreamBuffer> hBufs(num_buffers);
 
+    // Buffers usually come back in runs from the same stream
+    std::shared_ptr<BufferIdTable> table;
     for (size_t i = 0; i < num_buffers; i++) {
         hBufs[i].streamId =
                 static_cast<Camera3Stream*>(buffers[i]->stream)->mId;
         hBufs[i].buffer = nullptr; // use bufferId
-        hBufs[i].bufferId = popBufferId(*(buffers[i]->buffer), hBufs[i].streamId);
+        if (i == 0 || hBufs[i].streamId != hBufs[i - 1].streamId) {
+            table = getBufferIdTable(hBufs[i].streamId);
+        }
+        hBufs[i].bufferId = (table == nullptr) ? BUFFER_ID_NO_BUFFER :
+                popBufferId(table.get(), *(buffers[i]->buffer));
         if (hBufs[i].bufferId == BUFFER_ID_NO_BUFFER) {
             ALOGE("%s: unknown buffer is returned to stream %d",
                     __FUNCTION__, hBufs[i].streamId);
@@ -21,7 +21,9 @@
 #include <android/hardware/camera/device/3.5/ICameraDeviceSession.h>
 #include <android/hardware/camera/device/3.5/ICameraDeviceCallback.h>
 #include <../../3.4/default/include/device_v3_4_impl/CameraDeviceSession.h>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 namespace android {
 namespace hardware {
@@ -112,20 +114,6 @@ protected:
             uint32_t num_buffers,
             const camera3_stream_buffer_t* const* buffers);
 
-    struct BufferHasher {
-        size_t operator()(const buffer_handle_t& buf) const {
-            if (buf == nullptr)
-                return 0;
-
-            size_t result = 1;
-            result = 31 * result + buf->numFds;
-            for (int i = 0; i < buf->numFds; i++) {
-                result = 31 * result + buf->data[i];
-            }
-            return result;
-        }
-    };
-
     struct BufferComparator {
         bool operator()(const buffer_handle_t& buf1, const buffer_handle_t& buf2) const {
             if (buf1->numFds == buf2->numFds) {
@@ -140,14 +128,44 @@ protected:
         }
     };
 
-    Camera3Stream* getStreamPointer(int32_t streamId);
+    // Fill in the stream of every returned buffer request. Returns that answer the request
+    // at the same index reuse its stream; the others are looked up together under a single
+    // lock. Returns false if any stream is unknown.
+    bool getStreamPointers(const camera3_buffer_request_t* buffer_reqs,
+            const hidl_vec<StreamBufferRet>& bufRets,
+            /*out*/camera3_stream_buffer_ret_t* returned_buf_reqs);
+
+    // Buffer IDs of the buffers a stream got through requestStreamBuffers and has not
+    // returned yet. A stream never holds more than its max_buffers of them, so they are
+    // kept in a flat array that is sized once and searched linearly.
+    struct BufferIdTable {
+        typedef std::vector<std::pair<buffer_handle_t, uint64_t>> Entries;
+        std::mutex lock; // protecting entries
+        Entries entries;
+
+        // Find buf in entries, with lock held by the caller
+        Entries::iterator find(const buffer_handle_t& buf);
+    };
+
+    // Returns the buffer ID table of a stream, or nullptr if the stream has never been
+    // given a buffer. Does not take mBufferIdMapLock.
+    std::shared_ptr<BufferIdTable> getBufferIdTable(int streamId);
+
+    // Same as getBufferIdTable, but creates the table if needed, reserving capacity entries
+    std::shared_ptr<BufferIdTable> getOrCreateBufferIdTable(int streamId, size_t capacity);
+
+    // Drop the empty tables of streams that are no longer configured. Must only be called
+    // from configureStreams, when the HAL cannot be requesting buffers of removed streams.
+    void pruneBufferIdTables();
 
-    // Register buffer to mBufferIdMaps so we can find corresponding bufferId
+    // Register buffer to its stream's BufferIdTable so we can find corresponding bufferId
     // when the buffer is returned to camera service
-    void pushBufferId(const buffer_handle_t& buf, uint64_t bufferId, int streamId);
+    static void pushBufferId(BufferIdTable* table, const buffer_handle_t& buf,
+            uint64_t bufferId);
 
-    // Method to pop buffer's bufferId from mBufferIdMaps
+    // Method to pop buffer's bufferId from its stream's BufferIdTable
     // BUFFER_ID_NO_BUFFER is returned if no matching buffer is found
+    static uint64_t popBufferId(BufferIdTable* table, const buffer_handle_t& buf);
     uint64_t popBufferId(const buffer_handle_t& buf, int streamId);
 
     // Method to cleanup imported buffer/fences if requestStreamBuffers fails half way
@@ -157,13 +175,13 @@ protected:
     // Overrides the default constructCaptureResult behavior for buffer management APIs
     virtual uint64_t getCapResultBufferId(const buffer_handle_t& buf, int streamId) override;
 
-    std::mutex mBufferIdMapLock; // protecting mBufferIdMaps and mNextBufferId
-    typedef std::unordered_map<const buffer_handle_t, uint64_t,
-            BufferHasher, BufferComparator> BufferIdMap;
-    // stream ID -> per stream buffer ID map for buffers coming from requestStreamBuffers API
-    // Entries are created during requestStreamBuffers when a stream first request a buffer, and
-    // deleted in returnStreamBuffers/processCaptureResult* when all buffers are returned
-    std::unordered_map<int, BufferIdMap> mBufferIdMaps;
+    typedef std::unordered_map<int, std::shared_ptr<BufferIdTable>> BufferIdTables;
+    std::mutex mBufferIdMapLock; // serializing updates of mBufferIdTables
+    // stream ID -> per stream buffer ID table for buffers coming from requestStreamBuffers API.
+    // A table is created when its stream first requests a buffer. The map itself is never
+    // modified: updates publish a new copy with std::atomic_store, so that lookups from
+    // processCaptureResult* and returnStreamBuffers only need an std::atomic_load.
+    std::shared_ptr<const BufferIdTables> mBufferIdTables;
 
     sp<ICameraDeviceCallback> mCallback_3_5;
     bool mSupportBufMgr;
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Drives the HAL buffer management callbacks (request_stream_buffers and
+ * return_stream_buffers) of a session the way a HAL does, against a fake
+ * camera3 device and an in-process camera service callback. Every buffer ID
+ * the fake service hands out is already in the session's buffer cache, so the
+ * numbers cover the session's own bookkeeping: stream lookup, buffer import,
+ * and buffer ID tracking.
+ */
+
+#include <benchmark/benchmark.h>
+#include <cutils/native_handle.h>
+#include <system/camera_metadata.h>
+
+#include <atomic>
+#include <vector>
+
+#include "CameraDeviceSession.h"
+
+using ::android::Mutex;
+using ::android::sp;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::camera::device::V3_2::BufferStatus;
+using ::android::hardware::camera::device::V3_2::NotifyMsg;
+using ::android::hardware::camera::device::V3_2::StreamBuffer;
+using ::android::hardware::camera::device::V3_2::implementation::Camera3Stream;
+using ::android::hardware::camera::device::V3_5::BufferRequest;
+using ::android::hardware::camera::device::V3_5::BufferRequestStatus;
+using ::android::hardware::camera::device::V3_5::ICameraDeviceCallback;
+using ::android::hardware::camera::device::V3_5::StreamBufferRet;
+using ::android::hardware::camera::device::V3_5::implementation::CameraDeviceSession;
+
+namespace V3_2 = ::android::hardware::camera::device::V3_2;
+namespace V3_4 = ::android::hardware::camera::device::V3_4;
+
+namespace {
+
+constexpr int kMaxStreams = 8;
+constexpr uint32_t kBuffersPerStream = 8;
+
+// Hands out the buffers of each stream round robin, by buffer ID only.
+class FakeCallback : public ICameraDeviceCallback {
+  public:
+    Return<void> processCaptureResult(const hidl_vec<V3_2::CaptureResult>&) override {
+        return Void();
+    }
+
+    Return<void> processCaptureResult_3_4(const hidl_vec<V3_4::CaptureResult>&) override {
+        return Void();
+    }
+
+    Return<void> notify(const hidl_vec<NotifyMsg>&) override { return Void(); }
+
+    Return<void> requestStreamBuffers(const hidl_vec<BufferRequest>& bufReqs,
+                                      requestStreamBuffers_cb _hidl_cb) override {
+        hidl_vec<StreamBufferRet> bufRets(bufReqs.size());
+        for (size_t i = 0; i < bufReqs.size(); i++) {
+            int32_t streamId = bufReqs[i].streamId;
+            hidl_vec<StreamBuffer> buffers(bufReqs[i].numBuffersRequested);
+            for (auto& buffer : buffers) {
+                uint32_t slot = mNextSlot[streamId]++ % kBuffersPerStream;
+                buffer.streamId = streamId;
+                buffer.bufferId = bufferId(streamId, slot);
+                buffer.buffer = nullptr;
+                buffer.status = BufferStatus::OK;
+            }
+            bufRets[i].streamId = streamId;
+            bufRets[i].val.buffers(std::move(buffers));
+        }
+        _hidl_cb(BufferRequestStatus::OK, bufRets);
+        return Void();
+    }
+
+    Return<void> returnStreamBuffers(const hidl_vec<StreamBuffer>&) override { return Void(); }
+
+    static uint64_t bufferId(int streamId, uint32_t slot) {
+        // 0 is BUFFER_ID_NO_BUFFER
+        return streamId * kBuffersPerStream + slot + 1;
+    }
+
+  private:
+    std::atomic<uint32_t> mNextSlot[kMaxStreams] = {};
+};
+
+int fakeInitialize(const camera3_device_t*, const camera3_callback_ops_t*) {
+    return 0;
+}
+
+int fakeClose(hw_device_t*) {
+    return 0;
+}
+
+// A session with kMaxStreams configured streams whose buffers are all cached.
+class BenchmarkSession : public CameraDeviceSession {
+  public:
+    BenchmarkSession(camera3_device_t* device, const camera_metadata_t* deviceInfo)
+        : CameraDeviceSession(device, deviceInfo, new FakeCallback()) {
+        Mutex::Autolock _l(mInflightLock);
+        for (int streamId = 0; streamId < kMaxStreams; streamId++) {
+            Camera3Stream& stream = mStreamMap[streamId];
+            stream.mId = streamId;
+            stream.max_buffers = kBuffersPerStream;
+            for (uint32_t slot = 0; slot < kBuffersPerStream; slot++) {
+                native_handle_t* handle = native_handle_create(/*numFds*/ 1, /*numInts*/ 0);
+                // Never used as an actual fd, only to tell the handles apart.
+                handle->data[0] = static_cast<int>(FakeCallback::bufferId(streamId, slot));
+                mCirculatingBuffers[streamId][FakeCallback::bufferId(streamId, slot)] = handle;
+            }
+        }
+    }
+
+    ~BenchmarkSession() {
+        // The handles were never imported, so they must not be freed by close().
+        Mutex::Autolock _l(mInflightLock);
+        for (auto& pair : mCirculatingBuffers) {
+            for (auto& buffer : pair.second) {
+                native_handle_delete(const_cast<native_handle_t*>(buffer.second));
+            }
+        }
+        mCirculatingBuffers.clear();
+    }
+
+    bool supportsBufferManagement() const { return mSupportBufMgr; }
+
+    Camera3Stream* stream(int streamId) { return &mStreamMap[streamId]; }
+
+    // Requests numBuffers buffers of each of the numStreams streams starting at
+    // firstStream in one call, then returns them all in one call.
+    bool requestAndReturn(int firstStream, int numStreams, uint32_t numBuffers) {
+        std::vector<camera3_buffer_request_t> bufReqs(numStreams);
+        std::vector<camera3_stream_buffer_ret_t> bufRets(numStreams);
+        std::vector<camera3_stream_buffer_t> buffers(numStreams * numBuffers);
+        for (int i = 0; i < numStreams; i++) {
+            bufReqs[i].stream = stream(firstStream + i);
+            bufReqs[i].num_buffers_requested = numBuffers;
+            bufRets[i].output_buffers = &buffers[i * numBuffers];
+        }
+
+        uint32_t numBufRets = 0;
+        auto status = request_stream_buffers(this, numStreams, bufReqs.data(), &numBufRets,
+                                             bufRets.data());
+        if (status != CAMERA3_BUF_REQ_OK) {
+            return false;
+        }
+
+        std::vector<const camera3_stream_buffer_t*> returned;
+        returned.reserve(buffers.size());
+        for (const auto& buffer : buffers) {
+            returned.push_back(&buffer);
+        }
+        return_stream_buffers(this, returned.size(), returned.data());
+        return true;
+    }
+};
+
+// Shared by all benchmarks, so that the threaded ones run against one session.
+BenchmarkSession* getSession() {
+    static camera3_device_ops_t sOps = [] {
+        camera3_device_ops_t ops = {};
+        ops.initialize = fakeInitialize;
+        return ops;
+    }();
+    static camera3_device_t sDevice = [] {
+        camera3_device_t device = {};
+        device.common.version = CAMERA_DEVICE_API_VERSION_3_5;
+        device.common.close = fakeClose;
+        device.ops = &sOps;
+        return device;
+    }();
+    static sp<BenchmarkSession> sSession = [] {
+        camera_metadata_t* deviceInfo = allocate_camera_metadata(1, 1);
+        uint8_t bufMgrVersion = ANDROID_INFO_SUPPORTED_BUFFER_MANAGEMENT_VERSION_HIDL_DEVICE_3_5;
+        add_camera_metadata_entry(deviceInfo, ANDROID_INFO_SUPPORTED_BUFFER_MANAGEMENT_VERSION,
+                                  &bufMgrVersion, 1);
+        sp<BenchmarkSession> session = new BenchmarkSession(&sDevice, deviceInfo);
+        free_camera_metadata(deviceInfo);
+        return session;
+    }();
+    return sSession->supportsBufferManagement() ? sSession.get() : nullptr;
+}
+
+// One buffer of each of state.range(0) streams per call, as a HAL does per frame.
+void BM_RequestReturn(benchmark::State& state) {
+    BenchmarkSession* session = getSession();
+    if (session == nullptr) {
+        state.SkipWithError("buffer management is not enabled");
+        return;
+    }
+    for (auto _ : state) {
+        if (!session->requestAndReturn(0, state.range(0), 1)) {
+            state.SkipWithError("requestStreamBuffers failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Every thread requests and returns state.range(0) buffers of its own stream.
+void BM_RequestReturnPerThread(benchmark::State& state) {
+    BenchmarkSession* session = getSession();
+    if (session == nullptr) {
+        state.SkipWithError("buffer management is not enabled");
+        return;
+    }
+    for (auto _ : state) {
+        if (!session->requestAndReturn(state.thread_index, 1, state.range(0))) {
+            state.SkipWithError("requestStreamBuffers failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+}  // namespace
+
+BENCHMARK(BM_RequestReturn)->Arg(1)->Arg(3)->Arg(kMaxStreams);
+BENCHMARK(BM_RequestReturnPerThread)->Arg(1)->Arg(kBuffersPerStream)->ThreadRange(1, 4);
+
+BENCHMARK_MAIN();
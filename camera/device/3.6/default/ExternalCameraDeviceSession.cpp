@@ -281,10 +281,8 @@ Status ExternalCameraDeviceSession::switchToOffline(const hidl_vec<int32_t>& off
         offlineReqs[i]->buffers = v4lReq->buffers;
         sp<V3_4::implementation::V4L2Frame> v4l2Frame =
                 static_cast<V3_4::implementation::V4L2Frame*>(v4lReq->frameIn.get());
-        offlineReqs[i]->frameIn = new AllocatedV4L2Frame(v4l2Frame);
+        offlineReqs[i]->frameIn = handOffV4l2Frame(v4l2Frame);
         i++;
-        // enqueue V4L2 frame
-        enqueueV4l2Frame(v4l2Frame);
     }
 
     // Collect buffer caches/streams
@@ -28,8 +28,10 @@ extern "C" {
 #include <android-base/memory.h>
 #include <gatekeeper/gatekeeper.h>
 
+#include <array>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 
 namespace gatekeeper {
@@ -39,6 +41,47 @@ struct fast_hash_t {
     uint8_t digest[SHA256_DIGEST_LENGTH];
 };
 
+// An unordered_map split into shards with a lock each, so that lookups of different keys
+// rarely contend. Values are copied in and out; nothing is computed under a shard lock.
+template <typename Key, typename Value>
+class ShardedMap {
+  public:
+    bool Get(Key key, Value* value) {
+        Shard& shard = ShardOf(key);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end()) return false;
+        *value = it->second;
+        return true;
+    }
+
+    void Put(Key key, const Value& value) {
+        Shard& shard = ShardOf(key);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        shard.map[key] = value;
+    }
+
+    // Runs update on the value of key, default constructing it if needed.
+    template <typename F>
+    void Update(Key key, F update) {
+        Shard& shard = ShardOf(key);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        update(&shard.map[key]);
+    }
+
+  private:
+    static const size_t kShardCount = 16;
+
+    struct Shard {
+        std::mutex lock;
+        std::unordered_map<Key, Value> map;
+    };
+
+    Shard& ShardOf(Key key) { return shards_[std::hash<Key>()(key) % kShardCount]; }
+
+    std::array<Shard, kShardCount> shards_;
+};
+
 class SoftGateKeeper : public GateKeeper {
   public:
     static const uint32_t SIGNATURE_LENGTH_BYTES = 32;
@@ -57,6 +100,19 @@ class SoftGateKeeper : public GateKeeper {
 
     virtual ~SoftGateKeeper() {}
 
+    // GateKeeper::Enroll and GateKeeper::Verify read, check and rewrite the failure record of
+    // a uid in several steps, so calls for one uid are serialized. Calls for different uids,
+    // including their scrypt, run in parallel.
+    void Enroll(const EnrollRequest& request, EnrollResponse* response) {
+        std::lock_guard<std::mutex> lock(UidLock(request.user_id));
+        GateKeeper::Enroll(request, response);
+    }
+
+    void Verify(const VerifyRequest& request, VerifyResponse* response) {
+        std::lock_guard<std::mutex> lock(UidLock(request.user_id));
+        GateKeeper::Verify(request, response);
+    }
+
     virtual bool GetAuthTokenKey(const uint8_t** auth_token_key, uint32_t* length) const {
         if (auth_token_key == NULL || length == NULL) return false;
         *auth_token_key = key_.get();
@@ -100,26 +156,28 @@ class SoftGateKeeper : public GateKeeper {
 
     virtual bool GetFailureRecord(uint32_t uid, secure_id_t user_id, failure_record_t* record,
                                   bool /* secure */) {
-        failure_record_t* stored = &failure_map_[uid];
-        if (user_id != stored->secure_user_id) {
-            stored->secure_user_id = user_id;
-            stored->last_checked_timestamp = 0;
-            stored->failure_counter = 0;
-        }
-        memcpy(record, stored, sizeof(*record));
+        failure_map_.Update(uid, [&](failure_record_t* stored) {
+            if (user_id != stored->secure_user_id) {
+                stored->secure_user_id = user_id;
+                stored->last_checked_timestamp = 0;
+                stored->failure_counter = 0;
+            }
+            memcpy(record, stored, sizeof(*record));
+        });
         return true;
     }
 
     virtual bool ClearFailureRecord(uint32_t uid, secure_id_t user_id, bool /* secure */) {
-        failure_record_t* stored = &failure_map_[uid];
-        stored->secure_user_id = user_id;
-        stored->last_checked_timestamp = 0;
-        stored->failure_counter = 0;
+        failure_map_.Update(uid, [&](failure_record_t* stored) {
+            stored->secure_user_id = user_id;
+            stored->last_checked_timestamp = 0;
+            stored->failure_counter = 0;
+        });
         return true;
     }
 
     virtual bool WriteFailureRecord(uint32_t uid, failure_record_t* record, bool /* secure */) {
-        failure_map_[uid] = *record;
+        failure_map_.Put(uid, *record);
         return true;
     }
 
@@ -143,14 +201,14 @@ class SoftGateKeeper : public GateKeeper {
 
     bool DoVerify(const password_handle_t* expected_handle, const SizedBuffer& password) {
         uint64_t user_id = android::base::get_unaligned<secure_id_t>(&expected_handle->user_id);
-        FastHashMap::const_iterator it = fast_hash_map_.find(user_id);
-        if (it != fast_hash_map_.end() && VerifyFast(it->second, password)) {
+        fast_hash_t fast_hash;
+        if (fast_hash_map_.Get(user_id, &fast_hash) && VerifyFast(fast_hash, password)) {
             return true;
         } else {
             if (GateKeeper::DoVerify(expected_handle, password)) {
                 uint64_t salt;
                 GetRandom(&salt, sizeof(salt));
-                fast_hash_map_[user_id] = ComputeFastHash(password, salt);
+                fast_hash_map_.Put(user_id, ComputeFastHash(password, salt));
                 return true;
             }
         }
@@ -159,12 +217,22 @@ class SoftGateKeeper : public GateKeeper {
     }
 
   private:
-    typedef std::unordered_map<uint32_t, failure_record_t> FailureRecordMap;
-    typedef std::unordered_map<uint64_t, fast_hash_t> FastHashMap;
+    typedef ShardedMap<uint32_t, failure_record_t> FailureRecordMap;
+    typedef ShardedMap<uint64_t, fast_hash_t> FastHashMap;
+
+    std::mutex& UidLock(uint32_t uid) {
+        std::lock_guard<std::mutex> lock(uid_locks_lock_);
+        std::unique_ptr<std::mutex>& uid_lock = uid_locks_[uid];
+        if (!uid_lock) uid_lock.reset(new std::mutex());
+        return *uid_lock;
+    }
 
     std::unique_ptr<uint8_t[]> key_;
     FailureRecordMap failure_map_;
     FastHashMap fast_hash_map_;
+
+    std::mutex uid_locks_lock_;
+    std::unordered_map<uint32_t, std::unique_ptr<std::mutex>> uid_locks_;
 };
 }  // namespace gatekeeper
 
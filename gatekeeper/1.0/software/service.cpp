@@ -27,7 +27,8 @@ using android::SoftGateKeeperDevice;
 using android::hardware::gatekeeper::V1_0::IGatekeeper;
 
 int main() {
-    ::android::hardware::configureRpcThreadpool(1, true /* willJoinThreadpool */);
+    // SoftGateKeeper serves different users in parallel.
+    ::android::hardware::configureRpcThreadpool(4, true /* willJoinThreadpool */);
     android::sp<SoftGateKeeperDevice> gatekeeper(new SoftGateKeeperDevice());
     auto status = gatekeeper->registerAsService();
     if (status != android::OK) {
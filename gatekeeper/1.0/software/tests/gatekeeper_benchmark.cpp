@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "../SoftGateKeeper.h"
+
+using ::gatekeeper::EnrollRequest;
+using ::gatekeeper::EnrollResponse;
+using ::gatekeeper::SizedBuffer;
+using ::gatekeeper::SoftGateKeeper;
+using ::gatekeeper::VerifyRequest;
+using ::gatekeeper::VerifyResponse;
+
+static SizedBuffer makePasswordBuffer(int init) {
+    constexpr const uint32_t pw_buffer_size = 16;
+    auto pw_buffer = new uint8_t[pw_buffer_size];
+    memset(pw_buffer, init, pw_buffer_size);
+    return {pw_buffer, pw_buffer_size};
+}
+
+static SizedBuffer copySizedBuffer(const SizedBuffer& rhs) {
+    auto buffer = new uint8_t[rhs.size()];
+    memcpy(buffer, rhs.Data<uint8_t>(), rhs.size());
+    return {buffer, rhs.size()};
+}
+
+// One instance shared by all threads, like the one behind the HAL service. Each benchmark
+// uses its own range of uids.
+static SoftGateKeeper& gateKeeper() {
+    static SoftGateKeeper* gatekeeper = new SoftGateKeeper();
+    return *gatekeeper;
+}
+
+// Every enroll runs scrypt; each thread is a different user.
+static void BM_Enroll(benchmark::State& state) {
+    uint32_t uid = state.thread_index;
+    for (auto _ : state) {
+        EnrollRequest request(uid, {}, makePasswordBuffer(uid), {});
+        EnrollResponse response;
+        gateKeeper().Enroll(request, &response);
+        if (response.error != ::gatekeeper::ERROR_NONE) {
+            state.SkipWithError("enroll failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// A wrong password misses the fast hash and always runs scrypt.
+static void BM_VerifySlow(benchmark::State& state) {
+    uint32_t uid = 100 + state.thread_index;
+    EnrollRequest enroll_request(uid, {}, makePasswordBuffer(uid), {});
+    EnrollResponse enroll_response;
+    gateKeeper().Enroll(enroll_request, &enroll_response);
+
+    for (auto _ : state) {
+        VerifyRequest request(uid, 0, copySizedBuffer(enroll_response.enrolled_password_handle),
+                              makePasswordBuffer(uid + 1));
+        VerifyResponse response;
+        gateKeeper().Verify(request, &response);
+        // Keep the failure record from throttling the next attempt.
+        gateKeeper().ClearFailureRecord(uid, 0, false);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_VerifyFast(benchmark::State& state) {
+    uint32_t uid = 200 + state.thread_index;
+    EnrollRequest enroll_request(uid, {}, makePasswordBuffer(uid), {});
+    EnrollResponse enroll_response;
+    gateKeeper().Enroll(enroll_request, &enroll_response);
+
+    for (auto _ : state) {
+        VerifyRequest request(uid, 0, copySizedBuffer(enroll_response.enrolled_password_handle),
+                              makePasswordBuffer(uid));
+        VerifyResponse response;
+        gateKeeper().Verify(request, &response);
+        if (response.error != ::gatekeeper::ERROR_NONE) {
+            state.SkipWithError("verify failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+#define BENCHMARK_GATEKEEPER(func) BENCHMARK(func)->ThreadRange(1, 8)->UseRealTime()
+
+BENCHMARK_GATEKEEPER(BM_Enroll);
+BENCHMARK_GATEKEEPER(BM_VerifySlow);
+BENCHMARK_GATEKEEPER(BM_VerifyFast);
+
+BENCHMARK_MAIN();
@@ -15,7 +15,13 @@
  */
 
 #include <arpa/inet.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <hardware/hw_auth_token.h>
@@ -24,6 +30,9 @@
 
 using ::gatekeeper::EnrollRequest;
 using ::gatekeeper::EnrollResponse;
+using ::gatekeeper::failure_record_t;
+using ::gatekeeper::password_handle_t;
+using ::gatekeeper::salt_t;
 using ::gatekeeper::secure_id_t;
 using ::gatekeeper::SizedBuffer;
 using ::gatekeeper::SoftGateKeeper;
@@ -176,3 +185,113 @@ TEST(GateKeeperTest, VerifyBogusData) {
 
     ASSERT_EQ(::gatekeeper::gatekeeper_error_t::ERROR_INVALID, response.error);
 }
+
+// Records how many scrypt computations overlap. Each one waits a little for a peer, so that
+// calls which may run in parallel reliably do.
+class OverlapTrackingGateKeeper : public SoftGateKeeper {
+  public:
+    void ComputePasswordSignature(uint8_t* signature, uint32_t signature_length,
+                                  const uint8_t* key, uint32_t key_length,
+                                  const uint8_t* password, uint32_t password_length,
+                                  salt_t salt) const override {
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            max_in_flight_ = std::max(max_in_flight_, ++in_flight_);
+            cond_.notify_all();
+            cond_.wait_for(lock, std::chrono::milliseconds(200), [this] { return in_flight_ > 1; });
+        }
+        SoftGateKeeper::ComputePasswordSignature(signature, signature_length, key, key_length,
+                                                 password, password_length, salt);
+        std::lock_guard<std::mutex> lock(lock_);
+        --in_flight_;
+    }
+
+    int TakeMaxInFlight() {
+        std::lock_guard<std::mutex> lock(lock_);
+        int max_in_flight = max_in_flight_;
+        max_in_flight_ = 0;
+        return max_in_flight;
+    }
+
+  private:
+    mutable std::mutex lock_;
+    mutable std::condition_variable cond_;
+    mutable int in_flight_ = 0;
+    mutable int max_in_flight_ = 0;
+};
+
+static constexpr int kThreadCount = 4;
+
+TEST(GateKeeperTest, ConcurrentEnrollDifferentUsersRunInParallel) {
+    OverlapTrackingGateKeeper gatekeeper;
+    std::vector<std::thread> threads;
+    std::vector<EnrollResponse> responses(kThreadCount);
+
+    for (uint32_t uid = 0; uid < kThreadCount; ++uid) {
+        threads.emplace_back([&, uid] {
+            EnrollRequest request(uid, {}, makePasswordBuffer(uid), {});
+            gatekeeper.Enroll(request, &responses[uid]);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    for (const auto& response : responses) {
+        ASSERT_EQ(::gatekeeper::gatekeeper_error_t::ERROR_NONE, response.error);
+    }
+    EXPECT_GT(gatekeeper.TakeMaxInFlight(), 1);
+}
+
+TEST(GateKeeperTest, ConcurrentVerifySameUserKeepsFailureCount) {
+    OverlapTrackingGateKeeper gatekeeper;
+    EnrollResponse enroll_response;
+    do_enroll(gatekeeper, &enroll_response);
+    ASSERT_EQ(::gatekeeper::gatekeeper_error_t::ERROR_NONE, enroll_response.error);
+    gatekeeper.TakeMaxInFlight();
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreadCount; ++i) {
+        threads.emplace_back([&] {
+            VerifyRequest request(0, 0, copySizedBuffer(enroll_response.enrolled_password_handle),
+                                  makePasswordBuffer(1) /* wrong password */);
+            VerifyResponse response;
+            gatekeeper.Verify(request, &response);
+            EXPECT_EQ(::gatekeeper::gatekeeper_error_t::ERROR_INVALID, response.error);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    // Serialized per uid: no failure is lost to a racing read-modify-write.
+    EXPECT_EQ(1, gatekeeper.TakeMaxInFlight());
+    secure_id_t secure_id =
+            enroll_response.enrolled_password_handle.Data<password_handle_t>()->user_id;
+    failure_record_t record;
+    ASSERT_TRUE(gatekeeper.GetFailureRecord(0, secure_id, &record, false));
+    EXPECT_EQ(static_cast<uint32_t>(kThreadCount), record.failure_counter);
+}
+
+TEST(GateKeeperTest, ConcurrentFastVerify) {
+    SoftGateKeeper gatekeeper;
+    std::vector<SizedBuffer> handles;
+    for (uint32_t uid = 0; uid < kThreadCount; ++uid) {
+        EnrollResponse enroll_response;
+        EnrollRequest enroll_request(uid, {}, makePasswordBuffer(uid), {});
+        gatekeeper.Enroll(enroll_request, &enroll_response);
+        ASSERT_EQ(::gatekeeper::gatekeeper_error_t::ERROR_NONE, enroll_response.error);
+        handles.push_back(std::move(enroll_response.enrolled_password_handle));
+    }
+
+    std::vector<std::thread> threads;
+    for (uint32_t uid = 0; uid < kThreadCount; ++uid) {
+        threads.emplace_back([&, uid] {
+            // The first verify goes through scrypt, the others hit the fast hash.
+            for (int i = 0; i < 100; ++i) {
+                VerifyRequest request(uid, i, copySizedBuffer(handles[uid]),
+                                      makePasswordBuffer(uid));
+                VerifyResponse response;
+                gatekeeper.Verify(request, &response);
+                ASSERT_EQ(::gatekeeper::gatekeeper_error_t::ERROR_NONE, response.error);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+}
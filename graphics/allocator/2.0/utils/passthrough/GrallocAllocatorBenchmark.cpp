@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GrallocAllocatorBenchmark"
+
+/*
+ * Allocates buffers through the passthrough allocator on top of a gralloc0
+ * module whose allocations take kAllocationTime, the way reconfiguring a few
+ * surfaces or camera streams allocates the same descriptors over and over.
+ * The time measured is what the client waits for, up to the allocate
+ * callback; the spare buffers are allocated after it.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include <allocator-passthrough/2.0/GrallocLoader.h>
+
+using android::hardware::hidl_handle;
+using android::hardware::hidl_vec;
+using android::hardware::graphics::allocator::V2_0::passthrough::Gralloc0Hal;
+using android::hardware::graphics::allocator::V2_0::passthrough::GrallocBufferPool;
+using android::hardware::graphics::common::V1_0::BufferUsage;
+using android::hardware::graphics::common::V1_0::PixelFormat;
+using android::hardware::graphics::mapper::V2_0::BufferDescriptor;
+using android::hardware::graphics::mapper::V2_0::Error;
+using android::hardware::graphics::mapper::V2_0::IMapper;
+using android::hardware::graphics::mapper::V2_0::passthrough::grallocEncodeBufferDescriptor;
+using Allocator = android::hardware::graphics::allocator::V2_0::hal::Allocator;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// about what an ION allocation of a 1080p buffer takes
+constexpr auto kAllocationTime = std::chrono::microseconds(200);
+constexpr uint32_t kBuffersPerStream = 4;
+
+std::atomic<int64_t> sModuleAllocations(0);
+
+int stubAlloc(alloc_device_t*, int, int, int, int, buffer_handle_t* handle, int* stride) {
+    std::this_thread::sleep_for(kAllocationTime);
+    sModuleAllocations++;
+    *handle = native_handle_create(0 /* numFds */, 1 /* numInts */);
+    *stride = 1920;
+    return 0;
+}
+
+int stubFree(alloc_device_t*, buffer_handle_t handle) {
+    return native_handle_delete(const_cast<native_handle_t*>(handle));
+}
+
+int stubClose(hw_device_t*) {
+    return 0;
+}
+
+int stubOpen(const hw_module_t* module, const char*, hw_device_t** device) {
+    static alloc_device_t sDevice = {};
+    sDevice.common.tag = HARDWARE_DEVICE_TAG;
+    sDevice.common.module = const_cast<hw_module_t*>(module);
+    sDevice.common.close = stubClose;
+    sDevice.alloc = stubAlloc;
+    sDevice.free = stubFree;
+    *device = &sDevice.common;
+    return 0;
+}
+
+hw_module_methods_t sMethods = {.open = stubOpen};
+
+gralloc_module_t makeStubModule() {
+    gralloc_module_t module = {};
+    module.common.tag = HARDWARE_MODULE_TAG;
+    module.common.module_api_version = GRALLOC_MODULE_API_VERSION_0_2;
+    module.common.hal_api_version = HARDWARE_HAL_API_VERSION;
+    module.common.id = GRALLOC_HARDWARE_MODULE_ID;
+    module.common.name = "gralloc0 stub";
+    module.common.methods = &sMethods;
+    return module;
+}
+
+// outPool is set to the buffer pool of the allocator when it is not null
+std::unique_ptr<Allocator> createAllocator(size_t poolMaxBuffers, uint32_t maxParallelAllocations,
+                                           const GrallocBufferPool** outPool = nullptr) {
+    static const gralloc_module_t sModule = makeStubModule();
+    auto hal = std::make_unique<Gralloc0Hal>();
+    if (!hal->initWithModule(&sModule.common)) {
+        return nullptr;
+    }
+    if (outPool) {
+        *outPool = &hal->getBufferPool();
+    }
+
+    GrallocBufferPool::Options options;
+    options.maxBuffers = poolMaxBuffers;
+    hal->setBufferPoolOptions(options);
+    hal->setMaxParallelAllocations(maxParallelAllocations);
+
+    auto allocator = std::make_unique<Allocator>();
+    allocator->init(std::move(hal));
+    return allocator;
+}
+
+// a 1080p stream, told apart from the others by its format
+BufferDescriptor streamDescriptor(uint32_t stream) {
+    IMapper::BufferDescriptorInfo info = {};
+    info.width = 1920;
+    info.height = 1080;
+    info.layerCount = 1;
+    info.format = static_cast<PixelFormat>(static_cast<int32_t>(PixelFormat::RGBA_8888) + stream);
+    info.usage = static_cast<uint64_t>(BufferUsage::GPU_TEXTURE);
+    return grallocEncodeBufferDescriptor(info);
+}
+
+// Return how long the client waited for count buffers, or a negative time on
+// errors.
+double allocate(Allocator* allocator, const BufferDescriptor& descriptor, uint32_t count) {
+    Clock::time_point start = Clock::now();
+    Clock::time_point end;
+    Error result = Error::NO_RESOURCES;
+    allocator->allocate(descriptor, count,
+                        [&](Error error, uint32_t, const hidl_vec<hidl_handle>& buffers) {
+                            end = Clock::now();
+                            result = buffers.size() == count ? error : Error::NO_RESOURCES;
+                        });
+    if (result != Error::NONE) {
+        return -1.0;
+    }
+    return std::chrono::duration<double>(end - start).count();
+}
+
+// Reconfigures state.range(1) streams of kBuffersPerStream buffers in turn,
+// with a pool of state.range(0) buffers.  module_allocs includes the spare
+// buffers allocated after the client got its buffers.
+void BM_Reconfigure(benchmark::State& state) {
+    const GrallocBufferPool* pool = nullptr;
+    std::unique_ptr<Allocator> allocator = createAllocator(state.range(0), 1, &pool);
+    const uint32_t numStreams = state.range(1);
+    std::vector<BufferDescriptor> descriptors;
+    for (uint32_t stream = 0; stream < numStreams; stream++) {
+        descriptors.push_back(streamDescriptor(stream));
+    }
+
+    const int64_t moduleAllocations = sModuleAllocations;
+    uint32_t stream = 0;
+    for (auto _ : state) {
+        double seconds = allocate(allocator.get(), descriptors[stream], kBuffersPerStream);
+        if (seconds < 0) {
+            state.SkipWithError("could not allocate the buffers");
+            break;
+        }
+        state.SetIterationTime(seconds);
+        stream = (stream + 1) % numStreams;
+    }
+
+    const double requested = state.iterations() * kBuffersPerStream;
+    state.counters["module_allocs"] = sModuleAllocations - moduleAllocations;
+    state.counters["pool_hits"] = pool->getHits();
+    state.counters["pool_misses"] = pool->getMisses();
+    state.counters["hit_rate"] = pool->getHits() / requested;
+    state.SetItemsProcessed(requested);
+}
+
+// Allocates state.range(1) buffers at once on up to state.range(0) threads,
+// without a pool.
+void BM_AllocateParallel(benchmark::State& state) {
+    std::unique_ptr<Allocator> allocator = createAllocator(0, state.range(0));
+    const BufferDescriptor descriptor = streamDescriptor(0);
+    for (auto _ : state) {
+        double seconds = allocate(allocator.get(), descriptor, state.range(1));
+        if (seconds < 0) {
+            state.SkipWithError("could not allocate the buffers");
+            break;
+        }
+        state.SetIterationTime(seconds);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+
+}  // namespace
+
+BENCHMARK(BM_Reconfigure)
+        ->ArgNames({"pool", "streams"})
+        ->Args({0, 1})
+        ->Args({0, 4})
+        ->Args({8, 1})
+        ->Args({8, 4})
+        ->Args({32, 4})
+        ->UseManualTime();
+BENCHMARK(BM_AllocateParallel)
+        ->ArgNames({"threads", "count"})
+        ->Args({1, 2})
+        ->Args({1, 8})
+        ->Args({4, 2})
+        ->Args({4, 8})
+        ->UseManualTime();
+
+BENCHMARK_MAIN();
@@ -20,9 +20,11 @@
 #warning "Gralloc0Hal.h included without LOG_TAG"
 #endif
 
+#include <algorithm>
 #include <cstring>  // for strerror
 
 #include <allocator-hal/2.0/AllocatorHal.h>
+#include <allocator-passthrough/2.0/GrallocBufferPool.h>
 #include <hardware/gralloc.h>
 #include <log/log.h>
 #include <mapper-passthrough/2.0/GrallocBufferDescriptor.h>
@@ -46,6 +48,8 @@ class Gralloc0HalImpl : public Hal {
    public:
     ~Gralloc0HalImpl() {
         if (mDevice) {
+            mBufferPool.stopTrimThread();
+            releaseBuffers(mBufferPool.clear());
             gralloc_close(mDevice);
         }
     }
@@ -61,6 +65,25 @@ class Gralloc0HalImpl : public Hal {
         return true;
     }
 
+    // keep spare buffers of recently allocated descriptors
+    void setBufferPoolOptions(const GrallocBufferPool::Options& options) {
+        mBufferPool.setOptions(options);
+        if (options.maxBuffers > 0) {
+            mBufferPool.startTrimThread(
+                    [this](const std::vector<const native_handle_t*>& buffers) {
+                        releaseBuffers(buffers);
+                    });
+        }
+    }
+
+    const GrallocBufferPool& getBufferPool() const { return mBufferPool; }
+
+    // allocate the buffers of a descriptor on up to maxThreads threads, for
+    // modules that can allocate concurrently
+    void setMaxParallelAllocations(uint32_t maxThreads) {
+        mMaxParallelAllocations = std::max(maxThreads, 1u);
+    }
+
     std::string dumpDebugInfo() override {
         char buf[4096] = {};
         if (mDevice->dump) {
@@ -68,7 +91,7 @@ class Gralloc0HalImpl : public Hal {
             buf[sizeof(buf) - 1] = '\0';
         }
 
-        return buf;
+        return buf + mBufferPool.dump();
     }
 
     Error allocateBuffers(const BufferDescriptor& descriptor, uint32_t count, uint32_t* outStride,
@@ -78,36 +101,23 @@ class Gralloc0HalImpl : public Hal {
             return Error::BAD_DESCRIPTOR;
         }
 
-        Error error = Error::NONE;
         uint32_t stride = 0;
         std::vector<const native_handle_t*> buffers;
         buffers.reserve(count);
+        mBufferPool.take(descriptor, count, &stride, &buffers);
 
-        // allocate the buffers
-        for (uint32_t i = 0; i < count; i++) {
-            const native_handle_t* tmpBuffer;
-            uint32_t tmpStride;
-            error = allocateOneBuffer(descriptorInfo, &tmpBuffer, &tmpStride);
-            if (error != Error::NONE) {
-                break;
-            }
-
-            buffers.push_back(tmpBuffer);
-
-            if (stride == 0) {
-                stride = tmpStride;
-            } else if (stride != tmpStride) {
-                // non-uniform strides
-                error = Error::UNSUPPORTED;
-                break;
-            }
+        Error error = Error::NONE;
+        if (buffers.size() < count) {
+            error = allocateNewBuffers(descriptorInfo, count - buffers.size(), &stride, &buffers);
         }
 
         if (error != Error::NONE) {
-            freeBuffers(buffers);
+            releaseBuffers(buffers);
             return error;
         }
 
+        mBufferPool.handOut(descriptor, stride, buffers);
+
         *outStride = stride;
         *outBuffers = std::move(buffers);
 
@@ -115,15 +125,42 @@ class Gralloc0HalImpl : public Hal {
     }
 
     void freeBuffers(const std::vector<const native_handle_t*>& buffers) override {
-        for (auto buffer : buffers) {
-            int result = mDevice->free(mDevice, buffer);
-            if (result != 0) {
-                ALOGE("failed to free buffer %p: %d", buffer, result);
+        std::vector<const native_handle_t*> expired;
+        std::vector<GrallocBufferPool::Refill> refills;
+        mBufferPool.release(buffers, &expired, &refills);
+
+        releaseBuffers(buffers);
+        releaseBuffers(expired);
+
+        // this is called once the buffers were sent to the client
+        for (const auto& refill : refills) {
+            mapper::V2_0::IMapper::BufferDescriptorInfo descriptorInfo;
+            grallocDecodeBufferDescriptor(refill.descriptor, &descriptorInfo);
+
+            uint32_t stride = 0;
+            std::vector<const native_handle_t*> spares;
+            std::vector<const native_handle_t*> rejected;
+            if (allocateNewBuffers(descriptorInfo, refill.count, &stride, &spares) != Error::NONE) {
+                rejected = std::move(spares);
+                spares.clear();
             }
+            mBufferPool.put(refill, stride, spares, &rejected);
+            releaseBuffers(rejected);
         }
     }
 
    protected:
+    Error allocateNewBuffers(const mapper::V2_0::IMapper::BufferDescriptorInfo& info, uint32_t count,
+                             uint32_t* inOutStride,
+                             std::vector<const native_handle_t*>* inOutBuffers) {
+        return allocateBuffersInParallel(
+                count, mMaxParallelAllocations,
+                [&](const native_handle_t** outBuffer, uint32_t* outStride) {
+                    return allocateOneBuffer(info, outBuffer, outStride);
+                },
+                inOutStride, inOutBuffers);
+    }
+
     Error allocateOneBuffer(const mapper::V2_0::IMapper::BufferDescriptorInfo& info,
                             const native_handle_t** outBuffer, uint32_t* outStride) {
         if (info.layerCount > 1 || (info.usage >> 32) != 0) {
@@ -146,7 +183,18 @@ class Gralloc0HalImpl : public Hal {
         }
     }
 
+    void releaseBuffers(const std::vector<const native_handle_t*>& buffers) {
+        for (auto buffer : buffers) {
+            int result = mDevice->free(mDevice, buffer);
+            if (result != 0) {
+                ALOGE("failed to free buffer %p: %d", buffer, result);
+            }
+        }
+    }
+
     alloc_device_t* mDevice = nullptr;
+    uint32_t mMaxParallelAllocations = 1;
+    GrallocBufferPool mBufferPool;
 };
 
 }  // namespace detail
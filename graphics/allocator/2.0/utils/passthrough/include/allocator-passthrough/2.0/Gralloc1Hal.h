@@ -20,9 +20,11 @@
 #warning "Gralloc1Hal.h included without LOG_TAG"
 #endif
 
+#include <algorithm>
 #include <cstring>  // for strerror
 
 #include <allocator-hal/2.0/AllocatorHal.h>
+#include <allocator-passthrough/2.0/GrallocBufferPool.h>
 #include <hardware/gralloc1.h>
 #include <log/log.h>
 #include <mapper-passthrough/2.0/GrallocBufferDescriptor.h>
@@ -47,6 +49,8 @@ class Gralloc1HalImpl : public Hal {
    public:
     ~Gralloc1HalImpl() {
         if (mDevice) {
+            mBufferPool.stopTrimThread();
+            releaseBuffers(mBufferPool.clear());
             gralloc1_close(mDevice);
         }
     }
@@ -69,6 +73,25 @@ class Gralloc1HalImpl : public Hal {
         return true;
     }
 
+    // keep spare buffers of recently allocated descriptors
+    void setBufferPoolOptions(const GrallocBufferPool::Options& options) {
+        mBufferPool.setOptions(options);
+        if (options.maxBuffers > 0) {
+            mBufferPool.startTrimThread(
+                    [this](const std::vector<const native_handle_t*>& buffers) {
+                        releaseBuffers(buffers);
+                    });
+        }
+    }
+
+    const GrallocBufferPool& getBufferPool() const { return mBufferPool; }
+
+    // allocate the buffers of a descriptor on up to maxThreads threads, for
+    // modules that can allocate concurrently
+    void setMaxParallelAllocations(uint32_t maxThreads) {
+        mMaxParallelAllocations = std::max(maxThreads, 1u);
+    }
+
     std::string dumpDebugInfo() override {
         uint32_t len = 0;
         mDispatch.dump(mDevice, &len, nullptr);
@@ -78,7 +101,7 @@ class Gralloc1HalImpl : public Hal {
         buf.resize(len + 1);
         buf[len] = '\0';
 
-        return buf.data();
+        return buf.data() + mBufferPool.dump();
     }
 
     Error allocateBuffers(const BufferDescriptor& descriptor, uint32_t count, uint32_t* outStride,
@@ -88,43 +111,23 @@ class Gralloc1HalImpl : public Hal {
             return Error::BAD_DESCRIPTOR;
         }
 
-        gralloc1_buffer_descriptor_t desc;
-        Error error = createDescriptor(descriptorInfo, &desc);
-        if (error != Error::NONE) {
-            return error;
-        }
-
         uint32_t stride = 0;
         std::vector<const native_handle_t*> buffers;
         buffers.reserve(count);
+        mBufferPool.take(descriptor, count, &stride, &buffers);
 
-        // allocate the buffers
-        for (uint32_t i = 0; i < count; i++) {
-            const native_handle_t* tmpBuffer;
-            uint32_t tmpStride;
-            error = allocateOneBuffer(desc, &tmpBuffer, &tmpStride);
-            if (error != Error::NONE) {
-                break;
-            }
-
-            buffers.push_back(tmpBuffer);
-
-            if (stride == 0) {
-                stride = tmpStride;
-            } else if (stride != tmpStride) {
-                // non-uniform strides
-                error = Error::UNSUPPORTED;
-                break;
-            }
+        Error error = Error::NONE;
+        if (buffers.size() < count) {
+            error = allocateNewBuffers(descriptorInfo, count - buffers.size(), &stride, &buffers);
         }
 
-        mDispatch.destroyDescriptor(mDevice, desc);
-
         if (error != Error::NONE) {
-            freeBuffers(buffers);
+            releaseBuffers(buffers);
             return error;
         }
 
+        mBufferPool.handOut(descriptor, stride, buffers);
+
         *outStride = stride;
         *outBuffers = std::move(buffers);
 
@@ -132,11 +135,27 @@ class Gralloc1HalImpl : public Hal {
     }
 
     void freeBuffers(const std::vector<const native_handle_t*>& buffers) override {
-        for (auto buffer : buffers) {
-            int32_t error = mDispatch.release(mDevice, buffer);
-            if (error != GRALLOC1_ERROR_NONE) {
-                ALOGE("failed to free buffer %p: %d", buffer, error);
+        std::vector<const native_handle_t*> expired;
+        std::vector<GrallocBufferPool::Refill> refills;
+        mBufferPool.release(buffers, &expired, &refills);
+
+        releaseBuffers(buffers);
+        releaseBuffers(expired);
+
+        // this is called once the buffers were sent to the client
+        for (const auto& refill : refills) {
+            mapper::V2_0::IMapper::BufferDescriptorInfo descriptorInfo;
+            grallocDecodeBufferDescriptor(refill.descriptor, &descriptorInfo);
+
+            uint32_t stride = 0;
+            std::vector<const native_handle_t*> spares;
+            std::vector<const native_handle_t*> rejected;
+            if (allocateNewBuffers(descriptorInfo, refill.count, &stride, &spares) != Error::NONE) {
+                rejected = std::move(spares);
+                spares.clear();
             }
+            mBufferPool.put(refill, stride, spares, &rejected);
+            releaseBuffers(rejected);
         }
     }
 
@@ -310,6 +329,27 @@ class Gralloc1HalImpl : public Hal {
         return toError(error);
     }
 
+    Error allocateNewBuffers(const mapper::V2_0::IMapper::BufferDescriptorInfo& info, uint32_t count,
+                             uint32_t* inOutStride,
+                             std::vector<const native_handle_t*>* inOutBuffers) {
+        gralloc1_buffer_descriptor_t desc;
+        Error error = createDescriptor(info, &desc);
+        if (error != Error::NONE) {
+            return error;
+        }
+
+        error = allocateBuffersInParallel(
+                count, mMaxParallelAllocations,
+                [&](const native_handle_t** outBuffer, uint32_t* outStride) {
+                    return allocateOneBuffer(desc, outBuffer, outStride);
+                },
+                inOutStride, inOutBuffers);
+
+        mDispatch.destroyDescriptor(mDevice, desc);
+
+        return error;
+    }
+
     Error allocateOneBuffer(gralloc1_buffer_descriptor_t descriptor,
                             const native_handle_t** outBuffer, uint32_t* outStride) {
         const native_handle_t* buffer = nullptr;
@@ -331,7 +371,18 @@ class Gralloc1HalImpl : public Hal {
         return Error::NONE;
     }
 
+    void releaseBuffers(const std::vector<const native_handle_t*>& buffers) {
+        for (auto buffer : buffers) {
+            int32_t error = mDispatch.release(mDevice, buffer);
+            if (error != GRALLOC1_ERROR_NONE) {
+                ALOGE("failed to free buffer %p: %d", buffer, error);
+            }
+        }
+    }
+
     gralloc1_device_t* mDevice = nullptr;
+    uint32_t mMaxParallelAllocations = 1;
+    GrallocBufferPool mBufferPool;
 
     struct {
         bool layeredBuffers;
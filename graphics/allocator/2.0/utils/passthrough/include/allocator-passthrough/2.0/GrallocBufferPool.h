@@ -0,0 +1,477 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <android/hardware/graphics/mapper/2.0/IMapper.h>
+#include <cutils/native_handle.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace allocator {
+namespace V2_0 {
+namespace passthrough {
+
+using mapper::V2_0::BufferDescriptor;
+using mapper::V2_0::Error;
+
+// GrallocBufferPool keeps spare buffers of the descriptors that were
+// allocated recently, so that allocating the same descriptors again, as
+// surface and camera stream reconfiguration do, does not go to the module.
+//
+// The allocator frees its handles of the buffers it allocates as soon as they
+// are sent to the client, which keeps using them, and it is never told when
+// the client is done with them.  The buffers it frees are therefore never
+// recycled.  Instead, once the buffers of a descriptor are handed out, the pool
+// asks for as many spare buffers of the descriptor to be allocated, which
+// happens after the client got its reply.  Spare buffers are never handed out
+// twice, and are trimmed once they stay unused longer than maxAge, or when
+// there are more than maxBuffers of them.
+//
+// The pool does not allocate or free buffers itself; it returns the buffers to
+// free and the refills to allocate to the caller, which must not hold any
+// lock of its own that the pool's callers take.  The exception is the trim
+// thread, which frees the spare buffers that expire while the allocator is
+// idle with the function it is started with.
+class GrallocBufferPool {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        // the most spare buffers to keep, 0 to disable the pool
+        size_t maxBuffers = 0;
+        // how long spare buffers of a descriptor are kept after the
+        // descriptor was last allocated
+        Clock::duration maxAge = std::chrono::seconds(2);
+    };
+
+    // count spare buffers to allocate for descriptor, to be passed to put()
+    struct Refill {
+        BufferDescriptor descriptor;
+        uint32_t count;
+    };
+
+    using ReleaseBuffersFunction = std::function<void(const std::vector<const native_handle_t*>&)>;
+
+    ~GrallocBufferPool() { stopTrimThread(); }
+
+    void setOptions(const Options& options) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mOptions = options;
+    }
+
+    bool isEnabled() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mOptions.maxBuffers > 0;
+    }
+
+    // Start a thread that frees the spare buffers with releaseBuffers once
+    // they are older than maxAge.  Otherwise they are only trimmed when
+    // buffers are released or refilled, which may not happen again for a long
+    // time.  It must be stopped before releaseBuffers can no longer be called.
+    void startTrimThread(ReleaseBuffersFunction releaseBuffers) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mTrimThread.joinable()) {
+            return;
+        }
+
+        mStopTrimThread = false;
+        mTrimThread = std::thread(&GrallocBufferPool::trimThreadLoop, this,
+                                  std::move(releaseBuffers));
+    }
+
+    void stopTrimThread() {
+        std::thread thread;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopTrimThread = true;
+            mTrimCondition.notify_one();
+            thread = std::move(mTrimThread);
+        }
+
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    // how many of the buffers asked from take() were spare, and were not
+    uint64_t getHits() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mHits;
+    }
+
+    uint64_t getMisses() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mMisses;
+    }
+
+    // Move up to count spare buffers of descriptor to outBuffers.  outStride
+    // is set when any is moved.
+    void take(const BufferDescriptor& descriptor, uint32_t count, uint32_t* outStride,
+              std::vector<const native_handle_t*>* outBuffers) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mOptions.maxBuffers == 0) {
+            return;
+        }
+
+        auto it = mEntries.find(toKey(descriptor));
+        size_t taken = 0;
+        if (it != mEntries.end() && !it->second.spares.empty()) {
+            Entry& entry = it->second;
+            taken = std::min<size_t>(count, entry.spares.size());
+            for (size_t i = entry.spares.size() - taken; i < entry.spares.size(); i++) {
+                outBuffers->push_back(entry.spares[i]);
+            }
+            entry.spares.resize(entry.spares.size() - taken);
+            mSpareCount -= taken;
+            *outStride = entry.stride;
+        }
+
+        mHits += taken;
+        mMisses += count - taken;
+    }
+
+    // Remember that buffers of descriptor, with the given stride, were handed
+    // out.  They are passed to release() before they are freed.
+    void handOut(const BufferDescriptor& descriptor, uint32_t stride,
+                 const std::vector<const native_handle_t*>& buffers) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mOptions.maxBuffers == 0 || buffers.empty()) {
+            return;
+        }
+
+        auto it = mEntries.emplace(toKey(descriptor), Entry{}).first;
+        Entry& entry = it->second;
+        if (entry.stride != stride) {
+            // the module changed its mind about the stride; spares of the old
+            // one can't be handed out with new buffers
+            mExpired.insert(mExpired.end(), entry.spares.begin(), entry.spares.end());
+            mSpareCount -= entry.spares.size();
+            entry.spares.clear();
+            entry.stride = stride;
+        }
+        entry.demand = buffers.size();
+        entry.lastHandedOut = Clock::now();
+
+        for (auto buffer : buffers) {
+            mHandedOut[buffer] = &it->first;
+        }
+    }
+
+    // Forget buffers, which are about to be freed.  Return the spare buffers
+    // to free in outExpired, and the spare buffers to allocate for the
+    // descriptors of buffers in outRefills.
+    void release(const std::vector<const native_handle_t*>& buffers,
+                 std::vector<const native_handle_t*>* outExpired, std::vector<Refill>* outRefills) {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        std::vector<const Key*> keys;
+        for (auto buffer : buffers) {
+            auto it = mHandedOut.find(buffer);
+            if (it == mHandedOut.end()) {
+                continue;
+            }
+            if (std::find(keys.begin(), keys.end(), it->second) == keys.end()) {
+                keys.push_back(it->second);
+            }
+            mHandedOut.erase(it);
+        }
+
+        const Clock::time_point now = Clock::now();
+        for (const Key* key : keys) {
+            Entry& entry = mEntries.at(*key);
+            if (now - entry.lastHandedOut > mOptions.maxAge) {
+                continue;
+            }
+
+            size_t room = mOptions.maxBuffers - std::min(mOptions.maxBuffers,
+                                                         mSpareCount + mRefillCount);
+            size_t wanted = entry.demand - std::min<size_t>(entry.demand,
+                                                            entry.spares.size() + entry.refilling);
+            uint32_t count = std::min(room, wanted);
+            if (count > 0) {
+                entry.refilling += count;
+                mRefillCount += count;
+                outRefills->push_back({toDescriptor(*key), count});
+            }
+        }
+
+        trimLocked(now, outExpired);
+        mTrimCondition.notify_one();
+    }
+
+    // Add the spare buffers allocated for refill.  The ones the pool no longer
+    // has room for are returned in outRejected.
+    void put(const Refill& refill, uint32_t stride,
+             const std::vector<const native_handle_t*>& buffers,
+             std::vector<const native_handle_t*>* outRejected) {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        Entry& entry = mEntries.at(toKey(refill.descriptor));
+        entry.refilling -= refill.count;
+        mRefillCount -= refill.count;
+
+        size_t accepted = 0;
+        if (stride == entry.stride && mOptions.maxBuffers > mSpareCount) {
+            accepted = std::min(buffers.size(), mOptions.maxBuffers - mSpareCount);
+            accepted = std::min<size_t>(accepted,
+                                        entry.demand - std::min<size_t>(entry.demand,
+                                                                        entry.spares.size()));
+        }
+        entry.spares.insert(entry.spares.end(), buffers.begin(), buffers.begin() + accepted);
+        mSpareCount += accepted;
+        outRejected->insert(outRejected->end(), buffers.begin() + accepted, buffers.end());
+
+        trimLocked(Clock::now(), outRejected);
+        mTrimCondition.notify_one();
+    }
+
+    // Remove all spare buffers, and return them to be freed.
+    std::vector<const native_handle_t*> clear() {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        std::vector<const native_handle_t*> buffers = std::move(mExpired);
+        mExpired.clear();
+        for (auto& entry : mEntries) {
+            buffers.insert(buffers.end(), entry.second.spares.begin(), entry.second.spares.end());
+            entry.second.spares.clear();
+        }
+        mSpareCount = 0;
+
+        return buffers;
+    }
+
+    std::string dump() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mOptions.maxBuffers == 0) {
+            return "";
+        }
+
+        return "buffer pool: " + std::to_string(mSpareCount) + "/" +
+               std::to_string(mOptions.maxBuffers) + " spare buffers of " +
+               std::to_string(mEntries.size()) + " descriptors, " + std::to_string(mHits) +
+               " hits, " + std::to_string(mMisses) + " misses\n";
+    }
+
+   private:
+    using Key = std::vector<uint32_t>;
+
+    struct Entry {
+        std::vector<const native_handle_t*> spares;
+        uint32_t stride = 0;
+        // how many buffers were handed out the last time
+        uint32_t demand = 0;
+        // how many spare buffers are being allocated
+        uint32_t refilling = 0;
+        Clock::time_point lastHandedOut;
+    };
+
+    static Key toKey(const BufferDescriptor& descriptor) {
+        return Key(descriptor.begin(), descriptor.end());
+    }
+
+    static BufferDescriptor toDescriptor(const Key& key) { return BufferDescriptor(key); }
+
+    // drop the descriptors that were not allocated for maxAge, then the
+    // oldest spare buffers until there are at most maxBuffers
+    void trimLocked(Clock::time_point now, std::vector<const native_handle_t*>* outExpired) {
+        outExpired->insert(outExpired->end(), mExpired.begin(), mExpired.end());
+        mExpired.clear();
+
+        for (auto it = mEntries.begin(); it != mEntries.end();) {
+            Entry& entry = it->second;
+            if (now - entry.lastHandedOut <= mOptions.maxAge) {
+                ++it;
+                continue;
+            }
+
+            outExpired->insert(outExpired->end(), entry.spares.begin(), entry.spares.end());
+            mSpareCount -= entry.spares.size();
+            entry.spares.clear();
+
+            if (entry.refilling == 0 && !isHandedOutLocked(it->first)) {
+                it = mEntries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        while (mSpareCount > mOptions.maxBuffers) {
+            auto oldest = mEntries.end();
+            for (auto it = mEntries.begin(); it != mEntries.end(); ++it) {
+                if (!it->second.spares.empty() &&
+                    (oldest == mEntries.end() ||
+                     it->second.lastHandedOut < oldest->second.lastHandedOut)) {
+                    oldest = it;
+                }
+            }
+
+            outExpired->push_back(oldest->second.spares.back());
+            oldest->second.spares.pop_back();
+            mSpareCount--;
+        }
+    }
+
+    // Return when the next spare buffers expire, or Clock::time_point::max()
+    // when there are none.
+    Clock::time_point nextExpiryLocked() const {
+        if (!mExpired.empty()) {
+            return Clock::time_point::min();
+        }
+
+        Clock::time_point expiry = Clock::time_point::max();
+        for (const auto& entry : mEntries) {
+            if (!entry.second.spares.empty()) {
+                // trimLocked keeps spares that are exactly maxAge old
+                expiry = std::min(expiry, entry.second.lastHandedOut + mOptions.maxAge +
+                                                  Clock::duration(1));
+            }
+        }
+        return expiry;
+    }
+
+    void trimThreadLoop(ReleaseBuffersFunction releaseBuffers) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mStopTrimThread) {
+            // release() and put() wake the thread up to wait for the spare
+            // buffers they may have added
+            Clock::time_point expiry = nextExpiryLocked();
+            if (expiry == Clock::time_point::max()) {
+                mTrimCondition.wait(lock);
+                continue;
+            }
+            if (Clock::now() < expiry) {
+                mTrimCondition.wait_until(lock, expiry);
+                continue;
+            }
+
+            std::vector<const native_handle_t*> expired;
+            trimLocked(Clock::now(), &expired);
+            if (!expired.empty()) {
+                lock.unlock();
+                releaseBuffers(expired);
+                lock.lock();
+            }
+        }
+    }
+
+    bool isHandedOutLocked(const Key& key) const {
+        for (const auto& handedOut : mHandedOut) {
+            if (handedOut.second == &key) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    mutable std::mutex mMutex;
+    Options mOptions;
+
+    // entries are never moved, so keys of mEntries are used in mHandedOut
+    std::map<Key, Entry> mEntries;
+    std::unordered_map<const native_handle_t*, const Key*> mHandedOut;
+    std::vector<const native_handle_t*> mExpired;
+    size_t mSpareCount = 0;
+    size_t mRefillCount = 0;
+
+    uint64_t mHits = 0;
+    uint64_t mMisses = 0;
+
+    std::condition_variable mTrimCondition;
+    std::thread mTrimThread;
+    bool mStopTrimThread = false;
+};
+
+// Call allocateOne(&buffer, &stride) count times, on up to maxThreads
+// threads, and append the buffers to inOutBuffers.  inOutStride is the stride
+// all buffers must have, or 0 when any stride will do.  On errors, the buffers
+// that were allocated are appended as well, for the caller to free, and the
+// error of the first allocation that failed is returned.
+template <typename AllocateOne>
+Error allocateBuffersInParallel(uint32_t count, uint32_t maxThreads, AllocateOne allocateOne,
+                                uint32_t* inOutStride,
+                                std::vector<const native_handle_t*>* inOutBuffers) {
+    // buffer is null when the allocation failed or was skipped after another
+    // one failed
+    struct Result {
+        const native_handle_t* buffer = nullptr;
+        uint32_t stride = 0;
+    };
+
+    std::vector<Result> results(count);
+    std::atomic<uint32_t> next(0);
+    std::atomic<bool> failed(false);
+    Error firstError = Error::NONE;
+    auto allocate = [&] {
+        for (uint32_t i = next++; i < count && !failed; i = next++) {
+            Error error = allocateOne(&results[i].buffer, &results[i].stride);
+            if (error != Error::NONE) {
+                results[i].buffer = nullptr;
+                bool expected = false;
+                if (failed.compare_exchange_strong(expected, true)) {
+                    firstError = error;
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < std::min(count, maxThreads); i++) {
+        threads.emplace_back(allocate);
+    }
+    allocate();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    Error error = firstError;
+    for (const Result& result : results) {
+        if (!result.buffer) {
+            continue;
+        }
+
+        inOutBuffers->push_back(result.buffer);
+
+        if (*inOutStride == 0) {
+            *inOutStride = result.stride;
+        } else if (*inOutStride != result.stride && error == Error::NONE) {
+            // non-uniform strides
+            error = Error::UNSUPPORTED;
+        }
+    }
+
+    return error;
+}
+
+}  // namespace passthrough
+}  // namespace V2_0
+}  // namespace allocator
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
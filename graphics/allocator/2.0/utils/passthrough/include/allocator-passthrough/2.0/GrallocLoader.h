@@ -20,11 +20,13 @@
 #warning "GrallocLoader.h included without LOG_TAG"
 #endif
 
+#include <chrono>
 #include <memory>
 
 #include <allocator-hal/2.0/Allocator.h>
 #include <allocator-passthrough/2.0/Gralloc0Hal.h>
 #include <allocator-passthrough/2.0/Gralloc1Hal.h>
+#include <android-base/properties.h>
 #include <hardware/gralloc.h>
 #include <hardware/hardware.h>
 #include <log/log.h>
@@ -73,11 +75,19 @@ class GrallocLoader {
         switch (major) {
             case 1: {
                 auto hal = std::make_unique<Gralloc1Hal>();
-                return hal->initWithModule(module) ? std::move(hal) : nullptr;
+                if (!hal->initWithModule(module)) {
+                    return nullptr;
+                }
+                configureHal(hal.get());
+                return hal;
             }
             case 0: {
                 auto hal = std::make_unique<Gralloc0Hal>();
-                return hal->initWithModule(module) ? std::move(hal) : nullptr;
+                if (!hal->initWithModule(module)) {
+                    return nullptr;
+                }
+                configureHal(hal.get());
+                return hal;
             }
             default:
                 ALOGE("unknown gralloc module major version %d", major);
@@ -85,6 +95,23 @@ class GrallocLoader {
         }
     }
 
+    // Enable the buffer pool and parallel allocations when the device opts
+    // in.  Both are off by default.
+    template <typename T>
+    static void configureHal(T* hal) {
+        GrallocBufferPool::Options options;
+        options.maxBuffers = base::GetUintProperty<size_t>(
+                "ro.vendor.graphics.allocator.pool_max_buffers", options.maxBuffers);
+        options.maxAge = std::chrono::milliseconds(base::GetUintProperty<uint64_t>(
+                "ro.vendor.graphics.allocator.pool_max_age_ms",
+                std::chrono::duration_cast<std::chrono::milliseconds>(options.maxAge).count()));
+        hal->setBufferPoolOptions(options);
+
+        // only for modules that can allocate concurrently
+        hal->setMaxParallelAllocations(base::GetUintProperty<uint32_t>(
+                "ro.vendor.graphics.allocator.max_parallel_allocations", 1));
+    }
+
     // create an IAllocator instance
     static IAllocator* createAllocator(std::unique_ptr<hal::AllocatorHal> hal) {
         auto allocator = std::make_unique<hal::Allocator>();
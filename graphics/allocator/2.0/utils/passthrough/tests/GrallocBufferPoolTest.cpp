@@ -0,0 +1,379 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <allocator-passthrough/2.0/GrallocBufferPool.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace allocator {
+namespace V2_0 {
+namespace passthrough {
+namespace {
+
+using namespace std::chrono_literals;
+
+using Buffers = std::vector<const native_handle_t*>;
+
+constexpr uint32_t kStride = 64;
+
+// Handles that are freed with the test.  The pool never looks into them.
+class Handles {
+   public:
+    ~Handles() {
+        for (native_handle_t* handle : mHandles) {
+            native_handle_delete(handle);
+        }
+    }
+
+    Buffers create(size_t count) {
+        Buffers buffers;
+        for (size_t i = 0; i < count; i++) {
+            mHandles.push_back(native_handle_create(0, 0));
+            buffers.push_back(mHandles.back());
+        }
+        return buffers;
+    }
+
+   private:
+    std::vector<native_handle_t*> mHandles;
+};
+
+// Collects the buffers the trim thread frees.
+class Freed {
+   public:
+    void add(const Buffers& buffers) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mBuffers.insert(mBuffers.end(), buffers.begin(), buffers.end());
+        mCondition.notify_all();
+    }
+
+    bool waitFor(size_t count, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        return mCondition.wait_for(lock, timeout, [&] { return mBuffers.size() >= count; });
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mBuffers.size();
+    }
+
+   private:
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    Buffers mBuffers;
+};
+
+bool containsAll(const Buffers& buffers, const Buffers& subset) {
+    return std::all_of(subset.begin(), subset.end(), [&](const native_handle_t* buffer) {
+        return std::find(buffers.begin(), buffers.end(), buffer) != buffers.end();
+    });
+}
+
+class GrallocBufferPoolTest : public ::testing::Test {
+   protected:
+    void SetUp() override { setOptions(8, 10s); }
+
+    void setOptions(size_t maxBuffers, GrallocBufferPool::Clock::duration maxAge) {
+        GrallocBufferPool::Options options;
+        options.maxBuffers = maxBuffers;
+        options.maxAge = maxAge;
+        mPool.setOptions(options);
+    }
+
+    // Allocate count buffers of descriptor the way the HALs do, with the
+    // module allocations coming from mHandles.
+    Buffers allocate(const BufferDescriptor& descriptor, uint32_t count,
+                     uint32_t stride = kStride) {
+        uint32_t outStride = 0;
+        Buffers buffers;
+        mPool.take(descriptor, count, &outStride, &buffers);
+        if (!buffers.empty()) {
+            EXPECT_EQ(stride, outStride);
+        }
+        Buffers allocated = mHandles.create(count - buffers.size());
+        buffers.insert(buffers.end(), allocated.begin(), allocated.end());
+        mPool.handOut(descriptor, stride, buffers);
+        return buffers;
+    }
+
+    // Free buffers the way the HALs do, and put the refills in the pool.
+    // Return the spare buffers the pool let go of.
+    Buffers free(const Buffers& buffers, std::vector<GrallocBufferPool::Refill>* outRefills,
+                 uint32_t stride = kStride) {
+        Buffers expired;
+        std::vector<GrallocBufferPool::Refill> refills;
+        mPool.release(buffers, &expired, &refills);
+        for (const auto& refill : refills) {
+            mPool.put(refill, stride, mHandles.create(refill.count), &expired);
+        }
+        if (outRefills) {
+            *outRefills = refills;
+        }
+        return expired;
+    }
+
+    const BufferDescriptor mDescriptorA = {1, 2, 3};
+    const BufferDescriptor mDescriptorB = {4, 5, 6};
+
+    Handles mHandles;
+    GrallocBufferPool mPool;
+};
+
+TEST_F(GrallocBufferPoolTest, DisabledPoolKeepsNothing) {
+    setOptions(0, 10s);
+    EXPECT_FALSE(mPool.isEnabled());
+
+    std::vector<GrallocBufferPool::Refill> refills;
+    EXPECT_TRUE(free(allocate(mDescriptorA, 3), &refills).empty());
+    EXPECT_TRUE(refills.empty());
+    EXPECT_TRUE(free(allocate(mDescriptorA, 3), &refills).empty());
+    EXPECT_EQ(0u, mPool.getHits());
+    EXPECT_EQ(0u, mPool.getMisses());
+}
+
+TEST_F(GrallocBufferPoolTest, RefillsHandedOutBuffers) {
+    std::vector<GrallocBufferPool::Refill> refills;
+    EXPECT_TRUE(free(allocate(mDescriptorA, 3), &refills).empty());
+    EXPECT_EQ(0u, mPool.getHits());
+    EXPECT_EQ(3u, mPool.getMisses());
+    ASSERT_EQ(1u, refills.size());
+    EXPECT_EQ(mDescriptorA, refills[0].descriptor);
+    EXPECT_EQ(3u, refills[0].count);
+
+    // the spares are handed out, and refilled again once the buffers are freed
+    Buffers buffers = allocate(mDescriptorA, 3);
+    EXPECT_EQ(3u, mPool.getHits());
+    EXPECT_EQ(3u, mPool.getMisses());
+    EXPECT_TRUE(free(buffers, &refills).empty());
+    ASSERT_EQ(1u, refills.size());
+    EXPECT_EQ(3u, refills[0].count);
+
+    // more buffers than there are spares
+    free(allocate(mDescriptorA, 5), &refills);
+    EXPECT_EQ(6u, mPool.getHits());
+    EXPECT_EQ(5u, mPool.getMisses());
+    ASSERT_EQ(1u, refills.size());
+    EXPECT_EQ(5u, refills[0].count);
+}
+
+TEST_F(GrallocBufferPoolTest, RefillsAreLimitedByMaxBuffers) {
+    setOptions(4, 10s);
+    std::vector<GrallocBufferPool::Refill> refills;
+
+    free(allocate(mDescriptorA, 3), &refills);
+    ASSERT_EQ(1u, refills.size());
+    EXPECT_EQ(3u, refills[0].count);
+
+    free(allocate(mDescriptorB, 3), &refills);
+    ASSERT_EQ(1u, refills.size());
+    EXPECT_EQ(mDescriptorB, refills[0].descriptor);
+    EXPECT_EQ(1u, refills[0].count);
+
+    // only the spare that was handed out fits again
+    free(allocate(mDescriptorB, 3), &refills);
+    EXPECT_EQ(1u, mPool.getHits());
+    ASSERT_EQ(1u, refills.size());
+    EXPECT_EQ(1u, refills[0].count);
+}
+
+TEST_F(GrallocBufferPoolTest, EvictsSparesOfTheOldestDescriptorFirst) {
+    free(allocate(mDescriptorA, 3), nullptr);
+    std::this_thread::sleep_for(1ms);
+    free(allocate(mDescriptorB, 3), nullptr);
+
+    // the next trim drops spares until there are at most maxBuffers
+    setOptions(4, 10s);
+    Buffers expired;
+    std::vector<GrallocBufferPool::Refill> refills;
+    mPool.release({}, &expired, &refills);
+    EXPECT_EQ(2u, expired.size());
+    EXPECT_TRUE(refills.empty());
+
+    uint32_t stride = 0;
+    Buffers spares;
+    mPool.take(mDescriptorB, 3, &stride, &spares);
+    EXPECT_EQ(3u, spares.size());
+    spares.clear();
+    mPool.take(mDescriptorA, 3, &stride, &spares);
+    EXPECT_EQ(1u, spares.size());
+}
+
+TEST_F(GrallocBufferPoolTest, RejectsSparesOfAnotherStride) {
+    Buffers expired;
+    std::vector<GrallocBufferPool::Refill> refills;
+    mPool.release(allocate(mDescriptorA, 3), &expired, &refills);
+    ASSERT_EQ(1u, refills.size());
+
+    Buffers spares = mHandles.create(3);
+    Buffers rejected;
+    mPool.put(refills[0], kStride * 2, spares, &rejected);
+    EXPECT_EQ(spares, rejected);
+
+    // the refill is done, so the next release asks for it again
+    refills.clear();
+    mPool.release(allocate(mDescriptorA, 3), &expired, &refills);
+    EXPECT_EQ(0u, mPool.getHits());
+    ASSERT_EQ(1u, refills.size());
+    EXPECT_EQ(3u, refills[0].count);
+}
+
+TEST_F(GrallocBufferPoolTest, StrideChangeDropsSpares) {
+    free(allocate(mDescriptorA, 3), nullptr);
+
+    // the module allocated the descriptor with another stride; the spares
+    // can't go with the new buffers anymore
+    Buffers spares;
+    uint32_t stride = 0;
+    Buffers buffers = mHandles.create(2);
+    mPool.handOut(mDescriptorA, kStride * 2, buffers);
+
+    std::vector<GrallocBufferPool::Refill> refills;
+    Buffers expired = free(buffers, &refills, kStride * 2);
+    EXPECT_EQ(3u, expired.size());
+    ASSERT_EQ(1u, refills.size());
+    EXPECT_EQ(2u, refills[0].count);
+
+    mPool.take(mDescriptorA, 2, &stride, &spares);
+    EXPECT_EQ(2u, spares.size());
+    EXPECT_EQ(kStride * 2, stride);
+    EXPECT_FALSE(containsAll(expired, spares));
+}
+
+TEST_F(GrallocBufferPoolTest, ExpiredDescriptorIsNotRefilled) {
+    setOptions(8, 20ms);
+    Buffers buffers = allocate(mDescriptorA, 3);
+    std::this_thread::sleep_for(40ms);
+
+    std::vector<GrallocBufferPool::Refill> refills;
+    EXPECT_TRUE(free(buffers, &refills).empty());
+    EXPECT_TRUE(refills.empty());
+}
+
+TEST_F(GrallocBufferPoolTest, TrimThreadFreesExpiredSpares) {
+    constexpr auto kMaxAge = 50ms;
+    setOptions(8, kMaxAge);
+    Freed freed;
+    mPool.startTrimThread([&](const Buffers& buffers) { freed.add(buffers); });
+
+    auto start = GrallocBufferPool::Clock::now();
+    EXPECT_TRUE(free(allocate(mDescriptorA, 3), nullptr).empty());
+    ASSERT_TRUE(freed.waitFor(3, 2s));
+    EXPECT_GE(GrallocBufferPool::Clock::now() - start, kMaxAge);
+    EXPECT_EQ(3u, freed.size());
+
+    uint32_t stride = 0;
+    Buffers spares;
+    mPool.take(mDescriptorA, 3, &stride, &spares);
+    EXPECT_TRUE(spares.empty());
+
+    // the thread keeps serving spares added later
+    free(allocate(mDescriptorB, 2), nullptr);
+    EXPECT_TRUE(freed.waitFor(5, 2s));
+
+    mPool.stopTrimThread();
+    EXPECT_TRUE(mPool.clear().empty());
+}
+
+TEST_F(GrallocBufferPoolTest, StoppedTrimThreadFreesNothing) {
+    setOptions(8, 10ms);
+    Freed freed;
+    mPool.startTrimThread([&](const Buffers& buffers) { freed.add(buffers); });
+    mPool.stopTrimThread();
+
+    free(allocate(mDescriptorA, 3), nullptr);
+    EXPECT_FALSE(freed.waitFor(1, 50ms));
+    EXPECT_EQ(3u, mPool.clear().size());
+}
+
+TEST(AllocateBuffersInParallelTest, AllocatesEveryBuffer) {
+    Handles handles;
+    std::mutex mutex;
+    uint32_t stride = 0;
+    Buffers buffers;
+    Error error = allocateBuffersInParallel(
+            8, 4,
+            [&](const native_handle_t** outBuffer, uint32_t* outStride) {
+                std::lock_guard<std::mutex> lock(mutex);
+                *outBuffer = handles.create(1)[0];
+                *outStride = kStride;
+                return Error::NONE;
+            },
+            &stride, &buffers);
+    EXPECT_EQ(Error::NONE, error);
+    EXPECT_EQ(8u, buffers.size());
+    EXPECT_EQ(kStride, stride);
+}
+
+TEST(AllocateBuffersInParallelTest, ReturnsTheModuleError) {
+    for (uint32_t maxThreads : {1u, 4u}) {
+        Handles handles;
+        std::mutex mutex;
+        std::atomic<int> calls(0);
+        uint32_t stride = 0;
+        Buffers buffers;
+        Error error = allocateBuffersInParallel(
+                8, maxThreads,
+                [&](const native_handle_t** outBuffer, uint32_t* outStride) {
+                    if (calls++ >= 2) {
+                        return Error::BAD_VALUE;
+                    }
+                    std::lock_guard<std::mutex> lock(mutex);
+                    *outBuffer = handles.create(1)[0];
+                    *outStride = kStride;
+                    return Error::NONE;
+                },
+                &stride, &buffers);
+        EXPECT_EQ(Error::BAD_VALUE, error) << maxThreads << " threads";
+        // the buffers that were allocated are returned to be freed
+        EXPECT_EQ(2u, buffers.size()) << maxThreads << " threads";
+    }
+}
+
+TEST(AllocateBuffersInParallelTest, RejectsNonUniformStrides) {
+    Handles handles;
+    std::atomic<uint32_t> calls(0);
+    uint32_t stride = 0;
+    Buffers buffers;
+    Error error = allocateBuffersInParallel(
+            2, 1,
+            [&](const native_handle_t** outBuffer, uint32_t* outStride) {
+                *outBuffer = handles.create(1)[0];
+                *outStride = kStride * (1 + calls++);
+                return Error::NONE;
+            },
+            &stride, &buffers);
+    EXPECT_EQ(Error::UNSUPPORTED, error);
+    EXPECT_EQ(2u, buffers.size());
+}
+
+}  // namespace
+}  // namespace passthrough
+}  // namespace V2_0
+}  // namespace allocator
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GrallocMapperBenchmark"
+
+/*
+ * Locks and unlocks imported buffers from several threads through the
+ * passthrough mapper, on top of a gralloc0 module whose functions do nothing,
+ * so that what is measured is mostly the imported buffer validation every
+ * IMapper call does.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <mapper-passthrough/2.0/GrallocLoader.h>
+
+using android::hardware::hidl_handle;
+using android::hardware::graphics::mapper::V2_0::Error;
+using android::hardware::graphics::mapper::V2_0::IMapper;
+using android::hardware::graphics::mapper::V2_0::hal::Mapper;
+using android::hardware::graphics::mapper::V2_0::passthrough::Gralloc0Hal;
+using android::hardware::graphics::mapper::V2_0::passthrough::GrallocMapper;
+
+namespace {
+
+uint8_t sPixels[64];
+
+int stubRegisterBuffer(const gralloc_module_t*, buffer_handle_t) {
+    return 0;
+}
+
+int stubUnregisterBuffer(const gralloc_module_t*, buffer_handle_t) {
+    return 0;
+}
+
+int stubLock(const gralloc_module_t*, buffer_handle_t, int, int, int, int, int, void** vaddr) {
+    *vaddr = sPixels;
+    return 0;
+}
+
+int stubUnlock(const gralloc_module_t*, buffer_handle_t) {
+    return 0;
+}
+
+gralloc_module_t makeStubModule() {
+    gralloc_module_t module = {};
+    module.common.tag = HARDWARE_MODULE_TAG;
+    module.common.module_api_version = GRALLOC_MODULE_API_VERSION_0_2;
+    module.common.hal_api_version = HARDWARE_HAL_API_VERSION;
+    module.common.id = GRALLOC_HARDWARE_MODULE_ID;
+    module.common.name = "gralloc0 stub";
+    module.registerBuffer = stubRegisterBuffer;
+    module.unregisterBuffer = stubUnregisterBuffer;
+    module.lock = stubLock;
+    module.unlock = stubUnlock;
+    return module;
+}
+
+IMapper* getMapper() {
+    static const gralloc_module_t sModule = makeStubModule();
+    static IMapper* sMapper = [] {
+        auto hal = std::make_unique<Gralloc0Hal>();
+        hal->initWithModule(&sModule.common);
+        auto mapper = std::make_unique<GrallocMapper<Mapper>>();
+        mapper->init(std::move(hal));
+        return mapper.release();
+    }();
+    return sMapper;
+}
+
+void* importBuffer() {
+    native_handle_t* rawHandle = native_handle_create(0 /* numFds */, 0 /* numInts */);
+    void* buffer = nullptr;
+    getMapper()->importBuffer(hidl_handle(rawHandle), [&](Error error, void* importedBuffer) {
+        if (error == Error::NONE) buffer = importedBuffer;
+    });
+    native_handle_delete(rawHandle);
+    return buffer;
+}
+
+// Buffers other than the ones being locked, the way a process holds on to
+// the buffers of its queues.
+void importBackgroundBuffers(size_t count) {
+    static std::vector<void*> sBuffers;
+    static std::mutex sMutex;
+    std::lock_guard<std::mutex> lock(sMutex);
+    while (sBuffers.size() < count) {
+        sBuffers.push_back(importBuffer());
+    }
+}
+
+// Each thread locks and unlocks a buffer of its own, with state.range(0)
+// buffers imported in the process.
+void BM_LockUnlock(benchmark::State& state) {
+    importBackgroundBuffers(state.range(0));
+    void* buffer = importBuffer();
+    if (!buffer) {
+        state.SkipWithError("could not import the buffer");
+        return;
+    }
+
+    const IMapper::Rect region = {0, 0, 8, 8};
+    for (auto _ : state) {
+        Error lockError = Error::NONE;
+        getMapper()->lock(buffer, 0 /* cpuUsage */, region, hidl_handle(),
+                          [&](Error error, void*) { lockError = error; });
+        Error unlockError = Error::NONE;
+        getMapper()->unlock(buffer,
+                            [&](Error error, const hidl_handle&) { unlockError = error; });
+        if (lockError != Error::NONE || unlockError != Error::NONE) {
+            state.SkipWithError("could not lock the buffer");
+            break;
+        }
+    }
+
+    getMapper()->freeBuffer(buffer);
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Each thread imports and frees a buffer, which serializes on the pool mutex
+// and rebuilds its table from time to time, while the other threads do the
+// same.
+void BM_ImportFree(benchmark::State& state) {
+    importBackgroundBuffers(state.range(0));
+    for (auto _ : state) {
+        void* buffer = importBuffer();
+        if (!buffer || getMapper()->freeBuffer(buffer) != Error::NONE) {
+            state.SkipWithError("could not import the buffer");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+BENCHMARK(BM_LockUnlock)->Arg(16)->Arg(256)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_ImportFree)->Arg(16)->Arg(256)->ThreadRange(1, 8)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -22,7 +22,6 @@
 
 #include <memory>
 #include <mutex>
-#include <unordered_set>
 
 #include <hardware/gralloc.h>
 #include <hardware/hardware.h>
@@ -30,6 +29,7 @@
 #include <mapper-hal/2.0/Mapper.h>
 #include <mapper-passthrough/2.0/Gralloc0Hal.h>
 #include <mapper-passthrough/2.0/Gralloc1Hal.h>
+#include <mapper-passthrough/2.0/ImportedBufferSet.h>
 
 namespace android {
 namespace hardware {
@@ -56,32 +56,31 @@ class GrallocImportedBufferPool {
         return *singleton;
     }
 
+    // Serializes adding and removing buffers.  It is held while a buffer is
+    // freed and removed, so that a buffer imported at the same address in
+    // between is not rejected.  Looking up buffers does not take it.
     std::mutex* getMutex() { return &mMutex; }
 
     void* add(native_handle_t* bufferHandle) {
         std::lock_guard<std::mutex> lock(mMutex);
-        return mBufferHandles.insert(bufferHandle).second ? bufferHandle : nullptr;
+        return mBufferHandles.insertLocked(bufferHandle) ? bufferHandle : nullptr;
     }
 
-    void removeLocked(native_handle* bufferHandle) { mBufferHandles.erase(bufferHandle); }
+    void removeLocked(native_handle* bufferHandle) { mBufferHandles.removeLocked(bufferHandle); }
 
     native_handle_t* get(void* buffer) {
         auto bufferHandle = static_cast<native_handle_t*>(buffer);
-
-        std::lock_guard<std::mutex> lock(mMutex);
-        return mBufferHandles.count(bufferHandle) == 1 ? bufferHandle : nullptr;
+        return mBufferHandles.contains(bufferHandle) ? bufferHandle : nullptr;
     }
 
     const native_handle_t* getConst(void* buffer) {
         auto bufferHandle = static_cast<const native_handle_t*>(buffer);
-
-        std::lock_guard<std::mutex> lock(mMutex);
-        return mBufferHandles.count(bufferHandle) == 1 ? bufferHandle : nullptr;
+        return mBufferHandles.contains(bufferHandle) ? bufferHandle : nullptr;
     }
 
    private:
     std::mutex mMutex;
-    std::unordered_set<const native_handle_t*> mBufferHandles;
+    detail::ImportedBufferSet mBufferHandles;
 };
 
 // Inherit from V2_*::hal::Mapper and override imported buffer management functions
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <cutils/native_handle.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace mapper {
+namespace V2_0 {
+namespace passthrough {
+
+namespace detail {
+
+// ImportedBufferSet is a set of buffer handles whose membership checks are
+// lock-free.  Insertions and removals must be serialized by the caller.
+//
+// The handles live in an open-addressed table of atomic pointers.  A removed
+// handle leaves a tombstone behind so that the probe sequences of the other
+// handles stay intact, and the table is rebuilt once handles and tombstones
+// fill half of it.  Readers may still be probing the table being replaced, so
+// tables are never freed.  They are kept as spares for later rebuilds of the
+// same capacity instead, and the generation is bumped before a spare is
+// rewritten so that readers still probing it retry.
+class ImportedBufferSet {
+   public:
+    ImportedBufferSet() { mTable.store(getTableLocked(kMinCapacity), std::memory_order_relaxed); }
+
+    ImportedBufferSet(const ImportedBufferSet&) = delete;
+    ImportedBufferSet& operator=(const ImportedBufferSet&) = delete;
+
+    bool contains(const native_handle_t* bufferHandle) const {
+        if (!bufferHandle) {
+            return false;
+        }
+
+        while (true) {
+            uint32_t generation = mGeneration.load(std::memory_order_acquire);
+            const Table* table = mTable.load(std::memory_order_acquire);
+            bool found = table->find(bufferHandle) != table->capacity;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (mGeneration.load(std::memory_order_relaxed) == generation) {
+                return found;
+            }
+        }
+    }
+
+    bool insertLocked(const native_handle_t* bufferHandle) {
+        Table* table = mTable.load(std::memory_order_relaxed);
+        if (table->find(bufferHandle) != table->capacity) {
+            return false;
+        }
+
+        if ((mSize + mTombstones + 1) * 2 > table->capacity) {
+            table = rebuildLocked(mSize + 1);
+        }
+
+        std::atomic<const native_handle_t*>& slot = table->slots[table->findFree(bufferHandle)];
+        if (slot.load(std::memory_order_relaxed) == tombstone()) {
+            mTombstones--;
+        }
+        slot.store(bufferHandle, std::memory_order_release);
+        mSize++;
+
+        return true;
+    }
+
+    void removeLocked(const native_handle_t* bufferHandle) {
+        Table* table = mTable.load(std::memory_order_relaxed);
+        size_t index = table->find(bufferHandle);
+        if (index == table->capacity) {
+            return;
+        }
+
+        table->slots[index].store(tombstone(), std::memory_order_release);
+        mSize--;
+        mTombstones++;
+    }
+
+   private:
+    friend class ImportedBufferSetTest;
+
+    static constexpr size_t kMinCapacity = 64;
+
+    // marks the slot of a removed handle
+    static const native_handle_t* tombstone() {
+        static const native_handle_t sTombstone = {};
+        return &sTombstone;
+    }
+
+    struct Table {
+        explicit Table(size_t capacity)
+            : capacity(capacity), slots(new std::atomic<const native_handle_t*>[capacity]) {
+            while ((size_t(1) << (64 - shift)) < capacity) {
+                shift--;
+            }
+            clear();
+        }
+
+        void clear() {
+            for (size_t i = 0; i < capacity; i++) {
+                slots[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        // Fibonacci hashing, as handles are allocated with a coarse alignment
+        size_t home(const native_handle_t* bufferHandle) const {
+            uint64_t key = reinterpret_cast<uintptr_t>(bufferHandle);
+            return static_cast<size_t>((key * 0x9e3779b97f4a7c15ull) >> shift);
+        }
+
+        // Return the slot of bufferHandle, or capacity when it is not in the
+        // table.  The probe is bounded as a reader may be probing a spare
+        // table that is being rewritten.
+        size_t find(const native_handle_t* bufferHandle) const {
+            size_t index = home(bufferHandle);
+            for (size_t probes = 0; probes < capacity; probes++) {
+                const native_handle_t* handle = slots[index].load(std::memory_order_acquire);
+                if (handle == bufferHandle) {
+                    return index;
+                }
+                if (!handle) {
+                    break;
+                }
+                index = (index + 1) & (capacity - 1);
+            }
+            return capacity;
+        }
+
+        // return the first empty or removed slot for bufferHandle
+        size_t findFree(const native_handle_t* bufferHandle) const {
+            size_t index = home(bufferHandle);
+            while (true) {
+                const native_handle_t* handle = slots[index].load(std::memory_order_relaxed);
+                if (!handle || handle == tombstone()) {
+                    return index;
+                }
+                index = (index + 1) & (capacity - 1);
+            }
+        }
+
+        const size_t capacity;
+        uint32_t shift = 64;
+        std::unique_ptr<std::atomic<const native_handle_t*>[]> slots;
+    };
+
+    // return a spare table of the given capacity, or a new one
+    Table* getTableLocked(size_t capacity) {
+        for (auto it = mSpareTables.begin(); it != mSpareTables.end(); ++it) {
+            if ((*it)->capacity == capacity) {
+                Table* table = *it;
+                mSpareTables.erase(it);
+                return table;
+            }
+        }
+
+        mTables.push_back(std::make_unique<Table>(capacity));
+        return mTables.back().get();
+    }
+
+    // move the handles to a table sized for size handles, dropping the
+    // tombstones
+    Table* rebuildLocked(size_t size) {
+        size_t capacity = kMinCapacity;
+        while (capacity < size * 4) {
+            capacity *= 2;
+        }
+
+        Table* oldTable = mTable.load(std::memory_order_relaxed);
+        Table* table = getTableLocked(capacity);
+
+        mGeneration.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        table->clear();
+        for (size_t i = 0; i < oldTable->capacity; i++) {
+            const native_handle_t* handle = oldTable->slots[i].load(std::memory_order_relaxed);
+            if (handle && handle != tombstone()) {
+                table->slots[table->findFree(handle)].store(handle, std::memory_order_relaxed);
+            }
+        }
+
+        mTable.store(table, std::memory_order_release);
+        mSpareTables.push_back(oldTable);
+        mTombstones = 0;
+
+        return table;
+    }
+
+    std::atomic<uint32_t> mGeneration{0};
+    std::atomic<Table*> mTable{nullptr};
+    size_t mSize = 0;
+    size_t mTombstones = 0;
+
+    // at most two tables of each capacity, one of which may be current
+    std::vector<std::unique_ptr<Table>> mTables;
+    std::vector<Table*> mSpareTables;
+};
+
+}  // namespace detail
+
+}  // namespace passthrough
+}  // namespace V2_0
+}  // namespace mapper
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <mapper-passthrough/2.0/ImportedBufferSet.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace mapper {
+namespace V2_0 {
+namespace passthrough {
+namespace detail {
+
+// Handles that are freed with the test, so that their addresses are not
+// reused while the set may still hold them.
+class Handles {
+   public:
+    ~Handles() {
+        for (native_handle_t* handle : mHandles) {
+            native_handle_delete(handle);
+        }
+    }
+
+    const native_handle_t* create() {
+        mHandles.push_back(native_handle_create(0, 0));
+        return mHandles.back();
+    }
+
+   private:
+    std::vector<native_handle_t*> mHandles;
+};
+
+class ImportedBufferSetTest : public ::testing::Test {
+   protected:
+    size_t capacity() const { return mSet.mTable.load()->capacity; }
+
+    size_t tombstones() const { return mSet.mTombstones; }
+
+    uint32_t rebuilds() const { return mSet.mGeneration.load(); }
+
+    size_t tablesOfCapacity(size_t capacity) const {
+        size_t count = 0;
+        for (const auto& table : mSet.mTables) {
+            count += table->capacity == capacity;
+        }
+        return count;
+    }
+
+    size_t tableCount() const { return mSet.mTables.size(); }
+
+    // insert and remove a new handle count times
+    void churn(int count) {
+        for (int i = 0; i < count; i++) {
+            const native_handle_t* handle = mHandles.create();
+            ASSERT_TRUE(mSet.insertLocked(handle));
+            mSet.removeLocked(handle);
+        }
+    }
+
+    ImportedBufferSet mSet;
+    Handles mHandles;
+};
+
+TEST_F(ImportedBufferSetTest, InsertRemoveContains) {
+    const native_handle_t* a = mHandles.create();
+    const native_handle_t* b = mHandles.create();
+
+    EXPECT_FALSE(mSet.contains(nullptr));
+    EXPECT_FALSE(mSet.contains(a));
+
+    EXPECT_TRUE(mSet.insertLocked(a));
+    EXPECT_FALSE(mSet.insertLocked(a));
+    EXPECT_TRUE(mSet.contains(a));
+    EXPECT_FALSE(mSet.contains(b));
+
+    // removing a handle that is not in the set does nothing
+    mSet.removeLocked(b);
+    EXPECT_TRUE(mSet.contains(a));
+    EXPECT_EQ(0u, tombstones());
+
+    mSet.removeLocked(a);
+    EXPECT_FALSE(mSet.contains(a));
+    EXPECT_EQ(1u, tombstones());
+
+    EXPECT_TRUE(mSet.insertLocked(a));
+    EXPECT_TRUE(mSet.contains(a));
+    EXPECT_EQ(0u, tombstones());
+}
+
+TEST_F(ImportedBufferSetTest, GrowthKeepsHandles) {
+    std::vector<const native_handle_t*> handles;
+    for (int i = 0; i < 1000; i++) {
+        handles.push_back(mHandles.create());
+        ASSERT_TRUE(mSet.insertLocked(handles.back()));
+    }
+    EXPECT_GE(capacity(), handles.size() * 2);
+    EXPECT_EQ(0u, tombstones());
+    for (const native_handle_t* handle : handles) {
+        EXPECT_TRUE(mSet.contains(handle));
+    }
+
+    for (size_t i = 0; i < handles.size(); i += 2) {
+        mSet.removeLocked(handles[i]);
+    }
+    for (size_t i = 0; i < handles.size(); i++) {
+        EXPECT_EQ(i % 2 == 1, mSet.contains(handles[i])) << "handle " << i;
+    }
+}
+
+TEST_F(ImportedBufferSetTest, CompactsTombstones) {
+    std::vector<const native_handle_t*> handles;
+    for (int i = 0; i < 10; i++) {
+        handles.push_back(mHandles.create());
+        ASSERT_TRUE(mSet.insertLocked(handles.back()));
+    }
+
+    churn(1000);
+
+    // the tombstones are dropped without growing the table
+    EXPECT_GT(rebuilds(), 0u);
+    EXPECT_EQ(64u, capacity());
+    EXPECT_LE((handles.size() + tombstones()) * 2, capacity());
+    for (const native_handle_t* handle : handles) {
+        EXPECT_TRUE(mSet.contains(handle));
+    }
+}
+
+TEST_F(ImportedBufferSetTest, ReusesSpareTables) {
+    churn(1000);
+
+    // every rebuild swaps the current table with the spare one
+    EXPECT_GT(rebuilds(), 2u);
+    EXPECT_EQ(2u, tableCount());
+
+    // grow, then shrink back when rebuilding with few handles
+    std::vector<const native_handle_t*> handles;
+    for (int i = 0; i < 1000; i++) {
+        handles.push_back(mHandles.create());
+        ASSERT_TRUE(mSet.insertLocked(handles.back()));
+    }
+    size_t grownTables = tableCount();
+    for (const native_handle_t* handle : handles) {
+        mSet.removeLocked(handle);
+    }
+    // how soon the tombstones fill half the table depends on where the
+    // handles hash to
+    for (int i = 0; i < 100000 && capacity() != 64; i++) {
+        churn(1);
+    }
+    ASSERT_EQ(64u, capacity());
+    churn(1000);
+
+    // shrinking and the rebuilds after it only used spare tables
+    EXPECT_EQ(grownTables, tableCount());
+    EXPECT_EQ(2u, tablesOfCapacity(64));
+}
+
+// Writers churn the set and force rebuilds, while readers look up handles
+// that are in the set for the whole test and one that never is.
+TEST_F(ImportedBufferSetTest, ConcurrentLookups) {
+    constexpr int kReaders = 4;
+    constexpr int kWriters = 2;
+
+    std::vector<const native_handle_t*> stable;
+    for (int i = 0; i < 100; i++) {
+        stable.push_back(mHandles.create());
+        ASSERT_TRUE(mSet.insertLocked(stable.back()));
+    }
+    const native_handle_t* never = mHandles.create();
+
+    std::mutex mutex;
+    std::atomic<bool> done{false};
+    std::atomic<int> misses{0};
+    std::atomic<int> falseHits{0};
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < kReaders; r++) {
+        readers.emplace_back([&] {
+            while (!done.load()) {
+                for (const native_handle_t* handle : stable) {
+                    misses += !mSet.contains(handle);
+                }
+                falseHits += mSet.contains(never);
+            }
+        });
+    }
+
+    std::vector<std::thread> writers;
+    for (int w = 0; w < kWriters; w++) {
+        writers.emplace_back([&, w] {
+            Handles owned;
+            for (int i = 0; i < 200; i++) {
+                // vary the number of handles so that the table grows and shrinks
+                std::vector<const native_handle_t*> handles;
+                for (int j = 0; j < (i * 37 + w * 101) % 300; j++) {
+                    handles.push_back(owned.create());
+                    std::lock_guard<std::mutex> lock(mutex);
+                    mSet.insertLocked(handles.back());
+                }
+                for (const native_handle_t* handle : handles) {
+                    misses += !mSet.contains(handle);
+                }
+                for (const native_handle_t* handle : handles) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    mSet.removeLocked(handle);
+                }
+                for (const native_handle_t* handle : handles) {
+                    falseHits += mSet.contains(handle);
+                }
+            }
+        });
+    }
+
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    EXPECT_GT(rebuilds(), 0u);
+    EXPECT_EQ(0, misses.load());
+    EXPECT_EQ(0, falseHits.load());
+    for (const native_handle_t* handle : stable) {
+        EXPECT_TRUE(mSet.contains(handle));
+    }
+}
+
+}  // namespace detail
+}  // namespace passthrough
+}  // namespace V2_0
+}  // namespace mapper
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2021, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <cppbor.h>
+
+#include "FakeSecureHardwareProxy.h"
+#include "IdentityCredential.h"
+#include "IdentityCredentialStore.h"
+
+// Presents an mDL with a portrait and a few dozen other data elements from a
+// credential provisioned with the in-process libeic backend, retrieving the
+// entries one call per chunk and in a single retrieveEntryValues() call. The
+// HAL is called in-process, so the transactions counter is what binder round
+// trips would add on top.
+
+using std::optional;
+using std::string;
+using std::vector;
+
+using aidl::android::hardware::identity::IdentityCredential;
+using aidl::android::hardware::identity::IdentityCredentialStore;
+using aidl::android::hardware::identity::IIdentityCredentialStore;
+using aidl::android::hardware::identity::RequestDataItem;
+using aidl::android::hardware::identity::RequestNamespace;
+using aidl::android::hardware::identity::RetrieveEntryValueRequest;
+using aidl::android::hardware::identity::RetrieveEntryValueResult;
+using aidl::android::hardware::identity::SecureAccessControlProfile;
+using aidl::android::hardware::keymaster::HardwareAuthToken;
+using android::sp;
+using android::hardware::identity::FakeSecureHardwareProvisioningProxy;
+using android::hardware::identity::FakeSecureHardwareProxyFactory;
+
+namespace {
+
+constexpr size_t kPortraitSize = 150 * 1024;
+constexpr size_t kNumOtherElements = 40;
+
+const string kDocType = "org.iso.18013.5.1.mDL";
+const string kNameSpace = "org.iso.18013.5.1";
+
+struct Element {
+    string name;
+    vector<uint8_t> value;  // CBOR
+    vector<vector<uint8_t>> encryptedChunks;
+};
+
+struct Credential {
+    vector<Element> elements;
+    vector<uint8_t> credentialData;
+    SecureAccessControlProfile profile;
+};
+
+// Provisions the elements with a single access control profile, which doesn't
+// require user or reader authentication.
+Credential provision() {
+    Credential credential;
+    credential.elements.push_back(
+            {"portrait", cppbor::Bstr(vector<uint8_t>(kPortraitSize, 0x42)).encode(), {}});
+    for (size_t n = 0; n < kNumOtherElements; n++) {
+        credential.elements.push_back({"element_" + std::to_string(n),
+                                       cppbor::Tstr(string(32, 'a' + n % 26)).encode(),
+                                       {}});
+    }
+
+    cppbor::Array entries;
+    for (const Element& element : credential.elements) {
+        auto [valueItem, _, message] = cppbor::parse(element.value);
+        entries.add(cppbor::Map()
+                            .add("name", element.name)
+                            .add("value", std::move(valueItem))
+                            .add("accessControlProfiles", cppbor::Array().add(0)));
+    }
+    cppbor::Array proofOfProvisioning;
+    proofOfProvisioning.add("ProofOfProvisioning")
+            .add(kDocType)
+            .add(cppbor::Array().add(cppbor::Map().add("id", 0)))
+            .add(cppbor::Map().add(kNameSpace, std::move(entries)))
+            .add(false);
+    size_t proofOfProvisioningSize = proofOfProvisioning.encode().size();
+
+    FakeSecureHardwareProvisioningProxy provisioningProxy;
+    CHECK(provisioningProxy.initialize(false /* testCredential */));
+    CHECK(provisioningProxy.createCredentialKey({0x01, 0x02}, {0x03, 0x04}));
+    CHECK(provisioningProxy.startPersonalization(1, {int(credential.elements.size())}, kDocType,
+                                                 proofOfProvisioningSize));
+    optional<vector<uint8_t>> mac = provisioningProxy.addAccessControlProfile(
+            0, {} /* readerCertificate */, false /* userAuthenticationRequired */,
+            0 /* timeoutMillis */, 0 /* secureUserId */);
+    CHECK(mac);
+
+    const vector<int> acpIds = {0};
+    for (Element& element : credential.elements) {
+        CHECK(provisioningProxy.beginAddEntry(acpIds, kNameSpace, element.name,
+                                              element.value.size()));
+        for (size_t offset = 0; offset < element.value.size();
+             offset += IdentityCredentialStore::kGcmChunkSize) {
+            size_t size = std::min(IdentityCredentialStore::kGcmChunkSize,
+                                   element.value.size() - offset);
+            optional<vector<uint8_t>> encryptedChunk = provisioningProxy.addEntryValue(
+                    acpIds, kNameSpace, element.name,
+                    vector<uint8_t>(element.value.begin() + offset,
+                                    element.value.begin() + offset + size));
+            CHECK(encryptedChunk);
+            element.encryptedChunks.push_back(encryptedChunk.value());
+        }
+    }
+    CHECK(provisioningProxy.finishAddingEntries());
+    optional<vector<uint8_t>> encryptedCredentialKeys =
+            provisioningProxy.finishGetCredentialData(kDocType);
+    CHECK(encryptedCredentialKeys);
+    CHECK(provisioningProxy.shutdown());
+
+    credential.credentialData =
+            cppbor::Array().add(kDocType).add(false).add(encryptedCredentialKeys.value()).encode();
+    credential.profile.id = 0;
+    credential.profile.mac = mac.value();
+    return credential;
+}
+
+const Credential& getCredential() {
+    static const Credential credential = provision();
+    return credential;
+}
+
+std::shared_ptr<IdentityCredential> presentCredential(const Credential& credential) {
+    sp<FakeSecureHardwareProxyFactory> factory = new FakeSecureHardwareProxyFactory();
+    std::shared_ptr<IdentityCredential> identityCredential =
+            ndk::SharedRefBase::make<IdentityCredential>(
+                    factory, factory->createPresentationProxy(), credential.credentialData);
+    CHECK(identityCredential->initialize() == IIdentityCredentialStore::STATUS_OK);
+
+    RequestNamespace requestNamespace;
+    requestNamespace.namespaceName = kNameSpace;
+    for (const Element& element : credential.elements) {
+        RequestDataItem item;
+        item.name = element.name;
+        item.size = element.value.size();
+        item.accessControlProfileIds = {0};
+        requestNamespace.items.push_back(item);
+    }
+    CHECK(identityCredential->setRequestedNamespaces({requestNamespace}).isOk());
+    return identityCredential;
+}
+
+bool startRetrieval(IdentityCredential* identityCredential, const Credential& credential) {
+    return identityCredential
+            ->startRetrieval({credential.profile}, HardwareAuthToken(), {} /* itemsRequest */,
+                             {} /* signingKeyBlob */, {} /* sessionTranscript */,
+                             {} /* readerSignature */, {int(credential.elements.size())})
+            .isOk();
+}
+
+bool finishRetrieval(IdentityCredential* identityCredential) {
+    vector<uint8_t> mac;
+    vector<uint8_t> deviceNameSpaces;
+    if (!identityCredential->finishRetrieval(&mac, &deviceNameSpaces).isOk()) {
+        return false;
+    }
+    benchmark::DoNotOptimize(deviceNameSpaces.data());
+    return true;
+}
+
+void BM_RetrieveEachChunk(benchmark::State& state) {
+    const Credential& credential = getCredential();
+    std::shared_ptr<IdentityCredential> identityCredential = presentCredential(credential);
+    size_t transactions = 0;
+    for (auto _ : state) {
+        transactions = 2;
+        bool ok = startRetrieval(identityCredential.get(), credential);
+        for (const Element& element : credential.elements) {
+            ok = ok && identityCredential
+                               ->startRetrieveEntryValue(kNameSpace, element.name,
+                                                         element.value.size(), {0})
+                               .isOk();
+            transactions++;
+            for (const vector<uint8_t>& encryptedChunk : element.encryptedChunks) {
+                vector<uint8_t> content;
+                ok = ok && identityCredential->retrieveEntryValue(encryptedChunk, &content).isOk();
+                transactions++;
+            }
+        }
+        if (!ok || !finishRetrieval(identityCredential.get())) {
+            state.SkipWithError("Retrieval failed");
+            break;
+        }
+    }
+    state.counters["transactions"] = transactions;
+}
+
+void BM_RetrieveAllEntries(benchmark::State& state) {
+    const Credential& credential = getCredential();
+    std::shared_ptr<IdentityCredential> identityCredential = presentCredential(credential);
+    vector<RetrieveEntryValueRequest> requests;
+    for (const Element& element : credential.elements) {
+        RetrieveEntryValueRequest request;
+        request.nameSpace = kNameSpace;
+        request.name = element.name;
+        request.entrySize = element.value.size();
+        request.accessControlProfileIds = {0};
+        for (const vector<uint8_t>& encryptedChunk : element.encryptedChunks) {
+            request.encryptedContent.insert(request.encryptedContent.end(),
+                                            encryptedChunk.begin(), encryptedChunk.end());
+        }
+        requests.push_back(request);
+    }
+    for (auto _ : state) {
+        vector<RetrieveEntryValueResult> results;
+        bool ok = startRetrieval(identityCredential.get(), credential) &&
+                  identityCredential->retrieveEntryValues(requests, &results).isOk();
+        for (const RetrieveEntryValueResult& result : results) {
+            ok = ok && result.status == IIdentityCredentialStore::STATUS_OK;
+        }
+        if (!ok || !finishRetrieval(identityCredential.get())) {
+            state.SkipWithError("Retrieval failed");
+            break;
+        }
+    }
+    state.counters["transactions"] = 3;
+}
+
+}  // namespace
+
+BENCHMARK(BM_RetrieveEachChunk);
+BENCHMARK(BM_RetrieveAllEntries);
+
+BENCHMARK_MAIN();
@@ -23,6 +23,8 @@
 
 #include <string.h>
 
+#include <algorithm>
+
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 
@@ -515,8 +517,11 @@ ndk::ScopedAStatus IdentityCredential::startRetrieval(
         }
     }
 
-    deviceNameSpacesMap_ = cppbor::Map();
-    currentNameSpaceDeviceNameSpacesMap_ = cppbor::Map();
+    numDeviceNameSpaces_ = 0;
+    deviceNameSpacesEntries_.clear();
+    numCurrentNameSpaceEntries_ = 0;
+    currentNameSpaceEntries_.clear();
+    currentEntryOffset_.reset();
 
     requestCountsRemaining_ = requestCounts;
     currentNameSpace_ = "";
@@ -576,6 +581,28 @@ size_t cborNumBytesForTstr(const string& value) {
     return 1 + cborNumBytesForLength(value.size()) + value.size();
 }
 
+void cborAppendHeader(cppbor::MajorType type, size_t length, vector<uint8_t>* out) {
+    size_t numBytesForLength = cborNumBytesForLength(length);
+    if (numBytesForLength == 0) {
+        out->push_back(type | length);
+        return;
+    }
+    // Additional information 24, 25, 26 and 27 stand for 1, 2, 4 and 8 bytes of length.
+    uint8_t additionalInfo = numBytesForLength == 1   ? 24
+                             : numBytesForLength == 2 ? 25
+                             : numBytesForLength == 4 ? 26
+                                                      : 27;
+    out->push_back(type | additionalInfo);
+    for (size_t n = numBytesForLength; n > 0; n--) {
+        out->push_back((length >> (8 * (n - 1))) & 0xff);
+    }
+}
+
+void cborAppendTstr(const string& value, vector<uint8_t>* out) {
+    cborAppendHeader(cppbor::TSTR, value.size(), out);
+    out->insert(out->end(), value.begin(), value.end());
+}
+
 void IdentityCredential::calcDeviceNameSpacesSize(uint32_t accessControlProfileMask) {
     /*
      * This is how DeviceNameSpaces is defined:
@@ -665,6 +692,8 @@ void IdentityCredential::calcDeviceNameSpacesSize(uint32_t accessControlProfileM
 ndk::ScopedAStatus IdentityCredential::startRetrieveEntryValue(
         const string& nameSpace, const string& name, int32_t entrySize,
         const vector<int32_t>& accessControlProfileIds) {
+    discardIncompleteEntry();
+
     if (name.empty()) {
         return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                 IIdentityCredentialStore::STATUS_INVALID_DATA, "Name cannot be empty"));
@@ -703,11 +732,7 @@ ndk::ScopedAStatus IdentityCredential::startRetrieveEntryValue(
                     "Moved to new name space but one or more entries need to be retrieved "
                     "in current name space"));
         }
-        if (currentNameSpaceDeviceNameSpacesMap_.size() > 0) {
-            deviceNameSpacesMap_.add(currentNameSpace_,
-                                     std::move(currentNameSpaceDeviceNameSpacesMap_));
-        }
-        currentNameSpaceDeviceNameSpacesMap_ = cppbor::Map();
+        finishCurrentNameSpace();
 
         requestCountsRemaining_.erase(requestCountsRemaining_.begin());
         currentNameSpace_ = nameSpace;
@@ -778,13 +803,46 @@ ndk::ScopedAStatus IdentityCredential::startRetrieveEntryValue(
     currentName_ = name;
     currentAccessControlProfileIds_ = accessControlProfileIds;
     entryRemainingBytes_ = entrySize;
-    entryValue_.resize(0);
+    currentEntryOffset_ = currentNameSpaceEntries_.size();
+    cborAppendTstr(name, &currentNameSpaceEntries_);
 
     return ndk::ScopedAStatus::ok();
 }
 
+void IdentityCredential::discardIncompleteEntry() {
+    if (currentEntryOffset_) {
+        currentNameSpaceEntries_.resize(currentEntryOffset_.value());
+        currentEntryOffset_.reset();
+    }
+}
+
+void IdentityCredential::finishCurrentNameSpace() {
+    if (numCurrentNameSpaceEntries_ > 0) {
+        cborAppendTstr(currentNameSpace_, &deviceNameSpacesEntries_);
+        cborAppendHeader(cppbor::MAP, numCurrentNameSpaceEntries_, &deviceNameSpacesEntries_);
+        deviceNameSpacesEntries_.insert(deviceNameSpacesEntries_.end(),
+                                        currentNameSpaceEntries_.begin(),
+                                        currentNameSpaceEntries_.end());
+        numDeviceNameSpaces_ += 1;
+    }
+    numCurrentNameSpaceEntries_ = 0;
+    currentNameSpaceEntries_.clear();
+}
+
 ndk::ScopedAStatus IdentityCredential::retrieveEntryValue(const vector<uint8_t>& encryptedContent,
                                                           vector<uint8_t>* outContent) {
+    outContent->clear();
+    return retrieveEntryValueChunk(encryptedContent, outContent);
+}
+
+ndk::ScopedAStatus IdentityCredential::retrieveEntryValueChunk(
+        const vector<uint8_t>& encryptedContent, vector<uint8_t>* outContent) {
+    if (!currentEntryOffset_) {
+        return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                IIdentityCredentialStore::STATUS_INVALID_DATA,
+                "No entry value is being retrieved"));
+    }
+
     optional<vector<uint8_t>> content = hwProxy_->retrieveEntryValue(
             encryptedContent, currentNameSpace_, currentName_, currentAccessControlProfileIds_);
     if (!content) {
@@ -811,29 +869,78 @@ ndk::ScopedAStatus IdentityCredential::retrieveEntryValue(const vector<uint8_t>&
         }
     }
 
-    entryValue_.insert(entryValue_.end(), content.value().begin(), content.value().end());
-
+    // The value was authenticated by the secure hardware, which also includes it as is in
+    // the MACed DeviceNameSpaces, so it is spliced in without being parsed.
+    currentNameSpaceEntries_.insert(currentNameSpaceEntries_.end(), content.value().begin(),
+                                    content.value().end());
     if (entryRemainingBytes_ == 0) {
-        auto [entryValueItem, _, message] = cppbor::parse(entryValue_);
-        if (entryValueItem == nullptr) {
+        numCurrentNameSpaceEntries_ += 1;
+        currentEntryOffset_.reset();
+    }
+
+    outContent->insert(outContent->end(), content.value().begin(), content.value().end());
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus IdentityCredential::retrieveEntryValues(
+        const vector<RetrieveEntryValueRequest>& requests,
+        vector<RetrieveEntryValueResult>* outResults) {
+    // Each chunk is prefixed with its nonce and followed by its tag.
+    const size_t encryptedChunkSize = IdentityCredentialStore::kGcmChunkSize +
+                                      support::kAesGcmIvSize + support::kAesGcmTagSize;
+
+    vector<RetrieveEntryValueResult> results(requests.size());
+    vector<uint8_t> encryptedChunk;
+    for (size_t n = 0; n < requests.size(); n++) {
+        const RetrieveEntryValueRequest& request = requests[n];
+        RetrieveEntryValueResult& result = results[n];
+
+        ndk::ScopedAStatus status =
+                startRetrieveEntryValue(request.nameSpace, request.name, request.entrySize,
+                                        request.accessControlProfileIds);
+        if (!status.isOk()) {
+            if (status.getExceptionCode() != EX_SERVICE_SPECIFIC) {
+                return status;
+            }
+            result.status = status.getServiceSpecificError();
+            continue;
+        }
+
+        result.status = IIdentityCredentialStore::STATUS_OK;
+        const vector<uint8_t>& encryptedContent = request.encryptedContent;
+        result.content.reserve(encryptedContent.size());
+        for (size_t offset = 0; offset < encryptedContent.size();) {
+            size_t size = std::min(encryptedChunkSize, encryptedContent.size() - offset);
+            encryptedChunk.assign(encryptedContent.begin() + offset,
+                                  encryptedContent.begin() + offset + size);
+            offset += size;
+            status = retrieveEntryValueChunk(encryptedChunk, &result.content);
+            if (!status.isOk()) {
+                return status;
+            }
+        }
+        if (currentEntryOffset_) {
             return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                     IIdentityCredentialStore::STATUS_INVALID_DATA,
-                    "Retrieved data which is invalid CBOR"));
+                    "Encrypted content doesn't hold the whole entry value"));
         }
-        currentNameSpaceDeviceNameSpacesMap_.add(currentName_, std::move(entryValueItem));
     }
 
-    *outContent = content.value();
+    *outResults = std::move(results);
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus IdentityCredential::finishRetrieval(vector<uint8_t>* outMac,
                                                        vector<uint8_t>* outDeviceNameSpaces) {
-    if (currentNameSpaceDeviceNameSpacesMap_.size() > 0) {
-        deviceNameSpacesMap_.add(currentNameSpace_,
-                                 std::move(currentNameSpaceDeviceNameSpacesMap_));
-    }
-    vector<uint8_t> encodedDeviceNameSpaces = deviceNameSpacesMap_.encode();
+    discardIncompleteEntry();
+    finishCurrentNameSpace();
+    vector<uint8_t> encodedDeviceNameSpaces;
+    encodedDeviceNameSpaces.reserve(1 + cborNumBytesForLength(numDeviceNameSpaces_) +
+                                    deviceNameSpacesEntries_.size());
+    cborAppendHeader(cppbor::MAP, numDeviceNameSpaces_, &encodedDeviceNameSpaces);
+    encodedDeviceNameSpaces.insert(encodedDeviceNameSpaces.end(),
+                                   deviceNameSpacesEntries_.begin(),
+                                   deviceNameSpacesEntries_.end());
 
     if (encodedDeviceNameSpaces.size() != expectedDeviceNameSpacesSize_) {
         LOG(ERROR) << "encodedDeviceNameSpaces is " << encodedDeviceNameSpaces.size() << " bytes, "
@@ -862,7 +969,7 @@ ndk::ScopedAStatus IdentityCredential::finishRetrieval(vector<uint8_t>* outMac,
     }
 
     *outMac = mac.value_or(vector<uint8_t>({}));
-    *outDeviceNameSpaces = encodedDeviceNameSpaces;
+    *outDeviceNameSpaces = std::move(encodedDeviceNameSpaces);
     return ndk::ScopedAStatus::ok();
 }
 
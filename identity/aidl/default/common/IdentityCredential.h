@@ -23,6 +23,7 @@
 #include <android/hardware/identity/support/IdentityCredentialSupport.h>
 
 #include <map>
+#include <optional>
 #include <set>
 #include <string>
 #include <vector>
@@ -39,6 +40,7 @@ using ::aidl::android::hardware::keymaster::VerificationToken;
 using ::android::sp;
 using ::android::hardware::identity::SecureHardwarePresentationProxy;
 using ::std::map;
+using ::std::optional;
 using ::std::set;
 using ::std::string;
 using ::std::vector;
@@ -52,6 +54,8 @@ class IdentityCredential : public BnIdentityCredential {
           hwProxy_(hwProxy),
           credentialData_(credentialData),
           numStartRetrievalCalls_(0),
+          numDeviceNameSpaces_(0),
+          numCurrentNameSpaceEntries_(0),
           expectedDeviceNameSpacesSize_(0) {}
 
     // Parses and decrypts credentialData_, return a status code from
@@ -81,6 +85,9 @@ class IdentityCredential : public BnIdentityCredential {
             const vector<int32_t>& accessControlProfileIds) override;
     ndk::ScopedAStatus retrieveEntryValue(const vector<uint8_t>& encryptedContent,
                                           vector<uint8_t>* outContent) override;
+    ndk::ScopedAStatus retrieveEntryValues(
+            const vector<RetrieveEntryValueRequest>& requests,
+            vector<RetrieveEntryValueResult>* outResults) override;
     ndk::ScopedAStatus finishRetrieval(vector<uint8_t>* outMac,
                                        vector<uint8_t>* outDeviceNameSpaces) override;
     ndk::ScopedAStatus generateSigningKeyPair(vector<uint8_t>* outSigningKeyBlob,
@@ -94,6 +101,14 @@ class IdentityCredential : public BnIdentityCredential {
                                               bool includeChallenge,
                                               vector<uint8_t>* outProofOfDeletionSignature);
 
+    // Decrypts a chunk of the entry value being retrieved and appends it to outContent.
+    ndk::ScopedAStatus retrieveEntryValueChunk(const vector<uint8_t>& encryptedContent,
+                                               vector<uint8_t>* outContent);
+    // Drops what was retrieved of the entry value being retrieved, if any.
+    void discardIncompleteEntry();
+    // Moves the entries of the current namespace to deviceNameSpacesEntries_.
+    void finishCurrentNameSpace();
+
     // Set by constructor
     sp<SecureHardwareProxyFactory> hwProxyFactory_;
     sp<SecureHardwarePresentationProxy> hwProxy_;
@@ -123,8 +138,15 @@ class IdentityCredential : public BnIdentityCredential {
     vector<uint8_t> itemsRequest_;
     vector<int32_t> requestCountsRemaining_;
     map<string, set<string>> requestedNameSpacesAndNames_;
-    cppbor::Map deviceNameSpacesMap_;
-    cppbor::Map currentNameSpaceDeviceNameSpacesMap_;
+
+    // DeviceNameSpaces is assembled from the retrieved entry values as they are, without
+    // decoding them. These hold the encoded NameSpace => DeviceSignedItems pairs of the
+    // namespaces retrieved so far, and the encoded DataItemName => DataItemValue pairs of
+    // the current namespace.
+    size_t numDeviceNameSpaces_;
+    vector<uint8_t> deviceNameSpacesEntries_;
+    size_t numCurrentNameSpaceEntries_;
+    vector<uint8_t> currentNameSpaceEntries_;
 
     // Calculated at startRetrieval() time.
     size_t expectedDeviceNameSpacesSize_;
@@ -135,7 +157,8 @@ class IdentityCredential : public BnIdentityCredential {
     string currentName_;
     vector<int32_t> currentAccessControlProfileIds_;
     size_t entryRemainingBytes_;
-    vector<uint8_t> entryValue_;
+    // Where the entry being retrieved starts in currentNameSpaceEntries_, until it is complete.
+    optional<size_t> currentEntryOffset_;
 
     void calcDeviceNameSpacesSize(uint32_t accessControlProfileMask);
 };
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RetrieveEntryValuesTests"
+
+#include <aidl/Gtest.h>
+#include <aidl/Vintf.h>
+#include <android-base/logging.h>
+#include <android/hardware/identity/IIdentityCredentialStore.h>
+#include <android/hardware/identity/support/IdentityCredentialSupport.h>
+#include <binder/IServiceManager.h>
+#include <binder/ProcessState.h>
+#include <cppbor.h>
+#include <cppbor_parse.h>
+#include <gtest/gtest.h>
+#include <map>
+
+#include "Util.h"
+
+namespace android::hardware::identity {
+
+using std::map;
+using std::optional;
+using std::string;
+using std::vector;
+
+using ::android::sp;
+using ::android::String16;
+using ::android::binder::Status;
+
+using ::android::hardware::keymaster::HardwareAuthToken;
+using ::android::hardware::keymaster::VerificationToken;
+
+// Checks that retrieveEntryValues() is a drop-in replacement for startRetrieveEntryValue()
+// followed by retrieveEntryValue() for each chunk.
+class RetrieveEntryValuesTests : public testing::TestWithParam<string> {
+  public:
+    virtual void SetUp() override {
+        credentialStore_ = android::waitForDeclaredService<IIdentityCredentialStore>(
+                String16(GetParam().c_str()));
+        ASSERT_NE(credentialStore_, nullptr);
+        if (credentialStore_->getInterfaceVersion() < 4) {
+            GTEST_SKIP() << "retrieveEntryValues() was introduced in API version 4";
+        }
+    }
+
+    void provisionData();
+    void presentCredential();
+    void startRetrieval();
+    vector<RetrieveEntryValueRequest> buildRequests();
+
+    // Set by provisionData()
+    vector<test_utils::TestEntryData> entries_;
+    vector<int32_t> entryCounts_;
+    map<const test_utils::TestEntryData*, vector<vector<uint8_t>>> encryptedBlobs_;
+    vector<SecureAccessControlProfile> secureProfiles_;
+    vector<uint8_t> credentialData_;
+
+    // Set by presentCredential()
+    sp<IIdentityCredential> credential_;
+    vector<uint8_t> signingKeyBlob_;
+    vector<uint8_t> sessionTranscriptEncoded_;
+
+    sp<IIdentityCredentialStore> credentialStore_;
+};
+
+void RetrieveEntryValuesTests::provisionData() {
+    vector<uint8_t> portraitImage;
+    test_utils::setImageData(portraitImage);
+
+    // "Home address" has no access control profiles, so it fails its access check in the
+    // middle of the PersonalData namespace. The portrait spans several chunks.
+    entries_ = {
+            {"PersonalData", "Last name", string("Turing"), vector<int32_t>{0}},
+            {"PersonalData", "Home address", string("Maida Vale, London, England"),
+             vector<int32_t>{}},
+            {"PersonalData", "First name", string("Alan"), vector<int32_t>{0}},
+            {"Image", "Portrait image", portraitImage, vector<int32_t>{0}},
+    };
+    entryCounts_ = {3, 1};
+
+    // The ProofOfProvisioning the HAL will build, to learn its size.
+    map<string, cppbor::Array> nameSpaces;
+    for (const auto& entry : entries_) {
+        auto [valueItem, _, message] = cppbor::parse(entry.valueCbor);
+        ASSERT_NE(valueItem, nullptr) << message;
+        cppbor::Array profileIds;
+        for (int32_t id : entry.profileIds) {
+            profileIds.add(id);
+        }
+        nameSpaces[entry.nameSpace].add(cppbor::Map()
+                                                .add("name", entry.name)
+                                                .add("value", std::move(valueItem))
+                                                .add("accessControlProfiles",
+                                                     std::move(profileIds)));
+    }
+    size_t proofOfProvisioningSize =
+            cppbor::Array()
+                    .add("ProofOfProvisioning")
+                    .add("org.iso.18013-5.2019.mdl")
+                    .add(cppbor::Array().add(cppbor::Map().add("id", 0)))
+                    .add(cppbor::Map()
+                                 .add("PersonalData", std::move(nameSpaces["PersonalData"]))
+                                 .add("Image", std::move(nameSpaces["Image"])))
+                    .add(true)
+                    .encode()
+                    .size();
+
+    HardwareInformation hwInfo;
+    ASSERT_TRUE(credentialStore_->getHardwareInformation(&hwInfo).isOk());
+
+    sp<IWritableIdentityCredential> wc;
+    ASSERT_TRUE(test_utils::setupWritableCredential(wc, credentialStore_,
+                                                    true /* testCredential */));
+    test_utils::AttestationData attData(wc, "attestationChallenge",
+                                        {1} /* attestationApplicationId */);
+    ASSERT_TRUE(attData.result.isOk());
+    ASSERT_TRUE(wc->setExpectedProofOfProvisioningSize(proofOfProvisioningSize).isOk());
+    ASSERT_TRUE(wc->startPersonalization(1 /* numAccessControlProfiles */, entryCounts_).isOk());
+
+    optional<vector<SecureAccessControlProfile>> secureProfiles =
+            test_utils::addAccessControlProfiles(wc, {{0, {}, false, 0}});
+    ASSERT_TRUE(secureProfiles);
+    secureProfiles_ = secureProfiles.value();
+
+    for (const auto& entry : entries_) {
+        ASSERT_TRUE(test_utils::addEntry(wc, entry, hwInfo.dataChunkSize, encryptedBlobs_, true));
+    }
+
+    vector<uint8_t> proofOfProvisioningSignature;
+    ASSERT_TRUE(wc->finishAddingEntries(&credentialData_, &proofOfProvisioningSignature).isOk());
+}
+
+// Sets up a presentation with a reader ephemeral key and a signing key, so that
+// finishRetrieval() returns a MAC. Retrievals started on the same credential_ use the same
+// keys and SessionTranscript, so they MAC the same DeviceNameSpaces the same way.
+void RetrieveEntryValuesTests::presentCredential() {
+    ASSERT_TRUE(credentialStore_
+                        ->getCredential(
+                                CipherSuite::CIPHERSUITE_ECDHE_HKDF_ECDSA_WITH_AES_256_GCM_SHA256,
+                                credentialData_, &credential_)
+                        .isOk());
+    ASSERT_NE(credential_, nullptr);
+
+    optional<vector<uint8_t>> readerEphemeralKeyPair = support::createEcKeyPair();
+    ASSERT_TRUE(readerEphemeralKeyPair);
+    optional<vector<uint8_t>> readerEphemeralPublicKey =
+            support::ecKeyPairGetPublicKey(readerEphemeralKeyPair.value());
+    ASSERT_TRUE(credential_->setReaderEphemeralPublicKey(readerEphemeralPublicKey.value()).isOk());
+
+    vector<uint8_t> ephemeralKeyPair;
+    ASSERT_TRUE(credential_->createEphemeralKeyPair(&ephemeralKeyPair).isOk());
+    optional<vector<uint8_t>> ephemeralPublicKey = support::ecKeyPairGetPublicKey(ephemeralKeyPair);
+    ASSERT_TRUE(ephemeralPublicKey);
+
+    auto [getXYSuccess, ephX, ephY] = support::ecPublicKeyGetXandY(ephemeralPublicKey.value());
+    ASSERT_TRUE(getXYSuccess);
+    cppbor::Map deviceEngagement = cppbor::Map().add("ephX", ephX).add("ephY", ephY);
+    vector<uint8_t> deviceEngagementBytes = deviceEngagement.encode();
+    vector<uint8_t> eReaderPubBytes = cppbor::Tstr("ignored").encode();
+    sessionTranscriptEncoded_ = cppbor::Array()
+                                        .add(cppbor::SemanticTag(24, deviceEngagementBytes))
+                                        .add(cppbor::SemanticTag(24, eReaderPubBytes))
+                                        .encode();
+
+    Certificate signingKeyCertificate;
+    ASSERT_TRUE(
+            credential_->generateSigningKeyPair(&signingKeyBlob_, &signingKeyCertificate).isOk());
+}
+
+void RetrieveEntryValuesTests::startRetrieval() {
+    // No user auth is needed for the test data, so clear out the tokens we pass to the HAL.
+    HardwareAuthToken authToken;
+    VerificationToken verificationToken;
+    authToken.challenge = 0;
+    authToken.userId = 0;
+    authToken.authenticatorId = 0;
+    authToken.authenticatorType = ::android::hardware::keymaster::HardwareAuthenticatorType::NONE;
+    authToken.timestamp.milliSeconds = 0;
+    authToken.mac.clear();
+    verificationToken.challenge = 0;
+    verificationToken.timestamp.milliSeconds = 0;
+    verificationToken.securityLevel = ::android::hardware::keymaster::SecurityLevel::SOFTWARE;
+    verificationToken.mac.clear();
+
+    ASSERT_TRUE(
+            credential_->setRequestedNamespaces(test_utils::buildRequestNamespaces(entries_))
+                    .isOk());
+    ASSERT_TRUE(credential_->setVerificationToken(verificationToken).isOk());
+    ASSERT_TRUE(credential_
+                        ->startRetrieval(secureProfiles_, authToken, {} /* itemsRequest */,
+                                         signingKeyBlob_, sessionTranscriptEncoded_,
+                                         {} /* readerSignature */, entryCounts_)
+                        .isOk());
+}
+
+vector<RetrieveEntryValueRequest> RetrieveEntryValuesTests::buildRequests() {
+    vector<RetrieveEntryValueRequest> requests;
+    for (const auto& entry : entries_) {
+        RetrieveEntryValueRequest request;
+        request.nameSpace = entry.nameSpace;
+        request.name = entry.name;
+        request.entrySize = entry.valueCbor.size();
+        request.accessControlProfileIds = entry.profileIds;
+        for (const auto& encryptedChunk : encryptedBlobs_[&entry]) {
+            request.encryptedContent.insert(request.encryptedContent.end(),
+                                            encryptedChunk.begin(), encryptedChunk.end());
+        }
+        requests.push_back(request);
+    }
+    return requests;
+}
+
+TEST_P(RetrieveEntryValuesTests, sameResultAsRetrieveEntryValue) {
+    ASSERT_NO_FATAL_FAILURE(provisionData());
+    ASSERT_NO_FATAL_FAILURE(presentCredential());
+
+    // One entry, and one chunk, at a time.
+    ASSERT_NO_FATAL_FAILURE(startRetrieval());
+    vector<int32_t> statuses;
+    vector<vector<uint8_t>> contents;
+    for (const auto& entry : entries_) {
+        Status status = credential_->startRetrieveEntryValue(
+                entry.nameSpace, entry.name, entry.valueCbor.size(), entry.profileIds);
+        vector<uint8_t> content;
+        if (status.isOk()) {
+            statuses.push_back(IIdentityCredentialStore::STATUS_OK);
+            for (const auto& encryptedChunk : encryptedBlobs_[&entry]) {
+                vector<uint8_t> chunk;
+                ASSERT_TRUE(credential_->retrieveEntryValue(encryptedChunk, &chunk).isOk());
+                content.insert(content.end(), chunk.begin(), chunk.end());
+            }
+        } else {
+            ASSERT_EQ(binder::Status::EX_SERVICE_SPECIFIC, status.exceptionCode());
+            statuses.push_back(status.serviceSpecificErrorCode());
+        }
+        contents.push_back(content);
+    }
+    vector<uint8_t> mac;
+    vector<uint8_t> deviceNameSpaces;
+    ASSERT_TRUE(credential_->finishRetrieval(&mac, &deviceNameSpaces).isOk());
+    ASSERT_FALSE(mac.empty());
+
+    // The access check fails in the middle of the batch and retrieval goes on.
+    EXPECT_EQ(IIdentityCredentialStore::STATUS_NO_ACCESS_CONTROL_PROFILES, statuses[1]);
+    EXPECT_EQ(
+            "{\n"
+            "  'PersonalData' : {\n"
+            "    'Last name' : 'Turing',\n"
+            "    'First name' : 'Alan',\n"
+            "  },\n"
+            "  'Image' : {\n"
+            "    'Portrait image' : <bstr size=262134 "
+            "sha1=941e372f654d86c32d88fae9e41b706afbfd02bb>,\n"
+            "  },\n"
+            "}",
+            cppbor::prettyPrint(deviceNameSpaces, 32, {}));
+
+    // All entries in one call, in the same session.
+    ASSERT_NO_FATAL_FAILURE(startRetrieval());
+    vector<RetrieveEntryValueResult> results;
+    ASSERT_TRUE(credential_->retrieveEntryValues(buildRequests(), &results).isOk());
+    ASSERT_EQ(entries_.size(), results.size());
+    for (size_t n = 0; n < entries_.size(); n++) {
+        EXPECT_EQ(statuses[n], results[n].status) << entries_[n].name;
+        EXPECT_EQ(contents[n], results[n].content) << entries_[n].name;
+    }
+    vector<uint8_t> batchMac;
+    vector<uint8_t> batchDeviceNameSpaces;
+    ASSERT_TRUE(credential_->finishRetrieval(&batchMac, &batchDeviceNameSpaces).isOk());
+
+    EXPECT_EQ(deviceNameSpaces, batchDeviceNameSpaces);
+    EXPECT_EQ(mac, batchMac);
+}
+
+TEST_P(RetrieveEntryValuesTests, truncatedEncryptedContent) {
+    ASSERT_NO_FATAL_FAILURE(provisionData());
+    const size_t portrait = 3;
+    ASSERT_GT(encryptedBlobs_[&entries_[portrait]].size(), 1u);
+    const size_t lastChunkSize = encryptedBlobs_[&entries_[portrait]].back().size();
+
+    // Missing the last chunk, and cut in the middle of it.
+    for (size_t cut : {lastChunkSize, lastChunkSize / 2}) {
+        SCOPED_TRACE(cut);
+        ASSERT_NO_FATAL_FAILURE(presentCredential());
+        ASSERT_NO_FATAL_FAILURE(startRetrieval());
+
+        vector<RetrieveEntryValueRequest> requests = buildRequests();
+        requests[portrait].encryptedContent.resize(requests[portrait].encryptedContent.size() -
+                                                   cut);
+        vector<RetrieveEntryValueResult> results;
+        Status status = credential_->retrieveEntryValues(requests, &results);
+        ASSERT_FALSE(status.isOk());
+        ASSERT_EQ(binder::Status::EX_SERVICE_SPECIFIC, status.exceptionCode());
+        EXPECT_EQ(IIdentityCredentialStore::STATUS_INVALID_DATA,
+                  status.serviceSpecificErrorCode());
+    }
+}
+
+GTEST_ALLOW_UNINSTANTIATED_PARAMETERIZED_TEST(RetrieveEntryValuesTests);
+INSTANTIATE_TEST_SUITE_P(
+        Identity, RetrieveEntryValuesTests,
+        testing::ValuesIn(android::getAidlHalInstanceNames(IIdentityCredentialStore::descriptor)),
+        android::PrintInstanceNameToString);
+
+}  // namespace android::hardware::identity
@@ -21,6 +21,8 @@
 #include <hardware/hardware.h>
 #include <hardware/consumerir.h>
 
+#include <limits>
+
 #include "ConsumerIr.h"
 
 namespace android {
@@ -31,34 +33,123 @@ namespace implementation {
 
 ConsumerIr::ConsumerIr(consumerir_device_t *device) {
     mDevice = device;
+    // The ranges are fixed by the transmitter, so they are only queried once.
+    std::lock_guard<std::mutex> lock(mFreqLock);
+    queryCarrierFreqsLocked();
 }
 
-// Methods from ::android::hardware::consumerir::V1_0::IConsumerIr follow.
-Return<bool> ConsumerIr::transmit(int32_t carrierFreq, const hidl_vec<int32_t>& pattern) {
-    return mDevice->transmit(mDevice, carrierFreq, pattern.data(), pattern.size()) == 0;
-}
-
-Return<void> ConsumerIr::getCarrierFreqs(getCarrierFreqs_cb _hidl_cb) {
+bool ConsumerIr::queryCarrierFreqsLocked() {
     int32_t len = mDevice->get_num_carrier_freqs(mDevice);
     if (len < 0) {
-        _hidl_cb(false, {});
-        return Void();
+        return false;
     }
 
-    consumerir_freq_range_t *rangeAr = new consumerir_freq_range_t[len];
-    bool success = (mDevice->get_carrier_freqs(mDevice, len, rangeAr) >= 0);
-    if (!success) {
-        _hidl_cb(false, {});
-        return Void();
+    std::vector<consumerir_freq_range_t> rangeAr(len);
+    if (mDevice->get_carrier_freqs(mDevice, len, rangeAr.data()) < 0) {
+        return false;
     }
 
-    hidl_vec<ConsumerIrFreqRange> rangeVec;
-    rangeVec.resize(len);
+    mCarrierFreqs.resize(len);
     for (int32_t i = 0; i < len; i++) {
-        rangeVec[i].min = static_cast<uint32_t>(rangeAr[i].min);
-        rangeVec[i].max = static_cast<uint32_t>(rangeAr[i].max);
+        mCarrierFreqs[i].min = static_cast<uint32_t>(rangeAr[i].min);
+        mCarrierFreqs[i].max = static_cast<uint32_t>(rangeAr[i].max);
+    }
+    mHaveCarrierFreqs = true;
+    return true;
+}
+
+bool ConsumerIr::isSupportedFreq(int32_t carrierFreq) {
+    std::lock_guard<std::mutex> lock(mFreqLock);
+    if (!mHaveCarrierFreqs && !queryCarrierFreqsLocked()) {
+        // Without the ranges, leave the decision to the transmitter.
+        return true;
+    }
+    if (mCarrierFreqs.size() == 0) {
+        return true;
+    }
+    for (const auto& range : mCarrierFreqs) {
+        if (carrierFreq >= 0 && static_cast<uint32_t>(carrierFreq) >= range.min &&
+            static_cast<uint32_t>(carrierFreq) <= range.max) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static_assert(ConsumerIr::kMaxTransmitTimeUs <= std::numeric_limits<int>::max(),
+              "a compacted span must fit the legacy HAL's int pattern");
+
+bool ConsumerIr::compactPattern(const hidl_vec<int32_t>& pattern, std::vector<int>* out) {
+    out->clear();
+    out->reserve(pattern.size());
+    int64_t totalUs = 0;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        if (pattern[i] < 0) {
+            return false;
+        }
+        totalUs += pattern[i];
+        // A leading zero is kept, since dropping it would swap the polarity of the rest.
+        if (pattern[i] == 0 && i > 0) {
+            if (i + 1 < pattern.size()) {
+                i++;
+                if (pattern[i] < 0) {
+                    return false;
+                }
+                totalUs += pattern[i];
+                // Merge in 64 bits and check before narrowing; two long spans can overflow an int.
+                int64_t mergedUs = static_cast<int64_t>(out->back()) + pattern[i];
+                if (mergedUs > kMaxTransmitTimeUs) {
+                    return false;
+                }
+                out->back() = static_cast<int>(mergedUs);
+            }
+        } else {
+            out->push_back(pattern[i]);
+        }
+        if (totalUs > kMaxTransmitTimeUs) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Methods from ::android::hardware::consumerir::V1_0::IConsumerIr follow.
+Return<bool> ConsumerIr::transmit(int32_t carrierFreq, const hidl_vec<int32_t>& pattern) {
+    // Bursts are checked and compacted before they queue for the transmitter, so a rejected
+    // burst never waits and an accepted one is ready to go as soon as the previous one is done.
+    if (!isSupportedFreq(carrierFreq)) {
+        ALOGE("Unsupported carrier frequency %d", carrierFreq);
+        return false;
+    }
+    std::vector<int> compacted;
+    if (!compactPattern(pattern, &compacted)) {
+        ALOGE("Invalid pattern of %zu entries", pattern.size());
+        return false;
+    }
+
+    // The HAL contract has transmit() return once the burst is sent, so each caller waits for
+    // its own turn; the tickets keep back-to-back bursts in the order they were sent.
+    std::unique_lock<std::mutex> lock(mTransmitLock);
+    const uint64_t ticket = mNextTicket++;
+    mTransmitTurn.wait(lock, [this, ticket] { return mServingTicket == ticket; });
+    lock.unlock();
+
+    int ret = mDevice->transmit(mDevice, carrierFreq, compacted.data(), compacted.size());
+
+    lock.lock();
+    mServingTicket++;
+    lock.unlock();
+    mTransmitTurn.notify_all();
+    return ret == 0;
+}
+
+Return<void> ConsumerIr::getCarrierFreqs(getCarrierFreqs_cb _hidl_cb) {
+    std::lock_guard<std::mutex> lock(mFreqLock);
+    if (!mHaveCarrierFreqs && !queryCarrierFreqsLocked()) {
+        _hidl_cb(false, {});
+        return Void();
     }
-    _hidl_cb(true, rangeVec);
+    _hidl_cb(true, mCarrierFreqs);
     return Void();
 }
 
@@ -22,6 +22,10 @@
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
 namespace android {
 namespace hardware {
 namespace ir {
@@ -42,8 +46,31 @@ struct ConsumerIr : public IConsumerIr {
     // Methods from ::android::hardware::ir::V1_0::IConsumerIr follow.
     Return<bool> transmit(int32_t carrierFreq, const hidl_vec<int32_t>& pattern) override;
     Return<void> getCarrierFreqs(getCarrierFreqs_cb _hidl_cb) override;
+
+    // Longest pattern accepted, in microseconds. ConsumerIrService enforces the same limit.
+    static constexpr int64_t kMaxTransmitTimeUs = 2000000;
+
+    // Copies pattern to out with every zero-length period folded away: the periods on either
+    // side of it have the same polarity and are merged. Returns false if a period is negative
+    // or the pattern lasts longer than kMaxTransmitTimeUs.
+    static bool compactPattern(const hidl_vec<int32_t>& pattern, std::vector<int>* out);
+
 private:
+    // Queries the supported carrier ranges into mCarrierFreqs. Called with mFreqLock held.
+    bool queryCarrierFreqsLocked();
+    bool isSupportedFreq(int32_t carrierFreq);
+
     consumerir_device_t *mDevice;
+
+    std::mutex mFreqLock;
+    bool mHaveCarrierFreqs = false;
+    hidl_vec<ConsumerIrFreqRange> mCarrierFreqs;
+
+    // Transmissions reach the device one at a time, in the order transmit() was called.
+    std::mutex mTransmitLock;
+    std::condition_variable mTransmitTurn;
+    uint64_t mNextTicket = 0;
+    uint64_t mServingTicket = 0;
 };
 
 extern "C" IConsumerIr* HIDL_FETCH_IConsumerIr(const char* name);
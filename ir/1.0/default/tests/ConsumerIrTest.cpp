@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "ConsumerIr.h"
+#include "FakeConsumerIrDevice.h"
+
+using namespace std::chrono_literals;
+using android::sp;
+using android::hardware::hidl_vec;
+using android::hardware::ir::V1_0::ConsumerIrFreqRange;
+using android::hardware::ir::V1_0::implementation::ConsumerIr;
+using android::hardware::ir::V1_0::implementation::FakeConsumerIrDevice;
+
+namespace {
+
+const std::vector<consumerir_freq_range_t> kRanges = {{30000, 40000}, {56000, 56000}};
+
+bool getCarrierFreqs(const sp<ConsumerIr>& ir, hidl_vec<ConsumerIrFreqRange>* ranges) {
+    bool success = false;
+    ir->getCarrierFreqs([&](bool ok, const hidl_vec<ConsumerIrFreqRange>& result) {
+        success = ok;
+        *ranges = result;
+    });
+    return success;
+}
+
+TEST(ConsumerIrTest, CarrierFreqsAreQueriedOnce) {
+    FakeConsumerIrDevice device(kRanges);
+    sp<ConsumerIr> ir = new ConsumerIr(&device);
+
+    for (int i = 0; i < 3; i++) {
+        hidl_vec<ConsumerIrFreqRange> ranges;
+        ASSERT_TRUE(getCarrierFreqs(ir, &ranges));
+        ASSERT_EQ(2u, ranges.size());
+        EXPECT_EQ(30000u, ranges[0].min);
+        EXPECT_EQ(40000u, ranges[0].max);
+        EXPECT_EQ(56000u, ranges[1].min);
+        EXPECT_EQ(56000u, ranges[1].max);
+    }
+    EXPECT_TRUE(ir->transmit(38000, {100, 200}));
+    EXPECT_EQ(1, device.mFreqQueries);
+}
+
+TEST(ConsumerIrTest, FailedQueryIsRetried) {
+    FakeConsumerIrDevice device(kRanges);
+    device.mFailFreqQueries = true;
+    sp<ConsumerIr> ir = new ConsumerIr(&device);
+
+    hidl_vec<ConsumerIrFreqRange> ranges;
+    EXPECT_FALSE(getCarrierFreqs(ir, &ranges));
+    device.mFailFreqQueries = false;
+    EXPECT_TRUE(getCarrierFreqs(ir, &ranges));
+    EXPECT_EQ(2u, ranges.size());
+    EXPECT_TRUE(getCarrierFreqs(ir, &ranges));
+    EXPECT_EQ(3, device.mFreqQueries);
+}
+
+TEST(ConsumerIrTest, UnsupportedFreqIsRejectedWithoutTransmitting) {
+    FakeConsumerIrDevice device(kRanges);
+    sp<ConsumerIr> ir = new ConsumerIr(&device);
+
+    EXPECT_FALSE(ir->transmit(20000, {100, 200}));
+    EXPECT_FALSE(ir->transmit(56001, {100, 200}));
+    EXPECT_FALSE(ir->transmit(-1, {100, 200}));
+    EXPECT_TRUE(device.getTransmitted().empty());
+    EXPECT_TRUE(ir->transmit(56000, {100, 200}));
+    EXPECT_EQ(1u, device.getTransmitted().size());
+}
+
+TEST(ConsumerIrTest, ZeroLengthPeriodsAreMerged) {
+    FakeConsumerIrDevice device(kRanges);
+    sp<ConsumerIr> ir = new ConsumerIr(&device);
+
+    EXPECT_TRUE(ir->transmit(38000, {100, 0, 200, 300, 0, 0, 50, 0}));
+    EXPECT_TRUE(ir->transmit(38000, {0, 100, 200}));
+    auto transmitted = device.getTransmitted();
+    ASSERT_EQ(2u, transmitted.size());
+    EXPECT_EQ(std::vector<int>({300, 300, 50}), transmitted[0]);
+    // The leading off period keeps the rest of the pattern in phase.
+    EXPECT_EQ(std::vector<int>({0, 100, 200}), transmitted[1]);
+}
+
+TEST(ConsumerIrTest, InvalidPatternsAreRejected) {
+    FakeConsumerIrDevice device(kRanges);
+    sp<ConsumerIr> ir = new ConsumerIr(&device);
+
+    EXPECT_FALSE(ir->transmit(38000, {100, -1, 200}));
+    EXPECT_FALSE(ir->transmit(38000, {100, 0, -200}));
+    EXPECT_FALSE(ir->transmit(38000, {1000000, 1000000, 1}));
+    EXPECT_FALSE(ir->transmit(38000, {1500000, 0, 1500000}));
+    EXPECT_FALSE(ir->transmit(38000, {INT32_MAX, 0, INT32_MAX}));
+    EXPECT_TRUE(device.getTransmitted().empty());
+    EXPECT_TRUE(ir->transmit(38000, {1000000, 1000000}));
+}
+
+TEST(ConsumerIrTest, ConcurrentBurstsAreSentOneAtATime) {
+    FakeConsumerIrDevice device(kRanges, 5ms);
+    sp<ConsumerIr> ir = new ConsumerIr(&device);
+
+    constexpr int kBursts = 8;
+    std::vector<std::thread> threads;
+    std::atomic<int> succeeded = 0;
+    for (int i = 0; i < kBursts; i++) {
+        threads.emplace_back([&ir, &succeeded, i] {
+            if (ir->transmit(38000, {100 + i, 200})) succeeded++;
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(kBursts, succeeded);
+    EXPECT_EQ(static_cast<size_t>(kBursts), device.getTransmitted().size());
+    EXPECT_EQ(1, device.mMaxConcurrentTransmits);
+}
+
+}  // namespace
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FakeConsumerIrDevice.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace android {
+namespace hardware {
+namespace ir {
+namespace V1_0 {
+namespace implementation {
+
+FakeConsumerIrDevice::FakeConsumerIrDevice(std::vector<consumerir_freq_range_t> ranges,
+                                           std::chrono::milliseconds transmitDelay)
+    : consumerir_device_t(), mRanges(std::move(ranges)), mTransmitDelay(transmitDelay) {
+    transmit = transmitHook;
+    get_num_carrier_freqs = getNumCarrierFreqsHook;
+    get_carrier_freqs = getCarrierFreqsHook;
+}
+
+std::vector<std::vector<int>> FakeConsumerIrDevice::getTransmitted() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mTransmitted;
+}
+
+int FakeConsumerIrDevice::transmitHook(consumerir_device* dev, int /* carrierFreq */,
+                                       const int pattern[], int patternLen) {
+    auto* self = static_cast<FakeConsumerIrDevice*>(dev);
+    const int concurrent = ++self->mConcurrentTransmits;
+    int max = self->mMaxConcurrentTransmits;
+    while (concurrent > max &&
+           !self->mMaxConcurrentTransmits.compare_exchange_weak(max, concurrent))
+        ;
+    std::this_thread::sleep_for(self->mTransmitDelay);
+    {
+        std::lock_guard<std::mutex> lock(self->mLock);
+        self->mTransmitted.emplace_back(pattern, pattern + patternLen);
+    }
+    self->mConcurrentTransmits--;
+    return 0;
+}
+
+int FakeConsumerIrDevice::getNumCarrierFreqsHook(consumerir_device* dev) {
+    auto* self = static_cast<FakeConsumerIrDevice*>(dev);
+    self->mFreqQueries++;
+    return self->mFailFreqQueries ? -1 : self->mRanges.size();
+}
+
+int FakeConsumerIrDevice::getCarrierFreqsHook(consumerir_device* dev, size_t len,
+                                              consumerir_freq_range_t* ranges) {
+    auto* self = static_cast<FakeConsumerIrDevice*>(dev);
+    if (self->mFailFreqQueries) return -1;
+    len = std::min(len, self->mRanges.size());
+    std::copy(self->mRanges.begin(), self->mRanges.begin() + len, ranges);
+    return len;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace ir
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <hardware/consumerir.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace ir {
+namespace V1_0 {
+namespace implementation {
+
+// Stands in for a legacy consumerir transmitter. It reports a fixed set of carrier ranges,
+// records every transmitted pattern and takes transmitDelay to send each one.
+class FakeConsumerIrDevice : public consumerir_device_t {
+  public:
+    FakeConsumerIrDevice(std::vector<consumerir_freq_range_t> ranges,
+                         std::chrono::milliseconds transmitDelay = std::chrono::milliseconds(0));
+
+    std::vector<std::vector<int>> getTransmitted();
+
+    std::atomic<int> mFreqQueries{0};
+    std::atomic<bool> mFailFreqQueries{false};
+    std::atomic<int> mMaxConcurrentTransmits{0};
+
+  private:
+    static int transmitHook(consumerir_device* dev, int carrierFreq, const int pattern[],
+                            int patternLen);
+    static int getNumCarrierFreqsHook(consumerir_device* dev);
+    static int getCarrierFreqsHook(consumerir_device* dev, size_t len,
+                                   consumerir_freq_range_t* ranges);
+
+    const std::vector<consumerir_freq_range_t> mRanges;
+    const std::chrono::milliseconds mTransmitDelay;
+
+    std::atomic<int> mConcurrentTransmits{0};
+    std::mutex mLock;
+    std::vector<std::vector<int>> mTransmitted;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace ir
+}  // namespace hardware
+}  // namespace android
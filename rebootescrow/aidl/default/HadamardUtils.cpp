@@ -90,39 +90,78 @@ std::vector<uint8_t> EncodeKey(const std::vector<uint8_t>& input) {
     return result;
 }
 
-// Constant-time conditional copy, to fix b/146520538
-// ctl must be 0 or 1; we do the copy if it's 1.
-static void CondCopy(uint32_t ctl, void* dest, const void* src, size_t len) {
-    const auto cdest = reinterpret_cast<uint8_t*>(dest);
-    const auto csrc = reinterpret_cast<const uint8_t*>(src);
-    for (size_t i = 0; i < len; i++) {
-        const uint32_t d = cdest[i];
-        const uint32_t s = csrc[i];
-        cdest[i] = d ^ (-ctl & (s ^ d));
+// The decoder keeps the scores of several codewords side by side, one codeword per 16-bit lane,
+// and transforms them in lockstep. The compiler lowers these vector types to AVX2 or SSE2 on
+// x86, NEON on ARM and plain scalar code elsewhere; the lane count matches the native width.
+#if defined(__AVX2__)
+constexpr size_t LANE_BYTES = 32;
+#else
+constexpr size_t LANE_BYTES = 16;
+#endif
+constexpr size_t LANES = LANE_BYTES / sizeof(int16_t);
+typedef int16_t ScoreRow __attribute__((vector_size(LANE_BYTES)));
+typedef uint16_t CodewordRow __attribute__((vector_size(LANE_BYTES)));
+
+static_assert(KEY_CODEWORDS % LANES == 0, "codewords are decoded a full row at a time");
+static_assert(KEY_CODEWORDS == CODEWORD_BITS, "an encoded word holds one bit of each codeword");
+
+// The first transform stages run on blocks of rows that fit in the L1 cache.
+constexpr uint32_t BLOCK_STAGES = 10;
+constexpr uint32_t BLOCK_ROWS = 1u << BLOCK_STAGES;
+constexpr uint16_t HALF_LENGTH = ENCODE_LENGTH / 2;
+constexpr uint16_t NEGATIVE_BIT = 1u << CODE_K;
+
+// x % RNG_MODULUS for x < 2^62, using 2^31 == 1 (mod 2^31 - 1).
+static inline uint32_t ReduceRng(uint64_t x) {
+    x = (x & RNG_MODULUS) + (x >> 31);
+    x = (x & RNG_MODULUS) + (x >> 31);
+    return x >= RNG_MODULUS ? x - RNG_MODULUS : x;
+}
+
+// One stage of the fast Walsh-Hadamard transform over rows [begin, end).
+static void Butterfly(ScoreRow* rows, uint32_t begin, uint32_t end, uint32_t step) {
+    for (uint32_t j = begin; j < end; j += 2 * step) {
+        for (uint32_t k = j; k < j + step; k++) {
+            const ScoreRow a0 = rows[k];
+            const ScoreRow a1 = rows[k + step];
+            rows[k] = a0 + a1;
+            rows[k + step] = a0 - a1;
+        }
     }
 }
 
-struct CodewordWinner {
-    uint16_t codeword;
-    int32_t score;
-};
-
-// Replace dest with src if it has a higher score
-static void CopyWinner(CodewordWinner* dest, const CodewordWinner& src) {
-    // Scores are between - 2^15 and 2^15, so taking the difference won't
-    // overflow; we use the sign bit of the difference here.
-    CondCopy(static_cast<uint32_t>(dest->score - src.score) >> 31, dest, &src,
-             sizeof(CodewordWinner));
+// Replace the winners in each lane whose score is higher than the current one, in constant
+// time.
+static inline void CopyWinners(CodewordRow* best_score, CodewordRow* best_codeword,
+                               const CodewordRow& score, const CodewordRow& codeword) {
+    const CodewordRow higher = score > *best_score;
+    *best_score = (higher & score) | (~higher & *best_score);
+    *best_codeword = (higher & codeword) | (~higher & *best_codeword);
 }
 
-// Decode a single codeword. Because of the way codewords are striped together
-// this takes the entire input, plus an offset telling it which word to decode.
-static uint16_t DecodeWord(size_t word, const std::vector<uint8_t>& encoded) {
-    std::vector<int32_t> scores;
-    scores.reserve(ENCODE_LENGTH);
-    // Convert x -> -1^x in the encoded bits. e.g [1, 0, 0, 1] -> [-1, 1, 1, -1]
-    for (uint32_t i = 0; i < ENCODE_LENGTH; i++) {
-        scores.push_back(1 - 2 * read_bit(encoded, i * KEY_CODEWORDS + word));
+// Decode LANES codewords at once, starting at first. Because of the way codewords are striped
+// together, the two bytes at each position of the encoding hold one bit of each codeword; they
+// become one row of scores, so the transform and the winner scan run on all lanes in parallel.
+// rows is scratch space for ENCODE_LENGTH rows.
+static void DecodeWords(const std::vector<uint8_t>& encoded, size_t first, ScoreRow* rows,
+                        uint16_t codewords[LANES]) {
+    // Bit first + j of each encoded word belongs to lane j.
+    ScoreRow lane_bits;
+    for (size_t j = 0; j < LANES; j++) {
+        lane_bits[j] = static_cast<int16_t>(1u << (first + j));
+    }
+    // Convert x -> -1^x in the encoded bits. e.g [1, 0, 0, 1] -> [-1, 1, 1, -1], and run the
+    // first stages of the transform on each block while it is still in cache.
+    for (uint32_t block = 0; block < ENCODE_LENGTH; block += BLOCK_ROWS) {
+        for (uint32_t i = block; i < block + BLOCK_ROWS; i++) {
+            const int16_t word = encoded[i * KEY_CODEWORD_BYTES] |
+                                 encoded[i * KEY_CODEWORD_BYTES + 1] << 8u;
+            const ScoreRow set = (lane_bits & word) != 0;
+            rows[i] = set | 1;
+        }
+        for (uint32_t i = 0; i < BLOCK_STAGES; i++) {
+            Butterfly(rows, block, block + BLOCK_ROWS, 1u << i);
+        }
     }
 
     // Multiply the hadamard matrix by the transformed input.
@@ -130,44 +169,63 @@ static uint16_t DecodeWord(size_t word, const std::vector<uint8_t>& encoded) {
     // |1 -1  1 -1|  *  | 1|  =  | 0|
     // |1  1 -1 -1|     | 1|     | 0|
     // |1 -1 -1  1|     |-1|     |-4|
-    for (uint32_t i = 0; i < CODE_K; i++) {
-        uint16_t step = 1u << i;
-        for (uint32_t j = 0; j < ENCODE_LENGTH; j += 2 * step) {
-            for (uint32_t k = j; k < j + step; k++) {
-                auto a0 = scores[k];
-                auto a1 = scores[k + step];
-                scores[k] = a0 + a1;
-                scores[k + step] = a0 - a1;
-            }
-        }
+    // After all but the last stage the scores are within [-2^14, 2^14], so they still fit in
+    // 16 bits; the last stage is folded into the winner scan below.
+    for (uint32_t i = BLOCK_STAGES; i < CODE_K - 1; i++) {
+        Butterfly(rows, 0, ENCODE_LENGTH, 1u << i);
     }
-    // -ENCODE_LENGTH is least possible score, so start one less than that
-    auto best = CodewordWinner{0, -static_cast<int32_t>(ENCODE_LENGTH + 1)};
+
     // For every possible codeword value, look at its score, and replace best if it's higher,
-    // in constant time.
-    for (size_t i = 0; i < ENCODE_LENGTH; i++) {
-        CopyWinner(&best, CodewordWinner{static_cast<uint16_t>(i), scores[i]});
-        CopyWinner(&best, CodewordWinner{static_cast<uint16_t>(i | (1 << CODE_K)), -scores[i]});
+    // in constant time. Codeword i scores s and codeword i | (1 << CODE_K) scores -s, so only
+    // |s| is compared, which lies in [0, 2^15] and fits in 16 unsigned bits. The first codeword
+    // with the highest score wins, as if they were all compared in order; the low and high
+    // halves are scanned side by side and merged at the end, so that the low half still wins
+    // ties. Starting each half at its own first codeword with a score of 0 picks the same
+    // winner as starting below the least possible score.
+    CodewordRow low_score = {}, low_codeword = {};
+    CodewordRow high_score = {}, high_codeword = CodewordRow{} + HALF_LENGTH;
+    for (uint16_t k = 0; k < HALF_LENGTH; k++) {
+        const uint16_t k_high = k + HALF_LENGTH;
+        const ScoreRow a0 = rows[k];
+        const ScoreRow a1 = rows[k_high];
+        // a0 + a1 and a0 - a1 wrap around at +-2^15, so their signs come from comparisons.
+        const ScoreRow low_neg = a0 < -a1;
+        const ScoreRow high_neg = a0 < a1;
+        const ScoreRow low = a0 + a1;
+        const ScoreRow high = a0 - a1;
+        CopyWinners(&low_score, &low_codeword, (CodewordRow)((low ^ low_neg) - low_neg),
+                    ((CodewordRow)low_neg & NEGATIVE_BIT) | k);
+        CopyWinners(&high_score, &high_codeword, (CodewordRow)((high ^ high_neg) - high_neg),
+                    ((CodewordRow)high_neg & NEGATIVE_BIT) | k_high);
+    }
+    CopyWinners(&low_score, &low_codeword, high_score, high_codeword);
+    for (size_t i = 0; i < LANES; i++) {
+        codewords[i] = low_codeword[i];
     }
-    return best.codeword;
 }
 
 std::vector<uint8_t> DecodeKey(const std::vector<uint8_t>& shuffled) {
     CHECK_EQ(OUTPUT_SIZE_BYTES, shuffled.size());
-    // Apply the forward Fisher-Yates shuffle.
+    // Apply the forward Fisher-Yates shuffle. The RNG state stays below 2^31, so the indices
+    // are computed in 32 bits.
     std::vector<uint8_t> encoded(OUTPUT_SIZE_BYTES, 0);
     encoded[0] = shuffled[0];
-    uint64_t rng_state = RNG_SEED;
-    for (size_t i = 1; i < OUTPUT_SIZE_BYTES; i++) {
+    uint32_t rng_state = RNG_SEED;
+    for (uint32_t i = 1; i < OUTPUT_SIZE_BYTES; i++) {
         auto j = rng_state % (i + 1);
         encoded[i] = encoded[j];
         encoded[j] = shuffled[i];
-        rng_state *= RNG_MUL;
-        rng_state %= RNG_MODULUS;
+        rng_state = ReduceRng(rng_state * RNG_MUL);
+    }
+    // The same scratch rows are reused for every group of codewords.
+    std::vector<ScoreRow> rows(ENCODE_LENGTH);
+    uint16_t codewords[KEY_CODEWORDS];
+    for (size_t i = 0; i < KEY_CODEWORDS; i += LANES) {
+        DecodeWords(encoded, i, rows.data(), codewords + i);
     }
     std::vector<uint8_t> result(KEY_SIZE_IN_BYTES, 0);
     for (size_t i = 0; i < KEY_CODEWORDS; i++) {
-        uint16_t val = DecodeWord(i, encoded);
+        uint16_t val = codewords[i];
         result[i * CODEWORD_BYTES] = val & 0xffu;
         result[i * CODEWORD_BYTES + 1] = val >> 8u;
     }
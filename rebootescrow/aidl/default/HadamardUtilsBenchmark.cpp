@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <random>
+
+#include <benchmark/benchmark.h>
+
+#include <HadamardUtils.h>
+
+using namespace aidl::android::hardware::rebootescrow::hadamard;
+
+static std::vector<uint8_t> EncodedKey(bool add_errors) {
+    std::mt19937 rng(0);
+    std::vector<uint8_t> key(KEY_SIZE_IN_BYTES);
+    for (auto& byte : key) {
+        byte = rng() & 0xff;
+    }
+    auto encoded = EncodeKey(key);
+    if (add_errors) {
+        for (auto& byte : encoded) {
+            byte ^= rng() & rng() & 0xff;
+        }
+    }
+    return encoded;
+}
+
+static void BM_EncodeKey(benchmark::State& state) {
+    std::vector<uint8_t> key(KEY_SIZE_IN_BYTES, 0x5a);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(EncodeKey(key));
+    }
+}
+BENCHMARK(BM_EncodeKey);
+
+// The decode cost does not depend on the data; the argument selects a clean or a noisy input.
+static void BM_DecodeKey(benchmark::State& state) {
+    auto encoded = EncodedKey(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(DecodeKey(encoded));
+    }
+}
+BENCHMARK(BM_DecodeKey)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -16,6 +16,7 @@
 
 #include <stdint.h>
 #include <random>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -25,6 +26,71 @@ using namespace aidl::android::hardware::rebootescrow::hadamard;
 
 class HadamardTest : public testing::Test {};
 
+// The straightforward bit-by-bit decoder that DecodeKey must agree with, ties included.
+static std::vector<uint8_t> ReferenceDecodeKey(const std::vector<uint8_t>& shuffled) {
+    std::vector<uint8_t> encoded(shuffled.size(), 0);
+    encoded[0] = shuffled[0];
+    uint64_t rng_state = 20170705;
+    for (size_t i = 1; i < encoded.size(); i++) {
+        auto j = rng_state % (i + 1);
+        encoded[i] = encoded[j];
+        encoded[j] = shuffled[i];
+        rng_state = rng_state * 742938285 % 0x7fffffff;
+    }
+    std::vector<uint8_t> result(KEY_SIZE_IN_BYTES, 0);
+    for (size_t word = 0; word < KEY_CODEWORDS; word++) {
+        std::vector<int32_t> scores;
+        for (uint32_t i = 0; i < ENCODE_LENGTH; i++) {
+            size_t bit = i * KEY_CODEWORDS + word;
+            scores.push_back(1 - 2 * ((encoded[bit >> 3] >> (bit & 7)) & 1));
+        }
+        for (uint32_t step = 1; step < ENCODE_LENGTH; step *= 2) {
+            for (uint32_t j = 0; j < ENCODE_LENGTH; j += 2 * step) {
+                for (uint32_t k = j; k < j + step; k++) {
+                    auto a0 = scores[k];
+                    auto a1 = scores[k + step];
+                    scores[k] = a0 + a1;
+                    scores[k + step] = a0 - a1;
+                }
+            }
+        }
+        uint16_t best = 0;
+        int32_t best_score = -static_cast<int32_t>(ENCODE_LENGTH + 1);
+        for (uint32_t i = 0; i < ENCODE_LENGTH; i++) {
+            if (scores[i] > best_score) {
+                best = i;
+                best_score = scores[i];
+            }
+            if (-scores[i] > best_score) {
+                best = i | (1 << CODE_K);
+                best_score = -scores[i];
+            }
+        }
+        result[word * CODEWORD_BYTES] = best & 0xffu;
+        result[word * CODEWORD_BYTES + 1] = best >> 8u;
+    }
+    return result;
+}
+
+static std::vector<uint8_t> RandomKey(std::mt19937* rng) {
+    std::vector<uint8_t> key;
+    for (size_t j = 0; j < KEY_SIZE_IN_BYTES; j++) {
+        key.emplace_back((*rng)() & 0xff);
+    }
+    return key;
+}
+
+// Flips each bit with the given probability, in percent.
+static void FlipBits(std::vector<uint8_t>* data, int percent, std::mt19937* rng) {
+    for (auto& byte : *data) {
+        for (size_t j = 0; j < BYTE_LENGTH; j++) {
+            if (static_cast<int>((*rng)() % 100) < percent) {
+                byte ^= (1 << j);
+            }
+        }
+    }
+}
+
 static void AddError(std::vector<uint8_t>* data) {
     for (size_t i = 0; i < data->size(); i++) {
         for (size_t j = 0; j < BYTE_LENGTH; j++) {
@@ -49,3 +115,47 @@ TEST_F(HadamardTest, Decode_error_correction) {
         ASSERT_EQ(key, std::vector<uint8_t>(decoded.begin(), decoded.begin() + key.size()));
     }
 }
+
+TEST_F(HadamardTest, Decode_no_error) {
+    std::mt19937 rng(1);
+    auto key = RandomKey(&rng);
+    auto decoded = DecodeKey(EncodeKey(key));
+    ASSERT_EQ(key, decoded);
+}
+
+TEST_F(HadamardTest, Decode_matches_reference_with_random_errors) {
+    std::mt19937 rng(2);
+    for (int percent : {10, 30, 45, 49, 50}) {
+        SCOPED_TRACE(percent);
+        auto encoded = EncodeKey(RandomKey(&rng));
+        FlipBits(&encoded, percent, &rng);
+        ASSERT_EQ(ReferenceDecodeKey(encoded), DecodeKey(encoded));
+    }
+}
+
+TEST_F(HadamardTest, Decode_matches_reference_with_lost_lines) {
+    std::mt19937 rng(3);
+    auto key = RandomKey(&rng);
+    auto encoded = EncodeKey(key);
+    // Lose a quarter of the encoding in 512-byte DRAM lines, to zeros or ones.
+    for (size_t line = 0; line < encoded.size(); line += 4 * 512) {
+        uint8_t lost = ((line / (4 * 512)) & 1) ? 0xff : 0;
+        std::fill(encoded.begin() + line, encoded.begin() + line + 512, lost);
+    }
+    auto decoded = DecodeKey(encoded);
+    ASSERT_EQ(ReferenceDecodeKey(encoded), decoded);
+    ASSERT_EQ(key, decoded);
+}
+
+TEST_F(HadamardTest, Decode_matches_reference_on_ties) {
+    // Uniform inputs score every codeword but one equally, and noise is full of ties.
+    std::mt19937 rng(4);
+    std::vector<uint8_t> noise(OUTPUT_SIZE_BYTES);
+    for (auto& byte : noise) {
+        byte = rng() & 0xff;
+    }
+    for (const auto& encoded : {std::vector<uint8_t>(OUTPUT_SIZE_BYTES, 0),
+                                std::vector<uint8_t>(OUTPUT_SIZE_BYTES, 0xff), noise}) {
+        ASSERT_EQ(ReferenceDecodeKey(encoded), DecodeKey(encoded));
+    }
+}
@@ -64,6 +64,14 @@ static std::vector<RsType> hidl_to_rs(const hidl_vec<HidlType>& src, Operation o
     return dst;
 }
 
+// Converts into dst, reusing its storage. Calls made once per frame pass a
+// thread_local dst, so that they do not allocate after the first frame.
+template<typename RsType, typename HidlType, typename Operation>
+static void hidl_to_rs(const hidl_vec<HidlType>& src, std::vector<RsType>* dst, Operation operation) {
+    dst->resize(src.size());
+    std::transform(src.begin(), src.end(), dst->begin(), operation);
+}
+
 template<typename ReturnType, typename SourceType>
 static ReturnType rs_to_hidl(SourceType* src) {
     return static_cast<ReturnType>(reinterpret_cast<uintptr_t>(src));
@@ -362,9 +370,9 @@ Return<void> Context::allocationGetPointer(Allocation allocation, uint32_t lod,
 
 Return<void> Context::elementGetNativeMetadata(Element element, elementGetNativeMetadata_cb _hidl_cb) {
     RsElement _element = hidl_to_rs<RsElement>(element);
-    std::vector<uint32_t> _elemData(5);
-    Device::getHal().ElementGetNativeData(mContext, _element, _elemData.data(), _elemData.size());
-    hidl_vec<uint32_t> elemData = _elemData;
+    hidl_vec<uint32_t> elemData;
+    elemData.resize(5);
+    Device::getHal().ElementGetNativeData(mContext, _element, elemData.data(), elemData.size());
     _hidl_cb(elemData);
     return Void();
 }
@@ -663,7 +671,8 @@ Return<void> Context::scriptInvokeV(Script vs, uint32_t slot, const hidl_vec<uin
 Return<void> Context::scriptForEach(Script vs, uint32_t slot, const hidl_vec<Allocation>& vains, Allocation vaout, const hidl_vec<uint8_t>& params, Ptr sc) {
     RsScript _vs = hidl_to_rs<RsScript>(vs);
     uint32_t _slot = slot;
-    std::vector<RsAllocation> _vains = hidl_to_rs<RsAllocation>(vains, [](Allocation val) { return hidl_to_rs<RsAllocation>(val); });
+    static thread_local std::vector<RsAllocation> _vains;
+    hidl_to_rs(vains, &_vains, [](Allocation val) { return hidl_to_rs<RsAllocation>(val); });
     RsAllocation _vaout = hidl_to_rs<RsAllocation>(vaout);
     const void* _paramsPtr = hidl_to_rs<const void*>(params.data());
     size_t _paramLen = params.size();
@@ -676,7 +685,8 @@ Return<void> Context::scriptForEach(Script vs, uint32_t slot, const hidl_vec<All
 Return<void> Context::scriptReduce(Script vs, uint32_t slot, const hidl_vec<Allocation>& vains, Allocation vaout, Ptr sc) {
     RsScript _vs = hidl_to_rs<RsScript>(vs);
     uint32_t _slot = slot;
-    std::vector<RsAllocation> _vains = hidl_to_rs<RsAllocation>(vains, [](Allocation val) { return hidl_to_rs<RsAllocation>(val); });
+    static thread_local std::vector<RsAllocation> _vains;
+    hidl_to_rs(vains, &_vains, [](Allocation val) { return hidl_to_rs<RsAllocation>(val); });
     RsAllocation _vaout = hidl_to_rs<RsAllocation>(vaout);
     const RsScriptCall* _sc = hidl_to_rs<const RsScriptCall*>(sc);
     size_t _scLen = _sc != nullptr ? sizeof(ScriptCall) : 0;
@@ -737,9 +747,9 @@ Return<void> Context::scriptGetVarV(Script vs, uint32_t slot, Size len, scriptGe
     RsScript _vs = hidl_to_rs<RsScript>(vs);
     uint32_t _slot = slot;
     size_t _len = static_cast<size_t>(len);
-    std::vector<uint8_t> _data(_len);
-    Device::getHal().ScriptGetVarV(mContext, _vs, _slot, _data.data(), _data.size());
-    hidl_vec<uint8_t> data = _data;
+    hidl_vec<uint8_t> data;
+    data.resize(_len);
+    Device::getHal().ScriptGetVarV(mContext, _vs, _slot, data.data(), data.size());
     _hidl_cb(data);
     return Void();
 }
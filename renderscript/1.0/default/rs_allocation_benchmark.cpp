@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares the two ways a client can move a frame in and out of a 2D RGBA8
+ * Allocation:
+ *
+ * - Copy: allocation2DWrite()/allocation2DRead() copy the frame between a
+ *   client buffer and the Allocation's own storage on every call.
+ * - Shared: the Allocation is created with AllocationUsageType::SHARED on top
+ *   of an ashmem mapping owned by the client (the region can be handed to
+ *   another process as a hidl_memory). The client produces and consumes the
+ *   frame in place, so a transfer is only an allocationSyncAll().
+ */
+
+#include <android/hardware/renderscript/1.0/IContext.h>
+#include <android/hardware/renderscript/1.0/IDevice.h>
+#include <benchmark/benchmark.h>
+#include <cutils/ashmem.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <vector>
+
+using ::android::sp;
+using ::android::hardware::hidl_vec;
+using namespace ::android::hardware::renderscript::V1_0;
+
+namespace {
+
+// An RGBA8 2D Allocation of the given size and usage, on top of ptr if not null.
+class FrameAllocation {
+  public:
+    FrameAllocation(uint32_t width, uint32_t height, int32_t usage, void* ptr = nullptr)
+        : mWidth(width), mHeight(height) {
+        sp<IDevice> device = IDevice::getService();
+        if (device == nullptr) return;
+        mContext = device->contextCreate(0, ContextType::NORMAL, 0);
+        if (mContext == nullptr) return;
+        mElement = mContext->elementCreate(DataType::UNSIGNED_8, DataKind::PIXEL_RGBA, true, 4);
+        mType = mContext->typeCreate(mElement, width, height, 0, false, false,
+                                     YuvFormat::YUV_NONE);
+        mAllocation = mContext->allocationCreateTyped(mType, AllocationMipmapControl::NONE,
+                                                      usage, reinterpret_cast<Ptr>(ptr));
+    }
+
+    ~FrameAllocation() {
+        if (mContext == nullptr) return;
+        if (mAllocation != 0) mContext->objDestroy(mAllocation);
+        if (mType != 0) mContext->objDestroy(mType);
+        if (mElement != 0) mContext->objDestroy(mElement);
+        mContext->contextFinish();
+        mContext->contextDestroy();
+    }
+
+    bool isValid() const { return mAllocation != 0; }
+    const sp<IContext>& context() const { return mContext; }
+    Allocation allocation() const { return mAllocation; }
+    uint32_t width() const { return mWidth; }
+    uint32_t height() const { return mHeight; }
+    size_t stride() const { return mWidth * 4; }
+    size_t size() const { return stride() * mHeight; }
+
+  private:
+    sp<IContext> mContext;
+    Element mElement = 0;
+    Type mType = 0;
+    Allocation mAllocation = 0;
+    uint32_t mWidth;
+    uint32_t mHeight;
+};
+
+// A client-owned ashmem region, mapped for the lifetime of the object.
+class SharedRegion {
+  public:
+    explicit SharedRegion(size_t size) : mSize(size) {
+        mFd = ashmem_create_region("rs_allocation_benchmark", size);
+        if (mFd < 0) return;
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+        mData = data != MAP_FAILED ? data : nullptr;
+    }
+
+    ~SharedRegion() {
+        if (mData != nullptr) munmap(mData, mSize);
+        if (mFd >= 0) close(mFd);
+    }
+
+    void* data() const { return mData; }
+
+  private:
+    int mFd = -1;
+    void* mData = nullptr;
+    size_t mSize;
+};
+
+constexpr int32_t kScriptUsage = static_cast<int32_t>(AllocationUsageType::SCRIPT);
+constexpr int32_t kSharedUsage =
+        kScriptUsage | static_cast<int32_t>(AllocationUsageType::SHARED);
+
+void BM_CopyWrite(benchmark::State& state) {
+    FrameAllocation frame(state.range(0), state.range(1), kScriptUsage);
+    if (!frame.isValid()) {
+        state.SkipWithError("could not create the allocation");
+        return;
+    }
+    std::vector<uint8_t> pixels(frame.size(), 0x7f);
+    hidl_vec<uint8_t> data;
+    data.setToExternal(pixels.data(), pixels.size());
+    for (auto _ : state) {
+        frame.context()->allocation2DWrite(frame.allocation(), 0, 0, 0,
+                                           AllocationCubemapFace::POSITIVE_X, frame.width(),
+                                           frame.height(), data, frame.stride());
+    }
+    state.SetBytesProcessed(state.iterations() * frame.size());
+}
+
+void BM_CopyRead(benchmark::State& state) {
+    FrameAllocation frame(state.range(0), state.range(1), kScriptUsage);
+    if (!frame.isValid()) {
+        state.SkipWithError("could not create the allocation");
+        return;
+    }
+    std::vector<uint8_t> pixels(frame.size());
+    for (auto _ : state) {
+        frame.context()->allocation2DRead(frame.allocation(), 0, 0, 0,
+                                          AllocationCubemapFace::POSITIVE_X, frame.width(),
+                                          frame.height(), reinterpret_cast<Ptr>(pixels.data()),
+                                          pixels.size(), frame.stride());
+        benchmark::DoNotOptimize(pixels.data());
+    }
+    state.SetBytesProcessed(state.iterations() * frame.size());
+}
+
+// The frame is written in place; publishing it to scripts is a sync from SHARED.
+void BM_SharedWrite(benchmark::State& state) {
+    SharedRegion region(state.range(0) * state.range(1) * 4);
+    if (region.data() == nullptr) {
+        state.SkipWithError("could not map the shared region");
+        return;
+    }
+    FrameAllocation frame(state.range(0), state.range(1), kSharedUsage, region.data());
+    if (!frame.isValid()) {
+        state.SkipWithError("could not create the allocation");
+        return;
+    }
+    for (auto _ : state) {
+        frame.context()->allocationSyncAll(frame.allocation(), AllocationUsageType::SHARED);
+    }
+    state.SetBytesProcessed(state.iterations() * frame.size());
+}
+
+// The frame is read in place once scripts' writes are synced out of SCRIPT.
+void BM_SharedRead(benchmark::State& state) {
+    SharedRegion region(state.range(0) * state.range(1) * 4);
+    if (region.data() == nullptr) {
+        state.SkipWithError("could not map the shared region");
+        return;
+    }
+    FrameAllocation frame(state.range(0), state.range(1), kSharedUsage, region.data());
+    if (!frame.isValid()) {
+        state.SkipWithError("could not create the allocation");
+        return;
+    }
+    for (auto _ : state) {
+        frame.context()->allocationSyncAll(frame.allocation(), AllocationUsageType::SCRIPT);
+        benchmark::DoNotOptimize(region.data());
+    }
+    state.SetBytesProcessed(state.iterations() * frame.size());
+}
+
+}  // namespace
+
+#define RS_FRAME_BENCHMARK(func) \
+    BENCHMARK(func)->Args({1920, 1080})->Args({3840, 2160})->UseRealTime()
+
+RS_FRAME_BENCHMARK(BM_CopyWrite);
+RS_FRAME_BENCHMARK(BM_CopyRead);
+RS_FRAME_BENCHMARK(BM_SharedWrite);
+RS_FRAME_BENCHMARK(BM_SharedRead);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,69 @@
+#define LOG_TAG "libhwbinder_benchmark"
+
+#include "Benchmark.h"
+
+#include <sys/mman.h>
+
+namespace android {
+namespace hardware {
+namespace tests {
+namespace libhwbinder {
+namespace V1_1 {
+namespace implementation {
+
+Return<void> Benchmark::sendVec(const hidl_vec<uint8_t>& data, sendVec_cb _hidl_cb) {
+    _hidl_cb(data);
+    return Void();
+}
+
+Return<void> Benchmark::sendVecOneway(const hidl_vec<uint8_t>& /* data */) {
+    return Void();
+}
+
+Return<void> Benchmark::sendNested(const NestedPayload& payload, sendNested_cb _hidl_cb) {
+    _hidl_cb(payload);
+    return Void();
+}
+
+Return<uint64_t> Benchmark::sendMemory(const hidl_memory& data) {
+    const native_handle_t* handle = data.handle();
+    if (handle == nullptr || handle->numFds < 1 || data.size() == 0) {
+        return 0;
+    }
+    // Maps the region directly rather than through IMapper, so that this also
+    // works in a passthrough process on a Linux host.
+    void* ptr = mmap(nullptr, data.size(), PROT_READ, MAP_SHARED, handle->data[0], 0);
+    if (ptr == MAP_FAILED) {
+        return 0;
+    }
+    munmap(ptr, data.size());
+    return data.size();
+}
+
+Return<uint32_t> Benchmark::sendHandle(const hidl_handle& data) {
+    const native_handle_t* handle = data.getNativeHandle();
+    return handle != nullptr ? handle->numFds : 0;
+}
+
+Return<void> Benchmark::setupFmq(uint32_t size, setupFmq_cb _hidl_cb) {
+    std::lock_guard<std::mutex> lock(mFmqLock);
+    mFmq.reset(new (std::nothrow) SyncQueue(size));
+    if (mFmq == nullptr || !mFmq->isValid()) {
+        mFmq.reset();
+        _hidl_cb(false /* success */, SyncQueue::Descriptor());
+        return Void();
+    }
+    _hidl_cb(true /* success */, *mFmq->getDesc());
+    return Void();
+}
+
+IBenchmark* HIDL_FETCH_IBenchmark(const char* /* name */) {
+    return new Benchmark();
+}
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace libhwbinder
+}  // namespace tests
+}  // namespace hardware
+}  // namespace android
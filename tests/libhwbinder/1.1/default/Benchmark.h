@@ -0,0 +1,52 @@
+#ifndef ANDROID_HARDWARE_BENCHMARK_V1_1_BENCHMARK_H
+#define ANDROID_HARDWARE_BENCHMARK_V1_1_BENCHMARK_H
+
+#include <android/hardware/tests/libhwbinder/1.1/IBenchmark.h>
+#include <fmq/MessageQueue.h>
+#include <hidl/Status.h>
+
+#include <memory>
+#include <mutex>
+
+namespace android {
+namespace hardware {
+namespace tests {
+namespace libhwbinder {
+namespace V1_1 {
+namespace implementation {
+
+using ::android::hardware::tests::libhwbinder::V1_1::IBenchmark;
+using ::android::hardware::tests::libhwbinder::V1_1::NestedPayload;
+using ::android::hardware::Return;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_memory;
+using ::android::hardware::hidl_vec;
+
+struct Benchmark : public IBenchmark {
+  // Methods from ::android::hardware::tests::libhwbinder::V1_0::IBenchmark follow.
+  Return<void> sendVec(const hidl_vec<uint8_t>& data, sendVec_cb _hidl_cb) override;
+
+  // Methods from ::android::hardware::tests::libhwbinder::V1_1::IBenchmark follow.
+  Return<void> sendVecOneway(const hidl_vec<uint8_t>& data) override;
+  Return<void> sendNested(const NestedPayload& payload, sendNested_cb _hidl_cb) override;
+  Return<uint64_t> sendMemory(const hidl_memory& data) override;
+  Return<uint32_t> sendHandle(const hidl_handle& data) override;
+  Return<void> setupFmq(uint32_t size, setupFmq_cb _hidl_cb) override;
+
+private:
+  using SyncQueue = MessageQueue<uint8_t, kSynchronizedReadWrite>;
+
+  std::mutex mFmqLock;
+  std::unique_ptr<SyncQueue> mFmq;
+};
+
+extern "C" IBenchmark* HIDL_FETCH_IBenchmark(const char* name);
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace libhwbinder
+}  // namespace tests
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_BENCHMARK_V1_1_BENCHMARK_H
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "libhwbinder_benchmark"
+
+/*
+ * Compares the ways @1.1::IBenchmark can move a payload, against the default
+ * implementation wrapped the way getService() returns it in passthrough mode
+ * (oneway calls go through the passthrough task runner). Nothing depends on
+ * a service being registered, so the binary also runs on a Linux host.
+ */
+
+#include <benchmark/benchmark.h>
+#include <cutils/ashmem.h>
+#include <fcntl.h>
+#include <hidl/HidlPassthroughSupport.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "Benchmark.h"
+
+using ::android::sp;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_memory;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::kSynchronizedReadWrite;
+using ::android::hardware::MessageQueue;
+using ::android::hardware::MQDescriptorSync;
+using ::android::hardware::details::wrapPassthrough;
+using ::android::hardware::tests::libhwbinder::V1_1::IBenchmark;
+using ::android::hardware::tests::libhwbinder::V1_1::NestedPayload;
+
+namespace {
+
+constexpr size_t kNestedPayloadSize = 16 * 1024;
+
+IBenchmark* getService() {
+    static sp<IBenchmark> sService =
+            wrapPassthrough<IBenchmark>(new ::android::hardware::tests::libhwbinder::V1_1::
+                                                implementation::Benchmark());
+    return sService.get();
+}
+
+void BM_SendVec(benchmark::State& state) {
+    hidl_vec<uint8_t> data(state.range(0));
+    for (auto _ : state) {
+        getService()->sendVec(data, [](const hidl_vec<uint8_t>& reply) {
+            benchmark::DoNotOptimize(reply.data());
+        });
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// Only measures queueing the call; calls refused by a full task runner are
+// counted, not retried.
+void BM_SendVecOneway(benchmark::State& state) {
+    hidl_vec<uint8_t> data(state.range(0));
+    int64_t refused = 0;
+    for (auto _ : state) {
+        if (!getService()->sendVecOneway(data).isOk()) refused++;
+    }
+    state.counters["refused"] = refused;
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// kNestedPayloadSize bytes split over state.range(0) chunks.
+void BM_SendNested(benchmark::State& state) {
+    const size_t numChunks = state.range(0);
+    NestedPayload payload;
+    payload.chunks.resize(numChunks);
+    for (size_t i = 0; i < numChunks; i++) {
+        payload.chunks[i].offset = i * (kNestedPayloadSize / numChunks);
+        payload.chunks[i].data.resize(kNestedPayloadSize / numChunks);
+    }
+    for (auto _ : state) {
+        payload.sequence++;
+        getService()->sendNested(payload, [](const NestedPayload& reply) {
+            benchmark::DoNotOptimize(reply.chunks.data());
+        });
+    }
+    state.SetBytesProcessed(state.iterations() * kNestedPayloadSize);
+}
+
+void BM_SendMemory(benchmark::State& state) {
+    const size_t size = state.range(0);
+    int fd = ashmem_create_region("libhwbinder_benchmark", size);
+    if (fd < 0) {
+        state.SkipWithError("could not create the ashmem region");
+        return;
+    }
+    native_handle_t* handle = native_handle_create(1 /* numFds */, 0 /* numInts */);
+    handle->data[0] = fd;
+    hidl_memory memory("ashmem", handle, size);
+    for (auto _ : state) {
+        if (getService()->sendMemory(memory) != size) {
+            state.SkipWithError("the region could not be mapped");
+            break;
+        }
+    }
+    native_handle_close(handle);
+    native_handle_delete(handle);
+    state.SetBytesProcessed(state.iterations() * size);
+}
+
+// A handle with state.range(0) file descriptors.
+void BM_SendHandle(benchmark::State& state) {
+    const int numFds = state.range(0);
+    native_handle_t* handle = native_handle_create(numFds, 0 /* numInts */);
+    for (int i = 0; i < numFds; i++) {
+        handle->data[i] = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+    hidl_handle data(handle);
+    for (auto _ : state) {
+        uint32_t numReceived = getService()->sendHandle(data);
+        benchmark::DoNotOptimize(numReceived);
+    }
+    native_handle_close(handle);
+    native_handle_delete(handle);
+}
+
+// Sets up a queue of state.range(0) bytes and maps the client end of it.
+void BM_SetupFmq(benchmark::State& state) {
+    using SyncQueue = MessageQueue<uint8_t, kSynchronizedReadWrite>;
+    for (auto _ : state) {
+        bool valid = false;
+        getService()->setupFmq(state.range(0),
+                               [&valid](bool success, const MQDescriptorSync<uint8_t>& desc) {
+                                   if (!success) return;
+                                   SyncQueue queue(desc);
+                                   valid = queue.isValid();
+                               });
+        if (!valid) {
+            state.SkipWithError("could not set up the queue");
+            break;
+        }
+    }
+}
+
+}  // namespace
+
+BENCHMARK(BM_SendVec)->RangeMultiplier(4)->Range(64, 64 * 1024);
+BENCHMARK(BM_SendVecOneway)->RangeMultiplier(4)->Range(64, 64 * 1024);
+BENCHMARK(BM_SendNested)->RangeMultiplier(4)->Range(1, 256);
+BENCHMARK(BM_SendMemory)->RangeMultiplier(4)->Range(4 * 1024, 1024 * 1024);
+BENCHMARK(BM_SendHandle)->Arg(1)->Arg(4)->Arg(16);
+BENCHMARK(BM_SetupFmq)->Arg(4 * 1024)->Arg(64 * 1024);
+
+BENCHMARK_MAIN();
@@ -15,6 +15,7 @@
  */
 
 #include "BenchmarkMsgQ.h"
+#include "LatencyStats.h"
 #include <iostream>
 #include <thread>
 #include <fmq/MessageQueue.h>
@@ -60,20 +61,19 @@ Return<void> BenchmarkMsgQ::configureClientOutboxSyncReadWrite(
 }
 
 Return<bool> BenchmarkMsgQ::requestWrite(int32_t count) {
-    uint8_t* data = new (std::nothrow) uint8_t[count];
-    for (int i = 0; i < count; i++) {
-        data[i] = i;
+    if (count < 0) return false;
+    for (size_t i = mWriteData.size(); i < static_cast<size_t>(count); i++) {
+        mWriteData.push_back(i);
     }
-    bool result = mFmqOutbox->write(data, count);
-    delete[] data;
-    return result;
+    return mFmqOutbox->write(mWriteData.data(), count);
 }
 
 Return<bool> BenchmarkMsgQ::requestRead(int32_t count) {
-    uint8_t* data = new (std::nothrow) uint8_t[count];
-    bool result = mFmqInbox->read(data, count);
-    delete[] data;
-    return result;
+    if (count < 0) return false;
+    if (mReadData.size() < static_cast<size_t>(count)) {
+        mReadData.resize(count);
+    }
+    return mFmqInbox->read(mReadData.data(), count);
 }
 
 Return<void> BenchmarkMsgQ::benchmarkPingPong(uint32_t numIter) {
@@ -86,28 +86,31 @@ Return<void> BenchmarkMsgQ::benchmarkPingPong(uint32_t numIter) {
 Return<void> BenchmarkMsgQ::benchmarkServiceWriteClientRead(uint32_t numIter) {
     if (mTimeData) delete[] mTimeData;
     mTimeData = new (std::nothrow) int64_t[numIter];
+    mNumTimeData = mTimeData ? numIter : 0;
     std::thread(QueueWriter<kSynchronizedReadWrite>, mFmqOutbox,
                 mTimeData, numIter).detach();
     return Void();
 }
 
 Return<void> BenchmarkMsgQ::sendTimeData(const hidl_vec<int64_t>& clientRcvTimeArray) {
-    int64_t accumulatedTime = 0;
+    std::vector<int64_t> delays;
+    delays.reserve(clientRcvTimeArray.size());
 
-    for (uint32_t i = 0; i < clientRcvTimeArray.size(); i++) {
+    for (uint32_t i = 0; i < clientRcvTimeArray.size() && i < mNumTimeData; i++) {
         std::chrono::time_point<std::chrono::high_resolution_clock>
                 clientRcvTime((std::chrono::high_resolution_clock::duration(
                         clientRcvTimeArray[i])));
         std::chrono::time_point<std::chrono::high_resolution_clock>serverSendTime(
                 (std::chrono::high_resolution_clock::duration(mTimeData[i])));
-        accumulatedTime += static_cast<int64_t>(
+        delays.push_back(static_cast<int64_t>(
                 std::chrono::duration_cast<std::chrono::nanoseconds>(clientRcvTime -
-                                                                     serverSendTime).count());
+                                                                     serverSendTime).count()));
     }
 
-    accumulatedTime /= clientRcvTimeArray.size();
+    LatencyStats stats = computeLatencyStats(std::move(delays));
     std::cout << "Average service to client write to read delay::"
-         << accumulatedTime << "ns" << std::endl;
+         << stats.mean << "ns" << std::endl;
+    std::cout << "Service to client write to read delay::" << stats << std::endl;
     return Void();
 }
 
@@ -22,6 +22,8 @@
 #include <hidl/Status.h>
 #include <fmq/MessageQueue.h>
 
+#include <vector>
+
 namespace android {
 namespace hardware {
 namespace tests {
@@ -83,9 +85,16 @@ struct BenchmarkMsgQ : public IBenchmarkMsgQ {
             uint32_t numIter);
 
 private:
-    android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqInbox;
-    android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqOutbox;
-    int64_t* mTimeData;
+    android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqInbox = nullptr;
+    android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqOutbox = nullptr;
+    int64_t* mTimeData = nullptr;
+    uint32_t mNumTimeData = 0;
+    /*
+     * Buffers for requestWrite() and requestRead(), kept across calls so that
+     * the measured requests do not allocate.
+     */
+    std::vector<uint8_t> mWriteData;
+    std::vector<uint8_t> mReadData;
 };
 
 extern "C" IBenchmarkMsgQ* HIDL_FETCH_IBenchmarkMsgQ(const char* name);
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_TESTS_MSGQ_V1_0_LATENCYSTATS_H
+#define ANDROID_HARDWARE_TESTS_MSGQ_V1_0_LATENCYSTATS_H
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <array>
+#include <ostream>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace tests {
+namespace msgq {
+namespace V1_0 {
+namespace implementation {
+
+/*
+ * Summary of a set of latency samples, all in ns.
+ */
+struct LatencyStats {
+    size_t count = 0;
+    int64_t mean = 0;
+    int64_t p50 = 0;
+    int64_t p99 = 0;
+    int64_t p999 = 0;
+    int64_t max = 0;
+    /*
+     * histogram[i] counts the samples in [2^i, 2^(i+1)) ns. Bucket 0 also
+     * holds the samples below 1 ns.
+     */
+    std::array<uint64_t, 64> histogram = {};
+};
+
+/*
+ * Samples are taken by value because they get sorted. Negative samples (from
+ * clocks read on different CPUs) count as 0.
+ */
+inline LatencyStats computeLatencyStats(std::vector<int64_t> samples) {
+    LatencyStats stats;
+    stats.count = samples.size();
+    if (samples.empty()) return stats;
+
+    int64_t total = 0;
+    for (auto& sample : samples) {
+        sample = std::max<int64_t>(sample, 0);
+        total += sample;
+        stats.histogram[sample > 1 ? 63 - __builtin_clzll(sample) : 0]++;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](size_t perMille) {
+        return samples[std::min(samples.size() - 1, samples.size() * perMille / 1000)];
+    };
+    stats.mean = total / static_cast<int64_t>(samples.size());
+    stats.p50 = percentile(500);
+    stats.p99 = percentile(990);
+    stats.p999 = percentile(999);
+    stats.max = samples.back();
+    return stats;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const LatencyStats& stats) {
+    os << "samples " << stats.count << " mean " << stats.mean << "ns p50 " << stats.p50
+       << "ns p99 " << stats.p99 << "ns p999 " << stats.p999 << "ns max " << stats.max << "ns";
+    for (size_t i = 0; i < stats.histogram.size(); i++) {
+        if (stats.histogram[i] != 0) {
+            os << std::endl << "  [" << (1ull << i) << "ns, " << (2ull << i)
+               << "ns): " << stats.histogram[i];
+        }
+    }
+    return os;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace msgq
+}  // namespace tests
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_TESTS_MSGQ_V1_0_LATENCYSTATS_H
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FMQ_Benchmarks"
+
+/*
+ * In-process FMQ benchmarks. A second thread plays the role of the remote
+ * end, so the numbers do not depend on binder or on the service being
+ * registered, and the binary also runs on a Linux host.
+ *
+ * Each benchmark is instantiated for a queue flavor and a transfer mode and
+ * swept over packet sizes. Besides the throughput, it reports the p50, p99
+ * and p999 latencies (in ns) as counters. A packet's latency runs from the
+ * start of the write call that queued it to the end of the read that
+ * returned it.
+ */
+
+#include <benchmark/benchmark.h>
+#include <fmq/MessageQueue.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "LatencyStats.h"
+
+using android::hardware::kSynchronizedReadWrite;
+using android::hardware::kUnsynchronizedWrite;
+using android::hardware::MessageQueue;
+using android::hardware::MQFlavor;
+using android::hardware::tests::msgq::V1_0::implementation::computeLatencyStats;
+using android::hardware::tests::msgq::V1_0::implementation::LatencyStats;
+
+namespace {
+
+/*
+ * Every benchmarked packet size divides the queue size, so a packet never
+ * wraps around the end of the ring and can be accessed in place.
+ */
+constexpr size_t kNumElementsInQueue = 16 * 1024;
+// How long a blocking call waits before checking whether the peer is done.
+constexpr int64_t kBlockingTimeoutNs = 100 * 1000 * 1000;
+
+enum class Mode {
+    // write()/read(), retried in a busy loop.
+    kSpin,
+    // writeBlocking()/readBlocking() on the queue's own EventFlag.
+    kBlocking,
+    // beginWrite()/commitWrite() and beginRead()/commitRead(), in place.
+    kZeroCopy,
+};
+
+int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+template <MQFlavor flavor, Mode mode>
+class Queue {
+  public:
+    static_assert(mode != Mode::kBlocking || flavor == kSynchronizedReadWrite,
+                  "blocking calls need a synchronized queue");
+
+    Queue() : mQueue(kNumElementsInQueue, mode == Mode::kBlocking /* configureEventFlagWord */) {}
+
+    bool isValid() const { return mQueue.isValid(); }
+
+    /*
+     * Makes one attempt to queue a packet stamped with the current time.
+     * packet is the staging buffer for the copying modes.
+     */
+    bool writePacket(uint8_t* packet, size_t size) {
+        // An unsynchronized queue never refuses a write; wait for room so
+        // that no packet is overwritten before it is read.
+        if (flavor == kUnsynchronizedWrite && mQueue.availableToWrite() < size) {
+            return false;
+        }
+        const int64_t sent = now();
+        if constexpr (mode == Mode::kZeroCopy) {
+            typename MessageQueue<uint8_t, flavor>::MemTransaction tx;
+            if (!mQueue.beginWrite(size, &tx)) return false;
+            // The producer builds the packet in the ring instead of a staging buffer.
+            memcpy(tx.getSlot(0), &sent, sizeof(sent));
+            return mQueue.commitWrite(size);
+        } else {
+            memcpy(packet, &sent, sizeof(sent));
+            if constexpr (mode == Mode::kBlocking) {
+                return mQueue.writeBlocking(packet, size, kBlockingTimeoutNs);
+            } else {
+                return mQueue.write(packet, size);
+            }
+        }
+    }
+
+    /*
+     * Makes one attempt to dequeue a packet and returns the time it was sent
+     * in sent. packet is the staging buffer for the copying modes.
+     */
+    bool readPacket(uint8_t* packet, size_t size, int64_t* sent) {
+        if constexpr (mode == Mode::kZeroCopy) {
+            typename MessageQueue<uint8_t, flavor>::MemTransaction tx;
+            if (!mQueue.beginRead(size, &tx)) return false;
+            memcpy(sent, tx.getSlot(0), sizeof(*sent));
+            return mQueue.commitRead(size);
+        } else {
+            bool result;
+            if constexpr (mode == Mode::kBlocking) {
+                result = mQueue.readBlocking(packet, size, kBlockingTimeoutNs);
+            } else {
+                result = mQueue.read(packet, size);
+            }
+            if (result) memcpy(sent, packet, sizeof(*sent));
+            return result;
+        }
+    }
+
+  private:
+    MessageQueue<uint8_t, flavor> mQueue;
+};
+
+void reportLatencies(benchmark::State& state, std::vector<int64_t> latencies) {
+    LatencyStats stats = computeLatencyStats(std::move(latencies));
+    state.counters["p50_ns"] = stats.p50;
+    state.counters["p99_ns"] = stats.p99;
+    state.counters["p999_ns"] = stats.p999;
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+/*
+ * A writer thread streams packets as fast as the queue lets it; the
+ * benchmark thread reads them. Packets queue up, so the latencies include
+ * the time spent waiting in a full queue.
+ */
+template <MQFlavor flavor, Mode mode>
+void BM_Stream(benchmark::State& state) {
+    const size_t size = state.range(0);
+    Queue<flavor, mode> queue;
+    if (!queue.isValid()) {
+        state.SkipWithError("could not create the queue");
+        return;
+    }
+
+    std::atomic<bool> stop = false;
+    std::thread writer([&queue, &stop, size, count = int64_t(state.max_iterations)] {
+        std::vector<uint8_t> packet(size);
+        for (int64_t i = 0; i < count && !stop.load(std::memory_order_relaxed);) {
+            if (queue.writePacket(packet.data(), size)) i++;
+        }
+    });
+
+    std::vector<uint8_t> packet(size);
+    std::vector<int64_t> latencies;
+    latencies.reserve(state.max_iterations);
+    for (auto _ : state) {
+        int64_t sent;
+        while (!queue.readPacket(packet.data(), size, &sent))
+            ;
+        latencies.push_back(now() - sent);
+    }
+    stop = true;
+    writer.join();
+    reportLatencies(state, std::move(latencies));
+}
+
+/*
+ * The benchmark thread sends a packet through one queue and an echo thread
+ * sends it back through another, one packet in flight at a time. This
+ * measures the handoff latency of the mode without any queueing.
+ */
+template <MQFlavor flavor, Mode mode>
+void BM_PingPong(benchmark::State& state) {
+    const size_t size = state.range(0);
+    Queue<flavor, mode> request;
+    Queue<flavor, mode> response;
+    if (!request.isValid() || !response.isValid()) {
+        state.SkipWithError("could not create the queues");
+        return;
+    }
+
+    std::atomic<bool> stop = false;
+    std::thread echo([&request, &response, &stop, size, count = int64_t(state.max_iterations)] {
+        std::vector<uint8_t> packet(size);
+        for (int64_t i = 0; i < count; i++) {
+            int64_t sent;
+            while (!request.readPacket(packet.data(), size, &sent)) {
+                if (stop.load(std::memory_order_relaxed)) return;
+            }
+            while (!response.writePacket(packet.data(), size)) {
+                if (stop.load(std::memory_order_relaxed)) return;
+            }
+        }
+    });
+
+    std::vector<uint8_t> packet(size);
+    std::vector<int64_t> latencies;
+    latencies.reserve(state.max_iterations);
+    for (auto _ : state) {
+        const int64_t start = now();
+        int64_t sent;
+        while (!request.writePacket(packet.data(), size))
+            ;
+        while (!response.readPacket(packet.data(), size, &sent))
+            ;
+        latencies.push_back(now() - start);
+    }
+    stop = true;
+    echo.join();
+    reportLatencies(state, std::move(latencies));
+}
+
+}  // namespace
+
+#define MQ_BENCHMARK(func, flavor, mode)          \
+    BENCHMARK_TEMPLATE(func, flavor, mode)        \
+            ->RangeMultiplier(2)                  \
+            ->Range(64, kNumElementsInQueue / 4)  \
+            ->UseRealTime()
+
+MQ_BENCHMARK(BM_Stream, kSynchronizedReadWrite, Mode::kSpin);
+MQ_BENCHMARK(BM_Stream, kSynchronizedReadWrite, Mode::kBlocking);
+MQ_BENCHMARK(BM_Stream, kSynchronizedReadWrite, Mode::kZeroCopy);
+MQ_BENCHMARK(BM_Stream, kUnsynchronizedWrite, Mode::kSpin);
+MQ_BENCHMARK(BM_Stream, kUnsynchronizedWrite, Mode::kZeroCopy);
+
+MQ_BENCHMARK(BM_PingPong, kSynchronizedReadWrite, Mode::kSpin);
+MQ_BENCHMARK(BM_PingPong, kSynchronizedReadWrite, Mode::kBlocking);
+MQ_BENCHMARK(BM_PingPong, kSynchronizedReadWrite, Mode::kZeroCopy);
+MQ_BENCHMARK(BM_PingPong, kUnsynchronizedWrite, Mode::kSpin);
+MQ_BENCHMARK(BM_PingPong, kUnsynchronizedWrite, Mode::kZeroCopy);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FlatTrie.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace android {
+namespace hardware {
+namespace tests {
+namespace trie {
+namespace V1_0 {
+namespace implementation {
+
+static std::string_view view(const hidl_string& str) {
+    return std::string_view(str.c_str(), str.size());
+}
+
+FlatTrie::FlatTrie(const TrieNode& trie, const hidl_vec<hidl_string>& strings) {
+    std::vector<std::string_view> sorted;
+    sorted.reserve(strings.size());
+    for (const auto& str : strings) {
+        sorted.push_back(view(str));
+    }
+    std::sort(sorted.begin(), sorted.end());
+    build(&trie, sorted.data(), sorted.data() + sorted.size(), 0);
+    mEdgeStack = {};
+    mChildStack = {};
+}
+
+// Appends the merge of node (which may be null) and the strings in [begin, end), which all
+// share their first depth characters, and returns its index.
+uint32_t FlatTrie::build(const TrieNode* node, const std::string_view* begin,
+                         const std::string_view* end, size_t depth) {
+    const uint32_t index = mNodes.size();
+    mNodes.push_back({0, 0, node != nullptr && node->isTerminal});
+
+    // Strings that end here sort before the ones that go on.
+    for (; begin != end && begin->size() == depth; ++begin) {
+        mNodes[index].isTerminal = true;
+    }
+
+    // The edges and children of the nodes being built are stacked in mEdgeStack and
+    // mChildStack, so that no node allocates its own scratch space.
+    const size_t edgesBegin = mEdgeStack.size();
+    if (node != nullptr) {
+        for (const auto& edge : node->next) {
+            mEdgeStack.push_back(&edge);
+        }
+        std::sort(mEdgeStack.begin() + edgesBegin, mEdgeStack.end(),
+                  [](const TrieEdge* a, const TrieEdge* b) {
+                      return static_cast<uint8_t>(a->character) <
+                             static_cast<uint8_t>(b->character);
+                  });
+    }
+
+    // Merge the existing edges with the next characters of the strings.
+    const size_t childrenBegin = mChildStack.size();
+    size_t edge = edgesBegin;
+    const size_t edgesEnd = mEdgeStack.size();
+    for (const std::string_view* str = begin; str != end || edge != edgesEnd;) {
+        const uint8_t strCh = str != end ? (*str)[depth] : 0;
+        const uint8_t edgeCh = edge != edgesEnd ? mEdgeStack[edge]->character : 0;
+        Child child{0, nullptr, str, str};
+        if (edge != edgesEnd && (str == end || edgeCh <= strCh)) {
+            child.ch = edgeCh;
+            child.node = &mEdgeStack[edge]->node;
+            ++edge;
+        } else {
+            child.ch = strCh;
+        }
+        while (child.end != end && static_cast<uint8_t>((*child.end)[depth]) == child.ch) {
+            ++child.end;
+        }
+        str = child.end;
+        mChildStack.push_back(child);
+    }
+    mEdgeStack.resize(edgesBegin);
+
+    const uint32_t numEdges = mChildStack.size() - childrenBegin;
+    const uint32_t firstEdge = mEdgeChars.size();
+    mNodes[index].firstEdge = firstEdge;
+    mNodes[index].numEdges = numEdges;
+    mEdgeChars.resize(firstEdge + numEdges);
+    mEdgeTargets.resize(firstEdge + numEdges);
+    for (uint32_t i = 0; i < numEdges; ++i) {
+        // Copied out, since the recursion grows mChildStack.
+        const Child child = mChildStack[childrenBegin + i];
+        mEdgeChars[firstEdge + i] = child.ch;
+        const uint32_t target = build(child.node, child.begin, child.end, depth + 1);
+        mEdgeTargets[firstEdge + i] = target;
+    }
+    mChildStack.resize(childrenBegin);
+    return index;
+}
+
+uint32_t FlatTrie::child(uint32_t node, uint8_t ch) const {
+    const auto begin = mEdgeChars.begin() + mNodes[node].firstEdge;
+    const auto end = begin + mNodes[node].numEdges;
+    const auto it = std::lower_bound(begin, end, ch);
+    if (it == end || *it != ch) return kNoNode;
+    return mEdgeTargets[it - mEdgeChars.begin()];
+}
+
+bool FlatTrie::contains(std::string_view str) const {
+    uint32_t node = 0;
+    for (char ch : str) {
+        node = child(node, ch);
+        if (node == kNoNode) return false;
+    }
+    return mNodes[node].isTerminal;
+}
+
+// Looks up strings in sorted order, starting each walk from where the walk of the previous
+// string left their common prefix. child(node, ch) returns the child of node along ch, or
+// none; isTerminal(node) tells whether a string ends at node.
+template <typename NodeRef, typename Child, typename IsTerminal>
+static std::vector<bool> walkSorted(const hidl_vec<hidl_string>& strings, NodeRef root,
+                                    NodeRef none, Child child, IsTerminal isTerminal) {
+    std::vector<uint32_t> order(strings.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&strings](uint32_t a, uint32_t b) { return view(strings[a]) < view(strings[b]); });
+
+    std::vector<bool> ret(strings.size());
+    // path[d] is the node reached after the first d characters of the previous string.
+    std::vector<NodeRef> path = {root};
+    std::string_view prev;
+    for (uint32_t i : order) {
+        const std::string_view str = view(strings[i]);
+        size_t common = 0;
+        const size_t limit = std::min({str.size(), prev.size(), path.size() - 1});
+        while (common < limit && str[common] == prev[common]) {
+            ++common;
+        }
+        path.resize(common + 1);
+
+        NodeRef node = path.back();
+        for (size_t depth = common; depth < str.size(); ++depth) {
+            node = child(node, str[depth]);
+            if (node == none) break;
+            path.push_back(node);
+        }
+        ret[i] = node != none && isTerminal(node);
+        prev = str;
+    }
+    return ret;
+}
+
+std::vector<bool> FlatTrie::containsAll(const hidl_vec<hidl_string>& strings) const {
+    return walkSorted(
+            strings, 0u, kNoNode, [this](uint32_t node, uint8_t ch) { return child(node, ch); },
+            [this](uint32_t node) { return mNodes[node].isTerminal; });
+}
+
+std::vector<bool> FlatTrie::containsAll(const TrieNode& trie,
+                                        const hidl_vec<hidl_string>& strings) {
+    auto child = [](const TrieNode* node, char ch) -> const TrieNode* {
+        for (const auto& edge : node->next) {
+            if (edge.character == static_cast<int8_t>(ch)) return &edge.node;
+        }
+        return nullptr;
+    };
+    return walkSorted(strings, &trie, static_cast<const TrieNode*>(nullptr), child,
+                      [](const TrieNode* node) { return node->isTerminal; });
+}
+
+TrieNode FlatTrie::toTrieNode() const {
+    TrieNode ret;
+    fill(0, &ret);
+    return ret;
+}
+
+void FlatTrie::fill(uint32_t node, TrieNode* out) const {
+    const Node& flat = mNodes[node];
+    out->isTerminal = flat.isTerminal;
+    out->next.resize(flat.numEdges);
+    for (uint32_t i = 0; i < flat.numEdges; ++i) {
+        out->next[i].character = mEdgeChars[flat.firstEdge + i];
+        fill(mEdgeTargets[flat.firstEdge + i], &out->next[i].node);
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace trie
+}  // namespace tests
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_TESTS_TRIE_V1_0_FLATTRIE_H
+#define ANDROID_HARDWARE_TESTS_TRIE_V1_0_FLATTRIE_H
+
+#include <android/hardware/tests/trie/1.0/types.h>
+
+#include <string_view>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace tests {
+namespace trie {
+namespace V1_0 {
+namespace implementation {
+
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::tests::trie::V1_0::TrieEdge;
+using ::android::hardware::tests::trie::V1_0::TrieNode;
+
+/*
+ * A flat copy of a TrieNode tree. All nodes live in one array, and the edges
+ * of each node take up a contiguous range of the edge arrays, sorted by
+ * character (as unsigned bytes, like std::string compares them) so that they
+ * can be binary searched.
+ */
+class FlatTrie {
+  public:
+    /*
+     * Flattens trie and adds strings to it in the same pass. The strings are
+     * sorted first, so every node is created once with all its edges.
+     */
+    explicit FlatTrie(const TrieNode& trie, const hidl_vec<hidl_string>& strings = {});
+
+    bool contains(std::string_view str) const;
+
+    /*
+     * Looks up every string. The strings are visited in sorted order, so a
+     * prefix shared with the previous string is only walked once.
+     */
+    std::vector<bool> containsAll(const hidl_vec<hidl_string>& strings) const;
+
+    /*
+     * The same sorted lookup, straight on the unsorted edges of trie. A single
+     * batch of lookups costs less this way than flattening trie first.
+     */
+    static std::vector<bool> containsAll(const TrieNode& trie,
+                                         const hidl_vec<hidl_string>& strings);
+
+    /*
+     * Builds the equivalent TrieNode tree. Every hidl_vec of edges is sized
+     * once.
+     */
+    TrieNode toTrieNode() const;
+
+    size_t numNodes() const { return mNodes.size(); }
+
+  private:
+    struct Node {
+        uint32_t firstEdge;
+        uint32_t numEdges;
+        bool isTerminal;
+    };
+
+    // An edge of a node being built, with the strings that continue along it.
+    struct Child {
+        uint8_t ch;
+        const TrieNode* node;
+        const std::string_view* begin;
+        const std::string_view* end;
+    };
+
+    static constexpr uint32_t kNoNode = UINT32_MAX;
+
+    uint32_t build(const TrieNode* node, const std::string_view* begin,
+                   const std::string_view* end, size_t depth);
+    uint32_t child(uint32_t node, uint8_t ch) const;
+    void fill(uint32_t node, TrieNode* out) const;
+
+    std::vector<Node> mNodes;
+    std::vector<uint8_t> mEdgeChars;
+    std::vector<uint32_t> mEdgeTargets;
+    // Scratch space of build().
+    std::vector<const TrieEdge*> mEdgeStack;
+    std::vector<Child> mChildStack;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace trie
+}  // namespace tests
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_TESTS_TRIE_V1_0_FLATTRIE_H
@@ -17,6 +17,7 @@
 #define LOG_TAG "hidl_test"
 
 #include "Trie.h"
+#include "FlatTrie.h"
 #include <android-base/logging.h>
 #include <inttypes.h>
 #include <string>
@@ -42,13 +43,10 @@ Return<void> Trie::addStrings(const TrieNode& trie, const hidl_vec<hidl_string>&
                               addStrings_cb _hidl_cb) {
     LOG(INFO) << "SERVER(Trie) addStrings(trie, " << strings.size() << " strings)";
 
-    // Make trie modifiable.
-    TrieNode newTrie = trie;
-
-    for (const auto& str : strings) {
-        addString(&newTrie, str);
-    }
-    _hidl_cb(newTrie);
+    // Merge the strings in while flattening, instead of deep-copying trie
+    // and growing its edge vectors one string at a time.
+    FlatTrie newTrie(trie, strings);
+    _hidl_cb(newTrie.toTrieNode());
     return Void();
 }
 
@@ -56,52 +54,10 @@ Return<void> Trie::containsStrings(const TrieNode& trie, const hidl_vec<hidl_str
                                    containsStrings_cb _hidl_cb) {
     LOG(INFO) << "SERVER(Trie) containsStrings(trie, " << strings.size() << " strings)";
 
-    std::vector<bool> ret(strings.size());
-    for (size_t i = 0; i != strings.size(); ++i) {
-        ret[i] = containsString(&trie, strings[i]);
-    }
-    _hidl_cb(ret);
+    _hidl_cb(FlatTrie::containsAll(trie, strings));
     return Void();
 }
 
-void Trie::addString(TrieNode* trieRoot, const std::string& str) {
-    TrieNode* currNode = trieRoot;
-
-    for (char ch : str) {
-        auto& vec = currNode->next;
-
-        auto it = std::find_if(vec.begin(), vec.end(),
-                               [&](const TrieEdge& edge) { return ch == edge.character; });
-
-        if (it == vec.end()) {
-            vec.resize(vec.size() + 1);
-            it = vec.end() - 1;
-            it->character = ch;
-            it->node.isTerminal = false;
-        }
-
-        currNode = &(it->node);
-    }
-
-    currNode->isTerminal = true;
-}
-
-bool Trie::containsString(const TrieNode* trieRoot, const std::string& str) {
-    const TrieNode* currNode = trieRoot;
-
-    for (char ch : str) {
-        const auto& vec = currNode->next;
-
-        auto it = std::find_if(vec.begin(), vec.end(),
-                               [&](const TrieEdge& edge) { return ch == edge.character; });
-
-        if (it == vec.end()) return false;
-        currNode = &(it->node);
-    }
-
-    return currNode->isTerminal;
-}
-
 ITrie* HIDL_FETCH_ITrie(const char* /* name */) {
     return new Trie();
 }
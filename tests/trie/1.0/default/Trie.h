@@ -43,10 +43,6 @@ struct Trie : public ITrie {
                                     addStrings_cb _hidl_cb) override;
     virtual Return<void> containsStrings(const TrieNode& trie, const hidl_vec<hidl_string>& strings,
                                          containsStrings_cb _hidl_cb) override;
-
-   private:
-    void addString(TrieNode* trieRoot, const std::string& str);
-    bool containsString(const TrieNode* trieRoot, const std::string& str);
 };
 
 extern "C" ITrie* HIDL_FETCH_ITrie(const char* name);
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android/hardware/tests/trie/1.0/hwtypes.h>
+#include <benchmark/benchmark.h>
+#include <hwbinder/Parcel.h>
+
+#include <algorithm>
+#include <random>
+
+#include "FlatTrie.h"
+#include "Trie.h"
+
+using ::android::sp;
+using ::android::hardware::Parcel;
+using ::android::hardware::tests::trie::V1_0::writeEmbeddedToParcel;
+using ::android::hardware::tests::trie::V1_0::implementation::FlatTrie;
+using ::android::hardware::tests::trie::V1_0::implementation::Trie;
+
+namespace {
+
+constexpr size_t kNumStrings = 100000;
+
+hidl_vec<hidl_string> randomStrings(size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<size_t> length(4, 24);
+    std::uniform_int_distribution<int> letter('a', 'z');
+    hidl_vec<hidl_string> strings(count);
+    for (auto& str : strings) {
+        std::string s(length(rng), ' ');
+        std::generate(s.begin(), s.end(), [&] { return letter(rng); });
+        str = s;
+    }
+    return strings;
+}
+
+const hidl_vec<hidl_string>& strings() {
+    static const auto* strings = new hidl_vec<hidl_string>(randomStrings(kNumStrings, 1));
+    return *strings;
+}
+
+// The trie holding strings(), as clients send it to the service.
+const TrieNode& largeTrie() {
+    static const auto* trie = new TrieNode(FlatTrie(TrieNode(), strings()).toTrieNode());
+    return *trie;
+}
+
+}  // namespace
+
+static void BM_AddStrings(benchmark::State& state) {
+    sp<Trie> service = new Trie();
+    for (auto _ : state) {
+        service->addStrings(TrieNode(), strings(), [](const TrieNode&) {});
+    }
+    state.SetItemsProcessed(state.iterations() * kNumStrings);
+}
+BENCHMARK(BM_AddStrings)->Unit(benchmark::kMillisecond);
+
+// A small batch added to a large trie, which used to be deep-copied first.
+static void BM_AddStringsToLargeTrie(benchmark::State& state) {
+    sp<Trie> service = new Trie();
+    const auto batch = randomStrings(1000, 2);
+    for (auto _ : state) {
+        service->addStrings(largeTrie(), batch, [](const TrieNode&) {});
+    }
+}
+BENCHMARK(BM_AddStringsToLargeTrie)->Unit(benchmark::kMillisecond);
+
+// Writes the large trie to a parcel the way the ITrie proxy does.
+static void BM_MarshalTrie(benchmark::State& state) {
+    const TrieNode& trie = largeTrie();
+    for (auto _ : state) {
+        Parcel parcel;
+        size_t parentHandle;
+        if (parcel.writeBuffer(&trie, sizeof(trie), &parentHandle) != ::android::OK ||
+            writeEmbeddedToParcel(trie, &parcel, parentHandle, 0 /* parentOffset */) !=
+                    ::android::OK) {
+            state.SkipWithError("marshalling failed");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_MarshalTrie)->Unit(benchmark::kMillisecond);
+
+// Half of the queries are in the trie. The argument selects sorted queries.
+static hidl_vec<hidl_string> makeQueries(bool sorted) {
+    auto queries = randomStrings(kNumStrings, 3);
+    for (size_t i = 0; i < queries.size(); i += 2) {
+        queries[i] = strings()[i];
+    }
+    if (sorted) {
+        std::sort(queries.begin(), queries.end());
+    }
+    return queries;
+}
+
+static void BM_ContainsStrings(benchmark::State& state) {
+    sp<Trie> service = new Trie();
+    const auto queries = makeQueries(state.range(0));
+    for (auto _ : state) {
+        service->containsStrings(largeTrie(), queries, [](const hidl_vec<bool>&) {});
+    }
+    state.SetItemsProcessed(state.iterations() * kNumStrings);
+}
+BENCHMARK(BM_ContainsStrings)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// The same lookups on an already flattened trie.
+static void BM_FlatTrieContains(benchmark::State& state) {
+    const FlatTrie trie(largeTrie());
+    const auto queries = makeQueries(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(trie.containsAll(queries));
+    }
+    state.SetItemsProcessed(state.iterations() * kNumStrings);
+}
+BENCHMARK(BM_FlatTrieContains)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
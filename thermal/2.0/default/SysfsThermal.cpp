@@ -0,0 +1,481 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.thermal@2.0-service-mock"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parsedouble.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+#include <cutils/uevent.h>
+
+#include "SysfsThermal.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+namespace {
+
+constexpr char kThermalSubsystem[] = "SUBSYSTEM=thermal";
+constexpr char kZonePrefix[] = "thermal_zone";
+constexpr char kCoolingPrefix[] = "cooling_device";
+constexpr size_t kSeverityCount = static_cast<size_t>(ThrottlingSeverity::SHUTDOWN) + 1;
+constexpr int kUeventMsgLen = 2048;
+
+// Reads the first line of an open sysfs attribute.
+bool readNode(int fd, std::string* contents) {
+    char buf[64];
+    ssize_t n = TEMP_FAILURE_RETRY(pread(fd, buf, sizeof(buf) - 1, 0));
+    if (n < 0) {
+        return false;
+    }
+    buf[n] = '\0';
+    contents->assign(buf, strcspn(buf, "\n"));
+    return true;
+}
+
+bool readFirstLine(const std::string& filename, std::string* contents) {
+    if (!android::base::ReadFileToString(filename, contents)) {
+        return false;
+    }
+    contents->resize(strcspn(contents->c_str(), "\n"));
+    return true;
+}
+
+// sysfs reports temperatures in millidegrees Celsius.
+bool readMilliCelsius(const std::string& filename, float* value) {
+    std::string contents;
+    int64_t milli;
+    if (!readFirstLine(filename, &contents) || !android::base::ParseInt(contents, &milli)) {
+        return false;
+    }
+    *value = milli / 1000.0f;
+    return true;
+}
+
+bool contains(const std::string& haystack, const char* needle) {
+    return haystack.find(needle) != std::string::npos;
+}
+
+TemperatureType zoneTypeOf(const std::string& name) {
+    std::string lower = android::base::Trim(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    if (contains(lower, "usb")) return TemperatureType::USB_PORT;
+    if (contains(lower, "npu")) return TemperatureType::NPU;
+    if (contains(lower, "gpu")) return TemperatureType::GPU;
+    if (contains(lower, "cpu")) return TemperatureType::CPU;
+    if (contains(lower, "batt")) return TemperatureType::BATTERY;
+    if (contains(lower, "skin")) return TemperatureType::SKIN;
+    if (contains(lower, "pa-therm") || contains(lower, "pa_therm"))
+        return TemperatureType::POWER_AMPLIFIER;
+    return TemperatureType::UNKNOWN;
+}
+
+CoolingType coolingTypeOf(const std::string& name) {
+    std::string lower = android::base::Trim(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    if (contains(lower, "fan")) return CoolingType::FAN;
+    if (contains(lower, "batt")) return CoolingType::BATTERY;
+    if (contains(lower, "npu")) return CoolingType::NPU;
+    if (contains(lower, "gpu")) return CoolingType::GPU;
+    if (contains(lower, "cpu")) return CoolingType::CPU;
+    if (contains(lower, "modem")) return CoolingType::MODEM;
+    return CoolingType::COMPONENT;
+}
+
+// Kernel trip point types, from the mildest to the most severe.
+bool severityOfTrip(const std::string& trip_type, ThrottlingSeverity* severity) {
+    if (trip_type == "active")
+        *severity = ThrottlingSeverity::LIGHT;
+    else if (trip_type == "passive")
+        *severity = ThrottlingSeverity::SEVERE;
+    else if (trip_type == "hot")
+        *severity = ThrottlingSeverity::EMERGENCY;
+    else if (trip_type == "critical")
+        *severity = ThrottlingSeverity::SHUTDOWN;
+    else
+        return false;
+    return true;
+}
+
+bool isThermalUevent(const char* msg, size_t length) {
+    const char* end = msg + length;
+    for (const char* cp = msg; cp < end && *cp; cp += strlen(cp) + 1) {
+        if (!strcmp(cp, kThermalSubsystem)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+SysfsThermal::SysfsThermal(const std::string& class_path) : class_path_(class_path) {
+    scan();
+}
+
+SysfsThermal::~SysfsThermal() {
+    if (monitor_thread_.joinable()) {
+        exiting_ = true;
+        uint64_t one = 1;
+        TEMP_FAILURE_RETRY(write(wake_fd_, &one, sizeof(one)));
+        monitor_thread_.join();
+    }
+    if (wake_fd_ >= 0) close(wake_fd_);
+    if (uevent_fd_ >= 0) close(uevent_fd_);
+    for (auto& zone : zones_) {
+        close(zone.temp_fd);
+    }
+    for (auto& cooling : coolings_) {
+        close(cooling.cur_state_fd);
+    }
+}
+
+void SysfsThermal::scan() {
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(class_path_.c_str()), closedir);
+    if (!dir) {
+        PLOG(ERROR) << "Failed to open " << class_path_;
+        return;
+    }
+
+    // Keep sysfs order (thermal_zone0, thermal_zone1, ...) stable across boots.
+    std::map<std::string, std::string> zones;
+    std::map<std::string, std::string> coolings;
+    while (struct dirent* entry = readdir(dir.get())) {
+        std::string name = entry->d_name;
+        if (android::base::StartsWith(name, kZonePrefix)) {
+            zones.emplace(name, class_path_ + "/" + name);
+        } else if (android::base::StartsWith(name, kCoolingPrefix)) {
+            coolings.emplace(name, class_path_ + "/" + name);
+        }
+    }
+    for (const auto& [name, path] : zones) {
+        addZone(path);
+    }
+    for (const auto& [name, path] : coolings) {
+        addCooling(path);
+    }
+    LOG(INFO) << "Found " << zones_.size() << " thermal zones and " << coolings_.size()
+              << " cooling devices in " << class_path_;
+}
+
+void SysfsThermal::addZone(const std::string& path) {
+    Zone zone;
+    if (!readFirstLine(path + "/type", &zone.name)) {
+        PLOG(WARNING) << "Skipping " << path << " without a type";
+        return;
+    }
+    zone.temp_fd = TEMP_FAILURE_RETRY(open((path + "/temp").c_str(), O_RDONLY | O_CLOEXEC));
+    if (zone.temp_fd < 0) {
+        PLOG(WARNING) << "Skipping " << path << " without a temp";
+        return;
+    }
+    zone.type = zoneTypeOf(zone.name);
+
+    zone.threshold.type = zone.type;
+    zone.threshold.name = zone.name;
+    for (size_t i = 0; i < kSeverityCount; ++i) {
+        zone.threshold.hotThrottlingThresholds[i] = NAN;
+        zone.threshold.coldThrottlingThresholds[i] = NAN;
+    }
+    zone.threshold.vrThrottlingThreshold = NAN;
+
+    for (int i = 0;; ++i) {
+        const std::string trip = path + "/trip_point_" + std::to_string(i);
+        float temp;
+        std::string trip_type;
+        if (!readMilliCelsius(trip + "_temp", &temp)) {
+            break;
+        }
+        ThrottlingSeverity severity;
+        if (!readFirstLine(trip + "_type", &trip_type) || !severityOfTrip(trip_type, &severity)) {
+            continue;
+        }
+        // The lowest trip point of a kind is where that severity starts.
+        float& threshold = zone.threshold.hotThrottlingThresholds[static_cast<size_t>(severity)];
+        if (std::isnan(threshold) || temp < threshold) {
+            threshold = temp;
+            float hyst = 0;
+            readMilliCelsius(trip + "_hyst", &hyst);
+            zone.hysteresis[static_cast<size_t>(severity)] = hyst;
+        }
+    }
+
+    float value;
+    if (readTemperature(zone, &value)) {
+        zone.severity = severityOf(zone, value);
+    }
+    zones_.push_back(std::move(zone));
+}
+
+void SysfsThermal::addCooling(const std::string& path) {
+    Cooling cooling;
+    if (!readFirstLine(path + "/type", &cooling.name)) {
+        PLOG(WARNING) << "Skipping " << path << " without a type";
+        return;
+    }
+    cooling.cur_state_fd =
+            TEMP_FAILURE_RETRY(open((path + "/cur_state").c_str(), O_RDONLY | O_CLOEXEC));
+    if (cooling.cur_state_fd < 0) {
+        PLOG(WARNING) << "Skipping " << path << " without a cur_state";
+        return;
+    }
+    cooling.type = coolingTypeOf(cooling.name);
+    coolings_.push_back(std::move(cooling));
+}
+
+bool SysfsThermal::readTemperature(const Zone& zone, float* value) const {
+    std::string contents;
+    int64_t milli;
+    if (!readNode(zone.temp_fd, &contents) || !android::base::ParseInt(contents, &milli)) {
+        LOG(ERROR) << "Failed to read temperature of " << zone.name;
+        return false;
+    }
+    *value = milli / 1000.0f;
+    return true;
+}
+
+ThrottlingSeverity SysfsThermal::severityOf(const Zone& zone, float value) const {
+    const auto& hot = zone.threshold.hotThrottlingThresholds;
+    size_t severity = 0;
+    for (size_t i = kSeverityCount - 1; i > 0; --i) {
+        if (!std::isnan(hot[i]) && value >= hot[i]) {
+            severity = i;
+            break;
+        }
+    }
+    // A zone leaves a severity only once it has cooled down past the hysteresis.
+    size_t current = static_cast<size_t>(zone.severity);
+    if (severity < current && !std::isnan(hot[current]) &&
+        value > hot[current] - zone.hysteresis[current]) {
+        severity = current;
+    }
+    return static_cast<ThrottlingSeverity>(severity);
+}
+
+std::vector<Temperature_1_0> SysfsThermal::getTemperatures_1_0() {
+    std::vector<Temperature_1_0> temperatures;
+    for (const auto& zone : zones_) {
+        // 1.0 only knows about the types up to SKIN.
+        if (zone.type > TemperatureType::SKIN) {
+            continue;
+        }
+        float value;
+        if (!readTemperature(zone, &value)) {
+            continue;
+        }
+        const auto& hot = zone.threshold.hotThrottlingThresholds;
+        temperatures.push_back({
+                .type = static_cast<V1_0::TemperatureType>(zone.type),
+                .name = zone.name,
+                .currentValue = value,
+                .throttlingThreshold = hot[static_cast<size_t>(ThrottlingSeverity::SEVERE)],
+                .shutdownThreshold = hot[static_cast<size_t>(ThrottlingSeverity::SHUTDOWN)],
+                .vrThrottlingThreshold = zone.threshold.vrThrottlingThreshold,
+        });
+    }
+    return temperatures;
+}
+
+std::vector<Temperature_2_0> SysfsThermal::getTemperatures(bool filter_type,
+                                                           TemperatureType type) {
+    std::vector<Temperature_2_0> temperatures;
+    for (const auto& zone : zones_) {
+        if (filter_type && zone.type != type) {
+            continue;
+        }
+        float value;
+        if (!readTemperature(zone, &value)) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(severity_mutex_);
+        temperatures.push_back({
+                .type = zone.type,
+                .name = zone.name,
+                .value = value,
+                .throttlingStatus = severityOf(zone, value),
+        });
+    }
+    return temperatures;
+}
+
+std::vector<TemperatureThreshold> SysfsThermal::getThresholds(bool filter_type,
+                                                              TemperatureType type) const {
+    std::vector<TemperatureThreshold> thresholds;
+    for (const auto& zone : zones_) {
+        if (!filter_type || zone.type == type) {
+            thresholds.push_back(zone.threshold);
+        }
+    }
+    return thresholds;
+}
+
+std::vector<CoolingDevice_2_0> SysfsThermal::getCoolingDevices(bool filter_type,
+                                                               CoolingType type) {
+    std::vector<CoolingDevice_2_0> cooling_devices;
+    for (const auto& cooling : coolings_) {
+        if (filter_type && cooling.type != type) {
+            continue;
+        }
+        std::string contents;
+        uint64_t value;
+        if (!readNode(cooling.cur_state_fd, &contents) ||
+            !android::base::ParseUint(contents, &value)) {
+            LOG(ERROR) << "Failed to read state of " << cooling.name;
+            continue;
+        }
+        cooling_devices.push_back({
+                .type = cooling.type,
+                .name = cooling.name,
+                .value = value,
+        });
+    }
+    return cooling_devices;
+}
+
+void SysfsThermal::startMonitor(const MonitorConfig& config, ThrottlingCallback callback) {
+    config_ = config;
+    callback_ = std::move(callback);
+
+    wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake_fd_ < 0) {
+        PLOG(ERROR) << "Failed to create the monitor eventfd";
+        return;
+    }
+    if (config_.listen_uevents) {
+        uevent_fd_ = uevent_open_socket(64 * 1024, true);
+        if (uevent_fd_ < 0) {
+            LOG(ERROR) << "Failed to open the uevent socket, polling only";
+        } else {
+            fcntl(uevent_fd_, F_SETFL, O_NONBLOCK);
+        }
+    }
+    // The first poll runs here, so changes after startMonitor() returns are never missed.
+    monitor_thread_ = std::thread(&SysfsThermal::monitor, this, pollZones());
+}
+
+bool SysfsThermal::handleUevent(const char* msg, size_t length) {
+    if (!isThermalUevent(msg, length)) {
+        return false;
+    }
+    if (wake_fd_ >= 0) {
+        uint64_t one = 1;
+        TEMP_FAILURE_RETRY(write(wake_fd_, &one, sizeof(one)));
+    }
+    return true;
+}
+
+void SysfsThermal::monitor(bool active) {
+    while (!exiting_) {
+        struct pollfd fds[2] = {
+                {.fd = wake_fd_, .events = POLLIN, .revents = 0},
+                {.fd = uevent_fd_, .events = POLLIN, .revents = 0},
+        };
+        auto interval = active ? config_.active_interval : config_.idle_interval;
+        int n = poll(fds, uevent_fd_ >= 0 ? 2 : 1, interval.count());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            PLOG(ERROR) << "Thermal monitor poll failed";
+            return;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            uint64_t count;
+            TEMP_FAILURE_RETRY(read(wake_fd_, &count, sizeof(count)));
+        }
+        if (uevent_fd_ >= 0 && (fds[1].revents & POLLIN)) {
+            char msg[kUeventMsgLen + 2];
+            bool thermal = false;
+            ssize_t len;
+            while ((len = uevent_kernel_multicast_recv(uevent_fd_, msg, kUeventMsgLen)) > 0) {
+                if (len >= kUeventMsgLen) {
+                    continue;  // overflow -- discard
+                }
+                msg[len] = '\0';
+                msg[len + 1] = '\0';
+                thermal |= isThermalUevent(msg, len);
+            }
+            // Other subsystems do not change the temperatures, keep waiting.
+            if (!thermal && !(fds[0].revents & POLLIN)) continue;
+        }
+        if (exiting_) break;
+        active = pollZones();
+    }
+}
+
+bool SysfsThermal::pollZones() {
+    bool active = false;
+    std::vector<Temperature_2_0> changed;
+    {
+        std::lock_guard<std::mutex> lock(severity_mutex_);
+        for (auto& zone : zones_) {
+            float value;
+            if (!readTemperature(zone, &value)) {
+                continue;
+            }
+            ThrottlingSeverity severity = severityOf(zone, value);
+            if (severity != zone.severity) {
+                zone.severity = severity;
+                changed.push_back({
+                        .type = zone.type,
+                        .name = zone.name,
+                        .value = value,
+                        .throttlingStatus = severity,
+                });
+            }
+
+            if (severity != ThrottlingSeverity::NONE) {
+                active = true;
+                continue;
+            }
+            const auto& hot = zone.threshold.hotThrottlingThresholds;
+            for (size_t i = 1; i < kSeverityCount; ++i) {
+                if (!std::isnan(hot[i])) {
+                    active |= value >= hot[i] - config_.approach_margin;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (const auto& temperature : changed) {
+        LOG(INFO) << "Throttling status of " << temperature.name << " changed to "
+                  << toString(temperature.throttlingStatus) << " at " << temperature.value;
+        callback_(temperature);
+    }
+    return active;
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_THERMAL_V2_0_SYSFSTHERMAL_H
+#define ANDROID_HARDWARE_THERMAL_V2_0_SYSFSTHERMAL_H
+
+#include <android/hardware/thermal/2.0/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+using CoolingDevice_1_0 = ::android::hardware::thermal::V1_0::CoolingDevice;
+using CoolingDevice_2_0 = ::android::hardware::thermal::V2_0::CoolingDevice;
+using Temperature_1_0 = ::android::hardware::thermal::V1_0::Temperature;
+using Temperature_2_0 = ::android::hardware::thermal::V2_0::Temperature;
+
+constexpr char kThermalClassPath[] = "/sys/class/thermal";
+
+struct MonitorConfig {
+    // Poll interval while every zone is well below its first hot threshold.
+    std::chrono::milliseconds idle_interval{2000};
+    // Poll interval while a zone is throttling or close to a threshold.
+    std::chrono::milliseconds active_interval{200};
+    // How close (in Celsius) to its first hot threshold a zone switches to active polling.
+    float approach_margin = 5.0f;
+    // Also wake up on thermal uevents from the kernel (trip point crossings).
+    bool listen_uevents = true;
+};
+
+// Thermal zones and cooling devices of a /sys/class/thermal directory.
+//
+// Zones and cooling devices are enumerated once. Their temp and cur_state attributes stay open
+// and are reread with pread, and the trip points of each zone become its hot thresholds. A
+// monitor thread tracks the throttling severity of every zone and reports a zone only when its
+// severity changes; it polls at an adaptive interval and rescans right away on thermal uevents.
+class SysfsThermal {
+   public:
+    using ThrottlingCallback = std::function<void(const Temperature_2_0&)>;
+
+    explicit SysfsThermal(const std::string& class_path);
+    ~SysfsThermal();
+
+    // Starts the monitor thread. Must be called at most once.
+    void startMonitor(const MonitorConfig& config, ThrottlingCallback callback);
+
+    std::vector<Temperature_1_0> getTemperatures_1_0();
+    std::vector<Temperature_2_0> getTemperatures(bool filter_type, TemperatureType type);
+    std::vector<TemperatureThreshold> getThresholds(bool filter_type, TemperatureType type) const;
+    std::vector<CoolingDevice_2_0> getCoolingDevices(bool filter_type, CoolingType type);
+
+    // Wakes the monitor up if the uevent (NUL separated KEY=value strings) belongs to the
+    // thermal subsystem. Returns whether it did.
+    bool handleUevent(const char* msg, size_t length);
+
+   private:
+    struct Zone {
+        std::string name;
+        TemperatureType type;
+        int temp_fd = -1;
+        TemperatureThreshold threshold;
+        // Hysteresis of each hot threshold, in Celsius.
+        float hysteresis[static_cast<size_t>(ThrottlingSeverity::SHUTDOWN) + 1] = {};
+        ThrottlingSeverity severity = ThrottlingSeverity::NONE;
+    };
+
+    struct Cooling {
+        std::string name;
+        CoolingType type;
+        int cur_state_fd = -1;
+    };
+
+    void scan();
+    void addZone(const std::string& path);
+    void addCooling(const std::string& path);
+    bool readTemperature(const Zone& zone, float* value) const;
+    ThrottlingSeverity severityOf(const Zone& zone, float value) const;
+    void monitor(bool active);
+    // Returns whether any zone asks for the active poll interval.
+    bool pollZones();
+
+    const std::string class_path_;
+    std::vector<Zone> zones_;
+    std::vector<Cooling> coolings_;
+
+    MonitorConfig config_;
+    ThrottlingCallback callback_;
+    int uevent_fd_ = -1;
+    int wake_fd_ = -1;
+    std::atomic<bool> exiting_ = false;
+    std::thread monitor_thread_;
+
+    // Guards the severity of the zones, which the monitor updates.
+    mutable std::mutex severity_mutex_;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_THERMAL_V2_0_SYSFSTHERMAL_H
@@ -16,8 +16,7 @@
 
 #define LOG_TAG "android.hardware.thermal@2.0-service-mock"
 
-#include <cmath>
-#include <set>
+#include <algorithm>
 
 #include <android-base/logging.h>
 #include <hidl/HidlTransportSupport.h>
@@ -35,45 +34,6 @@ using ::android::hardware::interfacesEqual;
 using ::android::hardware::thermal::V1_0::ThermalStatus;
 using ::android::hardware::thermal::V1_0::ThermalStatusCode;
 
-std::set<sp<IThermalChangedCallback>> gCallbacks;
-
-static const Temperature_1_0 kTemp_1_0 = {
-        .type = static_cast<::android::hardware::thermal::V1_0::TemperatureType>(
-                TemperatureType::SKIN),
-        .name = "test temperature sensor",
-        .currentValue = 30.8,
-        .throttlingThreshold = 48.0,
-        .shutdownThreshold = 60.0,
-        .vrThrottlingThreshold = 49.0,
-};
-
-static const Temperature_2_0 kTemp_2_0 = {
-        .type = TemperatureType::SKIN,
-        .name = "test temperature sensor",
-        .value = 30.8,
-        .throttlingStatus = ThrottlingSeverity::NONE,
-};
-
-static const TemperatureThreshold kTempThreshold = {
-        .type = TemperatureType::SKIN,
-        .name = "test temperature sensor",
-        .hotThrottlingThresholds = {{NAN, NAN, NAN, 48.0, NAN, NAN, 60.0}},
-        .coldThrottlingThresholds = {{NAN, NAN, NAN, NAN, NAN, NAN, NAN}},
-        .vrThrottlingThreshold = 49.0,
-};
-
-static const CoolingDevice_1_0 kCooling_1_0 = {
-        .type = ::android::hardware::thermal::V1_0::CoolingType::FAN_RPM,
-        .name = "test cooling device",
-        .currentValue = 100.0,
-};
-
-static const CoolingDevice_2_0 kCooling_2_0 = {
-        .type = CoolingType::FAN,
-        .name = "test cooling device",
-        .value = 100,
-};
-
 static const CpuUsage kCpuUsage = {
         .name = "cpu_name",
         .active = 0,
@@ -81,12 +41,47 @@ static const CpuUsage kCpuUsage = {
         .isOnline = true,
 };
 
+Thermal::Thermal() : Thermal(kThermalClassPath, MonitorConfig()) {}
+
+Thermal::Thermal(const std::string& class_path, const MonitorConfig& config)
+    : sysfs_(class_path) {
+    sysfs_.startMonitor(config, [this](const Temperature_2_0& temperature) {
+        notifyThrottling(temperature);
+    });
+}
+
+void Thermal::notifyThrottling(const Temperature_2_0& temperature) {
+    std::vector<sp<IThermalChangedCallback>> targets;
+    {
+        std::lock_guard<std::mutex> _lock(thermal_callback_mutex_);
+        for (const auto& c : callbacks_) {
+            if (!c.is_filter_type || c.type == temperature.type) {
+                targets.push_back(c.callback);
+            }
+        }
+    }
+    // Outside of the lock: a callback may (un)register from its notification.
+    for (const auto& callback : targets) {
+        Return<void> ret = callback->notifyThrottling(temperature);
+        if (!ret.isOk()) {
+            LOG(ERROR) << "Failed to notify throttling: " << ret.description();
+            if (ret.isDeadObject()) {
+                std::lock_guard<std::mutex> _lock(thermal_callback_mutex_);
+                callbacks_.erase(std::remove_if(callbacks_.begin(), callbacks_.end(),
+                                                [&](const CallbackSetting& c) {
+                                                    return interfacesEqual(c.callback, callback);
+                                                }),
+                                 callbacks_.end());
+            }
+        }
+    }
+}
+
 // Methods from ::android::hardware::thermal::V1_0::IThermal follow.
 Return<void> Thermal::getTemperatures(getTemperatures_cb _hidl_cb) {
     ThermalStatus status;
     status.code = ThermalStatusCode::SUCCESS;
-    std::vector<Temperature_1_0> temperatures = {kTemp_1_0};
-    _hidl_cb(status, temperatures);
+    _hidl_cb(status, sysfs_.getTemperatures_1_0());
     return Void();
 }
 
@@ -101,8 +96,9 @@ Return<void> Thermal::getCpuUsages(getCpuUsages_cb _hidl_cb) {
 Return<void> Thermal::getCoolingDevices(getCoolingDevices_cb _hidl_cb) {
     ThermalStatus status;
     status.code = ThermalStatusCode::SUCCESS;
-    std::vector<CoolingDevice_1_0> cooling_devices = {kCooling_1_0};
-    _hidl_cb(status, cooling_devices);
+    // 1.0 cooling devices report fan speeds in RPM, which the cur_state of a cooling device is
+    // not: it is an index into the throttle states of the device.
+    _hidl_cb(status, std::vector<CoolingDevice_1_0>());
     return Void();
 }
 
@@ -111,12 +107,10 @@ Return<void> Thermal::getCurrentTemperatures(bool filterType, TemperatureType ty
                                              getCurrentTemperatures_cb _hidl_cb) {
     ThermalStatus status;
     status.code = ThermalStatusCode::SUCCESS;
-    std::vector<Temperature_2_0> temperatures;
-    if (filterType && type != kTemp_2_0.type) {
+    std::vector<Temperature_2_0> temperatures = sysfs_.getTemperatures(filterType, type);
+    if (temperatures.empty()) {
         status.code = ThermalStatusCode::FAILURE;
         status.debugMessage = "Failed to read data";
-    } else {
-        temperatures = {kTemp_2_0};
     }
     _hidl_cb(status, temperatures);
     return Void();
@@ -126,12 +120,11 @@ Return<void> Thermal::getTemperatureThresholds(bool filterType, TemperatureType
                                                getTemperatureThresholds_cb _hidl_cb) {
     ThermalStatus status;
     status.code = ThermalStatusCode::SUCCESS;
-    std::vector<TemperatureThreshold> temperature_thresholds;
-    if (filterType && type != kTempThreshold.type) {
+    std::vector<TemperatureThreshold> temperature_thresholds =
+            sysfs_.getThresholds(filterType, type);
+    if (temperature_thresholds.empty()) {
         status.code = ThermalStatusCode::FAILURE;
         status.debugMessage = "Failed to read data";
-    } else {
-        temperature_thresholds = {kTempThreshold};
     }
     _hidl_cb(status, temperature_thresholds);
     return Void();
@@ -141,12 +134,10 @@ Return<void> Thermal::getCurrentCoolingDevices(bool filterType, CoolingType type
                                                getCurrentCoolingDevices_cb _hidl_cb) {
     ThermalStatus status;
     status.code = ThermalStatusCode::SUCCESS;
-    std::vector<CoolingDevice_2_0> cooling_devices;
-    if (filterType && type != kCooling_2_0.type) {
+    std::vector<CoolingDevice_2_0> cooling_devices = sysfs_.getCoolingDevices(filterType, type);
+    if (cooling_devices.empty()) {
         status.code = ThermalStatusCode::FAILURE;
         status.debugMessage = "Failed to read data";
-    } else {
-        cooling_devices = {kCooling_2_0};
     }
     _hidl_cb(status, cooling_devices);
     return Void();
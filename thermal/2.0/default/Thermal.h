@@ -21,6 +21,8 @@
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 
+#include "SysfsThermal.h"
+
 namespace android {
 namespace hardware {
 namespace thermal {
@@ -37,10 +39,6 @@ using ::android::hardware::Void;
 using ::android::hardware::thermal::V1_0::CpuUsage;
 using ::android::hardware::thermal::V2_0::CoolingType;
 using ::android::hardware::thermal::V2_0::IThermal;
-using CoolingDevice_1_0 = ::android::hardware::thermal::V1_0::CoolingDevice;
-using CoolingDevice_2_0 = ::android::hardware::thermal::V2_0::CoolingDevice;
-using Temperature_1_0 = ::android::hardware::thermal::V1_0::Temperature;
-using Temperature_2_0 = ::android::hardware::thermal::V2_0::Temperature;
 using ::android::hardware::thermal::V2_0::IThermalChangedCallback;
 using ::android::hardware::thermal::V2_0::TemperatureThreshold;
 using ::android::hardware::thermal::V2_0::TemperatureType;
@@ -55,6 +53,9 @@ struct CallbackSetting {
 
 class Thermal : public IThermal {
    public:
+    Thermal();
+    Thermal(const std::string& class_path, const MonitorConfig& config);
+
     // Methods from ::android::hardware::thermal::V1_0::IThermal follow.
     Return<void> getTemperatures(getTemperatures_cb _hidl_cb) override;
     Return<void> getCpuUsages(getCpuUsages_cb _hidl_cb) override;
@@ -75,8 +76,13 @@ class Thermal : public IThermal {
                                           getCurrentCoolingDevices_cb _hidl_cb) override;
 
    private:
+    // Sends a throttling change to the callbacks registered for its type.
+    void notifyThrottling(const Temperature_2_0& temperature);
+
     std::mutex thermal_callback_mutex_;
     std::vector<CallbackSetting> callbacks_;
+    // Declared last: its monitor thread calls notifyThrottling() until it is destroyed.
+    SysfsThermal sysfs_;
 };
 
 }  // namespace implementation
@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "SysfsThermal.h"
+#include "Thermal.h"
+
+using android::sp;
+using android::base::TemporaryDir;
+using android::base::WriteStringToFile;
+using android::hardware::Return;
+using android::hardware::Void;
+using android::hardware::thermal::V1_0::ThermalStatus;
+using android::hardware::thermal::V1_0::ThermalStatusCode;
+using android::hardware::thermal::V2_0::CoolingType;
+using android::hardware::thermal::V2_0::IThermalChangedCallback;
+using android::hardware::thermal::V2_0::TemperatureThreshold;
+using android::hardware::thermal::V2_0::TemperatureType;
+using android::hardware::thermal::V2_0::ThrottlingSeverity;
+using android::hardware::thermal::V2_0::implementation::MonitorConfig;
+using android::hardware::thermal::V2_0::implementation::SysfsThermal;
+using android::hardware::thermal::V2_0::implementation::Temperature_2_0;
+using android::hardware::thermal::V2_0::implementation::Thermal;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr char kThermalUevent[] =
+        "change@/devices/virtual/thermal/thermal_zone0\0ACTION=change\0SUBSYSTEM=thermal\0";
+
+// Long enough that a notification which arrives in time cannot come from an idle poll.
+constexpr auto kIdleInterval = 60s;
+constexpr auto kTimeout = 2s;
+
+// Collects notifications from the monitor thread.
+class Notifications {
+  public:
+    void push(const Temperature_2_0& temperature) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mTemperatures.push_back(temperature);
+        mCond.notify_all();
+    }
+
+    bool waitFor(Temperature_2_0* temperature, std::chrono::milliseconds timeout = kTimeout) {
+        std::unique_lock<std::mutex> lock(mLock);
+        if (!mCond.wait_for(lock, timeout, [this] { return !mTemperatures.empty(); })) {
+            return false;
+        }
+        *temperature = mTemperatures.front();
+        mTemperatures.pop_front();
+        return true;
+    }
+
+  private:
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::deque<Temperature_2_0> mTemperatures;
+};
+
+class FakeThermalCallback : public IThermalChangedCallback {
+  public:
+    Return<void> notifyThrottling(const Temperature_2_0& temperature) override {
+        mNotifications.push(temperature);
+        return Void();
+    }
+
+    Notifications mNotifications;
+};
+
+}  // namespace
+
+// Mirrors /sys/class/thermal: thermal_zoneN and cooling_deviceN directories with millidegree
+// Celsius attributes.
+class ThermalTest : public ::testing::Test {
+  protected:
+    void addZone(int id, const std::string& type, int milliCelsius,
+                 const std::vector<std::tuple<std::string, int, int>>& trips) {
+        std::string dir = zoneDir(id);
+        ASSERT_EQ(0, mkdir(dir.c_str(), 0755));
+        ASSERT_TRUE(WriteStringToFile(type + "\n", dir + "/type"));
+        setTemperature(id, milliCelsius);
+        for (size_t i = 0; i < trips.size(); ++i) {
+            const auto& [tripType, temp, hyst] = trips[i];
+            std::string trip = dir + "/trip_point_" + std::to_string(i);
+            ASSERT_TRUE(WriteStringToFile(tripType + "\n", trip + "_type"));
+            ASSERT_TRUE(WriteStringToFile(std::to_string(temp) + "\n", trip + "_temp"));
+            ASSERT_TRUE(WriteStringToFile(std::to_string(hyst) + "\n", trip + "_hyst"));
+        }
+    }
+
+    void addCooling(int id, const std::string& type, int state) {
+        std::string dir = std::string(mRoot.path) + "/cooling_device" + std::to_string(id);
+        ASSERT_EQ(0, mkdir(dir.c_str(), 0755));
+        ASSERT_TRUE(WriteStringToFile(type + "\n", dir + "/type"));
+        ASSERT_TRUE(WriteStringToFile(std::to_string(state) + "\n", dir + "/cur_state"));
+    }
+
+    // Rewrites temp in place, so that already open fds see the new value like in sysfs.
+    void setTemperature(int id, int milliCelsius) {
+        ASSERT_TRUE(WriteStringToFile(std::to_string(milliCelsius) + "\n",
+                                      zoneDir(id) + "/temp"));
+    }
+
+    std::string zoneDir(int id) const {
+        return std::string(mRoot.path) + "/thermal_zone" + std::to_string(id);
+    }
+
+    static MonitorConfig idleConfig() {
+        MonitorConfig config;
+        config.idle_interval = kIdleInterval;
+        config.active_interval = kIdleInterval;
+        config.listen_uevents = false;
+        return config;
+    }
+
+    TemporaryDir mRoot;
+};
+
+TEST_F(ThermalTest, EnumeratesZonesAndCoolingDevices) {
+    addZone(0, "cpu-thermal", 45000, {{"passive", 80000, 2000}, {"critical", 110000, 0}});
+    addZone(1, "skin-therm", 33500, {{"active", 40000, 1000}, {"passive", 45000, 1000}});
+    addCooling(0, "fan0", 3);
+    addCooling(1, "thermal-cpufreq-0", 2);
+    SysfsThermal sysfs(mRoot.path);
+
+    auto temperatures = sysfs.getTemperatures(false, TemperatureType::UNKNOWN);
+    ASSERT_EQ(2u, temperatures.size());
+    EXPECT_EQ("cpu-thermal", temperatures[0].name);
+    EXPECT_EQ(TemperatureType::CPU, temperatures[0].type);
+    EXPECT_FLOAT_EQ(45.0f, temperatures[0].value);
+    EXPECT_EQ(ThrottlingSeverity::NONE, temperatures[0].throttlingStatus);
+    EXPECT_EQ(TemperatureType::SKIN, temperatures[1].type);
+    EXPECT_FLOAT_EQ(33.5f, temperatures[1].value);
+
+    auto thresholds = sysfs.getThresholds(true, TemperatureType::SKIN);
+    ASSERT_EQ(1u, thresholds.size());
+    const auto& hot = thresholds[0].hotThrottlingThresholds;
+    EXPECT_FLOAT_EQ(40.0f, hot[static_cast<size_t>(ThrottlingSeverity::LIGHT)]);
+    EXPECT_FLOAT_EQ(45.0f, hot[static_cast<size_t>(ThrottlingSeverity::SEVERE)]);
+    EXPECT_TRUE(std::isnan(hot[static_cast<size_t>(ThrottlingSeverity::SHUTDOWN)]));
+
+    auto coolings = sysfs.getCoolingDevices(false, CoolingType::FAN);
+    ASSERT_EQ(2u, coolings.size());
+    EXPECT_EQ(CoolingType::FAN, coolings[0].type);
+    EXPECT_EQ(3u, coolings[0].value);
+    EXPECT_EQ(CoolingType::CPU, coolings[1].type);
+}
+
+TEST_F(ThermalTest, ReadsThroughOpenAttributes) {
+    addZone(0, "battery", 30000, {});
+    SysfsThermal sysfs(mRoot.path);
+
+    setTemperature(0, 31250);
+    auto temperatures = sysfs.getTemperatures(true, TemperatureType::BATTERY);
+    ASSERT_EQ(1u, temperatures.size());
+    EXPECT_FLOAT_EQ(31.25f, temperatures[0].value);
+    EXPECT_TRUE(sysfs.getTemperatures(true, TemperatureType::GPU).empty());
+}
+
+TEST_F(ThermalTest, UeventNotifiesWithoutWaitingForPoll) {
+    addZone(0, "cpu-thermal", 45000, {{"passive", 80000, 2000}});
+    Notifications notifications;
+    SysfsThermal sysfs(mRoot.path);
+    sysfs.startMonitor(idleConfig(), [&](const auto& t) { notifications.push(t); });
+
+    setTemperature(0, 85000);
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(sysfs.handleUevent(kThermalUevent, sizeof(kThermalUevent)));
+
+    Temperature_2_0 temperature;
+    ASSERT_TRUE(notifications.waitFor(&temperature));
+    auto latency = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(ThrottlingSeverity::SEVERE, temperature.throttlingStatus);
+    EXPECT_FLOAT_EQ(85.0f, temperature.value);
+    EXPECT_LT(latency, kTimeout);
+}
+
+TEST_F(ThermalTest, IgnoresOtherUevents) {
+    addZone(0, "cpu-thermal", 45000, {{"passive", 80000, 2000}});
+    Notifications notifications;
+    SysfsThermal sysfs(mRoot.path);
+    sysfs.startMonitor(idleConfig(), [&](const auto& t) { notifications.push(t); });
+
+    const char power[] = "change@/devices/power_supply/battery\0SUBSYSTEM=power_supply\0";
+    setTemperature(0, 85000);
+    EXPECT_FALSE(sysfs.handleUevent(power, sizeof(power)));
+
+    Temperature_2_0 temperature;
+    EXPECT_FALSE(notifications.waitFor(&temperature, 200ms));
+}
+
+TEST_F(ThermalTest, PollsFasterNearThreshold) {
+    addZone(0, "cpu-thermal", 77000, {{"passive", 80000, 2000}});
+    Notifications notifications;
+    MonitorConfig config = idleConfig();
+    config.active_interval = 20ms;
+    SysfsThermal sysfs(mRoot.path);
+    sysfs.startMonitor(config, [&](const auto& t) { notifications.push(t); });
+
+    // Within approach_margin of the threshold, no uevent needed.
+    setTemperature(0, 81000);
+    Temperature_2_0 temperature;
+    ASSERT_TRUE(notifications.waitFor(&temperature));
+    EXPECT_EQ(ThrottlingSeverity::SEVERE, temperature.throttlingStatus);
+}
+
+TEST_F(ThermalTest, NotifiesOnlySeverityChangesWithHysteresis) {
+    addZone(0, "cpu-thermal", 85000, {{"passive", 80000, 3000}, {"hot", 95000, 0}});
+    Notifications notifications;
+    MonitorConfig config = idleConfig();
+    config.active_interval = 10ms;
+    SysfsThermal sysfs(mRoot.path);
+    sysfs.startMonitor(config, [&](const auto& t) { notifications.push(t); });
+
+    Temperature_2_0 temperature;
+    // Still SEVERE: above the threshold, then within its hysteresis.
+    setTemperature(0, 88000);
+    EXPECT_FALSE(notifications.waitFor(&temperature, 100ms));
+    setTemperature(0, 78000);
+    EXPECT_FALSE(notifications.waitFor(&temperature, 100ms));
+
+    setTemperature(0, 76000);
+    ASSERT_TRUE(notifications.waitFor(&temperature));
+    EXPECT_EQ(ThrottlingSeverity::NONE, temperature.throttlingStatus);
+
+    setTemperature(0, 96000);
+    ASSERT_TRUE(notifications.waitFor(&temperature));
+    EXPECT_EQ(ThrottlingSeverity::EMERGENCY, temperature.throttlingStatus);
+}
+
+TEST_F(ThermalTest, CallbacksFilteredByType) {
+    addZone(0, "cpu-thermal", 45000, {{"passive", 80000, 2000}});
+    addZone(1, "skin-therm", 30000, {{"passive", 45000, 1000}});
+    MonitorConfig config = idleConfig();
+    config.active_interval = 10ms;
+    config.approach_margin = 100.0f;
+    sp<Thermal> thermal = new Thermal(mRoot.path, config);
+
+    sp<FakeThermalCallback> cpu = new FakeThermalCallback();
+    sp<FakeThermalCallback> skin = new FakeThermalCallback();
+    sp<FakeThermalCallback> all = new FakeThermalCallback();
+    auto expectSuccess = [](ThermalStatus status) {
+        EXPECT_EQ(ThermalStatusCode::SUCCESS, status.code);
+    };
+    thermal->registerThermalChangedCallback(cpu, true, TemperatureType::CPU, expectSuccess);
+    thermal->registerThermalChangedCallback(skin, true, TemperatureType::SKIN, expectSuccess);
+    thermal->registerThermalChangedCallback(all, false, TemperatureType::UNKNOWN, expectSuccess);
+
+    setTemperature(0, 82000);
+    Temperature_2_0 temperature;
+    ASSERT_TRUE(cpu->mNotifications.waitFor(&temperature));
+    EXPECT_EQ("cpu-thermal", temperature.name);
+    ASSERT_TRUE(all->mNotifications.waitFor(&temperature));
+    EXPECT_EQ("cpu-thermal", temperature.name);
+    EXPECT_FALSE(skin->mNotifications.waitFor(&temperature, 100ms));
+
+    setTemperature(1, 46000);
+    ASSERT_TRUE(skin->mNotifications.waitFor(&temperature));
+    EXPECT_EQ("skin-therm", temperature.name);
+    EXPECT_FALSE(cpu->mNotifications.waitFor(&temperature, 100ms));
+
+    thermal->unregisterThermalChangedCallback(all, expectSuccess);
+    setTemperature(1, 30000);
+    ASSERT_TRUE(skin->mNotifications.waitFor(&temperature));
+    EXPECT_EQ(ThrottlingSeverity::NONE, temperature.throttlingStatus);
+    EXPECT_FALSE(all->mNotifications.waitFor(&temperature, 100ms));
+}
+
+TEST_F(ThermalTest, ThresholdQueriesFilterByType) {
+    addZone(0, "gpu-thermal", 45000, {{"passive", 80000, 2000}});
+    sp<Thermal> thermal = new Thermal(mRoot.path, idleConfig());
+
+    thermal->getTemperatureThresholds(
+            true, TemperatureType::GPU,
+            [](ThermalStatus status, const auto& thresholds) {
+                EXPECT_EQ(ThermalStatusCode::SUCCESS, status.code);
+                ASSERT_EQ(1u, thresholds.size());
+                EXPECT_EQ("gpu-thermal", thresholds[0].name);
+            });
+    thermal->getTemperatureThresholds(
+            true, TemperatureType::SKIN,
+            [](ThermalStatus status, const auto& thresholds) {
+                EXPECT_EQ(ThermalStatusCode::FAILURE, status.code);
+                EXPECT_EQ(0u, thresholds.size());
+            });
+}
+
+TEST_F(ThermalTest, EmptyClassDirFails) {
+    sp<Thermal> thermal = new Thermal(mRoot.path, idleConfig());
+
+    thermal->getCurrentTemperatures(false, TemperatureType::UNKNOWN,
+                                    [](ThermalStatus status, const auto& temperatures) {
+                                        EXPECT_EQ(ThermalStatusCode::FAILURE, status.code);
+                                        EXPECT_EQ(0u, temperatures.size());
+                                    });
+    thermal->getTemperatureThresholds(false, TemperatureType::UNKNOWN,
+                                      [](ThermalStatus status, const auto& thresholds) {
+                                          EXPECT_EQ(ThermalStatusCode::FAILURE, status.code);
+                                          EXPECT_EQ(0u, thresholds.size());
+                                      });
+    thermal->getCurrentCoolingDevices(false, CoolingType::FAN,
+                                      [](ThermalStatus status, const auto& coolings) {
+                                          EXPECT_EQ(ThermalStatusCode::FAILURE, status.code);
+                                          EXPECT_EQ(0u, coolings.size());
+                                      });
+}
+
+TEST_F(ThermalTest, CoolingDeviceStatesAreNotReportedAsRpm) {
+    addCooling(0, "fan0", 3);
+    sp<Thermal> thermal = new Thermal(mRoot.path, idleConfig());
+
+    thermal->getCoolingDevices([](ThermalStatus status, const auto& coolings) {
+        EXPECT_EQ(ThermalStatusCode::SUCCESS, status.code);
+        EXPECT_EQ(0u, coolings.size());
+    });
+    thermal->getCurrentCoolingDevices(false, CoolingType::FAN,
+                                      [](ThermalStatus status, const auto& coolings) {
+                                          EXPECT_EQ(ThermalStatusCode::SUCCESS, status.code);
+                                          ASSERT_EQ(1u, coolings.size());
+                                          EXPECT_EQ(3u, coolings[0].value);
+                                      });
+}
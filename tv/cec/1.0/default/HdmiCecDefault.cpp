@@ -23,7 +23,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/ioctl.h>
-#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include "HdmiCecDefault.h"
 
@@ -31,6 +32,7 @@
 #define MIN_PORT_ID 0
 #define MAX_PORT_ID 15
 #define INVALID_PHYSICAL_ADDRESS 0xFFFF
+#define TRANSMIT_TIMEOUT_MS 2000
 
 namespace android {
 namespace hardware {
@@ -48,6 +50,8 @@ HdmiCecDefault::HdmiCecDefault() {
     mWakeupEnabled = false;
     mCecControlEnabled = false;
     mCallback = nullptr;
+    mEpollFd = -1;
+    mExitFd = -1;
 }
 
 HdmiCecDefault::~HdmiCecDefault() {
@@ -62,7 +66,7 @@ Return<Result> HdmiCecDefault::addLogicalAddress(CecLogicalAddress addr) {
     }
 
     cec_log_addrs cecLogAddrs;
-    int ret = ioctl(mHdmiCecPorts[MIN_PORT_ID]->mCecFd, CEC_ADAP_G_LOG_ADDRS, &cecLogAddrs);
+    int ret = mHdmiCecPorts[MIN_PORT_ID]->getLogicalAddresses(&cecLogAddrs);
     if (ret) {
         LOG(ERROR) << "Add logical address failed, Error = " << strerror(errno);
         return Result::FAILURE_BUSY;
@@ -131,7 +135,7 @@ Return<Result> HdmiCecDefault::addLogicalAddress(CecLogicalAddress addr) {
     // Return failure only if add logical address fails for all the ports
     Return<Result> result = Result::FAILURE_BUSY;
     for (int i = 0; i < mHdmiCecPorts.size(); i++) {
-        ret = ioctl(mHdmiCecPorts[i]->mCecFd, CEC_ADAP_S_LOG_ADDRS, &cecLogAddrs);
+        ret = mHdmiCecPorts[i]->setLogicalAddresses(&cecLogAddrs);
         if (ret) {
             LOG(ERROR) << "Add logical address failed for port " << mHdmiCecPorts[i]->mPortId
                        << ", Error = " << strerror(errno);
@@ -146,7 +150,7 @@ Return<void> HdmiCecDefault::clearLogicalAddress() {
     cec_log_addrs cecLogAddrs;
     memset(&cecLogAddrs, 0, sizeof(cecLogAddrs));
     for (int i = 0; i < mHdmiCecPorts.size(); i++) {
-        int ret = ioctl(mHdmiCecPorts[i]->mCecFd, CEC_ADAP_S_LOG_ADDRS, &cecLogAddrs);
+        int ret = mHdmiCecPorts[i]->setLogicalAddresses(&cecLogAddrs);
         if (ret) {
             LOG(ERROR) << "Clear logical Address failed for port " << mHdmiCecPorts[i]->mPortId
                        << ", Error = " << strerror(errno);
@@ -157,7 +161,7 @@ Return<void> HdmiCecDefault::clearLogicalAddress() {
 
 Return<void> HdmiCecDefault::getPhysicalAddress(getPhysicalAddress_cb callback) {
     uint16_t addr;
-    int ret = ioctl(mHdmiCecPorts[MIN_PORT_ID]->mCecFd, CEC_ADAP_G_PHYS_ADDR, &addr);
+    int ret = mHdmiCecPorts[MIN_PORT_ID]->getPhysicalAddress(&addr);
     if (ret) {
         LOG(ERROR) << "Get physical address failed, Error = " << strerror(errno);
         callback(Result::FAILURE_INVALID_STATE, addr);
@@ -184,25 +188,56 @@ Return<SendMessageResult> HdmiCecDefault::sendMessage(const CecMessage& message)
     }
     cecMsg.len = message.body.size() + 1;
 
-    // Return failure only if send message fails for all the ports
-    Return<SendMessageResult> result = SendMessageResult::FAIL;
-    for (int i = 0; i < mHdmiCecPorts.size(); i++) {
-        int ret = ioctl(mHdmiCecPorts[i]->mCecFd, CEC_TRANSMIT, &cecMsg);
+    // Start the transmit on every port before waiting for any of them. The event loop collects
+    // the tx_status of each one; sendMessage fails only if it fails for all the ports.
+    auto batch = std::make_shared<TransmitBatch>();
+    batch->pending = 0;
+    batch->result = SendMessageResult::FAIL;
+
+    std::unique_lock<mutex> lock(mTransmitLock);
+    for (auto& hdmiCecPort : mHdmiCecPorts) {
+        cec_msg portMsg = cecMsg;
+        int ret = hdmiCecPort->messageIoctl(CEC_TRANSMIT, &portMsg);
 
         if (ret) {
             LOG(ERROR) << "Send message failed, Error = " << strerror(errno);
             continue;
         }
 
-        if (cecMsg.tx_status != CEC_TX_STATUS_OK) {
-            LOG(ERROR) << "Send message tx_status = " << cecMsg.tx_status;
+        mTransmitBatches[{hdmiCecPort.get(), portMsg.sequence}] = batch;
+        batch->pending++;
+    }
+
+    bool done = mTransmitDone.wait_for(lock, std::chrono::milliseconds(TRANSMIT_TIMEOUT_MS),
+                                       [&batch] { return batch->pending == 0; });
+    if (!done) {
+        LOG(ERROR) << "Send message timed out on " << batch->pending << " port(s)";
+        for (auto it = mTransmitBatches.begin(); it != mTransmitBatches.end();) {
+            it = it->second == batch ? mTransmitBatches.erase(it) : std::next(it);
         }
+    }
+    return batch->result;
+}
+
+void HdmiCecDefault::onTransmitDone(HdmiCecPort* hdmiCecPort, const cec_msg& message) {
+    if (message.tx_status != CEC_TX_STATUS_OK) {
+        LOG(ERROR) << "Send message tx_status = " << message.tx_status;
+    }
 
-        if (result != SendMessageResult::SUCCESS) {
-            result = getSendMessageResult(cecMsg.tx_status);
+    {
+        std::lock_guard<mutex> lock(mTransmitLock);
+        auto it = mTransmitBatches.find({hdmiCecPort, message.sequence});
+        if (it == mTransmitBatches.end()) {
+            return;
+        }
+        auto batch = it->second;
+        mTransmitBatches.erase(it);
+        if (batch->result != SendMessageResult::SUCCESS) {
+            batch->result = getSendMessageResult(message.tx_status);
         }
+        batch->pending--;
     }
-    return result;
+    mTransmitDone.notify_all();
 }
 
 Return<void> HdmiCecDefault::setCallback(const sp<IHdmiCecCallback>& callback) {
@@ -227,16 +262,17 @@ Return<uint32_t> HdmiCecDefault::getVendorId() {
 }
 
 Return<void> HdmiCecDefault::getPortInfo(getPortInfo_cb callback) {
+    // Served from the per-port caches, so polling all ports costs no ioctl in steady state.
     hidl_vec<HdmiPortInfo> portInfos(mHdmiCecPorts.size());
+    uint32_t deviceType = GetUintProperty<uint32_t>(PROPERTY_DEVICE_TYPE, CEC_DEVICE_PLAYBACK);
     for (int i = 0; i < mHdmiCecPorts.size(); i++) {
         uint16_t addr = INVALID_PHYSICAL_ADDRESS;
-        int ret = ioctl(mHdmiCecPorts[i]->mCecFd, CEC_ADAP_G_PHYS_ADDR, &addr);
+        int ret = mHdmiCecPorts[i]->getPhysicalAddress(&addr);
         if (ret) {
             LOG(ERROR) << "Get port info failed for port : " << mHdmiCecPorts[i]->mPortId
                        << ", Error = " << strerror(errno);
         }
         HdmiPortType type = HdmiPortType::INPUT;
-        uint32_t deviceType = GetUintProperty<uint32_t>(PROPERTY_DEVICE_TYPE, CEC_DEVICE_PLAYBACK);
         if (deviceType != CEC_DEVICE_TV && i == MIN_PORT_ID) {
             type = HdmiPortType::OUTPUT;
         }
@@ -278,7 +314,7 @@ Return<void> HdmiCecDefault::enableAudioReturnChannel(int32_t /*portId*/, bool /
 
 Return<bool> HdmiCecDefault::isConnected(int32_t portId) {
     uint16_t addr;
-    int ret = ioctl(mHdmiCecPorts[portId]->mCecFd, CEC_ADAP_G_PHYS_ADDR, &addr);
+    int ret = mHdmiCecPorts[portId]->getPhysicalAddress(&addr);
     if (ret) {
         LOG(ERROR) << "Is connected failed, Error = " << strerror(errno);
         return false;
@@ -303,6 +339,7 @@ Return<Result> HdmiCecDefault::init() {
     const char* parentPath = "/dev/";
     DIR* dir = opendir(parentPath);
     const char* cecFilename = "cec";
+    vector<shared_ptr<HdmiCecPort>> hdmiCecPorts;
 
     while (struct dirent* dirEntry = readdir(dir)) {
         string filename = dirEntry->d_name;
@@ -317,16 +354,49 @@ Return<Result> HdmiCecDefault::init() {
             if (result != Result::SUCCESS) {
                 continue;
             }
-            thread eventThread(&HdmiCecDefault::event_thread, this, hdmiCecPort.get());
-            mEventThreads.push_back(std::move(eventThread));
-            mHdmiCecPorts.push_back(std::move(hdmiCecPort));
+            hdmiCecPorts.push_back(std::move(hdmiCecPort));
+        }
+    }
+    closedir(dir);
+
+    return init(std::move(hdmiCecPorts));
+}
+
+Return<Result> HdmiCecDefault::init(vector<shared_ptr<HdmiCecPort>> hdmiCecPorts) {
+    if (hdmiCecPorts.empty()) {
+        return Result::FAILURE_NOT_SUPPORTED;
+    }
+
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    mExitFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (mEpollFd < 0 || mExitFd < 0) {
+        LOG(ERROR) << "Failed to create event loop fds, Error = " << strerror(errno);
+        release();
+        return Result::FAILURE_NOT_SUPPORTED;
+    }
+
+    // The exit fd is tagged with a null port.
+    epoll_event exitEvent = {.events = EPOLLIN, .data = {.ptr = nullptr}};
+    epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mExitFd, &exitEvent);
+
+    for (auto& hdmiCecPort : hdmiCecPorts) {
+        // CEC messages and transmit results raise EPOLLIN, CEC events raise EPOLLPRI.
+        epoll_event portEvent = {.events = EPOLLIN | EPOLLPRI, .data = {.ptr = hdmiCecPort.get()}};
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, hdmiCecPort->mMessageFd, &portEvent)) {
+            LOG(ERROR) << "Failed to watch port " << hdmiCecPort->mPortId
+                       << ", Error = " << strerror(errno);
+            continue;
         }
+        mHdmiCecPorts.push_back(std::move(hdmiCecPort));
     }
 
     if (mHdmiCecPorts.empty()) {
+        release();
         return Result::FAILURE_NOT_SUPPORTED;
     }
 
+    mEventThread = thread(&HdmiCecDefault::event_thread, this);
+
     mCecEnabled = true;
     mWakeupEnabled = true;
     mCecControlEnabled = true;
@@ -337,107 +407,137 @@ Return<void> HdmiCecDefault::release() {
     mCecEnabled = false;
     mWakeupEnabled = false;
     mCecControlEnabled = false;
-    for (thread& eventThread : mEventThreads) {
-        if (eventThread.joinable()) {
-            eventThread.join();
-        }
+    if (mExitFd > 0) {
+        uint64_t tmp = 1;
+        write(mExitFd, &tmp, sizeof(tmp));
+    }
+    if (mEventThread.joinable()) {
+        mEventThread.join();
     }
     setCallback(nullptr);
     mHdmiCecPorts.clear();
-    mEventThreads.clear();
+    if (mExitFd > 0) {
+        close(mExitFd);
+        mExitFd = -1;
+    }
+    if (mEpollFd > 0) {
+        close(mEpollFd);
+        mEpollFd = -1;
+    }
     return Void();
 }
 
-void HdmiCecDefault::event_thread(HdmiCecPort* hdmiCecPort) {
-    struct pollfd ufds[3] = {
-            {hdmiCecPort->mCecFd, POLLIN, 0},
-            {hdmiCecPort->mCecFd, POLLERR, 0},
-            {hdmiCecPort->mExitFd, POLLIN, 0},
-    };
+void HdmiCecDefault::event_thread() {
+    epoll_event events[MAX_PORT_ID - MIN_PORT_ID + 2];
+    vector<HotplugEvent> hotplugEvents;
+    vector<CecMessage> cecMessages;
 
     while (1) {
-        ufds[0].revents = 0;
-        ufds[1].revents = 0;
-        ufds[2].revents = 0;
-
-        int ret = poll(ufds, /* size(ufds) = */ 3, /* timeout = */ -1);
+        int count = epoll_wait(mEpollFd, events, sizeof(events) / sizeof(events[0]),
+                               /* timeout = */ -1);
 
-        if (ret <= 0) {
+        if (count <= 0) {
             continue;
         }
 
-        if (ufds[2].revents == POLLIN) { /* Exit */
-            break;
+        bool exit = false;
+        for (int i = 0; i < count; i++) {
+            auto hdmiCecPort = static_cast<HdmiCecPort*>(events[i].data.ptr);
+            if (hdmiCecPort == nullptr) {
+                exit = true;
+                continue;
+            }
+            drainPort(hdmiCecPort, &hotplugEvents, &cecMessages);
         }
 
-        if (ufds[1].revents == POLLERR) { /* CEC Event */
-            cec_event ev;
-            ret = ioctl(hdmiCecPort->mCecFd, CEC_DQEVENT, &ev);
+        if (exit) {
+            break;
+        }
 
-            if (ret) {
-                LOG(ERROR) << "CEC_DQEVENT failed, Error = " << strerror(errno);
-                continue;
+        // Deliver everything read in this wakeup as one batch, with no ioctl in between.
+        sp<IHdmiCecCallback> callback = mCallback;
+        if (callback != nullptr) {
+            for (const auto& hotplugEvent : hotplugEvents) {
+                callback->onHotplugEvent(hotplugEvent);
             }
-
-            if (!mCecEnabled) {
-                continue;
+            for (const auto& cecMessage : cecMessages) {
+                callback->onCecMessage(cecMessage);
             }
+        } else if (!hotplugEvents.empty() || !cecMessages.empty()) {
+            LOG(ERROR) << "No event callback for " << hotplugEvents.size() << " hotplug event(s)"
+                       << " and " << cecMessages.size() << " message(s)";
+        }
+        hotplugEvents.clear();
+        cecMessages.clear();
+    }
+}
 
-            if (ev.event == CEC_EVENT_STATE_CHANGE) {
-                if (mCallback != nullptr) {
-                    HotplugEvent hotplugEvent{
-                            .connected = (ev.state_change.phys_addr != CEC_PHYS_ADDR_INVALID),
-                            .portId = hdmiCecPort->mPortId};
-                    mCallback->onHotplugEvent(hotplugEvent);
-                } else {
-                    LOG(ERROR) << "No event callback for hotplug";
-                }
-            }
+void HdmiCecDefault::drainPort(HdmiCecPort* hdmiCecPort, vector<HotplugEvent>* hotplugEvents,
+                               vector<CecMessage>* cecMessages) {
+    // Both queues are drained on every wakeup; an empty queue costs a single EAGAIN ioctl.
+    cec_event ev;
+    while (hdmiCecPort->messageIoctl(CEC_DQEVENT, &ev) == 0) {
+        if (ev.event == CEC_EVENT_STATE_CHANGE) {
+            hdmiCecPort->onStateChange(ev.state_change);
+        }
+
+        if (!mCecEnabled) {
+            continue;
         }
 
-        if (ufds[0].revents == POLLIN) { /* CEC Driver */
-            cec_msg msg = {};
-            ret = ioctl(hdmiCecPort->mCecFd, CEC_RECEIVE, &msg);
+        if (ev.event == CEC_EVENT_STATE_CHANGE) {
+            hotplugEvents->push_back(
+                    {.connected = (ev.state_change.phys_addr != CEC_PHYS_ADDR_INVALID),
+                     .portId = hdmiCecPort->mPortId});
+        }
+    }
+    if (errno != EAGAIN) {
+        LOG(ERROR) << "CEC_DQEVENT failed, Error = " << strerror(errno);
+    }
 
-            if (ret) {
+    while (1) {
+        cec_msg msg = {};
+        if (hdmiCecPort->messageIoctl(CEC_RECEIVE, &msg)) {
+            if (errno != EAGAIN) {
                 LOG(ERROR) << "CEC_RECEIVE failed, Error = " << strerror(errno);
-                continue;
             }
+            break;
+        }
 
-            if (msg.rx_status != CEC_RX_STATUS_OK) {
-                LOG(ERROR) << "msg rx_status = " << msg.rx_status;
-                continue;
-            }
+        if (msg.sequence != 0) { /* Result of a non-blocking transmit */
+            onTransmitDone(hdmiCecPort, msg);
+            continue;
+        }
 
-            if (!mCecEnabled) {
-                continue;
-            }
+        if (msg.rx_status != CEC_RX_STATUS_OK) {
+            LOG(ERROR) << "msg rx_status = " << msg.rx_status;
+            continue;
+        }
 
-            if (!mWakeupEnabled && isWakeupMessage(msg)) {
-                LOG(DEBUG) << "Filter wakeup message";
-                continue;
-            }
+        if (!mCecEnabled) {
+            continue;
+        }
 
-            if (!mCecControlEnabled && !isTransferableInSleep(msg)) {
-                LOG(DEBUG) << "Filter message in standby mode";
-                continue;
-            }
+        if (!mWakeupEnabled && isWakeupMessage(msg)) {
+            LOG(DEBUG) << "Filter wakeup message";
+            continue;
+        }
 
-            if (mCallback != nullptr) {
-                size_t length = std::min(msg.len - 1, (uint32_t)MaxLength::MESSAGE_BODY);
-                CecMessage cecMessage{
-                        .initiator = static_cast<CecLogicalAddress>(msg.msg[0] >> 4),
-                        .destination = static_cast<CecLogicalAddress>(msg.msg[0] & 0xf),
-                };
-                cecMessage.body.resize(length);
-                for (size_t i = 0; i < length; ++i) {
-                    cecMessage.body[i] = static_cast<uint8_t>(msg.msg[i + 1]);
-                }
-                mCallback->onCecMessage(cecMessage);
-            } else {
-                LOG(ERROR) << "no event callback for message";
-            }
+        if (!mCecControlEnabled && !isTransferableInSleep(msg)) {
+            LOG(DEBUG) << "Filter message in standby mode";
+            continue;
+        }
+
+        size_t length = std::min(msg.len - 1, (uint32_t)MaxLength::MESSAGE_BODY);
+        CecMessage cecMessage{
+                .initiator = static_cast<CecLogicalAddress>(msg.msg[0] >> 4),
+                .destination = static_cast<CecLogicalAddress>(msg.msg[0] & 0xf),
+        };
+        cecMessage.body.resize(length);
+        for (size_t i = 0; i < length; ++i) {
+            cecMessage.body[i] = static_cast<uint8_t>(msg.msg[i + 1]);
         }
+        cecMessages->push_back(std::move(cecMessage));
     }
 }
 
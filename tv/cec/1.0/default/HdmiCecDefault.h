@@ -13,8 +13,13 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#pragma once
+
 #include <hardware/hdmi_cec.h>
 #include <linux/cec.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 #include <thread>
 #include <vector>
 #include "HdmiCecPort.h"
@@ -26,6 +31,8 @@ namespace cec {
 namespace V1_0 {
 namespace implementation {
 
+using std::map;
+using std::mutex;
 using std::shared_ptr;
 using std::thread;
 using std::vector;
@@ -53,10 +60,21 @@ class HdmiCecDefault : public IHdmiCec, public hidl_death_recipient {
     }
 
     Return<Result> init();
+    // Serves the given, already initialised ports from a single event loop.
+    Return<Result> init(vector<shared_ptr<HdmiCecPort>> hdmiCecPorts);
     Return<void> release();
 
   private:
-    void event_thread(HdmiCecPort* hdmiCecPort);
+    // Transmits of one sendMessage call, outstanding on all ports at once.
+    struct TransmitBatch {
+        int pending;
+        SendMessageResult result;
+    };
+
+    void event_thread();
+    void drainPort(HdmiCecPort* hdmiCecPort, vector<HotplugEvent>* hotplugEvents,
+                   vector<CecMessage>* cecMessages);
+    void onTransmitDone(HdmiCecPort* hdmiCecPort, const cec_msg& message);
     static int getOpcode(cec_msg message);
     static int getFirstParam(cec_msg message);
     static bool isWakeupMessage(cec_msg message);
@@ -64,9 +82,16 @@ class HdmiCecDefault : public IHdmiCec, public hidl_death_recipient {
     static bool isPowerUICommand(cec_msg message);
     static Return<SendMessageResult> getSendMessageResult(int tx_status);
 
-    vector<thread> mEventThreads;
+    thread mEventThread;
+    int mEpollFd;
+    int mExitFd;
     vector<shared_ptr<HdmiCecPort>> mHdmiCecPorts;
 
+    // Guards mTransmitBatches, keyed by port and CEC_TRANSMIT sequence number.
+    mutex mTransmitLock;
+    std::condition_variable mTransmitDone;
+    map<std::pair<HdmiCecPort*, uint32_t>, shared_ptr<TransmitBatch>> mTransmitBatches;
+
     // When set to false, all the CEC commands are discarded. True by default after initialization.
     bool mCecEnabled;
     /*
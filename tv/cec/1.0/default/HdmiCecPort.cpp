@@ -18,8 +18,8 @@
 #include <android-base/logging.h>
 #include <errno.h>
 #include <linux/cec.h>
+#include <fcntl.h>
 #include <linux/ioctl.h>
-#include <sys/eventfd.h>
 #include <algorithm>
 
 #include "HdmiCecPort.h"
@@ -34,7 +34,7 @@ namespace implementation {
 HdmiCecPort::HdmiCecPort(unsigned int portId) {
     mPortId = portId;
     mCecFd = -1;
-    mExitFd = -1;
+    mMessageFd = -1;
 }
 
 HdmiCecPort::~HdmiCecPort() {
@@ -48,9 +48,9 @@ Return<Result> HdmiCecPort::init(const char* path) {
         LOG(ERROR) << "Failed to open " << path << ", Error = " << strerror(errno);
         return Result::FAILURE_NOT_SUPPORTED;
     }
-    mExitFd = eventfd(0, EFD_NONBLOCK);
-    if (mExitFd < 0) {
-        LOG(ERROR) << "Failed to open eventfd, Error = " << strerror(errno);
+    mMessageFd = open(path, O_RDWR | O_NONBLOCK);
+    if (mMessageFd < 0) {
+        LOG(ERROR) << "Failed to open " << path << ", Error = " << strerror(errno);
         release();
         return Result::FAILURE_NOT_SUPPORTED;
     }
@@ -71,7 +71,7 @@ Return<Result> HdmiCecPort::init(const char* path) {
     }
 
     uint32_t mode = CEC_MODE_INITIATOR | CEC_MODE_EXCL_FOLLOWER_PASSTHRU;
-    ret = ioctl(mCecFd, CEC_S_MODE, &mode);
+    ret = ioctl(mMessageFd, CEC_S_MODE, &mode);
     if (ret) {
         LOG(ERROR) << "Unable to set initiator mode, Error = " << strerror(errno);
         release();
@@ -81,18 +81,93 @@ Return<Result> HdmiCecPort::init(const char* path) {
 }
 
 Return<void> HdmiCecPort::release() {
-    if (mExitFd > 0) {
-        uint64_t tmp = 1;
-        write(mExitFd, &tmp, sizeof(tmp));
-    }
-    if (mExitFd > 0) {
-        close(mExitFd);
+    if (mMessageFd > 0) {
+        close(mMessageFd);
+        mMessageFd = -1;
     }
     if (mCecFd > 0) {
         close(mCecFd);
+        mCecFd = -1;
     }
     return Void();
 }
+
+int HdmiCecPort::adapterIoctl(unsigned long request, void* arg) {
+    return ioctl(mCecFd, request, arg);
+}
+
+int HdmiCecPort::messageIoctl(unsigned long request, void* arg) {
+    return ioctl(mMessageFd, request, arg);
+}
+
+int HdmiCecPort::getPhysicalAddress(uint16_t* addr) {
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mStateLock);
+        if (mPhysicalAddressValid) {
+            *addr = mPhysicalAddress;
+            return 0;
+        }
+        generation = mStateGeneration;
+    }
+
+    int ret = adapterIoctl(CEC_ADAP_G_PHYS_ADDR, addr);
+    if (ret) {
+        return ret;
+    }
+
+    std::lock_guard<std::mutex> lock(mStateLock);
+    if (generation == mStateGeneration) {
+        mPhysicalAddress = *addr;
+        mPhysicalAddressValid = true;
+    }
+    return 0;
+}
+
+int HdmiCecPort::getLogicalAddresses(cec_log_addrs* logAddrs) {
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mStateLock);
+        if (mLogicalAddressesValid) {
+            *logAddrs = mLogicalAddresses;
+            return 0;
+        }
+        generation = mStateGeneration;
+    }
+
+    int ret = adapterIoctl(CEC_ADAP_G_LOG_ADDRS, logAddrs);
+    if (ret) {
+        return ret;
+    }
+
+    std::lock_guard<std::mutex> lock(mStateLock);
+    if (generation == mStateGeneration) {
+        mLogicalAddresses = *logAddrs;
+        mLogicalAddressesValid = true;
+    }
+    return 0;
+}
+
+int HdmiCecPort::setLogicalAddresses(cec_log_addrs* logAddrs) {
+    int ret = adapterIoctl(CEC_ADAP_S_LOG_ADDRS, logAddrs);
+
+    std::lock_guard<std::mutex> lock(mStateLock);
+    mStateGeneration++;
+    mLogicalAddressesValid = (ret == 0);
+    if (ret == 0) {
+        mLogicalAddresses = *logAddrs;
+    }
+    return ret;
+}
+
+void HdmiCecPort::onStateChange(const cec_event_state_change& stateChange) {
+    std::lock_guard<std::mutex> lock(mStateLock);
+    mStateGeneration++;
+    mPhysicalAddress = stateChange.phys_addr;
+    mPhysicalAddressValid = true;
+    // The event only carries the mask of claimed addresses, so refetch the rest on demand.
+    mLogicalAddressesValid = false;
+}
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace cec
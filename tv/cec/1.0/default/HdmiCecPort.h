@@ -13,7 +13,11 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#pragma once
+
 #include <android/hardware/tv/cec/1.0/IHdmiCec.h>
+#include <linux/cec.h>
+#include <mutex>
 
 namespace android {
 namespace hardware {
@@ -25,13 +29,38 @@ namespace implementation {
 class HdmiCecPort {
   public:
     HdmiCecPort(unsigned int portId);
-    ~HdmiCecPort();
+    virtual ~HdmiCecPort();
     Return<Result> init(const char* path);
     Return<void> release();
 
+    // Adapter queries and configuration, issued on the blocking file handle.
+    virtual int adapterIoctl(unsigned long request, void* arg);
+    // CEC_RECEIVE, CEC_DQEVENT and CEC_TRANSMIT, issued on the non-blocking follower file handle.
+    virtual int messageIoctl(unsigned long request, void* arg);
+
+    // Cached views of CEC_ADAP_G_PHYS_ADDR and CEC_ADAP_G_LOG_ADDRS. They only go back to the
+    // adapter after onStateChange() invalidates them. Return 0, or -1 with errno set.
+    int getPhysicalAddress(uint16_t* addr);
+    int getLogicalAddresses(cec_log_addrs* logAddrs);
+    // CEC_ADAP_S_LOG_ADDRS; the addresses claimed by the adapter are cached.
+    int setLogicalAddresses(cec_log_addrs* logAddrs);
+    // Called by the event loop for every CEC_EVENT_STATE_CHANGE of this port.
+    void onStateChange(const cec_event_state_change& stateChange);
+
     unsigned int mPortId;
     int mCecFd;
-    int mExitFd;
+    // Watched by the event loop. Transmits on it return immediately and report their tx_status
+    // through CEC_RECEIVE, tagged with the sequence number assigned by CEC_TRANSMIT.
+    int mMessageFd;
+
+  private:
+    std::mutex mStateLock;
+    // Bumped on every state change, so that a query racing with one does not cache stale data.
+    uint64_t mStateGeneration = 0;
+    bool mPhysicalAddressValid = false;
+    uint16_t mPhysicalAddress = CEC_PHYS_ADDR_INVALID;
+    bool mLogicalAddressesValid = false;
+    cec_log_addrs mLogicalAddresses = {};
 };
 
 }  // namespace implementation
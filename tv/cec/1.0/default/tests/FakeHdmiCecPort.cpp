@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "FakeHdmiCecPort.h"
+
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace cec {
+namespace V1_0 {
+namespace implementation {
+
+FakeHdmiCecPort::FakeHdmiCecPort(unsigned int portId, std::chrono::milliseconds transmitDelay,
+                                 uint8_t transmitStatus)
+    : HdmiCecPort(portId), mTransmitDelay(transmitDelay), mTransmitStatus(transmitStatus) {
+    mMessageFd = eventfd(0, EFD_NONBLOCK);
+}
+
+FakeHdmiCecPort::~FakeHdmiCecPort() {
+    for (auto& transmitThread : mTransmitThreads) {
+        transmitThread.join();
+    }
+}
+
+int FakeHdmiCecPort::adapterIoctl(unsigned long request, void* arg) {
+    mAdapterIoctls++;
+    std::lock_guard<std::mutex> lock(mLock);
+    switch (request) {
+        case CEC_ADAP_G_PHYS_ADDR:
+            *static_cast<uint16_t*>(arg) = mPhysicalAddress;
+            return 0;
+        case CEC_ADAP_G_LOG_ADDRS:
+            *static_cast<cec_log_addrs*>(arg) = mLogicalAddresses;
+            return 0;
+        case CEC_ADAP_S_LOG_ADDRS:
+            mLogicalAddresses = *static_cast<cec_log_addrs*>(arg);
+            return 0;
+        default:
+            errno = ENOTTY;
+            return -1;
+    }
+}
+
+int FakeHdmiCecPort::messageIoctl(unsigned long request, void* arg) {
+    mMessageIoctls++;
+    std::lock_guard<std::mutex> lock(mLock);
+    switch (request) {
+        case CEC_RECEIVE:
+            if (mReceived.empty()) {
+                errno = EAGAIN;
+                return -1;
+            }
+            *static_cast<cec_msg*>(arg) = mReceived.front();
+            mReceived.pop_front();
+            updateReadinessLocked();
+            return 0;
+        case CEC_DQEVENT:
+            if (mEvents.empty()) {
+                errno = EAGAIN;
+                return -1;
+            }
+            *static_cast<cec_event*>(arg) = mEvents.front();
+            mEvents.pop_front();
+            updateReadinessLocked();
+            return 0;
+        case CEC_TRANSMIT: {
+            cec_msg* message = static_cast<cec_msg*>(arg);
+            message->sequence = ++mSequence;
+            mTransmitted.push_back(*message);
+            cec_msg result = *message;
+            result.tx_status = mTransmitStatus;
+            if (mHoldTransmitResults) {
+                mHeldTransmitResults.push_back(result);
+                return 0;
+            }
+            mTransmitThreads.emplace_back([this, result] {
+                std::this_thread::sleep_for(mTransmitDelay);
+                injectMessage(result);
+            });
+            return 0;
+        }
+        default:
+            errno = ENOTTY;
+            return -1;
+    }
+}
+
+void FakeHdmiCecPort::injectMessage(const cec_msg& message) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mReceived.push_back(message);
+    updateReadinessLocked();
+}
+
+void FakeHdmiCecPort::injectStateChange(uint16_t physicalAddress, uint16_t logicalAddressMask) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mPhysicalAddress = physicalAddress;
+    cec_event event = {};
+    event.event = CEC_EVENT_STATE_CHANGE;
+    event.state_change.phys_addr = physicalAddress;
+    event.state_change.log_addr_mask = logicalAddressMask;
+    mEvents.push_back(event);
+    updateReadinessLocked();
+}
+
+std::vector<cec_msg> FakeHdmiCecPort::getTransmitted() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mTransmitted;
+}
+
+void FakeHdmiCecPort::holdTransmitResults() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mHoldTransmitResults = true;
+}
+
+void FakeHdmiCecPort::releaseTransmitResults() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mHoldTransmitResults = false;
+    mReceived.insert(mReceived.end(), mHeldTransmitResults.begin(), mHeldTransmitResults.end());
+    mHeldTransmitResults.clear();
+    updateReadinessLocked();
+}
+
+void FakeHdmiCecPort::updateReadinessLocked() {
+    bool readable = !mReceived.empty() || !mEvents.empty();
+    if (readable == mReadable) {
+        return;
+    }
+    uint64_t value = 1;
+    if (readable) {
+        write(mMessageFd, &value, sizeof(value));
+    } else {
+        read(mMessageFd, &value, sizeof(value));
+    }
+    mReadable = readable;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace cec
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
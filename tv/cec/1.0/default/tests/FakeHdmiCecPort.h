@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <linux/cec.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "HdmiCecPort.h"
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace cec {
+namespace V1_0 {
+namespace implementation {
+
+// Stands in for a /dev/cecX character device. mMessageFd is an eventfd that stays readable while
+// received messages or events are queued, and ioctls are served from in-memory queues with the
+// non-blocking semantics of the kernel driver.
+class FakeHdmiCecPort : public HdmiCecPort {
+  public:
+    FakeHdmiCecPort(unsigned int portId, std::chrono::milliseconds transmitDelay,
+                    uint8_t transmitStatus = CEC_TX_STATUS_OK);
+    ~FakeHdmiCecPort() override;
+
+    int adapterIoctl(unsigned long request, void* arg) override;
+    int messageIoctl(unsigned long request, void* arg) override;
+
+    void injectMessage(const cec_msg& message);
+    void injectStateChange(uint16_t physicalAddress, uint16_t logicalAddressMask = 0);
+    std::vector<cec_msg> getTransmitted();
+
+    // Keeps transmit results queued until releaseTransmitResults() is called.
+    void holdTransmitResults();
+    void releaseTransmitResults();
+
+    std::atomic<int> mAdapterIoctls{0};
+    std::atomic<int> mMessageIoctls{0};
+    uint16_t mPhysicalAddress = 0x1000;
+    cec_log_addrs mLogicalAddresses = {};
+
+  private:
+    void updateReadinessLocked();
+
+    const std::chrono::milliseconds mTransmitDelay;
+    const uint8_t mTransmitStatus;
+
+    std::mutex mLock;
+    std::deque<cec_msg> mReceived;
+    std::deque<cec_event> mEvents;
+    std::vector<cec_msg> mTransmitted;
+    bool mHoldTransmitResults = false;
+    std::vector<cec_msg> mHeldTransmitResults;
+    std::vector<std::thread> mTransmitThreads;
+    uint32_t mSequence = 0;
+    bool mReadable = false;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace cec
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "FakeHdmiCecPort.h"
+#include "HdmiCecDefault.h"
+
+using namespace std::chrono_literals;
+using android::sp;
+using android::hardware::Return;
+using android::hardware::Void;
+using android::hardware::tv::cec::V1_0::CecLogicalAddress;
+using android::hardware::tv::cec::V1_0::CecMessage;
+using android::hardware::tv::cec::V1_0::HdmiPortInfo;
+using android::hardware::tv::cec::V1_0::HotplugEvent;
+using android::hardware::tv::cec::V1_0::IHdmiCecCallback;
+using android::hardware::tv::cec::V1_0::OptionKey;
+using android::hardware::tv::cec::V1_0::Result;
+using android::hardware::tv::cec::V1_0::SendMessageResult;
+using android::hardware::tv::cec::V1_0::implementation::FakeHdmiCecPort;
+using android::hardware::tv::cec::V1_0::implementation::HdmiCecDefault;
+using android::hardware::tv::cec::V1_0::implementation::HdmiCecPort;
+using std::chrono::steady_clock;
+
+namespace {
+
+class RecordingCallback : public IHdmiCecCallback {
+  public:
+    Return<void> onCecMessage(const CecMessage& message) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mMessages.push_back(message);
+        mCondition.notify_all();
+        return Void();
+    }
+
+    Return<void> onHotplugEvent(const HotplugEvent& event) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mHotplugEvents.push_back(event);
+        mCondition.notify_all();
+        return Void();
+    }
+
+    bool waitForMessages(size_t count, std::chrono::milliseconds timeout = 1s) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mCondition.wait_for(lock, timeout, [&] { return mMessages.size() >= count; });
+    }
+
+    bool waitForHotplugEvents(size_t count, std::chrono::milliseconds timeout = 1s) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mCondition.wait_for(lock, timeout, [&] { return mHotplugEvents.size() >= count; });
+    }
+
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::vector<CecMessage> mMessages;
+    std::vector<HotplugEvent> mHotplugEvents;
+};
+
+cec_msg makeMessage(uint8_t header, uint8_t opcode, uint8_t param = 0) {
+    cec_msg message = {};
+    message.len = 3;
+    message.msg[0] = header;
+    message.msg[1] = opcode;
+    message.msg[2] = param;
+    message.rx_status = CEC_RX_STATUS_OK;
+    return message;
+}
+
+}  // namespace
+
+class HdmiCecDefaultTest : public ::testing::Test {
+  protected:
+    void startPorts(size_t count, std::chrono::milliseconds transmitDelay = 0ms,
+                    uint8_t transmitStatus = CEC_TX_STATUS_OK) {
+        std::vector<std::shared_ptr<HdmiCecPort>> ports;
+        for (size_t i = 0; i < count; i++) {
+            auto port = std::make_shared<FakeHdmiCecPort>(i, transmitDelay, transmitStatus);
+            mPorts.push_back(port);
+            ports.push_back(port);
+        }
+        ASSERT_EQ(Result::SUCCESS, static_cast<Result>(mHdmiCec->init(std::move(ports))));
+        mHdmiCec->setCallback(mCallback);
+    }
+
+    void TearDown() override { mHdmiCec->release(); }
+
+    sp<HdmiCecDefault> mHdmiCec = new HdmiCecDefault();
+    sp<RecordingCallback> mCallback = new RecordingCallback();
+    std::vector<std::shared_ptr<FakeHdmiCecPort>> mPorts;
+};
+
+TEST_F(HdmiCecDefaultTest, DrainsAllPendingMessagesOfAllPorts) {
+    startPorts(3);
+    constexpr size_t kMessagesPerPort = 20;
+
+    for (size_t i = 0; i < kMessagesPerPort; i++) {
+        for (auto& port : mPorts) {
+            port->injectMessage(makeMessage(0x40, CEC_MESSAGE_GIVE_OSD_NAME, i));
+        }
+    }
+
+    ASSERT_TRUE(mCallback->waitForMessages(kMessagesPerPort * mPorts.size()));
+    EXPECT_EQ(kMessagesPerPort * mPorts.size(), mCallback->mMessages.size());
+    for (auto& port : mPorts) {
+        // Each wakeup drains the queues until EAGAIN, so ioctls stay close to one per message.
+        EXPECT_LE(port->mMessageIoctls.load(), static_cast<int>(kMessagesPerPort * 3));
+    }
+}
+
+TEST_F(HdmiCecDefaultTest, PreservesMessageOrderPerPort) {
+    startPorts(1);
+    constexpr size_t kMessages = 50;
+
+    for (size_t i = 0; i < kMessages; i++) {
+        mPorts[0]->injectMessage(makeMessage(0x40, CEC_MESSAGE_GIVE_OSD_NAME, i));
+    }
+
+    ASSERT_TRUE(mCallback->waitForMessages(kMessages));
+    for (size_t i = 0; i < kMessages; i++) {
+        EXPECT_EQ(i, mCallback->mMessages[i].body[1]);
+    }
+}
+
+TEST_F(HdmiCecDefaultTest, DeliversHotplugEventsWithPortId) {
+    startPorts(2);
+
+    mPorts[1]->injectStateChange(0x2000);
+    mPorts[0]->injectStateChange(CEC_PHYS_ADDR_INVALID);
+
+    ASSERT_TRUE(mCallback->waitForHotplugEvents(2));
+    for (const auto& event : mCallback->mHotplugEvents) {
+        EXPECT_EQ(event.portId == 1, event.connected);
+    }
+}
+
+TEST_F(HdmiCecDefaultTest, FiltersWakeupMessagesWhenDisabled) {
+    startPorts(1);
+    mHdmiCec->setOption(OptionKey::WAKEUP, false);
+
+    mPorts[0]->injectMessage(makeMessage(0x40, CEC_MESSAGE_IMAGE_VIEW_ON));
+    mPorts[0]->injectMessage(makeMessage(0x40, CEC_MESSAGE_GIVE_OSD_NAME));
+
+    ASSERT_TRUE(mCallback->waitForMessages(1));
+    std::this_thread::sleep_for(50ms);
+    ASSERT_EQ(1u, mCallback->mMessages.size());
+    EXPECT_EQ(CEC_MESSAGE_GIVE_OSD_NAME, mCallback->mMessages[0].body[0]);
+}
+
+TEST_F(HdmiCecDefaultTest, DeliversEachMessageWithoutWaitingForMore) {
+    startPorts(4);
+    constexpr size_t kMessages = 100;
+
+    for (size_t i = 0; i < kMessages; i++) {
+        mPorts[i % mPorts.size()]->injectMessage(makeMessage(0x40, CEC_MESSAGE_GIVE_OSD_NAME));
+        ASSERT_TRUE(mCallback->waitForMessages(i + 1));
+    }
+}
+
+TEST_F(HdmiCecDefaultTest, TransmitsOnAllPortsInParallel) {
+    startPorts(4);
+    for (auto& port : mPorts) {
+        port->holdTransmitResults();
+    }
+
+    CecMessage message = {.initiator = CecLogicalAddress::PLAYBACK_1,
+                          .destination = CecLogicalAddress::TV};
+    message.body = {CEC_MESSAGE_GIVE_OSD_NAME};
+    std::thread sender([&] {
+        EXPECT_EQ(SendMessageResult::SUCCESS,
+                  static_cast<SendMessageResult>(mHdmiCec->sendMessage(message)));
+    });
+
+    // No port has reported a result yet, so serial blocking transmits would
+    // stop at the first port.
+    auto allTransmitted = [&] {
+        for (auto& port : mPorts) {
+            if (port->getTransmitted().empty()) return false;
+        }
+        return true;
+    };
+    auto deadline = steady_clock::now() + 1s;
+    while (!allTransmitted() && steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(1ms);
+    }
+    EXPECT_TRUE(allTransmitted());
+
+    for (auto& port : mPorts) {
+        port->releaseTransmitResults();
+    }
+    sender.join();
+
+    for (auto& port : mPorts) {
+        ASSERT_EQ(1u, port->getTransmitted().size());
+        EXPECT_EQ(0x40, port->getTransmitted()[0].msg[0]);
+    }
+    // Transmit results must not reach the framework as received messages.
+    EXPECT_TRUE(mCallback->mMessages.empty());
+}
+
+TEST_F(HdmiCecDefaultTest, ReportsTransmitFailureFromAllPorts) {
+    startPorts(2, 0ms, CEC_TX_STATUS_NACK);
+
+    CecMessage message = {.initiator = CecLogicalAddress::PLAYBACK_1,
+                          .destination = CecLogicalAddress::TV};
+    message.body = {CEC_MESSAGE_GIVE_OSD_NAME};
+
+    EXPECT_EQ(SendMessageResult::NACK,
+              static_cast<SendMessageResult>(mHdmiCec->sendMessage(message)));
+}
+
+TEST_F(HdmiCecDefaultTest, CachesPhysicalAddress) {
+    startPorts(1);
+    mPorts[0]->mPhysicalAddress = 0x1200;
+
+    for (int i = 0; i < 10; i++) {
+        mHdmiCec->getPhysicalAddress([](Result result, uint16_t addr) {
+            EXPECT_EQ(Result::SUCCESS, result);
+            EXPECT_EQ(0x1200, addr);
+        });
+        EXPECT_TRUE(mHdmiCec->isConnected(0));
+    }
+
+    EXPECT_EQ(1, mPorts[0]->mAdapterIoctls.load());
+}
+
+TEST_F(HdmiCecDefaultTest, StateChangeUpdatesCachedPhysicalAddress) {
+    startPorts(1);
+    EXPECT_TRUE(mHdmiCec->isConnected(0));
+    int ioctls = mPorts[0]->mAdapterIoctls.load();
+
+    mPorts[0]->injectStateChange(CEC_PHYS_ADDR_INVALID);
+    ASSERT_TRUE(mCallback->waitForHotplugEvents(1));
+    EXPECT_FALSE(mHdmiCec->isConnected(0));
+
+    mPorts[0]->injectStateChange(0x3000);
+    ASSERT_TRUE(mCallback->waitForHotplugEvents(2));
+    EXPECT_TRUE(mHdmiCec->isConnected(0));
+    mHdmiCec->getPhysicalAddress(
+            [](Result /*result*/, uint16_t addr) { EXPECT_EQ(0x3000, addr); });
+
+    // The event carries the new address, so no query went to the adapter.
+    EXPECT_EQ(ioctls, mPorts[0]->mAdapterIoctls.load());
+}
+
+TEST_F(HdmiCecDefaultTest, GetPortInfoServedFromCache) {
+    startPorts(4);
+    for (size_t i = 0; i < mPorts.size(); i++) {
+        mPorts[i]->mPhysicalAddress = 0x1000 * (i + 1);
+    }
+
+    for (int round = 0; round < 5; round++) {
+        mHdmiCec->getPortInfo([&](const auto& portInfos) {
+            ASSERT_EQ(mPorts.size(), portInfos.size());
+            for (size_t i = 0; i < portInfos.size(); i++) {
+                EXPECT_EQ(0x1000 * (i + 1), portInfos[i].physicalAddress);
+            }
+        });
+    }
+
+    for (auto& port : mPorts) {
+        EXPECT_EQ(1, port->mAdapterIoctls.load());
+    }
+}
+
+TEST_F(HdmiCecDefaultTest, LogicalAddressesRefetchedAfterStateChange) {
+    startPorts(1);
+
+    EXPECT_EQ(Result::SUCCESS, static_cast<Result>(
+                                       mHdmiCec->addLogicalAddress(CecLogicalAddress::PLAYBACK_1)));
+    int ioctls = mPorts[0]->mAdapterIoctls.load();
+
+    // The addresses set by the first call are cached and extended by the second.
+    EXPECT_EQ(Result::SUCCESS, static_cast<Result>(
+                                       mHdmiCec->addLogicalAddress(CecLogicalAddress::PLAYBACK_2)));
+    EXPECT_EQ(ioctls + 1, mPorts[0]->mAdapterIoctls.load());
+    EXPECT_EQ(2, mPorts[0]->mLogicalAddresses.num_log_addrs);
+
+    // Another client reconfigured the adapter: the cache must not hand out the stale list.
+    mPorts[0]->mLogicalAddresses = {};
+    mPorts[0]->injectStateChange(0x1000);
+    ASSERT_TRUE(mCallback->waitForHotplugEvents(1));
+
+    ioctls = mPorts[0]->mAdapterIoctls.load();
+    EXPECT_EQ(Result::SUCCESS, static_cast<Result>(
+                                       mHdmiCec->addLogicalAddress(CecLogicalAddress::PLAYBACK_1)));
+    EXPECT_EQ(ioctls + 2, mPorts[0]->mAdapterIoctls.load());
+    EXPECT_EQ(1, mPorts[0]->mLogicalAddresses.num_log_addrs);
+}
@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.usb@1.0-service"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include <set>
+
+#include "PortStatusCache.h"
+
+namespace android {
+namespace hardware {
+namespace usb {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+constexpr char kSubsystem[] = "SUBSYSTEM=dual_role_usb";
+
+// Reads the first line of an open sysfs attribute.
+bool readNode(int fd, std::string* contents) {
+    char buf[64];
+    ssize_t n = TEMP_FAILURE_RETRY(pread(fd, buf, sizeof(buf) - 1, 0));
+    if (n < 0) {
+        return false;
+    }
+    buf[n] = '\0';
+    contents->assign(buf, strcspn(buf, "\n"));
+    return true;
+}
+
+bool readFirstLine(const std::string& filename, std::string* contents) {
+    int fd = TEMP_FAILURE_RETRY(open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        return false;
+    }
+    bool ret = readNode(fd, contents);
+    close(fd);
+    return ret;
+}
+
+Status parseRole(const std::string& roleName, uint32_t* currentRole) {
+    if (roleName == "dfp")
+        *currentRole = static_cast<uint32_t>(PortMode::DFP);
+    else if (roleName == "ufp")
+        *currentRole = static_cast<uint32_t>(PortMode::UFP);
+    else if (roleName == "source")
+        *currentRole = static_cast<uint32_t>(PortPowerRole::SOURCE);
+    else if (roleName == "sink")
+        *currentRole = static_cast<uint32_t>(PortPowerRole::SINK);
+    else if (roleName == "host")
+        *currentRole = static_cast<uint32_t>(PortDataRole::HOST);
+    else if (roleName == "device")
+        *currentRole = static_cast<uint32_t>(PortDataRole::DEVICE);
+    else if (roleName == "none")
+        *currentRole = 0;
+    else
+        return Status::UNRECOGNIZED_ROLE;
+    return Status::SUCCESS;
+}
+
+Status readRole(int fd, uint32_t* currentRole) {
+    std::string roleName;
+    if (!readNode(fd, &roleName)) {
+        ALOGE("getCurrentRole: Failed to read filesystem node");
+        return Status::ERROR;
+    }
+    return parseRole(roleName, currentRole);
+}
+
+}  // namespace
+
+PortStatusCache::PortStatusCache(const std::string& classPath) : mClassPath(classPath) {}
+
+PortStatusCache::~PortStatusCache() {
+    for (auto& [name, port] : mPorts) {
+        closePort(&port);
+    }
+}
+
+std::string PortStatusCache::getRoleNode(const std::string& portName, PortRoleType type) const {
+    std::string node(mClassPath + "/" + portName);
+
+    switch (type) {
+        case PortRoleType::DATA_ROLE:
+            return node + "/data_role";
+        case PortRoleType::POWER_ROLE:
+            return node + "/power_role";
+        default:
+            return node + "/mode";
+    }
+}
+
+Status PortStatusCache::getPortStatus(hidl_vec<PortStatus>* portStatus) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mValid) {
+        rescanLocked();
+    }
+
+    Status result = mScanStatus;
+    portStatus->resize(mPorts.size());
+    size_t i = 0;
+    for (const auto& [name, port] : mPorts) {
+        (*portStatus)[i++] = port.portStatus;
+        if (port.status != Status::SUCCESS) {
+            result = Status::ERROR;
+        }
+    }
+    return result;
+}
+
+bool PortStatusCache::handleUevent(const char* msg, size_t length) {
+    const char* end = msg + length;
+    bool matched = false;
+    std::string action;
+    std::string devpath;
+
+    for (const char* cp = msg; cp < end && *cp; cp += strlen(cp) + 1) {
+        if (!strcmp(cp, kSubsystem)) {
+            matched = true;
+        } else if (!strncmp(cp, "ACTION=", 7)) {
+            action = cp + 7;
+        } else if (!strncmp(cp, "DEVPATH=", 8)) {
+            devpath = cp + 8;
+        }
+    }
+
+    if (!matched) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    std::string portName = devpath.substr(devpath.find_last_of('/') + 1);
+    auto it = mPorts.find(portName);
+    if (!mValid || action != "change" || it == mPorts.end()) {
+        rescanLocked();
+    } else {
+        readRolesLocked(&it->second);
+    }
+    return true;
+}
+
+bool PortStatusCache::handleUeventRecv(const char* msg, int length, size_t bufferSize) {
+    if (length <= 0 || static_cast<size_t>(length) >= bufferSize) {
+        ALOGE("Lost uevents, rescanning on the next query");
+        invalidate();
+        return false;
+    }
+    return handleUevent(msg, length);
+}
+
+void PortStatusCache::invalidate() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mValid = false;
+}
+
+Status PortStatusCache::rescanLocked() {
+    DIR* dp = opendir(mClassPath.c_str());
+    if (dp == NULL) {
+        ALOGE("Failed to open %s", mClassPath.c_str());
+        for (auto& [name, port] : mPorts) {
+            closePort(&port);
+        }
+        mPorts.clear();
+        mValid = false;
+        mScanStatus = Status::ERROR;
+        return mScanStatus;
+    }
+
+    std::set<std::string> names;
+    while (struct dirent* ep = readdir(dp)) {
+        if (ep->d_type == DT_LNK) {
+            names.insert(ep->d_name);
+        }
+    }
+    closedir(dp);
+
+    for (auto it = mPorts.begin(); it != mPorts.end();) {
+        if (names.count(it->first) == 0) {
+            closePort(&it->second);
+            it = mPorts.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (const auto& name : names) {
+        auto it = mPorts.find(name);
+        if (it == mPorts.end()) {
+            Port port;
+            openPortLocked(name, &port);
+            it = mPorts.emplace(name, std::move(port)).first;
+        }
+        readRolesLocked(&it->second);
+    }
+
+    mValid = true;
+    mScanStatus = Status::SUCCESS;
+    return mScanStatus;
+}
+
+void PortStatusCache::openPortLocked(const std::string& portName, Port* port) {
+    ALOGI("%s", portName.c_str());
+    port->portStatus.portName = portName;
+    port->powerRoleFd = open(getRoleNode(portName, PortRoleType::POWER_ROLE).c_str(),
+                             O_RDONLY | O_CLOEXEC);
+    port->dataRoleFd =
+            open(getRoleNode(portName, PortRoleType::DATA_ROLE).c_str(), O_RDONLY | O_CLOEXEC);
+    port->modeFd = open(getRoleNode(portName, PortRoleType::MODE).c_str(), O_RDONLY | O_CLOEXEC);
+
+    port->portStatus.canChangeMode =
+            access(getRoleNode(portName, PortRoleType::MODE).c_str(), W_OK) == 0;
+    port->portStatus.canChangeDataRole =
+            access(getRoleNode(portName, PortRoleType::DATA_ROLE).c_str(), W_OK) == 0;
+    port->portStatus.canChangePowerRole =
+            access(getRoleNode(portName, PortRoleType::POWER_ROLE).c_str(), W_OK) == 0;
+
+    ALOGI("canChangeMode: %d canChagedata: %d canChangePower:%d", port->portStatus.canChangeMode,
+          port->portStatus.canChangeDataRole, port->portStatus.canChangePowerRole);
+
+    std::string modes;
+    if (!readFirstLine(mClassPath + "/" + portName + "/supported_modes", &modes)) {
+        ALOGE("getSupportedRoles: Failed to open filesystem node");
+        return;
+    }
+
+    if (modes == "ufp dfp")
+        port->portStatus.supportedModes = PortMode::DRP;
+    else if (modes == "ufp")
+        port->portStatus.supportedModes = PortMode::UFP;
+    else if (modes == "dfp")
+        port->portStatus.supportedModes = PortMode::DFP;
+}
+
+void PortStatusCache::closePort(Port* port) {
+    for (int* fd : {&port->powerRoleFd, &port->dataRoleFd, &port->modeFd}) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void PortStatusCache::readRolesLocked(Port* port) {
+    PortStatus& portStatus = port->portStatus;
+    uint32_t currentRole;
+
+    port->status = Status::ERROR;
+
+    portStatus.currentPowerRole = PortPowerRole::NONE;
+    if (readRole(port->powerRoleFd, &currentRole) != Status::SUCCESS) {
+        ALOGE("Error while retreiving portNames");
+        return;
+    }
+    portStatus.currentPowerRole = static_cast<PortPowerRole>(currentRole);
+
+    portStatus.currentDataRole = PortDataRole::NONE;
+    if (readRole(port->dataRoleFd, &currentRole) != Status::SUCCESS) {
+        ALOGE("Error while retreiving current port role");
+        return;
+    }
+    portStatus.currentDataRole = static_cast<PortDataRole>(currentRole);
+
+    portStatus.currentMode = PortMode::NONE;
+    if (readRole(port->modeFd, &currentRole) != Status::SUCCESS) {
+        ALOGE("Error while retreiving current data role");
+        return;
+    }
+    portStatus.currentMode = static_cast<PortMode>(currentRole);
+
+    if (portStatus.supportedModes == PortMode::NONE) {
+        ALOGE("Error while retrieving port modes");
+        return;
+    }
+
+    port->status = Status::SUCCESS;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace usb
+}  // namespace hardware
+}  // namespace android
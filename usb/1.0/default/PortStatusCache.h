@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_USB_V1_0_PORTSTATUSCACHE_H
+#define ANDROID_HARDWARE_USB_V1_0_PORTSTATUSCACHE_H
+
+#include <android/hardware/usb/1.0/types.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace android {
+namespace hardware {
+namespace usb {
+namespace V1_0 {
+namespace implementation {
+
+// Status of the ports under a dual_role_usb sysfs class directory.
+//
+// The role nodes of each port are opened once and reread with pread, since sysfs regenerates an
+// attribute on every read from offset 0. Attributes that do not change while a port exists
+// (supported_modes and whether a role node is writable) are read only when the port appears.
+class PortStatusCache {
+  public:
+    explicit PortStatusCache(const std::string& classPath);
+    ~PortStatusCache();
+
+    // Returns the status of every port, scanning sysfs first if the cache is not valid.
+    Status getPortStatus(hidl_vec<PortStatus>* portStatus);
+
+    // Applies one uevent (NUL separated KEY=value strings). A change of a known port rereads
+    // only that port; added or removed ports trigger a rescan of the class directory.
+    // Returns false if the uevent does not belong to the dual_role_usb subsystem.
+    bool handleUevent(const char* msg, size_t length);
+
+    // Applies the result of uevent_kernel_multicast_recv() into a buffer of bufferSize bytes.
+    // A failed receive (e.g. ENOBUFS once the socket buffer overflowed) or a uevent that did not
+    // fit means uevents were lost, so the next query rescans.
+    bool handleUeventRecv(const char* msg, int length, size_t bufferSize);
+
+    // Forces a rescan on the next query, e.g. after uevents may have been missed.
+    void invalidate();
+
+    std::string getRoleNode(const std::string& portName, PortRoleType type) const;
+
+  private:
+    struct Port {
+        int powerRoleFd = -1;
+        int dataRoleFd = -1;
+        int modeFd = -1;
+        Status status = Status::ERROR;
+        PortStatus portStatus;
+    };
+
+    Status rescanLocked();
+    void openPortLocked(const std::string& portName, Port* port);
+    void closePort(Port* port);
+    void readRolesLocked(Port* port);
+
+    const std::string mClassPath;
+
+    std::mutex mLock;
+    bool mValid = false;
+    Status mScanStatus = Status::ERROR;
+    std::map<std::string, Port> mPorts;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace usb
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_USB_V1_0_PORTSTATUSCACHE_H
@@ -49,19 +49,6 @@ int32_t readFile(std::string filename, std::string& contents) {
     return -1;
 }
 
-std::string appendRoleNodeHelper(const std::string portName, PortRoleType type) {
-    std::string node("/sys/class/dual_role_usb/" + portName);
-
-    switch(type) {
-        case PortRoleType::DATA_ROLE:
-            return node + "/data_role";
-        case PortRoleType::POWER_ROLE:
-            return node + "/power_role";
-        default:
-            return node + "/mode";
-    }
-}
-
 std::string convertRoletoString(PortRole role) {
     if (role.type == PortRoleType::POWER_ROLE) {
         if (role.role == static_cast<uint32_t> (PortPowerRole::SOURCE))
@@ -84,7 +71,7 @@ std::string convertRoletoString(PortRole role) {
 
 Return<void> Usb::switchRole(const hidl_string& portName,
         const PortRole& newRole) {
-    std::string filename = appendRoleNodeHelper(std::string(portName.c_str()),
+    std::string filename = mPortCache.getRoleNode(std::string(portName.c_str()),
         newRole.type);
     std::ofstream file(filename);
     std::string written;
@@ -115,195 +102,11 @@ Return<void> Usb::switchRole(const hidl_string& portName,
     return Void();
 }
 
-Status getCurrentRoleHelper(std::string portName,
-        PortRoleType type, uint32_t &currentRole)  {
-    std::string filename;
-    std::string roleName;
-
-    if (type == PortRoleType::POWER_ROLE) {
-        filename = "/sys/class/dual_role_usb/" +
-            portName + "/power_role";
-        currentRole = static_cast<uint32_t>(PortPowerRole::NONE);
-    } else if (type == PortRoleType::DATA_ROLE) {
-        filename = "/sys/class/dual_role_usb/" +
-            portName + "/data_role";
-        currentRole = static_cast<uint32_t> (PortDataRole::NONE);
-    } else if (type == PortRoleType::MODE) {
-        filename = "/sys/class/dual_role_usb/" +
-            portName + "/mode";
-        currentRole = static_cast<uint32_t> (PortMode::NONE);
-    }
-
-    if (readFile(filename, roleName)) {
-        ALOGE("getCurrentRole: Failed to open filesystem node");
-        return Status::ERROR;
-    }
-
-    if (roleName == "dfp")
-        currentRole = static_cast<uint32_t> (PortMode::DFP);
-    else if (roleName == "ufp")
-        currentRole = static_cast<uint32_t> (PortMode::UFP);
-    else if (roleName == "source")
-        currentRole = static_cast<uint32_t> (PortPowerRole::SOURCE);
-    else if (roleName == "sink")
-        currentRole = static_cast<uint32_t> (PortPowerRole::SINK);
-    else if (roleName == "host")
-        currentRole = static_cast<uint32_t> (PortDataRole::HOST);
-    else if (roleName == "device")
-        currentRole = static_cast<uint32_t> (PortDataRole::DEVICE);
-    else if (roleName != "none") {
-         /* case for none has already been addressed.
-          * so we check if the role isnt none.
-          */
-        return Status::UNRECOGNIZED_ROLE;
-    }
-    return Status::SUCCESS;
-}
-
-Status getTypeCPortNamesHelper(std::vector<std::string>& names) {
-    DIR *dp;
-
-    dp = opendir("/sys/class/dual_role_usb");
-    if (dp != NULL)
-    {
-rescan:
-        int32_t ports = 0;
-        int32_t current = 0;
-        struct dirent *ep;
-
-        while ((ep = readdir (dp))) {
-            if (ep->d_type == DT_LNK) {
-                ports++;
-            }
-        }
-
-        if (ports == 0) {
-            closedir(dp);
-            return Status::SUCCESS;
-        }
-
-        names.resize(ports);
-        rewinddir(dp);
-
-        while ((ep = readdir (dp))) {
-            if (ep->d_type == DT_LNK) {
-                /* Check to see if new ports were added since the first pass. */
-                if (current >= ports) {
-                    rewinddir(dp);
-                    goto rescan;
-                }
-                names[current++] = ep->d_name;
-            }
-        }
-
-        closedir (dp);
-        return Status::SUCCESS;
-    }
-
-    ALOGE("Failed to open /sys/class/dual_role_usb");
-    return Status::ERROR;
-}
-
-bool canSwitchRoleHelper(const std::string portName, PortRoleType type)  {
-    std::string filename = appendRoleNodeHelper(portName, type);
-    std::ofstream file(filename);
-
-    if (file.is_open()) {
-        file.close();
-        return true;
-    }
-    return false;
-}
-
-Status getPortModeHelper(const std::string portName, PortMode& portMode)  {
-    std::string filename = "/sys/class/dual_role_usb/" +
-    std::string(portName.c_str()) + "/supported_modes";
-    std::string modes;
-
-    if (readFile(filename, modes)) {
-        ALOGE("getSupportedRoles: Failed to open filesystem node");
-        return Status::ERROR;
-    }
-
-    if (modes == "ufp dfp")
-        portMode = PortMode::DRP;
-    else  if (modes == "ufp")
-        portMode = PortMode::UFP;
-    else if  (modes == "dfp")
-        portMode = PortMode::DFP;
-    else
-        return Status::UNRECOGNIZED_ROLE;
-
-        return Status::SUCCESS;
-}
-
-Status getPortStatusHelper (hidl_vec<PortStatus>& currentPortStatus) {
-    std::vector<std::string> names;
-    Status result = getTypeCPortNamesHelper(names);
-
-    if (result == Status::SUCCESS) {
-        currentPortStatus.resize(names.size());
-        for(std::vector<std::string>::size_type i = 0; i < names.size(); i++) {
-            ALOGI("%s", names[i].c_str());
-            currentPortStatus[i].portName = names[i];
-
-            uint32_t currentRole;
-            if (getCurrentRoleHelper(names[i], PortRoleType::POWER_ROLE,
-                    currentRole) == Status::SUCCESS) {
-                currentPortStatus[i].currentPowerRole =
-                static_cast<PortPowerRole> (currentRole);
-            } else {
-                ALOGE("Error while retreiving portNames");
-                goto done;
-            }
-
-            if (getCurrentRoleHelper(names[i],
-                    PortRoleType::DATA_ROLE, currentRole) == Status::SUCCESS) {
-                currentPortStatus[i].currentDataRole =
-                        static_cast<PortDataRole> (currentRole);
-            } else {
-                ALOGE("Error while retreiving current port role");
-                goto done;
-            }
-
-            if (getCurrentRoleHelper(names[i], PortRoleType::MODE,
-                    currentRole) == Status::SUCCESS) {
-                currentPortStatus[i].currentMode =
-                    static_cast<PortMode> (currentRole);
-            } else {
-                ALOGE("Error while retreiving current data role");
-                goto done;
-            }
-
-            currentPortStatus[i].canChangeMode =
-                canSwitchRoleHelper(names[i], PortRoleType::MODE);
-            currentPortStatus[i].canChangeDataRole =
-                canSwitchRoleHelper(names[i], PortRoleType::DATA_ROLE);
-            currentPortStatus[i].canChangePowerRole =
-                canSwitchRoleHelper(names[i], PortRoleType::POWER_ROLE);
-
-            ALOGI("canChangeMode: %d canChagedata: %d canChangePower:%d",
-                currentPortStatus[i].canChangeMode,
-                currentPortStatus[i].canChangeDataRole,
-                currentPortStatus[i].canChangePowerRole);
-
-            if (getPortModeHelper(names[i], currentPortStatus[i].supportedModes)
-                  != Status::SUCCESS) {
-                ALOGE("Error while retrieving port modes");
-                goto done;
-            }
-        }
-        return Status::SUCCESS;
-    }
-done:
-    return Status::ERROR;
-}
-
 Return<void> Usb::queryPortStatus() {
     hidl_vec<PortStatus> currentPortStatus;
     Status status;
 
-    status = getPortStatusHelper(currentPortStatus);
+    status = mPortCache.getPortStatus(&currentPortStatus);
     Return<void> ret = mCallback->notifyPortStatusChange(currentPortStatus,
        status);
     if (!ret.isOk())
@@ -322,30 +125,24 @@ static void uevent_event(uint32_t /*epevents*/, struct data *payload) {
     int n;
 
     n = uevent_kernel_multicast_recv(payload->uevent_fd, msg, UEVENT_MSG_LEN);
-    if (n <= 0)
-        return;
-    if (n >= UEVENT_MSG_LEN)   /* overflow -- discard */
-        return;
-
-    msg[n] = '\0';
-    msg[n + 1] = '\0';
+    if (n > 0 && n < UEVENT_MSG_LEN) {
+        msg[n] = '\0';
+        msg[n + 1] = '\0';
+    }
     cp = msg;
 
-    while (*cp) {
-        if (!strcmp(cp, "SUBSYSTEM=dual_role_usb")) {
-            ALOGE("uevent received %s", cp);
-            if (payload->usb->mCallback != NULL) {
-                hidl_vec<PortStatus> currentPortStatus;
-                Status status = getPortStatusHelper(currentPortStatus);
-                Return<void> ret =
-                    payload->usb->mCallback->notifyPortStatusChange(currentPortStatus, status);
-                if (!ret.isOk())
-                    ALOGE("error %s", ret.description().c_str());
-            }
-            break;
+    /* Rereads only the port named by the uevent, or rescans on add/remove.
+     * A lost or overflowing uevent invalidates the whole cache. */
+    if (payload->usb->mPortCache.handleUeventRecv(cp, n, UEVENT_MSG_LEN)) {
+        ALOGE("uevent received %s", cp);
+        if (payload->usb->mCallback != NULL) {
+            hidl_vec<PortStatus> currentPortStatus;
+            Status status = payload->usb->mPortCache.getPortStatus(&currentPortStatus);
+            Return<void> ret =
+                payload->usb->mCallback->notifyPortStatusChange(currentPortStatus, status);
+            if (!ret.isOk())
+                ALOGE("error %s", ret.description().c_str());
         }
-        /* advance to after the next \0 */
-        while (*cp++);
     }
 }
 
@@ -445,6 +242,8 @@ Return<void> Usb::setCallback(const sp<IUsbCallback>& callback) {
 
     destroyThread = false;
     signal(SIGUSR1, sighandler);
+    // Uevents were not watched while there was no callback.
+    mPortCache.invalidate();
 
     if (pthread_create(&mPoll, NULL, work, this)) {
         ALOGE("pthread creation failed %d", errno);
@@ -458,7 +257,7 @@ Return<void> Usb::setCallback(const sp<IUsbCallback>& callback) {
 pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
 Usb *usb;
 
-Usb::Usb() {
+Usb::Usb() : mPortCache("/sys/class/dual_role_usb") {
     pthread_mutex_lock(&lock);
     // Make this a singleton class
     assert(usb == NULL);
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "PortStatusCache.h"
+
+using android::base::TemporaryDir;
+using android::base::WriteStringToFile;
+using android::hardware::hidl_vec;
+using android::hardware::usb::V1_0::PortDataRole;
+using android::hardware::usb::V1_0::PortMode;
+using android::hardware::usb::V1_0::PortPowerRole;
+using android::hardware::usb::V1_0::PortStatus;
+using android::hardware::usb::V1_0::Status;
+using android::hardware::usb::V1_0::implementation::PortStatusCache;
+
+// Mirrors /sys/class/dual_role_usb: port directories live under devices/ and the class directory
+// holds symlinks to them.
+class PortStatusCacheTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mClassPath = std::string(mRoot.path) + "/class";
+        ASSERT_EQ(0, mkdir(mClassPath.c_str(), 0755));
+        ASSERT_EQ(0, mkdir((std::string(mRoot.path) + "/devices").c_str(), 0755));
+        mCache = std::make_unique<PortStatusCache>(mClassPath);
+    }
+
+    void addPort(const std::string& name, const std::string& powerRole,
+                 const std::string& dataRole, const std::string& mode) {
+        std::string dir = std::string(mRoot.path) + "/devices/" + name;
+        ASSERT_EQ(0, mkdir(dir.c_str(), 0755));
+        setNode(name, "supported_modes", "ufp dfp");
+        setNode(name, "power_role", powerRole);
+        setNode(name, "data_role", dataRole);
+        setNode(name, "mode", mode);
+        ASSERT_EQ(0, symlink(dir.c_str(), (mClassPath + "/" + name).c_str()));
+    }
+
+    void removePort(const std::string& name) {
+        ASSERT_EQ(0, unlink((mClassPath + "/" + name).c_str()));
+    }
+
+    // Rewrites the node in place, so that already open fds see the new value like in sysfs.
+    void setNode(const std::string& name, const std::string& node, const std::string& value) {
+        ASSERT_TRUE(WriteStringToFile(value + "\n",
+                                      std::string(mRoot.path) + "/devices/" + name + "/" + node));
+    }
+
+    bool sendUevent(const std::string& action, const std::string& name,
+                    const std::string& subsystem = "dual_role_usb") {
+        std::string msg = action + "@/devices/soc/usb/dual_role_usb/" + name;
+        msg.push_back('\0');
+        for (const std::string& line :
+             {"ACTION=" + action, "DEVPATH=/devices/soc/usb/dual_role_usb/" + name,
+              "SUBSYSTEM=" + subsystem}) {
+            msg += line;
+            msg.push_back('\0');
+        }
+        return mCache->handleUevent(msg.data(), msg.size());
+    }
+
+    hidl_vec<PortStatus> getPortStatus(Status expected = Status::SUCCESS) {
+        hidl_vec<PortStatus> portStatus;
+        EXPECT_EQ(expected, mCache->getPortStatus(&portStatus));
+        return portStatus;
+    }
+
+    TemporaryDir mRoot;
+    std::string mClassPath;
+    std::unique_ptr<PortStatusCache> mCache;
+};
+
+TEST_F(PortStatusCacheTest, ScansAllPorts) {
+    addPort("port0", "source", "host", "dfp");
+    addPort("port1", "sink", "device", "ufp");
+
+    auto portStatus = getPortStatus();
+    ASSERT_EQ(2u, portStatus.size());
+    EXPECT_EQ("port0", portStatus[0].portName);
+    EXPECT_EQ(PortPowerRole::SOURCE, portStatus[0].currentPowerRole);
+    EXPECT_EQ(PortDataRole::HOST, portStatus[0].currentDataRole);
+    EXPECT_EQ(PortMode::DFP, portStatus[0].currentMode);
+    EXPECT_EQ(PortMode::DRP, portStatus[0].supportedModes);
+    EXPECT_TRUE(portStatus[0].canChangeDataRole);
+    EXPECT_EQ("port1", portStatus[1].portName);
+    EXPECT_EQ(PortPowerRole::SINK, portStatus[1].currentPowerRole);
+    EXPECT_EQ(PortDataRole::DEVICE, portStatus[1].currentDataRole);
+    EXPECT_EQ(PortMode::UFP, portStatus[1].currentMode);
+}
+
+TEST_F(PortStatusCacheTest, ServesQueriesFromCache) {
+    addPort("port0", "source", "host", "dfp");
+    getPortStatus();
+
+    setNode("port0", "power_role", "sink");
+    EXPECT_EQ(PortPowerRole::SOURCE, getPortStatus()[0].currentPowerRole);
+}
+
+TEST_F(PortStatusCacheTest, ChangeUeventRereadsOnlyThatPort) {
+    addPort("port0", "source", "host", "dfp");
+    addPort("port1", "source", "host", "dfp");
+    getPortStatus();
+
+    setNode("port0", "power_role", "sink");
+    setNode("port1", "power_role", "sink");
+    EXPECT_TRUE(sendUevent("change", "port1"));
+
+    auto portStatus = getPortStatus();
+    ASSERT_EQ(2u, portStatus.size());
+    EXPECT_EQ(PortPowerRole::SOURCE, portStatus[0].currentPowerRole);
+    EXPECT_EQ(PortPowerRole::SINK, portStatus[1].currentPowerRole);
+}
+
+TEST_F(PortStatusCacheTest, AddAndRemoveUeventsRescan) {
+    addPort("port0", "source", "host", "dfp");
+    ASSERT_EQ(1u, getPortStatus().size());
+
+    addPort("port1", "sink", "device", "ufp");
+    EXPECT_TRUE(sendUevent("add", "port1"));
+    auto portStatus = getPortStatus();
+    ASSERT_EQ(2u, portStatus.size());
+    EXPECT_EQ(PortMode::UFP, portStatus[1].currentMode);
+
+    removePort("port0");
+    EXPECT_TRUE(sendUevent("remove", "port0"));
+    portStatus = getPortStatus();
+    ASSERT_EQ(1u, portStatus.size());
+    EXPECT_EQ("port1", portStatus[0].portName);
+}
+
+TEST_F(PortStatusCacheTest, IgnoresOtherSubsystems) {
+    addPort("port0", "source", "host", "dfp");
+    getPortStatus();
+
+    setNode("port0", "power_role", "sink");
+    EXPECT_FALSE(sendUevent("change", "port0", "power_supply"));
+    EXPECT_EQ(PortPowerRole::SOURCE, getPortStatus()[0].currentPowerRole);
+}
+
+TEST_F(PortStatusCacheTest, InvalidateForcesRescan) {
+    addPort("port0", "source", "host", "dfp");
+    getPortStatus();
+
+    setNode("port0", "power_role", "sink");
+    mCache->invalidate();
+    EXPECT_EQ(PortPowerRole::SINK, getPortStatus()[0].currentPowerRole);
+}
+
+TEST_F(PortStatusCacheTest, LostUeventForcesRescan) {
+    addPort("port0", "source", "host", "dfp");
+    getPortStatus();
+
+    // The uevent for this change is dropped: the receive fails with ENOBUFS.
+    setNode("port0", "power_role", "sink");
+    EXPECT_FALSE(mCache->handleUeventRecv(nullptr, -1, 1024));
+    EXPECT_EQ(PortPowerRole::SINK, getPortStatus()[0].currentPowerRole);
+
+    // The uevent does not fit the buffer.
+    setNode("port0", "data_role", "device");
+    std::string msg(1024, 'x');
+    EXPECT_FALSE(mCache->handleUeventRecv(msg.data(), msg.size(), msg.size()));
+    EXPECT_EQ(PortDataRole::DEVICE, getPortStatus()[0].currentDataRole);
+}
+
+TEST_F(PortStatusCacheTest, ReportsUnrecognizedRole) {
+    addPort("port0", "source", "host", "dfp");
+    setNode("port0", "data_role", "bogus");
+
+    auto portStatus = getPortStatus(Status::ERROR);
+    ASSERT_EQ(1u, portStatus.size());
+    EXPECT_EQ(PortDataRole::NONE, portStatus[0].currentDataRole);
+}
+
+TEST_F(PortStatusCacheTest, MissingClassDirectoryIsAnError) {
+    std::unique_ptr<PortStatusCache> cache =
+            std::make_unique<PortStatusCache>(mClassPath + "/missing");
+    hidl_vec<PortStatus> portStatus;
+    EXPECT_EQ(Status::ERROR, cache->getPortStatus(&portStatus));
+    EXPECT_EQ(0u, portStatus.size());
+}
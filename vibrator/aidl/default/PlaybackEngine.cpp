@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vibrator-impl/PlaybackEngine.h"
+
+#include <android-base/logging.h>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+PlaybackEngine& PlaybackEngine::getInstance() {
+    // Intentionally leaked: callbacks may still be in flight while the process exits.
+    static PlaybackEngine* engine = new PlaybackEngine();
+    return *engine;
+}
+
+PlaybackEngine::PlaybackEngine() : mThread(&PlaybackEngine::run, this) {}
+
+PlaybackEngine::~PlaybackEngine() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExiting = true;
+    }
+    mCond.notify_all();
+    mThread.join();
+}
+
+void PlaybackEngine::play(const void* owner, Steps steps, std::chrono::milliseconds duration,
+                          std::function<void()> onComplete) {
+    auto playback = std::make_shared<Playback>();
+    playback->steps = std::move(steps);
+    playback->duration = duration;
+    playback->onComplete = std::move(onComplete);
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mSyncOwners.count(owner) != 0) {
+            retireLocked(&mStaged, owner);
+            mStaged[owner] = std::move(playback);
+        } else {
+            startLocked(owner, std::move(playback), Clock::now());
+        }
+    }
+    mCond.notify_all();
+}
+
+void PlaybackEngine::cancel(const void* owner) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        retireLocked(&mActive, owner);
+        retireLocked(&mStaged, owner);
+    }
+    mCond.notify_all();
+}
+
+void PlaybackEngine::prepareSynced(const std::vector<const void*>& owners) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        while (!mStaged.empty()) {
+            retireLocked(&mStaged, mStaged.begin()->first);
+        }
+        mSyncOwners = std::set<const void*>(owners.begin(), owners.end());
+    }
+    mCond.notify_all();
+}
+
+void PlaybackEngine::triggerSynced(std::function<void()> onComplete) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        const auto start = Clock::now();
+        std::chrono::milliseconds longest{0};
+        for (auto& [owner, playback] : mStaged) {
+            longest = std::max(longest, playback->duration);
+            startLocked(owner, std::move(playback), start);
+        }
+        mStaged.clear();
+        mSyncOwners.clear();
+
+        auto sync = std::make_shared<Playback>();
+        sync->duration = longest;
+        sync->onComplete = std::move(onComplete);
+        startLocked(this, std::move(sync), start);
+    }
+    mCond.notify_all();
+}
+
+void PlaybackEngine::cancelSynced() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        while (!mStaged.empty()) {
+            retireLocked(&mStaged, mStaged.begin()->first);
+        }
+        mSyncOwners.clear();
+    }
+    mCond.notify_all();
+}
+
+void PlaybackEngine::startLocked(const void* owner, std::shared_ptr<Playback> playback,
+                                 Clock::time_point start) {
+    retireLocked(&mActive, owner);
+    playback->start = start;
+    pushLocked(owner, playback, 0);
+    mActive[owner] = std::move(playback);
+}
+
+void PlaybackEngine::retireLocked(std::map<const void*, std::shared_ptr<Playback>>* playbacks,
+                                  const void* owner) {
+    auto it = playbacks->find(owner);
+    if (it == playbacks->end()) {
+        return;
+    }
+    // Events still queued for this playback no longer match mActive and are dropped lazily.
+    if (it->second->onComplete) {
+        mPending.push_back(std::move(it->second->onComplete));
+    }
+    playbacks->erase(it);
+}
+
+void PlaybackEngine::pushLocked(const void* owner, const std::shared_ptr<Playback>& playback,
+                                size_t step) {
+    auto offset =
+            step < playback->stepCount() ? (*playback->steps)[step].offset : playback->duration;
+    mEvents.push({playback->start + offset, mSequence++, owner, playback, step});
+}
+
+void PlaybackEngine::run() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (!mExiting) {
+        if (!mPending.empty()) {
+            auto pending = std::move(mPending);
+            mPending.clear();
+            lock.unlock();
+            for (auto& onComplete : pending) {
+                onComplete();
+            }
+            lock.lock();
+            continue;
+        }
+
+        if (mEvents.empty()) {
+            mCond.wait(lock);
+            continue;
+        }
+
+        const auto deadline = mEvents.top().deadline;
+        if (Clock::now() < deadline) {
+            mCond.wait_until(lock, deadline);
+            continue;
+        }
+
+        Event event = mEvents.top();
+        mEvents.pop();
+
+        auto it = mActive.find(event.owner);
+        if (it == mActive.end() || it->second != event.playback) {
+            continue;
+        }
+
+        std::function<void()> action;
+        if (event.step < event.playback->stepCount()) {
+            action = (*event.playback->steps)[event.step].action;
+            pushLocked(event.owner, event.playback, event.step + 1);
+        } else {
+            action = std::move(event.playback->onComplete);
+            mActive.erase(it);
+        }
+
+        lock.unlock();
+        if (action) {
+            action();
+        }
+        lock.lock();
+    }
+}
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
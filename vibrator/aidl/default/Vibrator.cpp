@@ -17,7 +17,8 @@
 #include "vibrator-impl/Vibrator.h"
 
 #include <android-base/logging.h>
-#include <thread>
+
+#include <array>
 
 namespace aidl {
 namespace android {
@@ -27,6 +28,7 @@ namespace vibrator {
 static constexpr int32_t kComposeDelayMaxMs = 1000;
 static constexpr int32_t kComposeSizeMax = 256;
 static constexpr int32_t kComposePwleSizeMax = 127;
+static constexpr size_t kCompositionCacheMax = 64;
 
 static constexpr float kResonantFrequency = 150.0;
 static constexpr float kQFactor = 11.0;
@@ -37,6 +39,64 @@ static constexpr float PWLE_FREQUENCY_RESOLUTION_HZ = 1.0;
 static constexpr float PWLE_FREQUENCY_MIN_HZ = 140.0;
 static constexpr float PWLE_FREQUENCY_MAX_HZ = 160.0;
 
+static constexpr std::array<CompositePrimitive, 9> kSupportedPrimitives = {
+        CompositePrimitive::NOOP,       CompositePrimitive::CLICK,
+        CompositePrimitive::THUD,       CompositePrimitive::SPIN,
+        CompositePrimitive::QUICK_RISE, CompositePrimitive::SLOW_RISE,
+        CompositePrimitive::QUICK_FALL, CompositePrimitive::LIGHT_TICK,
+        CompositePrimitive::LOW_TICK,
+};
+
+static bool isSupportedPrimitive(CompositePrimitive primitive) {
+    static const uint64_t supportedMask = [] {
+        uint64_t mask = 0;
+        for (auto p : kSupportedPrimitives) {
+            mask |= 1ull << static_cast<uint32_t>(p);
+        }
+        return mask;
+    }();
+    auto index = static_cast<uint32_t>(primitive);
+    return index < 64 && ((supportedMask >> index) & 1) != 0;
+}
+
+// Appends the raw bytes of value, so equal compositions map to equal cache keys.
+template <typename T>
+static void appendKey(std::string* key, const T& value) {
+    key->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static std::function<void()> notifyComplete(const std::shared_ptr<IVibratorCallback>& callback,
+                                            const char* what) {
+    if (callback == nullptr) {
+        return nullptr;
+    }
+    return [=] {
+        LOG(INFO) << "Notifying " << what << " complete";
+        if (!callback->onComplete().isOk()) {
+            LOG(ERROR) << "Failed to call onComplete";
+        }
+    };
+}
+
+const void* Vibrator::getPlaybackOwner() const {
+    // Same key as the IVibrator pointer held by VibratorManager, so it can sync this vibrator.
+    return static_cast<const IVibrator*>(this);
+}
+
+std::shared_ptr<const Vibrator::Composition> Vibrator::findComposition(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mCompositionLock);
+    auto it = mCompositions.find(key);
+    return it != mCompositions.end() ? it->second : nullptr;
+}
+
+void Vibrator::cacheComposition(std::string key, std::shared_ptr<const Composition> composition) {
+    std::lock_guard<std::mutex> lock(mCompositionLock);
+    if (mCompositions.size() >= kCompositionCacheMax) {
+        mCompositions.clear();
+    }
+    mCompositions.emplace(std::move(key), std::move(composition));
+}
+
 ndk::ScopedAStatus Vibrator::getCapabilities(int32_t* _aidl_return) {
     LOG(INFO) << "Vibrator reporting capabilities";
     *_aidl_return = IVibrator::CAP_ON_CALLBACK | IVibrator::CAP_PERFORM_CALLBACK |
@@ -50,22 +110,16 @@ ndk::ScopedAStatus Vibrator::getCapabilities(int32_t* _aidl_return) {
 
 ndk::ScopedAStatus Vibrator::off() {
     LOG(INFO) << "Vibrator off";
+    PlaybackEngine::getInstance().cancel(getPlaybackOwner());
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Vibrator::on(int32_t timeoutMs,
                                 const std::shared_ptr<IVibratorCallback>& callback) {
     LOG(INFO) << "Vibrator on for timeoutMs: " << timeoutMs;
-    if (callback != nullptr) {
-        std::thread([=] {
-            LOG(INFO) << "Starting on on another thread";
-            usleep(timeoutMs * 1000);
-            LOG(INFO) << "Notifying on complete";
-            if (!callback->onComplete().isOk()) {
-                LOG(ERROR) << "Failed to call onComplete";
-            }
-        }).detach();
-    }
+    PlaybackEngine::getInstance().play(getPlaybackOwner(), nullptr,
+                                       std::chrono::milliseconds(timeoutMs),
+                                       notifyComplete(callback, "on"));
     return ndk::ScopedAStatus::ok();
 }
 
@@ -84,14 +138,9 @@ ndk::ScopedAStatus Vibrator::perform(Effect effect, EffectStrength strength,
 
     constexpr size_t kEffectMillis = 100;
 
-    if (callback != nullptr) {
-        std::thread([=] {
-            LOG(INFO) << "Starting perform on another thread";
-            usleep(kEffectMillis * 1000);
-            LOG(INFO) << "Notifying perform complete";
-            callback->onComplete();
-        }).detach();
-    }
+    PlaybackEngine::getInstance().play(getPlaybackOwner(), nullptr,
+                                       std::chrono::milliseconds(kEffectMillis),
+                                       notifyComplete(callback, "perform"));
 
     *_aidl_return = kEffectMillis;
     return ndk::ScopedAStatus::ok();
@@ -126,21 +175,13 @@ ndk::ScopedAStatus Vibrator::getCompositionSizeMax(int32_t* maxSize) {
 }
 
 ndk::ScopedAStatus Vibrator::getSupportedPrimitives(std::vector<CompositePrimitive>* supported) {
-    *supported = {
-            CompositePrimitive::NOOP,       CompositePrimitive::CLICK,
-            CompositePrimitive::THUD,       CompositePrimitive::SPIN,
-            CompositePrimitive::QUICK_RISE, CompositePrimitive::SLOW_RISE,
-            CompositePrimitive::QUICK_FALL, CompositePrimitive::LIGHT_TICK,
-            CompositePrimitive::LOW_TICK,
-    };
+    *supported = {kSupportedPrimitives.begin(), kSupportedPrimitives.end()};
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Vibrator::getPrimitiveDuration(CompositePrimitive primitive,
                                                   int32_t* durationMs) {
-    std::vector<CompositePrimitive> supported;
-    getSupportedPrimitives(&supported);
-    if (std::find(supported.begin(), supported.end(), primitive) == supported.end()) {
+    if (!isSupportedPrimitive(primitive)) {
         return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
     }
     if (primitive != CompositePrimitive::NOOP) {
@@ -157,41 +198,50 @@ ndk::ScopedAStatus Vibrator::compose(const std::vector<CompositeEffect>& composi
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
     }
 
-    std::vector<CompositePrimitive> supported;
-    getSupportedPrimitives(&supported);
-
+    std::string key(1, 'C');
+    key.reserve(1 + composite.size() * sizeof(CompositeEffect));
     for (auto& e : composite) {
-        if (e.delayMs > kComposeDelayMaxMs) {
-            return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
-        }
-        if (e.scale < 0.0f || e.scale > 1.0f) {
-            return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
-        }
-        if (std::find(supported.begin(), supported.end(), e.primitive) == supported.end()) {
-            return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
-        }
+        appendKey(&key, e.delayMs);
+        appendKey(&key, e.primitive);
+        appendKey(&key, e.scale);
     }
 
-    std::thread([=] {
-        LOG(INFO) << "Starting compose on another thread";
-
+    auto composition = findComposition(key);
+    if (composition == nullptr) {
         for (auto& e : composite) {
-            if (e.delayMs) {
-                usleep(e.delayMs * 1000);
+            if (e.delayMs > kComposeDelayMaxMs) {
+                return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+            }
+            if (e.scale < 0.0f || e.scale > 1.0f) {
+                return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
             }
-            LOG(INFO) << "triggering primitive " << static_cast<int>(e.primitive) << " @ scale "
-                      << e.scale;
+            if (!isSupportedPrimitive(e.primitive)) {
+                return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+            }
+        }
+
+        auto steps = std::make_shared<std::vector<PlaybackEngine::Step>>();
+        std::chrono::milliseconds offset{0};
+        steps->reserve(composite.size());
+
+        for (auto& e : composite) {
+            offset += std::chrono::milliseconds(e.delayMs);
+            steps->push_back({offset, [primitive = e.primitive, scale = e.scale] {
+                                  LOG(INFO) << "triggering primitive "
+                                            << static_cast<int>(primitive) << " @ scale " << scale;
+                              }});
 
             int32_t durationMs;
             getPrimitiveDuration(e.primitive, &durationMs);
-            usleep(durationMs * 1000);
+            offset += std::chrono::milliseconds(durationMs);
         }
 
-        if (callback != nullptr) {
-            LOG(INFO) << "Notifying perform complete";
-            callback->onComplete();
-        }
-    }).detach();
+        composition = std::make_shared<Composition>(Composition{std::move(steps), offset});
+        cacheComposition(std::move(key), composition);
+    }
+
+    PlaybackEngine::getInstance().play(getPlaybackOwner(), composition->steps,
+                                       composition->duration, notifyComplete(callback, "compose"));
 
     return ndk::ScopedAStatus::ok();
 }
@@ -303,15 +353,44 @@ void constructBrakingSegment(std::ostringstream &pwleBuilder, const int &segment
 
 ndk::ScopedAStatus Vibrator::composePwle(const std::vector<PrimitivePwle> &composite,
                                          const std::shared_ptr<IVibratorCallback> &callback) {
-    std::ostringstream pwleBuilder;
-    std::string pwleQueue;
-
     int compositionSizeMax;
     getPwleCompositionSizeMax(&compositionSizeMax);
     if (composite.size() <= 0 || composite.size() > compositionSizeMax) {
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
     }
 
+    std::string key(1, 'P');
+    key.reserve(1 + composite.size() * sizeof(PrimitivePwle));
+    for (auto &e : composite) {
+        appendKey(&key, e.getTag());
+        switch (e.getTag()) {
+            case PrimitivePwle::active: {
+                auto &active = e.get<PrimitivePwle::active>();
+                appendKey(&key, active.startAmplitude);
+                appendKey(&key, active.startFrequency);
+                appendKey(&key, active.endAmplitude);
+                appendKey(&key, active.endFrequency);
+                appendKey(&key, active.duration);
+                break;
+            }
+            case PrimitivePwle::braking: {
+                auto &braking = e.get<PrimitivePwle::braking>();
+                appendKey(&key, braking.braking);
+                appendKey(&key, braking.duration);
+                break;
+            }
+        }
+    }
+
+    auto composition = findComposition(key);
+    if (composition != nullptr) {
+        PlaybackEngine::getInstance().play(getPlaybackOwner(), nullptr, composition->duration,
+                                           notifyComplete(callback, "compose PWLE"));
+        return ndk::ScopedAStatus::ok();
+    }
+
+    std::ostringstream pwleBuilder;
+
     float prevEndAmplitude;
     float prevEndFrequency;
     resetPreviousEndAmplitudeEndFrequency(prevEndAmplitude, prevEndFrequency);
@@ -379,14 +458,12 @@ ndk::ScopedAStatus Vibrator::composePwle(const std::vector<PrimitivePwle> &compo
         }
     }
 
-    std::thread([=] {
-        LOG(INFO) << "Starting composePwle on another thread";
-        usleep(totalDuration * 1000);
-        if (callback != nullptr) {
-            LOG(INFO) << "Notifying compose PWLE complete";
-            callback->onComplete();
-        }
-    }).detach();
+    composition = std::make_shared<Composition>(
+            Composition{nullptr, std::chrono::milliseconds(totalDuration)});
+    cacheComposition(std::move(key), composition);
+
+    PlaybackEngine::getInstance().play(getPlaybackOwner(), nullptr, composition->duration,
+                                       notifyComplete(callback, "compose PWLE"));
 
     return ndk::ScopedAStatus::ok();
 }
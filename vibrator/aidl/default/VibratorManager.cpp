@@ -15,9 +15,9 @@
  */
 
 #include "vibrator-impl/VibratorManager.h"
+#include "vibrator-impl/PlaybackEngine.h"
 
 #include <android-base/logging.h>
-#include <thread>
 
 namespace aidl {
 namespace android {
@@ -57,6 +57,7 @@ ndk::ScopedAStatus VibratorManager::getVibrator(int32_t vibratorId,
 ndk::ScopedAStatus VibratorManager::prepareSynced(const std::vector<int32_t>& vibratorIds) {
     LOG(INFO) << "Vibrator Manager prepare synced";
     if (vibratorIds.size() == 1 && vibratorIds[0] == kDefaultVibratorId) {
+        PlaybackEngine::getInstance().prepareSynced({mDefaultVibrator.get()});
         return ndk::ScopedAStatus::ok();
     } else {
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
@@ -66,18 +67,19 @@ ndk::ScopedAStatus VibratorManager::prepareSynced(const std::vector<int32_t>& vi
 ndk::ScopedAStatus VibratorManager::triggerSynced(
         const std::shared_ptr<IVibratorCallback>& callback) {
     LOG(INFO) << "Vibrator Manager trigger synced";
-    std::thread([=] {
+    PlaybackEngine::getInstance().triggerSynced([=] {
         if (callback != nullptr) {
-            LOG(INFO) << "Notifying perform complete";
+            LOG(INFO) << "Notifying trigger synced complete";
             callback->onComplete();
         }
-    }).detach();
+    });
 
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus VibratorManager::cancelSynced() {
     LOG(INFO) << "Vibrator Manager cancel synced";
+    PlaybackEngine::getInstance().cancelSynced();
     return ndk::ScopedAStatus::ok();
 }
 
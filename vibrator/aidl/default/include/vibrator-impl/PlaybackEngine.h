@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace vibrator {
+
+// Single thread that plays back every effect of the process against one clock.
+//
+// Each owner (a vibrator) has at most one active playback. Starting a new one preempts the
+// previous playback, and cancel() stops it. The completion of a playback runs exactly once on
+// the engine thread: after its duration elapses, or right away when it is preempted or
+// cancelled.
+class PlaybackEngine {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Step {
+        std::chrono::milliseconds offset;
+        std::function<void()> action;
+    };
+    using Steps = std::shared_ptr<const std::vector<Step>>;
+
+    static PlaybackEngine& getInstance();
+
+    PlaybackEngine();
+    ~PlaybackEngine();
+
+    // Plays steps relative to now (or to the synced start, if owner is prepared for sync).
+    void play(const void* owner, Steps steps, std::chrono::milliseconds duration,
+              std::function<void()> onComplete);
+    void cancel(const void* owner);
+
+    // Playbacks of the given owners are held back until triggerSynced() starts them all at the
+    // same time point. onComplete runs once the longest of them has finished.
+    void prepareSynced(const std::vector<const void*>& owners);
+    void triggerSynced(std::function<void()> onComplete);
+    void cancelSynced();
+
+  private:
+    struct Playback {
+        size_t stepCount() const { return steps ? steps->size() : 0; }
+
+        Clock::time_point start;
+        Steps steps;
+        std::chrono::milliseconds duration;
+        std::function<void()> onComplete;
+    };
+
+    struct Event {
+        Clock::time_point deadline;
+        uint64_t sequence;
+        const void* owner;
+        std::shared_ptr<Playback> playback;
+        size_t step;  // == stepCount() for the completion
+    };
+
+    struct LaterFirst {
+        bool operator()(const Event& a, const Event& b) const {
+            return a.deadline != b.deadline ? a.deadline > b.deadline : a.sequence > b.sequence;
+        }
+    };
+
+    void startLocked(const void* owner, std::shared_ptr<Playback> playback,
+                     Clock::time_point start);
+    void retireLocked(std::map<const void*, std::shared_ptr<Playback>>* playbacks,
+                      const void* owner);
+    void pushLocked(const void* owner, const std::shared_ptr<Playback>& playback, size_t step);
+    void run();
+
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::priority_queue<Event, std::vector<Event>, LaterFirst> mEvents;
+    std::map<const void*, std::shared_ptr<Playback>> mActive;
+    std::map<const void*, std::shared_ptr<Playback>> mStaged;
+    std::set<const void*> mSyncOwners;
+    std::vector<std::function<void()>> mPending;
+    uint64_t mSequence = 0;
+    bool mExiting = false;
+    std::thread mThread;
+};
+
+}  // namespace vibrator
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
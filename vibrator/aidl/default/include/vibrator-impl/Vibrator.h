@@ -18,6 +18,12 @@
 
 #include <aidl/android/hardware/vibrator/BnVibrator.h>
 
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "vibrator-impl/PlaybackEngine.h"
+
 namespace aidl {
 namespace android {
 namespace hardware {
@@ -55,6 +61,19 @@ class Vibrator : public BnVibrator {
     ndk::ScopedAStatus composePwle(const std::vector<PrimitivePwle> &composite,
                                    const std::shared_ptr<IVibratorCallback> &callback) override;
 
+  private:
+    // A validated composition, flattened into the timeline handed to the PlaybackEngine.
+    struct Composition {
+        PlaybackEngine::Steps steps;
+        std::chrono::milliseconds duration;
+    };
+
+    const void* getPlaybackOwner() const;
+    std::shared_ptr<const Composition> findComposition(const std::string& key);
+    void cacheComposition(std::string key, std::shared_ptr<const Composition> composition);
+
+    std::mutex mCompositionLock;
+    std::unordered_map<std::string, std::shared_ptr<const Composition>> mCompositions;
 };
 
 }  // namespace vibrator
@@ -21,6 +21,9 @@
 #include <android/hardware/vibrator/IVibrator.h>
 #include <binder/IServiceManager.h>
 
+#include <fstream>
+#include <string>
+
 using ::android::enum_range;
 using ::android::sp;
 using ::android::hardware::hidl_enum_range;
@@ -284,6 +287,22 @@ class VibratorBench_Aidl : public BaseBench<Aidl::IVibrator> {
     }
 };
 
+// Number of threads in the process serving the HAL, or -1 if it cannot be determined.
+static long getServiceThreadCount(const sp<Aidl::IVibrator>& vibrator) {
+    pid_t pid = 0;
+    if (android::IInterface::asBinder(vibrator)->getDebugPid(&pid) != android::OK) {
+        return -1;
+    }
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("Threads:", 0) == 0) {
+            return std::stol(line.substr(sizeof("Threads:") - 1));
+        }
+    }
+    return -1;
+}
+
 class HalCallback : public Aidl::BnVibratorCallback {
   public:
     HalCallback() = default;
@@ -307,6 +326,28 @@ BENCHMARK_WRAPPER(VibratorBench_Aidl, on, {
     }
 });
 
+BENCHMARK_WRAPPER(VibratorBench_Aidl, onBurst, {
+    int32_t capabilities = 0;
+    mVibrator->getCapabilities(&capabilities);
+
+    int32_t ms = 10;
+    auto cb = (capabilities & Aidl::IVibrator::CAP_ON_CALLBACK) ? new HalCallback() : nullptr;
+    long threadsBefore = getServiceThreadCount(mVibrator);
+    long threadsMax = threadsBefore;
+
+    // Each call preempts the previous one, as rapid keyboard feedback does.
+    for (auto _ : state) {
+        mVibrator->on(ms, cb);
+        state.PauseTiming();
+        threadsMax = std::max(threadsMax, getServiceThreadCount(mVibrator));
+        state.ResumeTiming();
+    }
+
+    mVibrator->off();
+    state.counters["threads"] = Counter(threadsMax);
+    state.counters["threadsAdded"] = Counter(threadsMax - threadsBefore);
+});
+
 BENCHMARK_WRAPPER(VibratorBench_Aidl, off, {
     for (auto _ : state) {
         state.PauseTiming();
@@ -492,6 +533,37 @@ BENCHMARK_WRAPPER(VibratorEffectsBench_Aidl, perform, {
     }
 });
 
+BENCHMARK_WRAPPER(VibratorEffectsBench_Aidl, performBurst, {
+    int32_t capabilities = 0;
+    mVibrator->getCapabilities(&capabilities);
+
+    auto effect = getEffect(state);
+    auto strength = getStrength(state);
+    auto cb = (capabilities & Aidl::IVibrator::CAP_PERFORM_CALLBACK) ? new HalCallback() : nullptr;
+    int32_t lengthMs = 0;
+
+    std::vector<Aidl::Effect> supported;
+    mVibrator->getSupportedEffects(&supported);
+    if (std::find(supported.begin(), supported.end(), effect) == supported.end()) {
+        return;
+    }
+
+    long threadsBefore = getServiceThreadCount(mVibrator);
+    long threadsMax = threadsBefore;
+
+    // Back-to-back effects without off(), as when typing on the keyboard.
+    for (auto _ : state) {
+        mVibrator->perform(effect, strength, cb, &lengthMs);
+        state.PauseTiming();
+        threadsMax = std::max(threadsMax, getServiceThreadCount(mVibrator));
+        state.ResumeTiming();
+    }
+
+    mVibrator->off();
+    state.counters["threads"] = Counter(threadsMax);
+    state.counters["threadsAdded"] = Counter(threadsMax - threadsBefore);
+});
+
 class VibratorPrimitivesBench_Aidl : public VibratorBench_Aidl {
   public:
     static void DefaultArgs(Benchmark* b) {
@@ -574,4 +646,73 @@ BENCHMARK_WRAPPER(VibratorPrimitivesBench_Aidl, compose, {
     }
 });
 
+class VibratorComposeBench_Aidl : public VibratorBench_Aidl {
+  public:
+    static void DefaultArgs(Benchmark* b) {
+        b->ArgNames({"Size", "Cached"});
+        for (const auto& size : {1, 16, 256}) {
+            for (const auto& cached : {0, 1}) {
+                b->Args({size, cached});
+            }
+        }
+    }
+
+  protected:
+    auto getSize(const State& state) const { return this->getOtherArg(state, 0); }
+
+    auto isCached(const State& state) const { return this->getOtherArg(state, 1) != 0; }
+};
+
+BENCHMARK_WRAPPER(VibratorComposeBench_Aidl, compose, {
+    int32_t capabilities = 0;
+    mVibrator->getCapabilities(&capabilities);
+    if ((capabilities & Aidl::IVibrator::CAP_COMPOSE_EFFECTS) == 0) {
+        return;
+    }
+
+    int32_t sizeMax = 0;
+    int32_t delayMax = 0;
+    mVibrator->getCompositionSizeMax(&sizeMax);
+    mVibrator->getCompositionDelayMax(&delayMax);
+    if (getSize(state) > sizeMax || delayMax <= 0) {
+        return;
+    }
+
+    std::vector<Aidl::CompositePrimitive> supported;
+    mVibrator->getSupportedPrimitives(&supported);
+    if (supported.empty()) {
+        return;
+    }
+
+    std::vector<Aidl::CompositeEffect> effects(getSize(state));
+    for (size_t i = 0; i < effects.size(); i++) {
+        effects[i].primitive = supported[i % supported.size()];
+        effects[i].scale = 1.0f;
+        effects[i].delayMs = 0;
+    }
+
+    bool cached = isCached(state);
+    int32_t delayMs = 0;
+    auto cb = new HalCallback();
+
+    if (cached) {
+        mVibrator->compose(effects, cb);
+        mVibrator->off();
+    }
+
+    for (auto _ : state) {
+        if (!cached) {
+            // A composition the HAL has not seen recently, so it is validated again.
+            state.PauseTiming();
+            delayMs = (delayMs + 1) % delayMax;
+            effects[0].delayMs = delayMs;
+            state.ResumeTiming();
+        }
+        mVibrator->compose(effects, cb);
+        state.PauseTiming();
+        mVibrator->off();
+        state.ResumeTiming();
+    }
+});
+
 BENCHMARK_MAIN();
@@ -17,7 +17,9 @@
 #ifndef HIDL_CALLBACK_UTIL_H_
 #define HIDL_CALLBACK_UTIL_H_
 
+#include <memory>
 #include <set>
+#include <vector>
 
 #include <hidl/HidlSupport.h>
 
@@ -55,6 +57,10 @@ namespace wifi {
 namespace V1_5 {
 namespace implementation {
 namespace hidl_callback_util {
+// Immutable list of the callbacks registered at some point in time.
+template <typename CallbackType>
+using CallbackSnapshot = std::shared_ptr<const std::vector<sp<CallbackType>>>;
+
 template <typename CallbackType>
 // Provides a class to manage callbacks for the various HIDL interfaces and
 // handle the death of the process hosting each callback.
@@ -63,7 +69,9 @@ class HidlCallbackHandler {
     HidlCallbackHandler()
         : death_handler_(new HidlDeathHandler<CallbackType>(
               std::bind(&HidlCallbackHandler::onObjectDeath, this,
-                        std::placeholders::_1))) {}
+                        std::placeholders::_1))),
+          cb_snapshot_(
+              std::make_shared<const std::vector<sp<CallbackType>>>()) {}
     ~HidlCallbackHandler() = default;
 
     bool addCallback(const sp<CallbackType>& cb) {
@@ -80,6 +88,7 @@ class HidlCallbackHandler {
             return false;
         }
         cb_set_.insert(cb);
+        publishSnapshot();
         return true;
     }
 
@@ -87,6 +96,14 @@ class HidlCallbackHandler {
         return cb_set_;
     }
 
+    // Returns the registered callbacks without copying them. The snapshot is
+    // only replaced when a callback is added or removed, so it stays valid
+    // (and unchanged) for as long as the caller holds on to it, even if a
+    // callback dies meanwhile.
+    CallbackSnapshot<CallbackType> getCallbackSnapshot() const {
+        return std::atomic_load(&cb_snapshot_);
+    }
+
     // Death notification for callbacks.
     void onObjectDeath(uint64_t cookie) {
         CallbackType* cb = reinterpret_cast<CallbackType*>(cookie);
@@ -96,6 +113,7 @@ class HidlCallbackHandler {
             return;
         }
         cb_set_.erase(iter);
+        publishSnapshot();
         LOG(DEBUG) << "Dead callback removed from list";
     }
 
@@ -106,11 +124,23 @@ class HidlCallbackHandler {
             }
         }
         cb_set_.clear();
+        publishSnapshot();
     }
 
    private:
+    void publishSnapshot() {
+        std::atomic_store(
+            &cb_snapshot_,
+            CallbackSnapshot<CallbackType>(
+                std::make_shared<const std::vector<sp<CallbackType>>>(
+                    cb_set_.begin(), cb_set_.end())));
+    }
+
     std::set<sp<CallbackType>> cb_set_;
     sp<HidlDeathHandler<CallbackType>> death_handler_;
+    // Copy of |cb_set_| for the event paths. Read and replaced atomically,
+    // since callbacks die on binder threads.
+    CallbackSnapshot<CallbackType> cb_snapshot_;
 
     DISALLOW_COPY_AND_ASSIGN(HidlCallbackHandler);
 };
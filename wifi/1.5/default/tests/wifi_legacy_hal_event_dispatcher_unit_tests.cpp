@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/logging.h>
+#include <android-base/macros.h>
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+
+#undef NAN  // This is weird, NAN is defined in bionic/libc/include/math.h:38
+#include "hidl_sync_util.h"
+#include "mock_interface_tool.h"
+#include "wifi_legacy_hal.h"
+#include "wifi_legacy_hal_event_dispatcher.h"
+#include "wifi_legacy_hal_stubs.h"
+
+using testing::NiceMock;
+using testing::Test;
+
+namespace {
+constexpr auto kWaitTimeout = std::chrono::seconds(10);
+}  // namespace
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_5 {
+namespace implementation {
+namespace legacy_hal {
+
+class EventDispatcherTest : public Test {
+   protected:
+    // Blocks the dispatcher thread in a callback until unblock() is called,
+    // so that the events posted meanwhile stay queued.
+    void block() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        blocked_ = true;
+        dispatcher_.post(EventDispatcher::Source::ERROR_ALERT, [this] {
+            std::unique_lock<std::mutex> lock(mutex_);
+            blocking_ = true;
+            cv_.notify_all();
+            cv_.wait(lock, [this] { return !blocked_; });
+            blocking_ = false;
+        });
+        cv_.wait(lock, [this] { return blocking_; });
+    }
+
+    void unblock() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            blocked_ = false;
+        }
+        cv_.notify_all();
+    }
+
+    void record(int value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        values_.push_back(value);
+        cv_.notify_all();
+    }
+
+    // Waits until the dispatcher thread ran every event posted so far.
+    std::vector<int> waitForValues() {
+        dispatcher_.post(EventDispatcher::Source::ERROR_ALERT,
+                         [this] { record(-1); });
+        std::unique_lock<std::mutex> lock(mutex_);
+        EXPECT_TRUE(cv_.wait_for(lock, kWaitTimeout, [this] {
+            return !values_.empty() && values_.back() == -1;
+        }));
+        values_.pop_back();
+        return values_;
+    }
+
+    const size_t kMaxQueuedEvents = 4;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool blocked_ = false;
+    bool blocking_ = false;
+    std::vector<int> values_;
+    EventDispatcher dispatcher_{kMaxQueuedEvents};
+};
+
+TEST_F(EventDispatcherTest, RunsEventsInOrder) {
+    for (int i = 0; i < 10; i++) {
+        dispatcher_.post(EventDispatcher::Source::GSCAN,
+                         [this, i] { record(i); });
+    }
+    EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}),
+              waitForValues());
+}
+
+TEST_F(EventDispatcherTest, LatestEventReplacesQueuedEventWithSameKey) {
+    block();
+    dispatcher_.postLatest(EventDispatcher::Source::RSSI_MONITOR, "a",
+                           [this] { record(1); });
+    dispatcher_.postLatest(EventDispatcher::Source::RSSI_MONITOR, "b",
+                           [this] { record(2); });
+    dispatcher_.postLatest(EventDispatcher::Source::RSSI_MONITOR, "a",
+                           [this] { record(3); });
+    unblock();
+    EXPECT_EQ(std::vector<int>({3, 2}), waitForValues());
+}
+
+TEST_F(EventDispatcherTest, AppendedDataIsDeliveredInOneChunk) {
+    const uint8_t data[] = {1, 2, 3};
+    std::vector<uint8_t> delivered;
+    auto callback = [this, &delivered](const std::vector<uint8_t>& chunk) {
+        delivered = chunk;
+        record(chunk.size());
+    };
+    block();
+    dispatcher_.postAppend(EventDispatcher::Source::RING_BUFFER, "ring", data,
+                           1, callback, 1024);
+    dispatcher_.postAppend(EventDispatcher::Source::RING_BUFFER, "ring",
+                           data + 1, 2, callback, 1024);
+    unblock();
+    EXPECT_EQ(std::vector<int>({3}), waitForValues());
+    EXPECT_EQ(std::vector<uint8_t>({1, 2, 3}), delivered);
+}
+
+TEST_F(EventDispatcherTest, AppendedDataIsSplitAtMaxSize) {
+    const uint8_t data[] = {1, 2, 3};
+    auto callback = [this](const std::vector<uint8_t>& chunk) {
+        record(chunk.size());
+    };
+    block();
+    for (int i = 0; i < 3; i++) {
+        dispatcher_.postAppend(EventDispatcher::Source::RING_BUFFER, "ring",
+                               data, sizeof(data), callback, 6);
+    }
+    unblock();
+    EXPECT_EQ(std::vector<int>({6, 3}), waitForValues());
+}
+
+TEST_F(EventDispatcherTest, DroppableEventsAreDroppedWhenFull) {
+    block();
+    // The blocking event has already been dequeued.
+    for (size_t i = 0; i < kMaxQueuedEvents + 2; i++) {
+        dispatcher_.postLatest(EventDispatcher::Source::GSCAN,
+                               std::to_string(i), [this, i] { record(i); });
+    }
+    // Events that must not be lost still get queued.
+    dispatcher_.post(EventDispatcher::Source::GSCAN, [this] { record(10); });
+    EXPECT_EQ(2u, dispatcher_.getNumDroppedEvents());
+    unblock();
+    EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 10}), waitForValues());
+}
+
+TEST_F(EventDispatcherTest, DiscardDropsQueuedEventsOfSource) {
+    block();
+    dispatcher_.post(EventDispatcher::Source::GSCAN, [this] { record(1); });
+    dispatcher_.post(EventDispatcher::Source::ERROR_ALERT,
+                     [this] { record(2); });
+    dispatcher_.postLatest(EventDispatcher::Source::GSCAN, "a",
+                           [this] { record(3); });
+    // The global lock is held by the blocked dispatcher thread.
+    dispatcher_.discard(EventDispatcher::Source::GSCAN);
+    dispatcher_.postLatest(EventDispatcher::Source::GSCAN, "a",
+                           [this] { record(4); });
+    unblock();
+    EXPECT_EQ(std::vector<int>({2, 4}), waitForValues());
+}
+
+// A legacy HAL which fires ring buffer data and full scan results from its
+// event loop thread as fast as it can.
+namespace stub_hal {
+constexpr int kNumEvents = 2000;
+constexpr int kRingBufferDataSize = 512;
+constexpr int kNumBssids = 32;
+
+char handle_storage;
+char iface_storage;
+wifi_handle handle = reinterpret_cast<wifi_handle>(&handle_storage);
+wifi_interface_handle iface =
+    reinterpret_cast<wifi_interface_handle>(&iface_storage);
+
+std::mutex mutex;
+std::condition_variable cv;
+bool fire = false;
+bool cleanup = false;
+std::chrono::steady_clock::duration fire_duration;
+bool fired = false;
+wifi_cleaned_up_handler cleaned_up_handler = nullptr;
+wifi_ring_buffer_data_handler ring_buffer_handler = {};
+wifi_scan_result_handler scan_result_handler = {};
+
+void fireEvents() {
+    std::vector<char> data(kRingBufferDataSize, 'x');
+    char ring_name[] = "stub_ring";
+    wifi_ring_buffer_status status = {};
+    wifi_scan_result result = {};
+    for (int i = 0; i < kNumEvents; i++) {
+        status.written_bytes += data.size();
+        ring_buffer_handler.on_ring_buffer_data(ring_name, data.data(),
+                                                data.size(), &status);
+        result.bssid[5] = i % kNumBssids;
+        result.rssi = -i;
+        scan_result_handler.on_full_scan_result(1, &result, 1);
+    }
+}
+
+void eventLoop(wifi_handle /* handle */) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [] { return fire || cleanup; });
+    if (fire) {
+        lock.unlock();
+        const auto start = std::chrono::steady_clock::now();
+        fireEvents();
+        const auto duration = std::chrono::steady_clock::now() - start;
+        lock.lock();
+        fire_duration = duration;
+        fired = true;
+        cv.notify_all();
+    }
+    cv.wait(lock, [] { return cleanup; });
+    cleaned_up_handler(handle);
+}
+
+void initFuncTable(wifi_hal_fn* fn) {
+    initHalFuncTableWithStubs(fn);
+    fn->wifi_wait_for_driver_ready = [] { return WIFI_SUCCESS; };
+    fn->wifi_initialize = [](wifi_handle* out) {
+        *out = handle;
+        return WIFI_SUCCESS;
+    };
+    fn->wifi_event_loop = eventLoop;
+    fn->wifi_cleanup = [](wifi_handle, wifi_cleaned_up_handler handler) {
+        std::lock_guard<std::mutex> lock(mutex);
+        cleaned_up_handler = handler;
+        cleanup = true;
+        cv.notify_all();
+    };
+    fn->wifi_get_ifaces = [](wifi_handle, int* num,
+                             wifi_interface_handle** ifaces) {
+        *num = 1;
+        *ifaces = &iface;
+        return WIFI_SUCCESS;
+    };
+    fn->wifi_get_iface_name = [](wifi_interface_handle, char* name,
+                                 size_t size) {
+        strlcpy(name, "wlan0", size);
+        return WIFI_SUCCESS;
+    };
+    fn->wifi_set_log_handler = [](wifi_request_id, wifi_interface_handle,
+                                  wifi_ring_buffer_data_handler handler) {
+        ring_buffer_handler = handler;
+        return WIFI_SUCCESS;
+    };
+    fn->wifi_start_gscan = [](wifi_request_id, wifi_interface_handle,
+                              wifi_scan_cmd_params,
+                              wifi_scan_result_handler handler) {
+        scan_result_handler = handler;
+        return WIFI_SUCCESS;
+    };
+}
+}  // namespace stub_hal
+
+TEST(WifiLegacyHalEventDispatchTest, SlowCallbacksDoNotBlockEventLoop) {
+    constexpr auto kCallbackDelay = std::chrono::microseconds(200);
+    wifi_hal_fn fn;
+    stub_hal::initFuncTable(&fn);
+    auto iface_tool =
+        std::make_shared<NiceMock<wifi_system::MockInterfaceTool>>();
+    WifiLegacyHal hal(iface_tool, fn, false /* is_primary */);
+    ASSERT_EQ(WIFI_SUCCESS, hal.start());
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t ring_buffer_bytes = 0;
+    int full_results = 0;
+    {
+        const auto lock = hidl_sync_util::acquireGlobalLock();
+        ASSERT_EQ(WIFI_SUCCESS,
+                  hal.registerRingBufferCallbackHandler(
+                      "wlan0", [&](const std::string&,
+                                   const std::vector<uint8_t>& data,
+                                   const wifi_ring_buffer_status&) {
+                          std::this_thread::sleep_for(kCallbackDelay);
+                          std::lock_guard<std::mutex> lock(mutex);
+                          ring_buffer_bytes += data.size();
+                          cv.notify_all();
+                      }));
+        ASSERT_EQ(WIFI_SUCCESS,
+                  hal.startGscan(
+                      "wlan0", 1, {}, [](wifi_request_id) {},
+                      [](wifi_request_id,
+                         const std::vector<wifi_cached_scan_results>&) {},
+                      [&](wifi_request_id, const wifi_scan_result*,
+                          uint32_t) {
+                          std::this_thread::sleep_for(kCallbackDelay);
+                          std::lock_guard<std::mutex> lock(mutex);
+                          full_results++;
+                          cv.notify_all();
+                      }));
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(stub_hal::mutex);
+        stub_hal::fire = true;
+        stub_hal::cv.notify_all();
+        ASSERT_TRUE(stub_hal::cv.wait_for(lock, kWaitTimeout,
+                                          [] { return stub_hal::fired; }));
+    }
+    // Had the callbacks run inline, firing would have taken at least
+    // 2 * kNumEvents * kCallbackDelay.
+    EXPECT_LT(stub_hal::fire_duration, stub_hal::kNumEvents * kCallbackDelay);
+
+    {
+        // All the ring buffer data comes through, possibly coalesced.
+        std::unique_lock<std::mutex> lock(mutex);
+        EXPECT_TRUE(cv.wait_for(lock, kWaitTimeout, [&] {
+            return ring_buffer_bytes == static_cast<size_t>(
+                                            stub_hal::kNumEvents *
+                                            stub_hal::kRingBufferDataSize);
+        }));
+        EXPECT_GE(full_results, stub_hal::kNumBssids);
+        EXPECT_LE(full_results, stub_hal::kNumEvents);
+    }
+
+    auto lock = hidl_sync_util::acquireGlobalLock();
+    EXPECT_EQ(WIFI_SUCCESS, hal.stop(&lock, [] {}));
+}
+
+}  // namespace legacy_hal
+}  // namespace implementation
+}  // namespace V1_5
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Feeds NAN indications to the legacy HAL callbacks registered by a
+ * WifiNanIface, with a number of in-process HIDL callbacks registered, the
+ * way a burst of discovery results reaches the framework.
+ */
+
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <gmock/gmock.h>
+
+#undef NAN  // This is weird, NAN is defined in bionic/libc/include/math.h:38
+#include "wifi_nan_iface.h"
+
+#include "mock_interface_tool.h"
+#include "mock_wifi_iface_util.h"
+#include "mock_wifi_legacy_hal.h"
+
+using testing::_;
+using testing::DoAll;
+using testing::NiceMock;
+using testing::SaveArg;
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_5 {
+namespace implementation {
+namespace {
+constexpr char kIfaceName[] = "mockWlan0";
+
+// Drops every indication.
+class NullNanIfaceEventCallback : public IWifiNanIfaceEventCallback {
+   public:
+    using V1_0Capabilities = V1_0::NanCapabilities;
+    using V1_0ConfirmInd = V1_0::NanDataPathConfirmInd;
+    using V1_2ConfirmInd = V1_2::NanDataPathConfirmInd;
+
+    Return<void> notifyCapabilitiesResponse(
+        uint16_t, const WifiNanStatus&, const V1_0Capabilities&) override {
+        return Void();
+    }
+    Return<void> notifyEnableResponse(uint16_t, const WifiNanStatus&) override {
+        return Void();
+    }
+    Return<void> notifyConfigResponse(uint16_t, const WifiNanStatus&) override {
+        return Void();
+    }
+    Return<void> notifyDisableResponse(uint16_t,
+                                       const WifiNanStatus&) override {
+        return Void();
+    }
+    Return<void> notifyStartPublishResponse(uint16_t, const WifiNanStatus&,
+                                            uint8_t) override {
+        return Void();
+    }
+    Return<void> notifyStopPublishResponse(uint16_t,
+                                           const WifiNanStatus&) override {
+        return Void();
+    }
+    Return<void> notifyStartSubscribeResponse(uint16_t, const WifiNanStatus&,
+                                              uint8_t) override {
+        return Void();
+    }
+    Return<void> notifyStopSubscribeResponse(uint16_t,
+                                             const WifiNanStatus&) override {
+        return Void();
+    }
+    Return<void> notifyTransmitFollowupResponse(
+        uint16_t, const WifiNanStatus&) override {
+        return Void();
+    }
+    Return<void> notifyCreateDataInterfaceResponse(
+        uint16_t, const WifiNanStatus&) override {
+        return Void();
+    }
+    Return<void> notifyDeleteDataInterfaceResponse(
+        uint16_t, const WifiNanStatus&) override {
+        return Void();
+    }
+    Return<void> notifyInitiateDataPathResponse(uint16_t, const WifiNanStatus&,
+                                                uint32_t) override {
+        return Void();
+    }
+    Return<void> notifyRespondToDataPathIndicationResponse(
+        uint16_t, const WifiNanStatus&) override {
+        return Void();
+    }
+    Return<void> notifyTerminateDataPathResponse(
+        uint16_t, const WifiNanStatus&) override {
+        return Void();
+    }
+    Return<void> eventClusterEvent(const NanClusterEventInd&) override {
+        return Void();
+    }
+    Return<void> eventDisabled(const WifiNanStatus&) override { return Void(); }
+    Return<void> eventPublishTerminated(uint8_t,
+                                        const WifiNanStatus&) override {
+        return Void();
+    }
+    Return<void> eventSubscribeTerminated(uint8_t,
+                                          const WifiNanStatus&) override {
+        return Void();
+    }
+    Return<void> eventMatch(const NanMatchInd&) override { return Void(); }
+    Return<void> eventMatchExpired(uint8_t, uint32_t) override {
+        return Void();
+    }
+    Return<void> eventFollowupReceived(const NanFollowupReceivedInd&) override {
+        return Void();
+    }
+    Return<void> eventTransmitFollowup(uint16_t,
+                                       const WifiNanStatus&) override {
+        return Void();
+    }
+    Return<void> eventDataPathRequest(const NanDataPathRequestInd&) override {
+        return Void();
+    }
+    Return<void> eventDataPathConfirm(const V1_0ConfirmInd&) override {
+        return Void();
+    }
+    Return<void> eventDataPathTerminated(uint32_t) override { return Void(); }
+    Return<void> eventDataPathConfirm_1_2(const V1_2ConfirmInd&) override {
+        return Void();
+    }
+    Return<void> eventDataPathScheduleUpdate(
+        const NanDataPathScheduleUpdateInd&) override {
+        return Void();
+    }
+    Return<void> notifyCapabilitiesResponse_1_5(
+        uint16_t, const WifiNanStatus&, const NanCapabilities&) override {
+        return Void();
+    }
+};
+
+// A NAN iface with |num_callbacks| registered 1.5 callbacks.
+class NanIfaceFixture {
+   public:
+    explicit NanIfaceFixture(int num_callbacks) {
+        ON_CALL(*legacy_hal_, nanRegisterCallbackHandlers(_, _))
+            .WillByDefault(DoAll(SaveArg<1>(&callback_handlers_),
+                                 testing::Return(legacy_hal::WIFI_SUCCESS)));
+        nan_iface_ =
+            new WifiNanIface(kIfaceName, false, legacy_hal_, iface_util_);
+        for (int i = 0; i < num_callbacks; i++) {
+            sp<NullNanIfaceEventCallback> callback =
+                new NullNanIfaceEventCallback();
+            nan_iface_->registerEventCallback_1_5(
+                callback, [](const WifiStatus& status) {
+                    CHECK(status.code == WifiStatusCode::SUCCESS);
+                });
+            callbacks_.push_back(callback);
+        }
+    }
+
+    const legacy_hal::NanCallbackHandlers& handlers() const {
+        return callback_handlers_;
+    }
+
+   private:
+    legacy_hal::wifi_hal_fn fake_func_table_;
+    std::shared_ptr<NiceMock<wifi_system::MockInterfaceTool>> iface_tool_{
+        new NiceMock<wifi_system::MockInterfaceTool>};
+    std::shared_ptr<NiceMock<legacy_hal::MockWifiLegacyHal>> legacy_hal_{
+        new NiceMock<legacy_hal::MockWifiLegacyHal>(iface_tool_,
+                                                    fake_func_table_, true)};
+    std::shared_ptr<NiceMock<iface_util::MockWifiIfaceUtil>> iface_util_{
+        new NiceMock<iface_util::MockWifiIfaceUtil>(iface_tool_, legacy_hal_)};
+    legacy_hal::NanCallbackHandlers callback_handlers_;
+    sp<WifiNanIface> nan_iface_;
+    std::vector<sp<NullNanIfaceEventCallback>> callbacks_;
+};
+
+void BM_MatchIndication(benchmark::State& state) {
+    NanIfaceFixture fixture(state.range(0));
+    legacy_hal::NanMatchInd msg = {};
+    msg.publish_subscribe_id = 1;
+    msg.requestor_instance_id = 2;
+    msg.service_specific_info_len = 64;
+    msg.sdf_match_filter_len = 16;
+    for (auto _ : state) {
+        fixture.handlers().on_event_match(msg);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_FollowupIndication(benchmark::State& state) {
+    NanIfaceFixture fixture(state.range(0));
+    legacy_hal::NanFollowupInd msg = {};
+    msg.publish_subscribe_id = 1;
+    msg.requestor_instance_id = 2;
+    msg.service_specific_info_len = 255;
+    for (auto _ : state) {
+        fixture.handlers().on_event_followup(msg);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_MatchIndication)->Arg(0)->Arg(1)->Arg(4)->Arg(16);
+BENCHMARK(BM_FollowupIndication)->Arg(0)->Arg(1)->Arg(4)->Arg(16);
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_5
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
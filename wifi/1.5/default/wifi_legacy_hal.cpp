@@ -14,8 +14,11 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <array>
 #include <chrono>
+#include <cstddef>
+#include <memory>
 
 #include <android-base/logging.h>
 #include <cutils/properties.h>
@@ -23,6 +26,7 @@
 
 #include "hidl_sync_util.h"
 #include "wifi_legacy_hal.h"
+#include "wifi_legacy_hal_event_dispatcher.h"
 #include "wifi_legacy_hal_stubs.h"
 
 namespace {
@@ -40,6 +44,11 @@ static constexpr uint32_t kMaxWifiUsableChannels = 256;
 // need a long timeout (1000ms) for chips that unload their driver.
 static constexpr uint32_t kMaxStopCompleteWaitMs = 1000;
 static constexpr char kDriverPropName[] = "wlan.driver.status";
+// Bound of the queue of asynchronous events waiting for their callbacks.
+static constexpr size_t kMaxQueuedEvents = 256;
+// Ring buffer data of the same ring is coalesced into chunks of up to this
+// size while the callbacks are behind.
+static constexpr size_t kMaxCoalescedRingBufferDataSize = 64 * 1024;
 
 // Helper function to create a non-const char* for legacy Hal API's.
 std::vector<char> makeCharVec(const std::string& str) {
@@ -61,6 +70,14 @@ namespace legacy_hal {
 // functions to pass to the legacy HAL function and store the corresponding
 // std::function methods to be invoked.
 //
+// The callbacks of the high rate events are run by the event dispatcher,
+// which takes the global lock itself. Their "C" style functions only copy
+// the event out of the legacy HAL's buffers.
+EventDispatcher& getEventDispatcher() {
+    static EventDispatcher dispatcher(kMaxQueuedEvents);
+    return dispatcher;
+}
+
 // Callback to be invoked once |stop| is complete
 std::function<void(wifi_handle handle)> on_stop_complete_internal_callback;
 void onAsyncStopComplete(wifi_handle handle) {
@@ -92,10 +109,11 @@ void onSyncFirmwareMemoryDump(char* buffer, int buffer_size) {
 std::function<void(wifi_request_id, wifi_scan_event)>
     on_gscan_event_internal_callback;
 void onAsyncGscanEvent(wifi_request_id id, wifi_scan_event event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_gscan_event_internal_callback) {
-        on_gscan_event_internal_callback(id, event);
-    }
+    getEventDispatcher().post(EventDispatcher::Source::GSCAN, [id, event] {
+        if (on_gscan_event_internal_callback) {
+            on_gscan_event_internal_callback(id, event);
+        }
+    });
 }
 
 // Callback to be invoked for Gscan full results.
@@ -103,10 +121,27 @@ std::function<void(wifi_request_id, wifi_scan_result*, uint32_t)>
     on_gscan_full_result_internal_callback;
 void onAsyncGscanFullResult(wifi_request_id id, wifi_scan_result* result,
                             uint32_t buckets_scanned) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_gscan_full_result_internal_callback) {
-        on_gscan_full_result_internal_callback(id, result, buckets_scanned);
-    }
+    if (!result) {
+        return;
+    }
+    // The IEs run past the end of |result|.
+    const size_t size =
+        offsetof(wifi_scan_result, ie_data) + result->ie_length;
+    auto copy = std::make_shared<std::vector<uint8_t>>(
+        std::max(size, sizeof(wifi_scan_result)));
+    std::copy_n(reinterpret_cast<uint8_t*>(result), size, copy->begin());
+    // A BSS seen again before its previous result was delivered only needs
+    // its latest result.
+    const std::string bssid(reinterpret_cast<const char*>(result->bssid),
+                            sizeof(result->bssid));
+    getEventDispatcher().postLatest(
+        EventDispatcher::Source::GSCAN, bssid, [id, copy, buckets_scanned] {
+            if (on_gscan_full_result_internal_callback) {
+                on_gscan_full_result_internal_callback(
+                    id, reinterpret_cast<wifi_scan_result*>(copy->data()),
+                    buckets_scanned);
+            }
+        });
 }
 
 // Callback to be invoked for link layer stats results.
@@ -125,22 +160,44 @@ std::function<void((wifi_request_id, uint8_t*, int8_t))>
     on_rssi_threshold_breached_internal_callback;
 void onAsyncRssiThresholdBreached(wifi_request_id id, uint8_t* bssid,
                                   int8_t rssi) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_rssi_threshold_breached_internal_callback) {
-        on_rssi_threshold_breached_internal_callback(id, bssid, rssi);
-    }
+    if (!bssid) {
+        return;
+    }
+    // |bssid| is assumed to have 6 bytes for the mac address.
+    std::array<uint8_t, 6> bssid_arr;
+    std::copy(bssid, bssid + bssid_arr.size(), bssid_arr.begin());
+    // Only the latest breach of a request matters.
+    getEventDispatcher().postLatest(
+        EventDispatcher::Source::RSSI_MONITOR, std::to_string(id),
+        [id, bssid_arr, rssi]() mutable {
+            if (on_rssi_threshold_breached_internal_callback) {
+                on_rssi_threshold_breached_internal_callback(
+                    id, bssid_arr.data(), rssi);
+            }
+        });
 }
 
 // Callback to be invoked for ring buffer data indication.
-std::function<void(char*, char*, int, wifi_ring_buffer_status*)>
+std::function<void(const std::string&, const std::vector<uint8_t>&,
+                   const wifi_ring_buffer_status&)>
     on_ring_buffer_data_internal_callback;
 void onAsyncRingBufferData(char* ring_name, char* buffer, int buffer_size,
                            wifi_ring_buffer_status* status) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_ring_buffer_data_internal_callback) {
-        on_ring_buffer_data_internal_callback(ring_name, buffer, buffer_size,
-                                              status);
-    }
+    if (!ring_name || !buffer || buffer_size < 0 || !status) {
+        return;
+    }
+    // Consecutive data of a ring is delivered in one chunk, along with the
+    // latest status of the ring.
+    std::string name(ring_name);
+    getEventDispatcher().postAppend(
+        EventDispatcher::Source::RING_BUFFER, name,
+        reinterpret_cast<uint8_t*>(buffer), buffer_size,
+        [name, status_copy = *status](const std::vector<uint8_t>& data) {
+            if (on_ring_buffer_data_internal_callback) {
+                on_ring_buffer_data_internal_callback(name, data, status_copy);
+            }
+        },
+        kMaxCoalescedRingBufferDataSize);
 }
 
 // Callback to be invoked for error alert indication.
@@ -148,10 +205,18 @@ std::function<void(wifi_request_id, char*, int, int)>
     on_error_alert_internal_callback;
 void onAsyncErrorAlert(wifi_request_id id, char* buffer, int buffer_size,
                        int err_code) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_error_alert_internal_callback) {
-        on_error_alert_internal_callback(id, buffer, buffer_size, err_code);
-    }
+    if (!buffer || buffer_size < 0) {
+        return;
+    }
+    std::vector<char> copy(buffer, buffer + buffer_size);
+    getEventDispatcher().post(
+        EventDispatcher::Source::ERROR_ALERT,
+        [id, copy, err_code]() mutable {
+            if (on_error_alert_internal_callback) {
+                on_error_alert_internal_callback(id, copy.data(), copy.size(),
+                                                 err_code);
+            }
+        });
 }
 
 // Callback to be invoked for radio mode change indication.
@@ -624,6 +689,8 @@ wifi_error WifiLegacyHal::startGscan(
                     on_failure_user_callback(id);
                     on_gscan_event_internal_callback = nullptr;
                     on_gscan_full_result_internal_callback = nullptr;
+                    getEventDispatcher().discard(
+                        EventDispatcher::Source::GSCAN);
                     return;
             }
             LOG(FATAL) << "Unexpected gscan event received: " << event;
@@ -665,6 +732,7 @@ wifi_error WifiLegacyHal::stopGscan(const std::string& iface_name,
     if (status != WIFI_ERROR_INVALID_REQUEST_ID) {
         on_gscan_event_internal_callback = nullptr;
         on_gscan_full_result_internal_callback = nullptr;
+        getEventDispatcher().discard(EventDispatcher::Source::GSCAN);
     }
     return status;
 }
@@ -828,6 +896,7 @@ wifi_error WifiLegacyHal::stopRssiMonitoring(const std::string& iface_name,
     // other error should be treated as the end of background scan.
     if (status != WIFI_ERROR_INVALID_REQUEST_ID) {
         on_rssi_threshold_breached_internal_callback = nullptr;
+        getEventDispatcher().discard(EventDispatcher::Source::RSSI_MONITOR);
     }
     return status;
 }
@@ -1007,16 +1076,7 @@ wifi_error WifiLegacyHal::registerRingBufferCallbackHandler(
     if (on_ring_buffer_data_internal_callback) {
         return WIFI_ERROR_NOT_AVAILABLE;
     }
-    on_ring_buffer_data_internal_callback =
-        [on_user_data_callback](char* ring_name, char* buffer, int buffer_size,
-                                wifi_ring_buffer_status* status) {
-            if (status && buffer) {
-                std::vector<uint8_t> buffer_vector(
-                    reinterpret_cast<uint8_t*>(buffer),
-                    reinterpret_cast<uint8_t*>(buffer) + buffer_size);
-                on_user_data_callback(ring_name, buffer_vector, *status);
-            }
-        };
+    on_ring_buffer_data_internal_callback = on_user_data_callback;
     wifi_error status = global_func_table_.wifi_set_log_handler(
         0, getIfaceHandle(iface_name), {onAsyncRingBufferData});
     if (status != WIFI_SUCCESS) {
@@ -1031,6 +1091,7 @@ wifi_error WifiLegacyHal::deregisterRingBufferCallbackHandler(
         return WIFI_ERROR_NOT_AVAILABLE;
     }
     on_ring_buffer_data_internal_callback = nullptr;
+    getEventDispatcher().discard(EventDispatcher::Source::RING_BUFFER);
     return global_func_table_.wifi_reset_log_handler(
         0, getIfaceHandle(iface_name));
 }
@@ -1095,6 +1156,7 @@ wifi_error WifiLegacyHal::deregisterErrorAlertCallbackHandler(
         return WIFI_ERROR_NOT_AVAILABLE;
     }
     on_error_alert_internal_callback = nullptr;
+    getEventDispatcher().discard(EventDispatcher::Source::ERROR_ALERT);
     return global_func_table_.wifi_reset_alert_handler(
         0, getIfaceHandle(iface_name));
 }
@@ -1715,6 +1777,10 @@ void WifiLegacyHal::invalidate() {
     on_twt_event_teardown_completion_callback = nullptr;
     on_twt_event_info_frame_received_callback = nullptr;
     on_twt_event_device_notify_callback = nullptr;
+    getEventDispatcher().discard(EventDispatcher::Source::GSCAN);
+    getEventDispatcher().discard(EventDispatcher::Source::RSSI_MONITOR);
+    getEventDispatcher().discard(EventDispatcher::Source::RING_BUFFER);
+    getEventDispatcher().discard(EventDispatcher::Source::ERROR_ALERT);
 }
 
 }  // namespace legacy_hal
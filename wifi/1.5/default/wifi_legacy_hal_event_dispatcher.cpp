@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iterator>
+
+#include <android-base/logging.h>
+
+#include "hidl_sync_util.h"
+#include "wifi_legacy_hal_event_dispatcher.h"
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_5 {
+namespace implementation {
+namespace legacy_hal {
+
+EventDispatcher::EventDispatcher(size_t max_queued_events)
+    : max_queued_events_(max_queued_events),
+      num_dropped_events_(0),
+      overflowing_(false),
+      stopping_(false) {
+    for (auto& generation : generations_) {
+        generation = 0;
+    }
+    thread_ = std::thread(&EventDispatcher::runLoop, this);
+}
+
+EventDispatcher::~EventDispatcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+}
+
+void EventDispatcher::post(Source source, std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Event event{source, 0, {}, std::move(callback), {}, nullptr};
+    enqueueLocked(std::move(event), false /* droppable */);
+}
+
+bool EventDispatcher::postLatest(Source source, const std::string& key,
+                                 std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = findQueued(source, key);
+    if (it != queue_.end()) {
+        it->callback = std::move(callback);
+        return true;
+    }
+    Event event{source, 0, key, std::move(callback), {}, nullptr};
+    return enqueueLocked(std::move(event), true /* droppable */);
+}
+
+bool EventDispatcher::postAppend(
+    Source source, const std::string& key, const uint8_t* data, size_t size,
+    std::function<void(const std::vector<uint8_t>&)> callback,
+    size_t max_data_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = findQueued(source, key);
+    if (it != queue_.end() && it->data.size() < max_data_size) {
+        it->data.insert(it->data.end(), data, data + size);
+        it->data_callback = std::move(callback);
+        return true;
+    }
+    if (it != queue_.end()) {
+        // The queued event is full; the new one takes its place for
+        // coalescing.
+        keyed_events_.erase({source, key});
+    }
+    Event event{source,
+                0,
+                key,
+                nullptr,
+                std::vector<uint8_t>(data, data + size),
+                std::move(callback)};
+    return enqueueLocked(std::move(event), true /* droppable */);
+}
+
+void EventDispatcher::discard(Source source) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    generations_[static_cast<size_t>(source)]++;
+    for (auto it = queue_.begin(); it != queue_.end();) {
+        if (it->source != source) {
+            ++it;
+            continue;
+        }
+        if (!it->key.empty()) {
+            auto keyed = keyed_events_.find({source, it->key});
+            if (keyed != keyed_events_.end() && keyed->second == it) {
+                keyed_events_.erase(keyed);
+            }
+        }
+        it = queue_.erase(it);
+    }
+}
+
+uint64_t EventDispatcher::getNumDroppedEvents() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return num_dropped_events_;
+}
+
+EventDispatcher::Queue::iterator EventDispatcher::findQueued(
+    Source source, const std::string& key) {
+    auto it = keyed_events_.find({source, key});
+    return it != keyed_events_.end() ? it->second : queue_.end();
+}
+
+bool EventDispatcher::enqueueLocked(Event event, bool droppable) {
+    if (droppable && queue_.size() >= max_queued_events_) {
+        num_dropped_events_++;
+        if (!overflowing_) {
+            LOG(WARNING) << "Legacy HAL event queue is full, dropping events ("
+                         << num_dropped_events_ << " dropped so far)";
+            overflowing_ = true;
+        }
+        return false;
+    }
+    overflowing_ = false;
+    event.generation = generations_[static_cast<size_t>(event.source)];
+    const bool keyed = !event.key.empty();
+    queue_.push_back(std::move(event));
+    if (keyed) {
+        auto it = std::prev(queue_.end());
+        keyed_events_[{it->source, it->key}] = it;
+    }
+    cv_.notify_one();
+    return true;
+}
+
+void EventDispatcher::runLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (stopping_) {
+            return;
+        }
+        Event event = std::move(queue_.front());
+        if (!event.key.empty()) {
+            auto keyed = keyed_events_.find({event.source, event.key});
+            if (keyed != keyed_events_.end() &&
+                keyed->second == queue_.begin()) {
+                keyed_events_.erase(keyed);
+            }
+        }
+        queue_.pop_front();
+        lock.unlock();
+        {
+            const auto global_lock = hidl_sync_util::acquireGlobalLock();
+            // Skip the event if its source was discarded since it was queued.
+            if (event.generation ==
+                generations_[static_cast<size_t>(event.source)]) {
+                if (event.data_callback) {
+                    event.data_callback(event.data);
+                } else if (event.callback) {
+                    event.callback();
+                }
+            }
+        }
+        lock.lock();
+    }
+}
+
+}  // namespace legacy_hal
+}  // namespace implementation
+}  // namespace V1_5
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
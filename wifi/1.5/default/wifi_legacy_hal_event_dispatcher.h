@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WIFI_LEGACY_HAL_EVENT_DISPATCHER_H_
+#define WIFI_LEGACY_HAL_EVENT_DISPATCHER_H_
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_5 {
+namespace implementation {
+namespace legacy_hal {
+/**
+ * Runs the callbacks of asynchronous legacy HAL events on a thread of its
+ * own, with the global lock held.
+ *
+ * The legacy HAL event loop thread only copies the event payload into a
+ * bounded queue, so a slow HIDL client can no longer stall the driver's
+ * event processing. High rate events can be coalesced with the event of the
+ * same key which is still queued, and are dropped if the queue is full.
+ */
+class EventDispatcher {
+   public:
+    // Independent streams of events, which can be discarded separately.
+    enum class Source {
+        GSCAN,
+        RSSI_MONITOR,
+        RING_BUFFER,
+        ERROR_ALERT,
+        NUM_SOURCES,
+    };
+
+    explicit EventDispatcher(size_t max_queued_events);
+    ~EventDispatcher();
+
+    // Queues |callback|. It is never dropped for lack of room.
+    void post(Source source, std::function<void()> callback);
+    // Queues |callback| unless the queue is full. If an event with the same
+    // |key| is still queued, |callback| replaces its callback instead.
+    bool postLatest(Source source, const std::string& key,
+                    std::function<void()> callback);
+    // Queues |size| bytes of |data| for |callback| unless the queue is full.
+    // If an event with the same |key| is still queued and holds fewer than
+    // |max_data_size| bytes, the bytes are appended to it and |callback|
+    // replaces its callback instead.
+    bool postAppend(
+        Source source, const std::string& key, const uint8_t* data,
+        size_t size,
+        std::function<void(const std::vector<uint8_t>&)> callback,
+        size_t max_data_size);
+    // Drops the events of |source| which have not run yet. Must be called
+    // with the global lock held.
+    void discard(Source source);
+    // Number of events dropped for lack of room so far.
+    uint64_t getNumDroppedEvents();
+
+   private:
+    struct Event {
+        Source source;
+        uint32_t generation;
+        // Empty for events which are never coalesced.
+        std::string key;
+        std::function<void()> callback;
+        std::vector<uint8_t> data;
+        std::function<void(const std::vector<uint8_t>&)> data_callback;
+    };
+    using Queue = std::list<Event>;
+
+    // Must be called with |mutex_| held.
+    Queue::iterator findQueued(Source source, const std::string& key);
+    bool enqueueLocked(Event event, bool droppable);
+    void runLoop();
+
+    const size_t max_queued_events_;
+    std::mutex mutex_;  // protecting all the members below
+    std::condition_variable cv_;
+    Queue queue_;
+    // Queued events by source and key, for coalescing.
+    std::map<std::pair<Source, std::string>, Queue::iterator> keyed_events_;
+    // Bumped by discard(), so that an event which has already been dequeued
+    // but has not run yet is dropped too.
+    std::array<std::atomic<uint32_t>, static_cast<size_t>(Source::NUM_SOURCES)>
+        generations_;
+    uint64_t num_dropped_events_;
+    bool overflowing_;
+    bool stopping_;
+    std::thread thread_;
+};
+
+}  // namespace legacy_hal
+}  // namespace implementation
+}  // namespace V1_5
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
+
+#endif  // WIFI_LEGACY_HAL_EVENT_DISPATCHER_H_
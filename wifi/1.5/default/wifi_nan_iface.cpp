@@ -61,6 +61,7 @@ WifiNanIface::WifiNanIface(
             LOG(ERROR) << "Callback invoked on an invalid object";
             return;
         }
+        const auto callbacks = shared_ptr_this->getEventCallbacks();
         WifiNanStatus wifiNanStatus;
         if (!hidl_struct_util::convertLegacyNanResponseHeaderToHidl(
                 msg, &wifiNanStatus)) {
@@ -70,8 +71,7 @@ WifiNanIface::WifiNanIface(
 
         switch (msg.response_type) {
             case legacy_hal::NAN_RESPONSE_ENABLED: {
-                for (const auto& callback :
-                     shared_ptr_this->getEventCallbacks()) {
+                for (const auto& callback : *callbacks) {
                     if (!callback->notifyEnableResponse(id, wifiNanStatus)
                              .isOk()) {
                         LOG(ERROR) << "Failed to invoke the callback";
@@ -80,8 +80,7 @@ WifiNanIface::WifiNanIface(
                 break;
             }
             case legacy_hal::NAN_RESPONSE_DISABLED: {
-                for (const auto& callback :
-                     shared_ptr_this->getEventCallbacks()) {
+                for (const auto& callback : *callbacks) {
                     if (!callback->notifyDisableResponse(id, wifiNanStatus)
                              .isOk()) {
                         LOG(ERROR) << "Failed to invoke the callback";
@@ -90,8 +89,7 @@ WifiNanIface::WifiNanIface(
                 break;
             }
             case legacy_hal::NAN_RESPONSE_PUBLISH: {
-                for (const auto& callback :
-                     shared_ptr_this->getEventCallbacks()) {
+                for (const auto& callback : *callbacks) {
                     if (!callback
                              ->notifyStartPublishResponse(
                                  id, wifiNanStatus,
@@ -103,8 +101,7 @@ WifiNanIface::WifiNanIface(
                 break;
             }
             case legacy_hal::NAN_RESPONSE_PUBLISH_CANCEL: {
-                for (const auto& callback :
-                     shared_ptr_this->getEventCallbacks()) {
+                for (const auto& callback : *callbacks) {
                     if (!callback->notifyStopPublishResponse(id, wifiNanStatus)
                              .isOk()) {
                         LOG(ERROR) << "Failed to invoke the callback";
@@ -113,8 +110,7 @@ WifiNanIface::WifiNanIface(
                 break;
             }
             case legacy_hal::NAN_RESPONSE_TRANSMIT_FOLLOWUP: {
-                for (const auto& callback :
-                     shared_ptr_this->getEventCallbacks()) {
+                for (const auto& callback : *callbacks) {
                     if (!callback
                              ->notifyTransmitFollowupResponse(id, wifiNanStatus)
                              .isOk()) {
@@ -124,8 +120,7 @@ WifiNanIface::WifiNanIface(
                 break;
             }
             case legacy_hal::NAN_RESPONSE_SUBSCRIBE: {
-                for (const auto& callback :
-                     shared_ptr_this->getEventCallbacks()) {
+                for (const auto& callback : *callbacks) {
                     if (!callback
                              ->notifyStartSubscribeResponse(
                                  id, wifiNanStatus,
@@ -137,8 +132,7 @@ WifiNanIface::WifiNanIface(
                 break;
             }
             case legacy_hal::NAN_RESPONSE_SUBSCRIBE_CANCEL: {
-                for (const auto& callback :
-                     shared_ptr_this->getEventCallbacks()) {
+                for (const auto& callback : *callbacks) {
                     if (!callback
                              ->notifyStopSubscribeResponse(id, wifiNanStatus)
                              .isOk()) {
@@ -148,8 +142,7 @@ WifiNanIface::WifiNanIface(
                 break;
             }
             case legacy_hal::NAN_RESPONSE_CONFIG: {
-                for (const auto& callback :
-                     shared_ptr_this->getEventCallbacks()) {
+                for (const auto& callback : *callbacks) {
                     if (!callback->notifyConfigResponse(id, wifiNanStatus)
                              .isOk()) {
                         LOG(ERROR) << "Failed to invoke the callback";
@@ -158,6 +151,11 @@ WifiNanIface::WifiNanIface(
                 break;
             }
             case legacy_hal::NAN_GET_CAPABILITIES: {
+                const auto callbacks_1_5 =
+                    shared_ptr_this->getEventCallbacks_1_5();
+                if (callbacks_1_5->empty()) {
+                    break;
+                }
                 NanCapabilities hidl_struct;
                 if (!hidl_struct_util::
                         convertLegacyNanCapabilitiesResponseToHidl(
@@ -165,8 +163,7 @@ WifiNanIface::WifiNanIface(
                     LOG(ERROR) << "Failed to convert nan capabilities response";
                     return;
                 }
-                for (const auto& callback :
-                     shared_ptr_this->getEventCallbacks_1_5()) {
+                for (const auto& callback : *callbacks_1_5) {
                     if (!callback
                              ->notifyCapabilitiesResponse_1_5(id, wifiNanStatus,
                                                               hidl_struct)
@@ -177,8 +174,7 @@ WifiNanIface::WifiNanIface(
                 break;
             }
             case legacy_hal::NAN_DP_INTERFACE_CREATE: {
-                for (const auto& callback :
-                     shared_ptr_this->getEventCallbacks()) {
+                for (const auto& callback : *callbacks) {
                     if (!callback
                              ->notifyCreateDataInterfaceResponse(id,
                                                                  wifiNanStatus)
@@ -189,8 +185,7 @@ WifiNanIface::WifiNanIface(
                 break;
             }
             case legacy_hal::NAN_DP_INTERFACE_DELETE: {
-                for (const auto& callback :
-                     shared_ptr_this->getEventCallbacks()) {
+                for (const auto& callback : *callbacks) {
                     if (!callback
                              ->notifyDeleteDataInterfaceResponse(id,
                                                                  wifiNanStatus)
@@ -201,8 +196,7 @@ WifiNanIface::WifiNanIface(
                 break;
             }
             case legacy_hal::NAN_DP_INITIATOR_RESPONSE: {
-                for (const auto& callback :
-                     shared_ptr_this->getEventCallbacks()) {
+                for (const auto& callback : *callbacks) {
                     if (!callback
                              ->notifyInitiateDataPathResponse(
                                  id, wifiNanStatus,
@@ -214,8 +208,7 @@ WifiNanIface::WifiNanIface(
                 break;
             }
             case legacy_hal::NAN_DP_RESPONDER_RESPONSE: {
-                for (const auto& callback :
-                     shared_ptr_this->getEventCallbacks()) {
+                for (const auto& callback : *callbacks) {
                     if (!callback
                              ->notifyRespondToDataPathIndicationResponse(
                                  id, wifiNanStatus)
@@ -226,8 +219,7 @@ WifiNanIface::WifiNanIface(
                 break;
             }
             case legacy_hal::NAN_DP_END: {
-                for (const auto& callback :
-                     shared_ptr_this->getEventCallbacks()) {
+                for (const auto& callback : *callbacks) {
                     if (!callback
                              ->notifyTerminateDataPathResponse(id,
                                                                wifiNanStatus)
@@ -259,12 +251,13 @@ WifiNanIface::WifiNanIface(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
+            const auto callbacks = shared_ptr_this->getEventCallbacks();
             NanClusterEventInd hidl_struct;
             // event types defined identically - hence can be cast
             hidl_struct.eventType = (NanClusterEventType)msg.event_type;
             hidl_struct.addr = msg.data.mac_addr.addr;
 
-            for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
+            for (const auto& callback : *callbacks) {
                 if (!callback->eventClusterEvent(hidl_struct).isOk()) {
                     LOG(ERROR) << "Failed to invoke the callback";
                 }
@@ -278,11 +271,12 @@ WifiNanIface::WifiNanIface(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
+            const auto callbacks = shared_ptr_this->getEventCallbacks();
             WifiNanStatus status;
             hidl_struct_util::convertToWifiNanStatus(
                 msg.reason, msg.nan_reason, sizeof(msg.nan_reason), &status);
 
-            for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
+            for (const auto& callback : *callbacks) {
                 if (!callback->eventDisabled(status).isOk()) {
                     LOG(ERROR) << "Failed to invoke the callback";
                 }
@@ -296,11 +290,12 @@ WifiNanIface::WifiNanIface(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
+            const auto callbacks = shared_ptr_this->getEventCallbacks();
             WifiNanStatus status;
             hidl_struct_util::convertToWifiNanStatus(
                 msg.reason, msg.nan_reason, sizeof(msg.nan_reason), &status);
 
-            for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
+            for (const auto& callback : *callbacks) {
                 if (!callback->eventPublishTerminated(msg.publish_id, status)
                          .isOk()) {
                     LOG(ERROR) << "Failed to invoke the callback";
@@ -315,11 +310,12 @@ WifiNanIface::WifiNanIface(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
+            const auto callbacks = shared_ptr_this->getEventCallbacks();
             WifiNanStatus status;
             hidl_struct_util::convertToWifiNanStatus(
                 msg.reason, msg.nan_reason, sizeof(msg.nan_reason), &status);
 
-            for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
+            for (const auto& callback : *callbacks) {
                 if (!callback
                          ->eventSubscribeTerminated(msg.subscribe_id, status)
                          .isOk()) {
@@ -335,6 +331,10 @@ WifiNanIface::WifiNanIface(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
+            const auto callbacks = shared_ptr_this->getEventCallbacks();
+            if (callbacks->empty()) {
+                return;
+            }
             NanMatchInd hidl_struct;
             if (!hidl_struct_util::convertLegacyNanMatchIndToHidl(
                     msg, &hidl_struct)) {
@@ -342,7 +342,7 @@ WifiNanIface::WifiNanIface(
                 return;
             }
 
-            for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
+            for (const auto& callback : *callbacks) {
                 if (!callback->eventMatch(hidl_struct).isOk()) {
                     LOG(ERROR) << "Failed to invoke the callback";
                 }
@@ -356,7 +356,8 @@ WifiNanIface::WifiNanIface(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
-            for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
+            const auto callbacks = shared_ptr_this->getEventCallbacks();
+            for (const auto& callback : *callbacks) {
                 if (!callback
                          ->eventMatchExpired(msg.publish_subscribe_id,
                                              msg.requestor_instance_id)
@@ -373,6 +374,10 @@ WifiNanIface::WifiNanIface(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
+            const auto callbacks = shared_ptr_this->getEventCallbacks();
+            if (callbacks->empty()) {
+                return;
+            }
             NanFollowupReceivedInd hidl_struct;
             if (!hidl_struct_util::convertLegacyNanFollowupIndToHidl(
                     msg, &hidl_struct)) {
@@ -380,7 +385,7 @@ WifiNanIface::WifiNanIface(
                 return;
             }
 
-            for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
+            for (const auto& callback : *callbacks) {
                 if (!callback->eventFollowupReceived(hidl_struct).isOk()) {
                     LOG(ERROR) << "Failed to invoke the callback";
                 }
@@ -394,11 +399,12 @@ WifiNanIface::WifiNanIface(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
+            const auto callbacks = shared_ptr_this->getEventCallbacks();
             WifiNanStatus status;
             hidl_struct_util::convertToWifiNanStatus(
                 msg.reason, msg.nan_reason, sizeof(msg.nan_reason), &status);
 
-            for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
+            for (const auto& callback : *callbacks) {
                 if (!callback->eventTransmitFollowup(msg.id, status).isOk()) {
                     LOG(ERROR) << "Failed to invoke the callback";
                 }
@@ -412,6 +418,10 @@ WifiNanIface::WifiNanIface(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
+            const auto callbacks = shared_ptr_this->getEventCallbacks();
+            if (callbacks->empty()) {
+                return;
+            }
             NanDataPathRequestInd hidl_struct;
             if (!hidl_struct_util::convertLegacyNanDataPathRequestIndToHidl(
                     msg, &hidl_struct)) {
@@ -419,7 +429,7 @@ WifiNanIface::WifiNanIface(
                 return;
             }
 
-            for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
+            for (const auto& callback : *callbacks) {
                 if (!callback->eventDataPathRequest(hidl_struct).isOk()) {
                     LOG(ERROR) << "Failed to invoke the callback";
                 }
@@ -433,6 +443,10 @@ WifiNanIface::WifiNanIface(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
+            const auto callbacks = shared_ptr_this->getEventCallbacks_1_2();
+            if (callbacks->empty()) {
+                return;
+            }
             V1_2::NanDataPathConfirmInd hidl_struct;
             if (!hidl_struct_util::convertLegacyNanDataPathConfirmIndToHidl(
                     msg, &hidl_struct)) {
@@ -440,8 +454,7 @@ WifiNanIface::WifiNanIface(
                 return;
             }
 
-            for (const auto& callback :
-                 shared_ptr_this->getEventCallbacks_1_2()) {
+            for (const auto& callback : *callbacks) {
                 if (!callback->eventDataPathConfirm_1_2(hidl_struct).isOk()) {
                     LOG(ERROR) << "Failed to invoke the callback";
                 }
@@ -455,7 +468,8 @@ WifiNanIface::WifiNanIface(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
-            for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
+            const auto callbacks = shared_ptr_this->getEventCallbacks();
+            for (const auto& callback : *callbacks) {
                 for (int i = 0; i < msg.num_ndp_instances; ++i) {
                     if (!callback
                              ->eventDataPathTerminated(msg.ndp_instance_id[i])
@@ -490,6 +504,10 @@ WifiNanIface::WifiNanIface(
             LOG(ERROR) << "Callback invoked on an invalid object";
             return;
         }
+        const auto callbacks = shared_ptr_this->getEventCallbacks_1_2();
+        if (callbacks->empty()) {
+            return;
+        }
         V1_2::NanDataPathScheduleUpdateInd hidl_struct;
         if (!hidl_struct_util::convertLegacyNanDataPathScheduleUpdateIndToHidl(
                 msg, &hidl_struct)) {
@@ -497,7 +515,7 @@ WifiNanIface::WifiNanIface(
             return;
         }
 
-        for (const auto& callback : shared_ptr_this->getEventCallbacks_1_2()) {
+        for (const auto& callback : *callbacks) {
             if (!callback->eventDataPathScheduleUpdate(hidl_struct).isOk()) {
                 LOG(ERROR) << "Failed to invoke the callback";
             }
@@ -521,10 +539,11 @@ WifiNanIface::WifiNanIface(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
+            const auto callbacks = shared_ptr_this->getEventCallbacks();
             // Tell framework that NAN has been disabled.
             WifiNanStatus status = {
                 NanStatusType::UNSUPPORTED_CONCURRENCY_NAN_DISABLED, ""};
-            for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
+            for (const auto& callback : *callbacks) {
                 if (!callback->eventDisabled(status).isOk()) {
                     LOG(ERROR) << "Failed to invoke the callback";
                 }
@@ -557,18 +576,19 @@ bool WifiNanIface::isValid() { return is_valid_; }
 
 std::string WifiNanIface::getName() { return ifname_; }
 
-std::set<sp<V1_0::IWifiNanIfaceEventCallback>>
+hidl_callback_util::CallbackSnapshot<V1_0::IWifiNanIfaceEventCallback>
 WifiNanIface::getEventCallbacks() {
-    return event_cb_handler_.getCallbacks();
+    return event_cb_handler_.getCallbackSnapshot();
 }
 
-std::set<sp<V1_2::IWifiNanIfaceEventCallback>>
+hidl_callback_util::CallbackSnapshot<V1_2::IWifiNanIfaceEventCallback>
 WifiNanIface::getEventCallbacks_1_2() {
-    return event_cb_handler_1_2_.getCallbacks();
+    return event_cb_handler_1_2_.getCallbackSnapshot();
 }
 
-std::set<sp<IWifiNanIfaceEventCallback>> WifiNanIface::getEventCallbacks_1_5() {
-    return event_cb_handler_1_5_.getCallbacks();
+hidl_callback_util::CallbackSnapshot<IWifiNanIfaceEventCallback>
+WifiNanIface::getEventCallbacks_1_5() {
+    return event_cb_handler_1_5_.getCallbackSnapshot();
 }
 
 Return<void> WifiNanIface::getName(getName_cb hidl_status_cb) {
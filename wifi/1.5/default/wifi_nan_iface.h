@@ -182,11 +182,14 @@ class WifiNanIface : public V1_5::IWifiNanIface {
     WifiStatus getCapabilitiesRequest_1_5Internal(uint16_t cmd_id);
 
     // all 1_0 and descendant callbacks
-    std::set<sp<V1_0::IWifiNanIfaceEventCallback>> getEventCallbacks();
+    hidl_callback_util::CallbackSnapshot<V1_0::IWifiNanIfaceEventCallback>
+    getEventCallbacks();
     // all 1_2 and descendant callbacks
-    std::set<sp<V1_2::IWifiNanIfaceEventCallback>> getEventCallbacks_1_2();
+    hidl_callback_util::CallbackSnapshot<V1_2::IWifiNanIfaceEventCallback>
+    getEventCallbacks_1_2();
     // all 1_5 and descendant callbacks
-    std::set<sp<IWifiNanIfaceEventCallback>> getEventCallbacks_1_5();
+    hidl_callback_util::CallbackSnapshot<IWifiNanIfaceEventCallback>
+    getEventCallbacks_1_5();
 
     std::string ifname_;
     bool is_dedicated_iface_;